@@ -0,0 +1,36 @@
+////
+// @file arena.h
+// @brief
+// buffer内存分配
+// buffer的chunk直接向操作系统申请，可以使用大页，减少TLB缺失；也可以绑定到某个
+// NUMA结点上。大页在windows上需要SeLockMemoryPrivilege权限，申请失败时退回普通
+// 页。linux上结点数取自sysfs，用mbind绑定结点；其它非windows系统只有一个结点。
+//
+// @author niexw
+// @email niexiaowen@uestc.edu.cn
+//
+#ifndef __DB_ARENA_H__
+#define __DB_ARENA_H__
+
+#include "./config.h"
+
+namespace db {
+
+// 大页大小，0表示不支持
+size_t largePageSize();
+// NUMA结点个数
+unsigned short numaNodes();
+// 当前线程所在的NUMA结点
+unsigned short currentNode();
+
+// 分配内存，large为true时先尝试大页，退回普通页时将large置为false；
+// node小于0表示不指定结点
+void *arenaAlloc(size_t size, int node, bool &large);
+// 释放内存
+void arenaFree(void *ptr, size_t size, bool large);
+// ptr所在的页分配在哪个结点，应在访问之后查询，无法查询时返回-1
+int memoryNode(const void *ptr);
+
+} // namespace db
+
+#endif // __DB_ARENA_H__
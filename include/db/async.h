@@ -0,0 +1,299 @@
+////
+// @file async.h
+// @brief
+// 基于C++20协程的异步接口
+// block在池中时协程直接继续；不在时挂起，由运行时的后台任务读盘，完成后放回
+// AsyncLoop的就绪队列，在run所在的线程中恢复。一个线程可以同时驱动大量查找，
+// 表上的修改都在该线程中执行，不需要额外同步。
+//
+// 需要C++20，单独编译为dbasync库，其它部分仍按C++11编译。
+//
+// @author niexw
+// @email niexiaowen@uestc.edu.cn
+//
+#ifndef __DB_ASYNC_H__
+#define __DB_ASYNC_H__
+
+#include <coroutine>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <list>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "./table.h"
+
+namespace db {
+
+// 异步接口统计
+struct AsyncStats
+{
+    unsigned long long hits;    // 不挂起直接得到block
+    unsigned long long misses;  // 挂起等待读盘
+    unsigned long long resumed; // 恢复执行的次数
+
+    AsyncStats()
+        : hits(0)
+        , misses(0)
+        , resumed(0)
+    {}
+};
+
+class AsyncLoop;
+
+// 协程promise的公共部分，协程创建后挂起，被co_await或spawn时才开始执行
+struct AsyncPromise
+{
+    std::coroutine_handle<> continuation; // 等待本协程的协程
+    AsyncLoop *loop;                       // 顶层协程所在的循环
+
+    AsyncPromise()
+        : loop(NULL)
+    {}
+
+    // 结束时转到等待者；顶层协程通知循环
+    struct FinalAwaiter
+    {
+        bool await_ready() noexcept { return false; }
+        template <typename Promise>
+        std::coroutine_handle<>
+        await_suspend(std::coroutine_handle<Promise> handle) noexcept;
+        void await_resume() noexcept {}
+    };
+
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    FinalAwaiter final_suspend() noexcept { return {}; }
+    // 不使用异常
+    void unhandled_exception() { std::terminate(); }
+};
+
+////
+// @brief
+// 协程任务，co_await时开始执行并等待其结果
+//
+template <typename T>
+class Async
+{
+  public:
+    struct promise_type : AsyncPromise
+    {
+        T value; // 返回值
+
+        promise_type()
+            : value()
+        {}
+        Async get_return_object()
+        {
+            return Async(
+                std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+        void return_value(T result) { value = std::move(result); }
+    };
+    using Handle = std::coroutine_handle<promise_type>;
+
+  private:
+    Handle handle_; // 协程帧
+
+  public:
+    explicit Async(Handle handle)
+        : handle_(handle)
+    {}
+    Async(Async &&other)
+        : handle_(other.handle_)
+    {
+        other.handle_ = NULL;
+    }
+    Async(const Async &) = delete;
+    Async &operator=(const Async &) = delete;
+    ~Async()
+    {
+        if (handle_) handle_.destroy();
+    }
+
+    bool await_ready() { return false; }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> caller)
+    {
+        handle_.promise().continuation = caller;
+        return handle_;
+    }
+    T await_resume() { return std::move(handle_.promise().value); }
+
+    inline Handle handle() { return handle_; }
+};
+
+template <>
+class Async<void>
+{
+  public:
+    struct promise_type : AsyncPromise
+    {
+        Async get_return_object()
+        {
+            return Async(
+                std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+        void return_void() {}
+    };
+    using Handle = std::coroutine_handle<promise_type>;
+
+  private:
+    Handle handle_; // 协程帧
+
+  public:
+    explicit Async(Handle handle)
+        : handle_(handle)
+    {}
+    Async(Async &&other)
+        : handle_(other.handle_)
+    {
+        other.handle_ = NULL;
+    }
+    Async(const Async &) = delete;
+    Async &operator=(const Async &) = delete;
+    ~Async()
+    {
+        if (handle_) handle_.destroy();
+    }
+
+    bool await_ready() { return false; }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> caller)
+    {
+        handle_.promise().continuation = caller;
+        return handle_;
+    }
+    void await_resume() {}
+
+    inline Handle handle() { return handle_; }
+};
+
+////
+// @brief
+// 驱动协程的循环，其它线程完成I/O后通过post放回就绪队列
+//
+class AsyncLoop
+{
+  private:
+    std::mutex lock_;                           // 保护就绪队列
+    std::condition_variable cond_;              // 有协程就绪时唤醒run
+    std::deque<std::coroutine_handle<>> ready_; // 就绪的协程
+    std::list<Async<void>> tasks_;              // 顶层协程，run结束时释放
+    size_t active_;                             // 未结束的顶层协程数
+    AsyncStats stats_;                          // 统计，只在循环线程中修改
+
+  public:
+    AsyncLoop()
+        : active_(0)
+    {}
+
+    // 加入一个顶层协程，run时开始执行
+    void spawn(Async<void> &&task);
+    // 执行直到所有顶层协程结束
+    void run();
+    // 将挂起的协程放回就绪队列，可以在任意线程中调用
+    void post(std::coroutine_handle<> handle);
+    // 顶层协程结束
+    void finish();
+
+    // 统计
+    inline AsyncStats &stats() { return stats_; }
+};
+
+template <typename Promise>
+std::coroutine_handle<> AsyncPromise::FinalAwaiter::await_suspend(
+    std::coroutine_handle<Promise> handle) noexcept
+{
+    AsyncPromise &promise = handle.promise();
+    if (promise.continuation) return promise.continuation;
+    if (promise.loop) promise.loop->finish();
+    return std::noop_coroutine();
+}
+
+////
+// @brief
+// 借用block的awaiter，命中时不挂起；未命中时挂起，后台任务读入后恢复
+//
+class BorrowAwaiter
+{
+  private:
+    AsyncLoop &loop_;     // 恢复时所在的循环
+    Buffer &buffer_;      // 缓冲池
+    std::string table_;   // 表名，挂起期间调用者的字符串可能已经释放
+    unsigned int blockid_; // blockid
+    BufDesp *desp_;       // 借到的block
+
+  public:
+    BorrowAwaiter(
+        AsyncLoop &loop,
+        Buffer &buffer,
+        const char *table,
+        unsigned int blockid)
+        : loop_(loop)
+        , buffer_(buffer)
+        , table_(table)
+        , blockid_(blockid)
+        , desp_(NULL)
+    {}
+
+    bool await_ready();
+    void await_suspend(std::coroutine_handle<> handle);
+    BufDesp *await_resume() { return desp_; }
+};
+
+// 异步借用block，用完后调用buffer.releaseBuf归还
+inline BorrowAwaiter borrowAsync(
+    AsyncLoop &loop,
+    const char *table,
+    unsigned int blockid,
+    Buffer &buffer = kBuffer)
+{
+    return BorrowAwaiter(loop, buffer, table, blockid);
+}
+
+// 异步定位key所在的block；fence缓存未建立时先沿数据链异步读入各block
+Async<unsigned int>
+locateAsync(AsyncLoop &loop, Table &table, void *keybuf, unsigned int len);
+// 异步插入，先异步读入目标block；挂起期间block可能分裂，恢复后重新定位
+Async<int>
+insertAsync(AsyncLoop &loop, Table &table, std::vector<struct iovec> &iov);
+// 异步删除，同insertAsync
+Async<int> removeAsync(
+    AsyncLoop &loop,
+    Table &table,
+    void *keybuf,
+    unsigned int len);
+
+////
+// @brief
+// 沿数据链的异步block迭代器
+//
+class AsyncBlockIterator
+{
+  private:
+    AsyncLoop &loop_; // 所在的循环
+    Table &table_;    // 表
+    DataBlock block_; // 当前block
+    BufDesp *desp_;   // 当前block的buffer，映射表为NULL
+    bool started_;    // 是否已定位到第1个block
+
+  public:
+    AsyncBlockIterator(AsyncLoop &loop, Table &table);
+    ~AsyncBlockIterator();
+    AsyncBlockIterator(const AsyncBlockIterator &) = delete;
+    AsyncBlockIterator &operator=(const AsyncBlockIterator &) = delete;
+
+    // 移到下一个block，第1次调用时移到第1个block；到达链尾返回false
+    Async<bool> next();
+    // 当前block
+    inline DataBlock &block() { return block_; }
+
+  private:
+    // 异步读入blockid，映射表直接指向映射地址
+    Async<void> fetch(unsigned int blockid);
+    // 归还当前block
+    void release();
+};
+
+} // namespace db
+
+#endif // __DB_ASYNC_H__
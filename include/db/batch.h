@@ -0,0 +1,151 @@
+////
+// @file batch.h
+// @brief
+// 向量化批量扫描
+// 每次从一个block中解码至多capacity条记录，投影列按列存放：整数类型解码为
+// 主机字节序的定长数组，字符串为起始偏移+连续字节。选择向量记录批中有效的行，
+// 过滤在其上收缩，聚合只处理选中的行，循环中不再逐条调用refByIndex。
+//
+// @author niexw
+// @email niexiaowen@uestc.edu.cn
+//
+#ifndef __DB_BATCH_H__
+#define __DB_BATCH_H__
+
+#include <vector>
+#include "./table.h"
+
+namespace db {
+
+static const size_t BATCH_SIZE = 1024; // 缺省批大小
+
+////
+// @brief
+// 一列解码后的值
+//
+class ColumnVector
+{
+  public:
+    DataType *type_;                    // 列的类型
+    unsigned int field_;                // 在记录中的下标
+    unsigned int width_;                // 整数的宽度，0表示字符串
+    size_t size_;                       // 值的个数
+    std::vector<unsigned char> values_; // 整数值，主机字节序，按width_排列
+    std::vector<unsigned int> offsets_; // 字符串在bytes_中的起始位置，多1项
+    std::vector<unsigned char> bytes_;  // 字符串内容
+
+  public:
+    ColumnVector()
+        : type_(NULL)
+        , field_(0)
+        , width_(0)
+        , size_(0)
+    {}
+
+    // 设定类型和容量，清空已有的值；TINYINT/SMALLINT/INT/BIGINT为定长
+    void init(DataType *type, unsigned int field, size_t capacity);
+    // 清空
+    void clear();
+    // 追加一个记录中的原始值，整数为大序
+    inline void append(const unsigned char *value, unsigned int len)
+    {
+        if (width_) {
+            unsigned char *dst = &values_[size_ * width_];
+            switch (width_) {
+            case 1:
+                *dst = *value;
+                break;
+            case 2: {
+                unsigned short v;
+                ::memcpy(&v, value, sizeof(v));
+                v = be16toh(v);
+                ::memcpy(dst, &v, sizeof(v));
+                break;
+            }
+            case 4: {
+                unsigned int v;
+                ::memcpy(&v, value, sizeof(v));
+                v = be32toh(v);
+                ::memcpy(dst, &v, sizeof(v));
+                break;
+            }
+            default: {
+                unsigned long long v;
+                ::memcpy(&v, value, sizeof(v));
+                v = be64toh(v);
+                ::memcpy(dst, &v, sizeof(v));
+                break;
+            }
+            }
+        } else {
+            bytes_.insert(bytes_.end(), value, value + len);
+            offsets_.push_back((unsigned int) bytes_.size());
+        }
+        ++size_;
+    }
+
+    // 值的个数
+    inline size_t size() { return size_; }
+    // 定长值数组，T的宽度应与width_一致
+    template <typename T>
+    inline const T *data()
+    {
+        return reinterpret_cast<const T *>(values_.data());
+    }
+    // 第row个字符串
+    inline const unsigned char *string(size_t row, unsigned int *len)
+    {
+        *len = offsets_[row + 1] - offsets_[row];
+        return bytes_.data() + offsets_[row];
+    }
+};
+
+// 一批记录
+struct Batch
+{
+    unsigned int blockid;                  // 所在的block
+    unsigned short first;                  // 第1行在block中的槽位
+    size_t rows;                           // 行数
+    std::vector<ColumnVector> columns;     // 投影列，与请求的顺序一致
+    std::vector<unsigned short> selection; // 选中的行号，解码后为全部有效行
+
+    Batch()
+        : blockid(0)
+        , first(0)
+        , rows(0)
+    {}
+};
+
+////
+// @brief
+// 沿数据链批量扫描
+//
+class BatchScanner
+{
+  private:
+    Table *table_;                     // 表
+    Table::BlockIterator block_;       // 当前block
+    unsigned short next_;              // 当前block中下一个槽位
+    size_t capacity_;                  // 批大小
+    std::vector<unsigned int> fields_; // 投影列
+    std::vector<size_t> offsets_;      // 解码一条记录时各字段的偏移
+
+  public:
+    // 扫描table，投影fields中的列；大表可以指定访问策略
+    BatchScanner(
+        Table &table,
+        const std::vector<unsigned int> &fields,
+        size_t capacity = BATCH_SIZE,
+        AccessStrategy *strategy = NULL);
+
+    // 解码下一批，扫描结束返回false
+    bool next(Batch &batch);
+
+  private:
+    // 从当前block的next_开始解码至多capacity_条记录
+    void decode(Batch &batch);
+};
+
+} // namespace db
+
+#endif // __DB_BATCH_H__
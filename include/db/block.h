@@ -90,6 +90,8 @@ struct SuperHeader : CommonHeader
     unsigned int maxid;      // 最大的blockid(4B)
     unsigned int pad;        // 填充位(4B)
     long long records;       // 记录数目(8B)
+    unsigned int reserved;   // 已预留空间的最大blockid(4B)
+    unsigned int extents;    // 已分配的extent个数(4B)
 };
 
 // 空闲块头部
@@ -323,6 +325,31 @@ class SuperBlock : public Block
         SuperHeader *header = reinterpret_cast<SuperHeader *>(buffer_);
         return be64toh(header->records);
     }
+
+    // 获取已预留空间的最大blockid
+    inline unsigned int getReserved()
+    {
+        SuperHeader *header = reinterpret_cast<SuperHeader *>(buffer_);
+        return be32toh(header->reserved);
+    }
+    // 设定已预留空间的最大blockid
+    inline void setReserved(unsigned int reserved)
+    {
+        SuperHeader *header = reinterpret_cast<SuperHeader *>(buffer_);
+        header->reserved = htobe32(reserved);
+    }
+    // 获取extent个数
+    inline unsigned int getExtents()
+    {
+        SuperHeader *header = reinterpret_cast<SuperHeader *>(buffer_);
+        return be32toh(header->extents);
+    }
+    // 设定extent个数
+    inline void setExtents(unsigned int extents)
+    {
+        SuperHeader *header = reinterpret_cast<SuperHeader *>(buffer_);
+        header->extents = htobe32(extents);
+    }
 };
 
 ////
@@ -452,18 +479,18 @@ class MetaBlock : public Block
     inline void setFreeSpace(unsigned short freespace)
     {
         MetaHeader *header = reinterpret_cast<MetaHeader *>(buffer_);
-        // 判断是不是超过了Trailer的界限
+        // 判断是不是超过了Trailer的界限，恰好用完时freespace大小为0
         unsigned short upper = BLOCK_SIZE - getTrailerSize();
-        if (freespace >= upper) freespace = 0; //超过界限则设置为0
+        if (freespace > upper) freespace = 0; //超过界限则设置为0
         header->freespace = htobe16(freespace);
     }
 
-    // 分配一个空间，直接返回指针，后续需要重新排列slots[]，second表示是否需要reorder
-    std::pair<unsigned char *, bool>
-    allocate(unsigned short space, unsigned short index);
+    // 分配一个空间，槽位插入到slots[index]，返回记录的位置，空间不够返回NULL；
+    // 需要时先回收，slots[]的顺序不变，不需要重排
+    unsigned char *allocate(unsigned short space, unsigned short index);
     // 给定一条记录的槽位下标，回收一条记录，回收slots[]中分配的槽位
     void deallocate(unsigned short index);
-    // 回收删除记录的资源，回收了slots资源，后续需要重排slots[]
+    // 回收删除记录的资源，按偏移量顺序向前移动记录，slots[]的顺序不变
     void shrink();
     // 对slots[]重排
     inline void reorder(DataType *type, unsigned int key)
@@ -561,6 +588,9 @@ class DataBlock : public MetaBlock
     // 拷贝一条记录
     // 如果新block空间不够，简单地返回false
     bool copyRecord(Record &record);
+    // 回收一条记录，同时通知表上的zone map；不与MetaBlock::deallocate同名，
+    // 以免经基类调用时漏掉通知
+    void deallocateRecord(unsigned short index);
 
     // 记录分配长度
     unsigned short requireLength(std::vector<struct iovec> &iov);
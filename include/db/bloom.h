@@ -0,0 +1,166 @@
+////
+// @file bloom.h
+// @brief
+// block级Bloom过滤器
+// 采用split-block Bloom filter：过滤器由256bit的桶组成，每个key只落在一个桶里，
+// 在桶的8个32bit字上各置1位，探测时只访问一条cache line。CPU支持AVX2时，
+// 整个桶的置位和检查由bloom_avx2.cc各用一条指令完成。
+// 对表上选定的列，每个数据块维护一个过滤器，等值查找先查过滤器，确定不存在的block
+// 不再向buffer借用。过滤器不支持删除，删除只会增加误判。
+//
+// @author niexw
+// @email niexiaowen@uestc.edu.cn
+//
+#ifndef __DB_BLOOM_H__
+#define __DB_BLOOM_H__
+
+#include <map>
+#include <vector>
+#include "./record.h"
+#include "./schema.h"
+
+namespace db {
+
+// 计算64位hash
+unsigned long long hash64(const void *buf, size_t len);
+
+////
+// @brief
+// split-block Bloom过滤器
+//
+class BloomFilter
+{
+  public:
+    static const size_t BUCKET_SIZE = 32; // 桶大小256bit
+    static const size_t CACHELINE = 64;   // cache line大小
+
+  private:
+    std::vector<unsigned char> bytes_; // 多分配一条cache line用于对齐
+    size_t buckets_;                   // 桶的个数
+
+  public:
+    BloomFilter()
+        : buckets_(0)
+    {}
+
+    // 按期望的key数目和误判率分配空间
+    void init(size_t keys, double fpp);
+    // 按每个key占用的字节数分配空间
+    void initBytesPerKey(size_t keys, double bytesPerKey);
+    // 清空
+    void clear();
+
+    // 插入hash
+    void insert(unsigned long long hash);
+    // 判断hash是否可能存在，false表示一定不存在
+    bool find(unsigned long long hash);
+
+    // 过滤器大小
+    inline size_t size() { return buckets_ * BUCKET_SIZE; }
+    // 按照期望的key数目和误判率计算字节数
+    static size_t bytesFor(size_t keys, double fpp);
+
+  private:
+    // 按cache line对齐的桶数组
+    inline unsigned int *bucket(unsigned long long hash)
+    {
+        unsigned char *base = &bytes_[0];
+        base += (CACHELINE - (size_t) base % CACHELINE) % CACHELINE;
+        // 用高32位选桶，避免取模
+        size_t index = (size_t) (((hash >> 32) * buckets_) >> 32);
+        return reinterpret_cast<unsigned int *>(base + index * BUCKET_SIZE);
+    }
+};
+
+// 过滤器参数
+struct BloomOptions
+{
+    double fpp;          // 期望误判率
+    double bytesPerKey;  // 每个key的字节数，>0时优先于fpp
+    size_t keysPerBlock; // 每个block预期的key数目
+
+    BloomOptions()
+        : fpp(0.01)
+        , bytesPerKey(0)
+        , keysPerBlock(128)
+    {}
+};
+
+// 一个block上各列的过滤器
+struct BlockFilter
+{
+    unsigned int next;                // 数据链上的后继block
+    unsigned int keys;                // 插入的key数目
+    unsigned int removed;             // 删除的key数目
+    size_t capacity;                  // 过滤器按多少个key分配
+    std::vector<BloomFilter> filters; // 各跟踪列的过滤器
+
+    BlockFilter()
+        : next(0)
+        , keys(0)
+        , removed(0)
+        , capacity(0)
+    {}
+};
+
+////
+// @brief
+// 表上所有block的过滤器
+//
+class DataBlock;
+class BlockBloom
+{
+  public:
+    using Filters = std::map<unsigned int, BlockFilter>; // blockid --> 过滤器
+
+  private:
+    RelationInfo *info_;               // 表的元数据
+    std::vector<unsigned int> fields_; // 跟踪的列
+    BloomOptions options_;             // 参数
+    Filters filters_;                  // 各block过滤器
+
+  public:
+    BlockBloom()
+        : info_(NULL)
+    {}
+
+    // 设定需要跟踪的列，已有过滤器全部作废
+    void init(
+        RelationInfo *info,
+        const std::vector<unsigned int> &fields,
+        const BloomOptions &options);
+    // 是否打开
+    inline bool enabled() { return !fields_.empty(); }
+    // field在跟踪列中的位置，-1表示未跟踪
+    int column(unsigned int field);
+
+    // 新block，过滤器为空，按keys与keysPerBlock中较大者分配
+    void reset(unsigned int blkid, unsigned int next, size_t keys = 0);
+    // 根据block内容重建过滤器
+    void build(DataBlock &block);
+    // 将一条记录加入过滤器，未知block不处理
+    void add(unsigned int blkid, Record &record);
+    // 删除一条记录，只做计数
+    void remove(unsigned int blkid);
+    // 修改数据链后继
+    void setNext(unsigned int blkid, unsigned int next);
+    // 丢弃block过滤器
+    void drop(unsigned int blkid);
+    // 查找block过滤器，NULL表示未知
+    BlockFilter *find(unsigned int blkid);
+    // 删除过多时需要重建
+    bool stale(unsigned int blkid);
+
+    // 判断block上是否可能有field等于val的记录，未知block总是返回true
+    bool mayContain(
+        unsigned int blkid,
+        unsigned int field,
+        const void *val,
+        unsigned int len);
+    // 过滤器个数
+    inline size_t size() { return filters_.size(); }
+};
+
+} // namespace db
+
+#endif // __DB_BLOOM_H__
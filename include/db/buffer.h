@@ -11,10 +11,17 @@
 
 #include <string>
 #include <map>
+#include <vector>
 #include <atomic>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include "./cache.h"
+#include "./runtime.h"
 
 namespace db {
 // buffer描述符
+class Buffer;
 struct BufDesp
 {
     BufDesp *next;                  // 下一个描述符
@@ -25,6 +32,10 @@ struct BufDesp
     unsigned short size;            // 大小
     unsigned char type;             // 类型
     std::atomic<unsigned char> ref; // 引用计数
+    Buffer *pool;                   // 所属的buffer池
+    unsigned short node;            // buffer所在的NUMA结点
+    unsigned int frame;             // buffer编号，可以代替指针
+    std::atomic<int> latch;         // 块级latch，共享持有数，-1表示独占
 
     BufDesp()
         : next(NULL)
@@ -34,9 +45,222 @@ struct BufDesp
         , buffer(NULL)
         , size(0)
         , type(0)
+        , ref(0)
+        , pool(NULL)
+        , node(0)
+        , frame(0)
+        , latch(0)
     {}
     inline void addref() { ++ref; }
     inline void relref() { --ref; }
+
+    // 块级latch，由PageGuard和回写获取，持有时间很短，自旋一段后让出CPU；
+    // 不可重入，同一线程再次独占同一block会死锁
+    void lockShared();
+    void lockExclusive();
+    // 回写时获取共享latch，不等待，block被独占时返回false
+    bool tryLockShared();
+    inline void unlockShared() { latch.fetch_sub(1); }
+    inline void unlockExclusive() { latch.store(0); }
+};
+
+// buffer内存选项
+struct ArenaOptions
+{
+    bool largePages; // 使用大页，不支持时退回普通页
+    bool numa;       // chunk轮流分配到各NUMA结点，优先出借本结点的buffer
+
+    ArenaOptions()
+        : largePages(false)
+        , numa(false)
+    {}
+};
+
+// NUMA结点统计
+struct NodeStats
+{
+    size_t frames;                   // buffer个数
+    size_t largeFrames;              // 在大页上的buffer个数
+    size_t idles;                    // 空闲buffer个数
+    unsigned long long allocs;       // 从本结点分配的次数
+    unsigned long long remoteAllocs; // 本结点线程从其它结点分配的次数
+
+    NodeStats()
+        : frames(0)
+        , largeFrames(0)
+        , idles(0)
+        , allocs(0)
+        , remoteAllocs(0)
+    {}
+};
+
+// buffer统计，由各线程的计数器汇总，驻留情况在汇总时遍历得到
+struct BufferStats
+{
+    unsigned long long hits;       // 池中命中次数
+    unsigned long long misses;     // 未命中次数
+    unsigned long long reads;      // 读文件次数
+    unsigned long long readNanos;  // 读文件总耗时，纳秒
+    unsigned long long writes;     // 回写的block数
+    unsigned long long writeIos;   // 回写的I/O次数，相邻block合并为一次
+    unsigned long long writeBytes; // 回写的字节数
+    unsigned long long writeNanos; // 回写总耗时，纳秒
+    unsigned long long evictions;  // 淘汰次数
+    unsigned long long pins;       // borrow次数
+    unsigned long long unpins;     // releaseBuf次数
+    size_t resident;               // 驻留block个数
+    size_t dirty;                  // 脏block个数
+    size_t pinned;                 // 借出的block个数
+    size_t refs;                   // 借出的引用总数
+
+    BufferStats()
+        : hits(0)
+        , misses(0)
+        , reads(0)
+        , readNanos(0)
+        , writes(0)
+        , writeIos(0)
+        , writeBytes(0)
+        , writeNanos(0)
+        , evictions(0)
+        , pins(0)
+        , unpins(0)
+        , resident(0)
+        , dirty(0)
+        , pinned(0)
+        , refs(0)
+    {}
+
+    // 命中率
+    inline double hitRatio()
+    {
+        return hits + misses ? (double) hits / (hits + misses) : 0;
+    }
+    // 平均读延迟，微秒
+    inline double readLatency()
+    {
+        return reads ? (double) readNanos / reads / 1000 : 0;
+    }
+    // 平均每次回写I/O的延迟，微秒
+    inline double writeLatency()
+    {
+        return writeIos ? (double) writeNanos / writeIos / 1000 : 0;
+    }
+    // 平均每次回写I/O的字节数
+    inline double writeSize()
+    {
+        return writeIos ? (double) writeBytes / writeIos : 0;
+    }
+};
+
+// 驻留block的快照
+struct BufEntry
+{
+    std::string table;    // 表名
+    unsigned int blockid; // block的id
+    unsigned int frame;   // buffer编号
+    bool dirty;           // 是否为脏
+    unsigned char ref;    // 引用计数
+};
+
+// 预热选项
+struct WarmupOptions
+{
+    size_t batch; // 连续block合并读取的上限，缺省64个即1MB
+    size_t rate;  // 读取速率上限，单位MB/s，0表示不限
+
+    WarmupOptions()
+        : batch(64)
+        , rate(64)
+    {}
+};
+
+// 预热统计
+struct WarmupStats
+{
+    size_t listed;            // 列表中的block数
+    size_t loaded;            // 装入的block数
+    size_t skipped;           // 已驻留、池已满或读取失败而跳过的block数
+    size_t reads;             // 读文件次数
+    unsigned long long bytes; // 读取的字节数
+    bool done;                // 是否结束
+
+    WarmupStats()
+        : listed(0)
+        , loaded(0)
+        , skipped(0)
+        , reads(0)
+        , bytes(0)
+        , done(true)
+    {}
+};
+
+// 访问策略统计
+struct StrategyStats
+{
+    unsigned long long reads;  // 借用次数
+    unsigned long long hits;   // 已在池中的block，不改变lru位置
+    unsigned long long added;  // 从池中取来放到环上的buffer
+    unsigned long long reused; // 环上复用的buffer
+    unsigned long long writes; // 复用前回写的脏buffer
+
+    StrategyStats()
+        : reads(0)
+        , hits(0)
+        , added(0)
+        , reused(0)
+        , writes(0)
+    {}
+
+    // 触及主池的buffer个数
+    inline unsigned long long touched() { return hits + added; }
+};
+
+////
+// @brief
+// buffer访问策略
+// 大表扫描、批量装载等操作只在一个私有的小环上循环使用buffer，环上的buffer挂在
+// lru尾部，已在池中的block不改变lru位置，不会冲掉热点数据。环上的buffer被普通
+// borrow命中后就归还给主池，环上留下空位；归还的buffer淘汰后可能分给别的block
+// 或别的环，所以环还记录每个位置装入的block，只有仍装着该block时才属于环。
+//
+class AccessStrategy
+{
+  public:
+    enum Type
+    {
+        BULKREAD,  // 大表顺序扫描
+        BULKWRITE, // 批量装载，见Table::insert
+    };
+    static const unsigned int NO_FRAME = (unsigned int) -1; // 环上的空位
+
+  private:
+    using Block = std::pair<std::string, unsigned int>; // 表名+blockid
+
+    Type type_;                      // 类型
+    Buffer *pool_;                   // 环上buffer所在的池
+    std::vector<unsigned int> ring_; // 环上的buffer编号
+    std::vector<Block> blocks_;      // 环上各buffer装入的block
+    size_t current_;                 // 下一个使用的位置
+    StrategyStats stats_;            // 统计
+
+    // 环上第slot个buffer是否仍装着环装入的block
+    bool owns(size_t slot, BufDesp *desp);
+
+    friend class Buffer;
+
+  public:
+    // size为环上buffer个数，0表示按类型取缺省值
+    AccessStrategy(Type type, size_t size = 0);
+    // 环上的buffer归还主池
+    ~AccessStrategy();
+
+    // 类型
+    inline Type type() { return type_; }
+    // 环的大小
+    inline size_t size() { return ring_.size(); }
+    // 获取统计
+    inline StrategyStats &stats() { return stats_; }
 };
 
 ////
@@ -46,49 +270,247 @@ struct BufDesp
 // 3. 上层调用write接口写，调用release释放buffer；
 // 4. 完整的实现，Buffer应该由一个协程控制，上层用户通过rpc请求block；
 // 5. Buffer应该自主刷盘，同时设置两个通道
+// 6. 内存按chunk分配，可以在线增减，chunk可以使用大页，可以分布在各NUMA结点；
+//    每个chunk有一个预先分配的描述符数组，按cache line对齐，与buffer分开存放；
+// 7. kBuffer是缺省池，还可以创建命名池，表按RelationInfo中的池id分配到各池，
+//    borrow自动转给表所在的池
+// 8. 驻留列表可以在关闭时和定期保存，重启后由预热线程按表和blockid排序后合并
+//    读取，限速装入，前台操作与预热线程通过latch_互斥
 // TODO: 日志刷盘
 class FilePool;
 class Buffer
 {
   public:
     using BlockMap = std::map<std::pair<std::string, unsigned int>, BufDesp *>;
+    using Resident = std::pair<std::string, unsigned int>; // 表名+blockid
+    struct Chunk
+    {
+        unsigned char *base;  // 起始地址
+        unsigned char *desps; // 描述符数组，按cache line对齐
+        unsigned short node;  // 所在NUMA结点
+        bool large;           // 是否大页
+    };
+    using Chunks = std::vector<Chunk>;
+    struct Counters; // 一个线程的计数器，独占cache line
+    // 待回写的脏block
+    struct DirtyBlock
+    {
+        BufDesp *desp;             // 描述符
+        const char *file;          // 所在文件在文件池中的名字
+        unsigned long long offset; // 在文件中的偏移量
+    };
 
-    unsigned char BUFFER_LOCKED = 0x1; // 锁定buffer
-    unsigned char BUFFER_DIRTY = 0x2;  // 脏buffer
-    unsigned char BUFFER_READY = 0x4;  // 可回写buffer
+    static const size_t CHUNK_SIZE = 1024 * 1024; // chunk大小，大页时取大页大小
+    static const size_t MAX_POOLS = 256;          // 池id占8位
+    static const size_t COUNTER_SLOTS = 64;       // 计数器槽，线程按编号取模
+    static const size_t MAX_COALESCE = 64;        // 合并回写的最多block数
+
+    unsigned char BUFFER_LOCKED = 0x1;   // 锁定buffer
+    unsigned char BUFFER_DIRTY = 0x2;    // 脏buffer
+    unsigned char BUFFER_READY = 0x4;    // 可回写buffer
+    unsigned char BUFFER_RING = 0x8;     // 属于访问策略的环
+    unsigned char BUFFER_LOADING = 0x10; // 正在读入，读入者独占block的latch
 
   private:
-    BufDesp *idle_;         // 空闲buffer
-    BufDesp lru_;           // 最近访问队列
-    BlockMap map_;          // 块表 table+blockid --> BufDesp
-    unsigned char *buffer_; // 所有buffer
-    FilePool *filepool_;    // 文件池
-    size_t idleCount_;      // 空闲块个数
+    std::vector<BufDesp *> idles_; // 各结点的空闲buffer
+    BufDesp lru_;                  // 最近访问队列，lru_.prev指向尾部
+    BlockMap map_;                 // 块表 table+blockid --> BufDesp
+    Chunks chunks_;                // 所有buffer
+    size_t chunkSize_;             // chunk大小
+    ArenaOptions options_;         // 内存选项
+    std::vector<NodeStats> nodes_; // 各结点统计
+    FilePool *filepool_;           // 文件池
+    size_t idleCount_;             // 空闲块个数
+    SecondaryCache cache_;         // 二级缓存
+    std::string name_;             // 池名
+    std::vector<Buffer *> pools_;  // 下标为池id，0为缺省池自己
+    unsigned char *counters_;      // 各线程的计数器
+    std::recursive_mutex latch_;   // 前台与预热任务互斥
+    TaskGroup warming_;            // 预热任务
+    std::atomic<bool> stopping_;   // 通知预热任务退出
+    WarmupStats warmup_;           // 预热统计
+    unsigned long long epoch_;     // 回写次数，预热装入前检查
+    std::string residentPath_;     // 驻留列表文件
+    unsigned int interval_;        // 定期保存的间隔，单位为秒，0表示不定期保存
+    unsigned long long residentTimer_; // 定期保存的定时任务id
+    TaskGroup background_;             // 定期保存任务
 
   public:
     Buffer()
-        : idle_(NULL)
-        , buffer_(NULL)
+        : chunkSize_(CHUNK_SIZE)
         , filepool_(NULL)
         , idleCount_(0)
+        , name_("default")
+        , counters_(NULL)
+        , stopping_(false)
+        , epoch_(0)
+        , interval_(0)
+        , residentTimer_(0)
     {}
     ~Buffer();
 
     // 初始化缺省大小为256MB
-    void init(FilePool *fp, size_t defaultSize = 256);
-    // 用户请求一个block
-    BufDesp *borrow(const char *table, unsigned int blockid);
+    void init(
+        FilePool *fp,
+        size_t defaultSize = 256,
+        const ArenaOptions &options = ArenaOptions());
+    // 在线调整大小，单位为MB，按chunk取整；缩小时淘汰被释放chunk上的block，
+    // chunk上有借出的block时返回EBUSY
+    int resize(size_t size);
+    // block总数
+    size_t capacity();
+    // 按编号得到描述符，编号在[0, capacity())之间
+    BufDesp *descriptor(unsigned int frame);
+    // 用户请求一个block，strategy不为NULL时在策略的环上分配buffer。未命中时
+    // 在latch_下预留buffer并登记到块表，读盘时不持有latch_；同一block的其它
+    // 借用者等在block的latch上
+    BufDesp *borrow(
+        const char *table,
+        unsigned int blockid,
+        AccessStrategy *strategy = NULL);
+    // block已在池中时借出，否则返回NULL，不读盘；正在读入的block也返回NULL。
+    // 异步接口据此决定是否挂起
+    BufDesp *probe(const char *table, unsigned int blockid);
     // 写一个block
     void writeBuf(BufDesp *desp);
     // 释放block
-    inline void releaseBuf(BufDesp *desp) { desp->relref(); }
+    void releaseBuf(BufDesp *desp);
+    // 回写一个脏block，压缩表先压缩；写的期间持有block的共享latch和引用，
+    // 不持有latch_，block被独占守卫持有时返回EBUSY
+    int writeBack(BufDesp *desp);
+    // 回写脏block，按文件和偏移量排序，相邻block合并成一次写；file不为NULL
+    // 时只回写该文件中的block。被独占守卫持有的block跳过，仍然为脏
+    int flush(const char *file = NULL);
 
     // 空闲块个数
     inline size_t idles() { return idleCount_; }
+    // 所用的文件池
+    inline FilePool *filePool() { return filepool_; }
+    // NUMA结点个数
+    inline size_t nodes() { return nodes_.size(); }
+    // 结点统计
+    inline NodeStats &nodeStats(unsigned short node) { return nodes_[node]; }
+    // 汇总统计
+    BufferStats stats();
+    // 按lru顺序列出驻留的block，头部最近访问
+    void snapshot(std::vector<BufEntry> &entries);
+    // 各表驻留的block个数
+    void residency(std::map<std::string, size_t> &tables);
+    // 打印统计
+    void report();
+
+    // 按lru顺序保存驻留的(表名, blockid)列表
+    int saveResident(const char *path);
+    // 设定驻留列表文件，析构时保存，interval不为0时每隔interval秒保存
+    void keepResident(const char *path, unsigned int interval = 0);
+    // 从驻留列表异步预热，只装入空闲buffer能容纳的最热部分
+    int
+    warmup(const char *path, const WarmupOptions &options = WarmupOptions());
+    // 等待预热结束
+    void waitWarmup();
+    // 预热统计
+    WarmupStats warmupStats();
+    // 池名
+    inline const std::string &name() { return name_; }
+
+    // 创建命名池，size单位为MB，返回池id
+    int createPool(const char *name, size_t size, unsigned short &id);
+    // 按名字查找池，缺省池名为"default"，id为0
+    Buffer *findPool(const char *name, unsigned short *id = NULL);
+    // 按id得到池，不存在时返回缺省池
+    Buffer *pool(unsigned short id);
+    // 二级缓存
+    inline SecondaryCache &cache() { return cache_; }
     // 分配buffer
     BufDesp *allocFromIdle();
     // prepend到lru头部
     void prependLru(BufDesp *ptr);
+    // append到lru尾部
+    void appendLru(BufDesp *ptr);
+    // 从lru上摘下
+    void unlinkLru(BufDesp *ptr);
+    // 从lru尾部淘汰一个未借出的block，干净的block放入二级缓存；脏block回写
+    // 期间不持有latch_
+    int evict();
+
+  private:
+    // 当前线程的计数器
+    Counters &counters();
+    // 增加一个chunk
+    int addChunk();
+    // 丢弃一个干净未借出的block，buffer归还idle
+    void discard(BufDesp *desp);
+    // 在访问策略的环上分配buffer
+    BufDesp *allocFromRing(AccessStrategy *strategy, size_t &slot);
+    // 命中池中的block，调整lru并增加引用，调用者持有latch_
+    BufDesp *pinHit(BufDesp *desp, AccessStrategy *strategy);
+    // 预热任务，list已按表名+blockid排序
+    void warm(std::vector<Resident> list, WarmupOptions options);
+    // 定时保存驻留列表，保存后按interval_重新设定
+    void persist();
+    // 合并回写同一文件中偏移量连续的脏block，跳过被独占的block
+    int writeRun(DirtyBlock *run, size_t count);
+    // 将预热读入的连续block装入池中
+    void install(
+        const std::string &table,
+        unsigned int blockid,
+        size_t count,
+        const unsigned char *data);
+};
+
+////
+// @brief
+// block的pin守卫
+// 构造时borrow，析构时releaseBuf，只能移动不能复制，避免手工配对borrow和
+// relref时的泄漏和重复释放。借用后按模式获取block的latch：共享守卫只读，
+// 可以并存；独占守卫排斥其它守卫，修改后调用dirty()标脏。迭代器直接borrow，
+// 不取latch。
+//
+class PageGuard
+{
+  public:
+    enum Mode
+    {
+        SHARED,    // 只读
+        EXCLUSIVE, // 读写
+    };
+
+  private:
+    Buffer *buffer_; // 所在的buffer
+    BufDesp *desp_;  // 借用的block，NULL表示未持有
+    Mode mode_;      // 模式
+
+  public:
+    PageGuard()
+        : buffer_(NULL)
+        , desp_(NULL)
+        , mode_(SHARED)
+    {}
+    PageGuard(
+        Buffer &buffer,
+        const char *table,
+        unsigned int blockid,
+        Mode mode = SHARED,
+        AccessStrategy *strategy = NULL);
+    PageGuard(PageGuard &&other);
+    PageGuard &operator=(PageGuard &&other);
+    PageGuard(const PageGuard &) = delete;
+    PageGuard &operator=(const PageGuard &) = delete;
+    ~PageGuard() { release(); }
+
+    // 是否持有block
+    inline explicit operator bool() const { return desp_ != NULL; }
+    // 描述符
+    inline BufDesp *desp() { return desp_; }
+    // block数据
+    inline unsigned char *buffer() { return desp_ ? desp_->buffer : NULL; }
+    // 模式
+    inline Mode mode() { return mode_; }
+
+    // 标记修改，只有独占守卫可以写，返回EPERM
+    int dirty();
+    // 提前释放
+    void release();
 };
 
 // 全局buffer管理器
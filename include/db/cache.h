@@ -0,0 +1,108 @@
+////
+// @file cache.h
+// @brief
+// 二级缓存
+// Buffer淘汰干净的block时，将其压缩后放入内存中的二级缓存；borrow未命中时，先查
+// 二级缓存，再读文件。二级缓存有独立的lru，容量按压缩后的字节数计算，超过上限时
+// 从lru尾部丢弃。一个block只会在Buffer或二级缓存之一中存在，命中后即从二级缓存
+// 中移除。Buffer读盘时不持有池的latch_，二级缓存自带锁，解压在锁外进行。
+//
+// @author niexw
+// @email niexiaowen@uestc.edu.cn
+//
+#ifndef __DB_CACHE_H__
+#define __DB_CACHE_H__
+
+#include <string>
+#include <map>
+#include <list>
+#include <vector>
+#include <mutex>
+
+namespace db {
+
+// 二级缓存统计
+struct CacheStats
+{
+    unsigned long long hits;      // 命中次数
+    unsigned long long misses;    // 未命中次数
+    unsigned long long inserts;   // 放入的block数目
+    unsigned long long evictions; // 因容量不足丢弃的block数目
+
+    CacheStats()
+        : hits(0)
+        , misses(0)
+        , inserts(0)
+        , evictions(0)
+    {}
+
+    // 命中率
+    inline double hitRatio()
+    {
+        return hits + misses ? (double) hits / (hits + misses) : 0;
+    }
+};
+
+////
+// @brief
+// 压缩的二级缓存
+//
+class SecondaryCache
+{
+  public:
+    using Key = std::pair<std::string, unsigned int>; // 表名+blockid
+    struct Entry
+    {
+        Key key;                         // 表名+blockid
+        std::vector<unsigned char> data; // 压缩数据，BLOCK_SIZE表示未压缩
+    };
+    using Lru = std::list<Entry>;               // 头部最近放入
+    using Index = std::map<Key, Lru::iterator>; // key --> lru位置
+
+  private:
+    std::mutex lock_;                  // 保护以下各项
+    size_t capacity_;                  // 容量上限，0表示关闭
+    size_t used_;                      // 已用字节数
+    Lru lru_;                          // 最近放入队列
+    Index index_;                      // 索引
+    std::vector<unsigned char> stage_; // 压缩缓冲
+    CacheStats stats_;                 // 统计
+
+  public:
+    SecondaryCache()
+        : capacity_(0)
+        , used_(0)
+    {}
+
+    // 设定容量，单位为字节，0表示关闭；缩小时从lru尾部丢弃
+    void init(size_t capacity);
+    // 是否打开
+    inline bool enabled() { return capacity_ > 0; }
+
+    // 放入一个干净的block，已存在则替换
+    void insert(
+        const char *table,
+        unsigned int blockid,
+        const unsigned char *buffer);
+    // 查找block，命中时解压到buffer并移除
+    bool lookup(const char *table, unsigned int blockid, unsigned char *buffer);
+    // 移除block
+    void erase(const char *table, unsigned int blockid);
+
+    // 已用字节数
+    size_t used();
+    // block数目
+    size_t size();
+    // 获取统计
+    CacheStats stats();
+
+  private:
+    // 丢弃lru尾部，直到不超过容量，调用者持有lock_
+    void shrink();
+    // 移除block，调用者持有lock_
+    void remove(const char *table, unsigned int blockid);
+};
+
+} // namespace db
+
+#endif // __DB_CACHE_H__
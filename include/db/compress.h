@@ -0,0 +1,134 @@
+////
+// @file compress.h
+// @brief
+// block压缩
+// 内置一个LZ4风格的LZ77编码器，不依赖外部库。编码格式为一串sequence：
+//
+// +-------+----------+----------+--------+-----------+
+// | token | 字面长度 |   字面   | offset | 匹配长度  |
+// +-------+----------+----------+--------+-----------+
+//
+// token高4位是字面长度，低4位是匹配长度-4，取值15时后面跟着若干扩展字节，每个字节
+// 累加，直到某个字节不是255。offset为2B小序，最后一个sequence只有字面。
+//
+// 压缩表的数据块在文件中变长存放，由<path>.map记录每个block的位置：
+//
+// +--------------------+ <--- 0
+// |     super block    |
+// +--------------------+ <--- SUPER_SIZE
+// |   变长的压缩block   |
+// |        ...         |
+// +--------------------+
+//
+// map文件是一个以blockid为下标的BlockExtent数组，超块不压缩，仍在文件头部。
+//
+// @author niexw
+// @email niexiaowen@uestc.edu.cn
+//
+#ifndef __DB_COMPRESS_H__
+#define __DB_COMPRESS_H__
+
+#include <vector>
+#include <mutex>
+#include "./file.h"
+#include "./block.h"
+
+namespace db {
+
+// 压缩，返回压缩后长度，0表示无法压缩到cap以内
+size_t lzCompress(
+    const unsigned char *src,
+    size_t len,
+    unsigned char *dst,
+    size_t cap);
+// 解压，返回解压后长度，0表示数据损坏
+size_t lzDecompress(
+    const unsigned char *src,
+    size_t len,
+    unsigned char *dst,
+    size_t cap);
+// 压缩输出的最坏长度
+inline size_t lzBound(size_t len) { return len + len / 255 + 16; }
+
+// 压缩block在文件中的位置
+struct BlockExtent
+{
+    unsigned long long offset; // 文件偏移量
+    unsigned int length;       // 存放长度，BLOCK_SIZE表示未压缩
+    unsigned int capacity;     // 占用空间，原地覆盖时不能超过
+};
+
+// 压缩统计
+struct CompressStats
+{
+    unsigned long long blocks;       // 写出的block数目
+    unsigned long long rawBytes;     // 原始字节数
+    unsigned long long storedBytes;  // 落盘字节数
+    unsigned long long compressNs;   // 压缩耗时
+    unsigned long long reads;        // 读入的block数目
+    unsigned long long decompressNs; // 解压耗时
+
+    CompressStats()
+        : blocks(0)
+        , rawBytes(0)
+        , storedBytes(0)
+        , compressNs(0)
+        , reads(0)
+        , decompressNs(0)
+    {}
+
+    // 压缩比
+    inline double ratio()
+    {
+        return storedBytes ? (double) rawBytes / storedBytes : 0;
+    }
+    // 压缩吞吐率，MB/s
+    inline double compressMBps()
+    {
+        return compressNs ? rawBytes * 1000.0 / compressNs : 0;
+    }
+    // 解压吞吐率，MB/s
+    inline double decompressMBps()
+    {
+        return decompressNs ? reads * BLOCK_SIZE * 1000.0 / decompressNs : 0;
+    }
+};
+
+////
+// @brief
+// 压缩表的block映射
+//
+class BlockMapping
+{
+  public:
+    static const unsigned int SECTOR = 512; // 空间按扇区分配
+
+  private:
+    std::mutex lock_;                  // 保护以下各项
+    File map_;                         // map文件
+    std::vector<BlockExtent> extents_; // blockid --> 位置
+    unsigned long long tail_;          // 数据文件尾部
+    std::vector<unsigned char> stage_; // 编解码缓冲
+    CompressStats stats_;              // 统计
+
+  public:
+    BlockMapping()
+        : tail_(0)
+    {}
+
+    // 打开映射，path为数据文件路径
+    int open(const char *path, File *data);
+    // 读一个block，未写过的block清零
+    int read(File *data, unsigned int blockid, unsigned char *buffer);
+    // 写一个block
+    int write(File *data, unsigned int blockid, const unsigned char *buffer);
+
+    // 获取统计
+    CompressStats stats();
+    // 数据文件尾部
+    unsigned long long tail();
+};
+
+} // namespace db
+
+#endif // __DB_COMPRESS_H__
@@ -0,0 +1,101 @@
+////
+// @file fence.h
+// @brief
+// 键到block的定位缓存(fence key)
+// 对数据链上每个非空block，记录其第1条记录的key(fence key)，按key有序存放。
+// locate时在内存中二分查找最后一个不大于目标key的fence，不再沿数据链逐块借用。
+// 缓存只保存在内存中，第1次locate时沿数据链建立；插入分裂、删除合并时由Table
+// 维护，其它Table对象对同一张表的修改不可见，需要重新open。
+//
+// @author niexw
+// @email niexiaowen@uestc.edu.cn
+//
+#ifndef __DB_FENCE_H__
+#define __DB_FENCE_H__
+
+#include <map>
+#include <string>
+#include <vector>
+#include "./datatype.h"
+
+namespace db {
+
+// block的fence key，以记录中的大序原始字节保存
+struct Fence
+{
+    std::string key;      // 第1条记录的key
+    unsigned int blockid; // block的id
+};
+
+// 缓存统计
+struct FenceStats
+{
+    size_t hits;    // 在缓存中定位的次数
+    size_t builds;  // 沿数据链重建的次数
+    size_t updates; // 插入、删除引起的修改次数
+
+    FenceStats()
+        : hits(0)
+        , builds(0)
+        , updates(0)
+    {}
+};
+
+////
+// @brief
+// 表上所有非空block的fence key，按key有序
+//
+class FenceCache
+{
+  public:
+    using Fences = std::vector<Fence>;
+    using Keys = std::map<unsigned int, std::string>; // blockid --> fence key
+
+  private:
+    DataType *type_;    // key的类型
+    unsigned int head_; // 数据链上第1个block
+    bool valid_;        // 是否已经建立
+    Fences fences_;     // 有序的fence
+    Keys keys_;         // 按blockid查fence key，再二分得到位置
+    FenceStats stats_;  // 统计
+
+  public:
+    FenceCache()
+        : type_(NULL)
+        , head_(0)
+        , valid_(false)
+    {}
+
+    // 开始重建，清空已有的fence
+    void init(DataType *type, unsigned int head);
+    // 重建时按数据链顺序追加一个block
+    void append(unsigned int blockid, const void *key, unsigned int len);
+    // 重建完成
+    void finish();
+    // 作废缓存，下次locate时重建
+    void invalidate();
+    // 是否已经建立
+    inline bool valid() { return valid_; }
+
+    // 最后一个fence不大于key的block，都大于key时返回数据链上第1个block
+    unsigned int find(const void *key, unsigned int len);
+    // block的第1条记录改变，修改或加入其fence
+    void set(unsigned int blockid, const void *key, unsigned int len);
+    // block变空或被回收，删除其fence
+    void drop(unsigned int blockid);
+
+    // fence个数
+    inline size_t size() { return fences_.size(); }
+    // 统计
+    inline FenceStats &stats() { return stats_; }
+
+  private:
+    // 第1个大于key的fence的位置
+    size_t upper(const void *key, unsigned int len);
+    // blockid所在的位置，按其fence key二分查找，不存在时返回fences_.end()
+    Fences::iterator position(unsigned int blockid);
+};
+
+} // namespace db
+
+#endif // __DB_FENCE_H__
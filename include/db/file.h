@@ -11,6 +11,14 @@
 
 #include "./config.h"
 #include <map>
+#include <list>
+#include <deque>
+#include <string>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+struct iovec;
 
 namespace db {
 
@@ -33,29 +41,295 @@ class File
     int read(unsigned long long offset, char *buffer, size_t length);
     // 写文件
     int write(unsigned long long offset, const char *buffer, size_t length);
+    // 将多段buffer连续写到offset处
+    int writev(
+        unsigned long long offset,
+        const struct iovec *iov,
+        size_t count);
     // 文件长度
     int length(unsigned long long &len);
+    // 预分配磁盘空间到length，不改变文件长度
+    int allocate(unsigned long long length);
+    // 数据和元数据刷盘
+    int sync();
+    // 数据刷盘，只同步读回数据所需的元数据
+    int datasync();
     // 删除文件
     static int remove(const char *path);
 };
 
+////
+// @brief
+// 只读映射的文件
+// 整个文件映射到进程地址空间，读取时不经过buffer复制，映射之后文件的增长不可见
+//
+class MappedFile
+{
+  public:
+    unsigned char *base_;       // 映射地址，NULL表示未映射
+    unsigned long long length_; // 映射长度
+#if defined(WIN32)
+    HANDLE file_;    // 文件句柄
+    HANDLE mapping_; // 映射对象
+#endif
+
+  public:
+    MappedFile()
+        : base_(NULL)
+        , length_(0)
+#if defined(WIN32)
+        , file_(INVALID_HANDLE_VALUE)
+        , mapping_(NULL)
+#endif
+    {}
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+    ~MappedFile() { close(); }
+
+    // 只读映射整个文件，并提示按顺序访问；空文件返回EINVAL
+    int open(const char *path);
+    // 解除映射
+    void close();
+    // 提示预读[offset, offset + length)，超出映射的部分忽略
+    int prefetch(unsigned long long offset, unsigned long long length);
+};
+
+// 组提交选项
+struct CommitOptions
+{
+    unsigned int interval; // 等待更多请求的最长时间，单位为微秒
+    size_t depth;          // 等待的请求达到depth时立即刷盘
+
+    CommitOptions()
+        : interval(1000)
+        , depth(32)
+    {}
+};
+
+// 组提交统计
+struct CommitStats
+{
+    unsigned long long requests; // 提交请求数
+    unsigned long long syncs;    // 刷盘次数
+
+    CommitStats()
+        : requests(0)
+        , syncs(0)
+    {}
+
+    // 平均每次刷盘合并的请求数
+    inline double batch() { return syncs ? (double) requests / syncs : 0; }
+};
+
+// 文件池统计
+struct FileStats
+{
+    unsigned long long hits;   // 描述符已打开
+    unsigned long long misses; // 需要打开文件
+    unsigned long long closes; // 因超过容量关闭的文件数
+    unsigned long long opened; // 当前打开的文件数
+    unsigned long long pinned; // 当前有引用的文件数
+
+    FileStats()
+        : hits(0)
+        , misses(0)
+        , closes(0)
+        , opened(0)
+        , pinned(0)
+    {}
+
+    // 命中率
+    inline double hitRatio()
+    {
+        return hits + misses ? (double) hits / (hits + misses) : 0;
+    }
+};
+
 // 文件池
+// 按表名缓存打开的描述符，打开的文件数超过容量时，按lru关闭没有引用的文件；
+// 都有引用时暂时超出容量。I/O期间通过FileRef持有引用，防止文件被关闭。
+// 共享表空间中的表使用表空间的描述符，block的偏移量经表的段换算。
 class Schema;
+class BlockMapping;
+class SharedSpace;
+class Segment;
 class FilePool
 {
+  public:
+    static const size_t DEFAULT_CAPACITY = 1024; // 缺省最多打开的文件数
+
+    using Mappings = std::map<std::string, BlockMapping *>;
+    using Lru = std::list<std::string>; // 头部最近使用
+    // 打开的表文件
+    struct Handle
+    {
+        File file;         // 文件
+        unsigned int refs; // 引用计数
+        Lru::iterator lru; // lru位置
+
+        Handle()
+            : refs(0)
+        {}
+    };
+    using Handles = std::map<std::string, Handle>;
+    using Spaces = std::map<unsigned short, SharedSpace *>; // id --> 表空间
+    using Segments = std::map<std::string, Segment *>;      // 表名 --> 段
+    using CommitCallback = std::function<void(int)>;
+    // 一个文件的提交队列，请求按票号排序
+    struct CommitQueue
+    {
+        unsigned long long ticket; // 已发出的最大票号
+        unsigned long long synced; // 已刷盘的最大票号
+        bool syncing;              // 是否有线程负责刷盘
+        bool armed;                // 是否设定了刷盘的定时任务
+        bool kicked;               // 是否因队列深度提交了刷盘任务
+        std::string table;         // 后台刷盘时打开文件所用的表名
+        // 异步请求的票号和回调，按票号排序
+        std::deque<std::pair<unsigned long long, CommitCallback>> callbacks;
+        // 一轮刷盘的结果，覆盖票号(上一轮最大票号, 本轮最大票号]
+        struct Round
+        {
+            int status;                 // 刷盘结果
+            unsigned long long pending; // 尚未取走结果的请求数
+        };
+        std::map<unsigned long long, Round> rounds; // 本轮最大票号 --> 结果
+
+        CommitQueue()
+            : ticket(0)
+            , synced(0)
+            , syncing(false)
+            , armed(false)
+            , kicked(false)
+        {}
+    };
+    using CommitQueues = std::map<std::string, CommitQueue>;
+
   private:
-    Schema *schema_;                   // 指向元数据
-    std::map<const char *, File> map_; // 表名 --> 描述符
+    Schema *schema_;                     // 指向元数据
+    std::mutex lock_;                    // 保护描述符缓存
+    Handles map_;                        // 表名 --> 描述符
+    Lru lru_;                            // 描述符lru
+    size_t capacity_;                    // 最多打开的文件数，0表示不限
+    FileStats stats_;                    // 统计
+    Mappings mappings_;                  // 表名 --> 压缩映射，NULL表示不压缩
+    Spaces spaces_;                      // 打开的共享表空间
+    Segments segments_;                  // 各表的段，NULL表示独占文件
+    std::mutex commitLock_;              // 保护提交队列
+    std::condition_variable commitCond_; // 唤醒等待刷盘的线程
+    CommitQueues queues_;                // 表名 --> 提交队列
+    CommitOptions commitOptions_;        // 组提交选项
+    CommitStats commitStats_;            // 组提交统计
 
   public:
     FilePool()
         : schema_(NULL)
+        , capacity_(DEFAULT_CAPACITY)
     {}
+    ~FilePool();
 
     // 初始化
     void init(Schema *schema);
-    // 打开table
-    File *open(const char *table);
+    // 打开table并增加引用，失败返回NULL；通常经FileRef使用
+    Handle *acquire(const char *table);
+    // 释放引用
+    void release(Handle *handle);
+    // 设定最多打开的文件数，缩小时关闭多余的空闲文件
+    void setCapacity(size_t capacity);
+    // 最多打开的文件数
+    inline size_t capacity() { return capacity_; }
+    // 描述符缓存统计
+    FileStats stats();
+    // 压缩表的block映射，非压缩表返回NULL
+    BlockMapping *mapping(const char *table);
+    // 表所在的buffer池id，0为缺省池
+    unsigned short poolOf(const char *table);
+    // 打印各压缩表的压缩比和吞吐率
+    void report();
+
+    // 表所在的文件在池中的名字，共享表空间中的表返回表空间名，表不存在返回NULL
+    const char *fileName(const char *table);
+    // block在表文件中的偏移量；共享表空间中的表经段换算，block超出段的范围时
+    // 返回ENXIO，不分配空间
+    int offset(
+        const char *table,
+        unsigned int blockid,
+        unsigned long long &offset);
+    // 从共享表空间分配一个extent，返回起始页号
+    int extend(unsigned short spaceid, unsigned int &page);
+    // 共享表空间中的表扩展段，直到blockid有映射；独占文件的表不需要扩展
+    int extend(const char *table, unsigned int blockid);
+
+    // 设定组提交选项
+    void setCommitOptions(const CommitOptions &options);
+    // 等待表文件上此前的写刷盘，多个线程的请求合并为一次datasync；第1个等待
+    // 者负责刷盘，等到interval超时或未刷盘的请求达到depth，先回写kBuffer中该
+    // 文件的脏block再datasync，完成后唤醒所有等待者，每个请求返回所在一轮的结果
+    int commit(const char *table);
+    // 不等待刷盘，请求与同步请求排在同一队列；由运行时的定时任务在interval后
+    // 刷盘，未刷盘的请求达到depth时立即提交刷盘任务，完成后以该轮结果调用done
+    void commitAsync(const char *table, const CommitCallback &done);
+    // 立即刷盘所有还有未完成请求的队列，停止运行时前调用
+    void flushCommits();
+    // 组提交统计
+    CommitStats commitStats();
+
+  private:
+    // 查找或打开表文件，调用者持有lock_
+    Handle *lookup(const char *table);
+    // 加载共享表空间，调用者持有lock_
+    SharedSpace *space(unsigned short spaceid, File *file);
+    // 查找或加载表的段，独占文件的表得到NULL，调用者持有lock_
+    int segment(const char *table, Segment *&segment);
+    // 回写table所在文件在kBuffer中的脏block，再datasync
+    int syncFile(const char *table);
+    // 后台刷盘一轮，timer表示由定时任务触发
+    void syncRound(const std::string &file, bool timer);
+    // 记录一轮的结果，解锁后调用本轮覆盖的异步回调，必要时再设定定时任务
+    void complete(
+        const std::string &file,
+        CommitQueue &queue,
+        unsigned long long upto,
+        int ret,
+        std::unique_lock<std::mutex> &lock);
+    // 在运行时上设定刷盘任务，now为true时立即提交，调用者不持有commitLock_
+    void arm(const std::string &file, bool now, unsigned int delay);
+    // 关闭lru尾部的空闲文件，直到打开的文件数小于limit
+    void shrink(size_t limit);
+};
+
+////
+// @brief
+// 文件引用守卫，析构时释放引用
+//
+class FileRef
+{
+  private:
+    FilePool *pool_;           // 所在的文件池
+    FilePool::Handle *handle_; // 打开的文件，NULL表示未持有
+
+  public:
+    FileRef()
+        : pool_(NULL)
+        , handle_(NULL)
+    {}
+    FileRef(FilePool &pool, const char *table)
+        : pool_(&pool)
+        , handle_(pool.acquire(table))
+    {}
+    FileRef(FileRef &&other);
+    FileRef &operator=(FileRef &&other);
+    FileRef(const FileRef &) = delete;
+    FileRef &operator=(const FileRef &) = delete;
+    ~FileRef() { release(); }
+
+    // 是否持有文件
+    inline explicit operator bool() const { return handle_ != NULL; }
+    // 文件
+    inline File *get() { return handle_ ? &handle_->file : NULL; }
+    inline File *operator->() { return get(); }
+
+    // 提前释放
+    void release();
 };
 
 // 全局文件池
@@ -0,0 +1,58 @@
+////
+// @file kernel.h
+// @brief
+// 谓词核函数的接口
+// 核函数只接受指针和长度，不依赖列向量、表和标准库，各指令集的编译单元只包含
+// 这个头文件，predicate.h在其上实现对列向量的求值。
+//
+// @author niexw
+// @email niexiaowen@uestc.edu.cn
+//
+#ifndef __DB_KERNEL_H__
+#define __DB_KERNEL_H__
+
+#include <stddef.h>
+
+namespace db {
+
+// 比较运算
+enum CompareOp
+{
+    CMP_EQ, // =
+    CMP_NE, // <>
+    CMP_LT, // <
+    CMP_LE, // <=
+    CMP_GT, // >
+    CMP_GE, // >=
+};
+
+// 一种宽度的整数核函数，values为主机字节序的定长数组，常量按宽度截断，
+// 结果写入bitmap的(rows + 63) / 64个字
+struct IntKernels
+{
+    // values[i] op value
+    void (*compare)(
+        const void *values,
+        size_t rows,
+        CompareOp op,
+        unsigned long long value,
+        unsigned long long *bitmap);
+    // lo <= values[i] <= hi
+    void (*between)(
+        const void *values,
+        size_t rows,
+        unsigned long long lo,
+        unsigned long long hi,
+        unsigned long long *bitmap);
+    // values[i]在list[0, count)中
+    void (*in)(
+        const void *values,
+        size_t rows,
+        const unsigned long long *list,
+        size_t count,
+        unsigned long long *bitmap);
+};
+
+} // namespace db
+
+#endif // __DB_KERNEL_H__
@@ -0,0 +1,82 @@
+////
+// @file predicate.h
+// @brief
+// 列向量上的谓词核函数
+// 对批量扫描解码出的列向量求值比较、BETWEEN、IN和字符串前缀谓词，结果为
+// 位图，再与选择向量相交。整数核函数按宽度分为1/2/4/8字节，由数据类型的宽度
+// 选择，findDataType中注册的定长整数类型都自动可用。
+//
+// 启动后检测CPU，按AVX-512(F+BW)、AVX2、SSE4.2、标量的顺序选择最快的实现；
+// 各指令集的实现分别在单独的编译单元中以对应的编译选项编译。整数比较与引擎
+// 的less函数一致，按无符号数比较。
+//
+// @author niexw
+// @email niexiaowen@uestc.edu.cn
+//
+#ifndef __DB_PREDICATE_H__
+#define __DB_PREDICATE_H__
+
+#include <vector>
+#include "./batch.h"
+#include "./kernel.h"
+
+namespace db {
+
+// 指令集
+enum SimdLevel
+{
+    SIMD_SCALAR, // 标量
+    SIMD_SSE42,  // SSE4.2
+    SIMD_AVX2,   // AVX2
+    SIMD_AVX512, // AVX-512F+BW
+};
+
+// 位图，第i行对应第i/64个字的第i%64位，超出行数的位为0
+using Bitmap = std::vector<unsigned long long>;
+
+// CPU支持的最高指令集
+SimdLevel cpuSimdLevel();
+// 当前使用的指令集
+SimdLevel simdLevel();
+// 指定使用的指令集，不能超过CPU支持的，返回实际使用的
+SimdLevel setSimdLevel(SimdLevel level);
+// 数据类型在当前指令集下的整数核函数，不是定长整数返回NULL
+const IntKernels *findKernels(DataType *type);
+
+// 整数列与常量比较，value为主机字节序
+void filterCompare(
+    ColumnVector &column,
+    CompareOp op,
+    unsigned long long value,
+    Bitmap &bitmap);
+// 整数列BETWEEN lo AND hi
+void filterBetween(
+    ColumnVector &column,
+    unsigned long long lo,
+    unsigned long long hi,
+    Bitmap &bitmap);
+// 整数列IN (list)
+void filterIn(
+    ColumnVector &column,
+    const std::vector<unsigned long long> &list,
+    Bitmap &bitmap);
+// 字符串列与常量比较，按数据类型的less比较
+void filterCompare(
+    ColumnVector &column,
+    CompareOp op,
+    const void *value,
+    unsigned int len,
+    Bitmap &bitmap);
+// 字符串列以prefix开头
+void filterPrefix(
+    ColumnVector &column,
+    const void *prefix,
+    unsigned int len,
+    Bitmap &bitmap);
+
+// 去掉选择向量中位图未置位的行
+void select(const Bitmap &bitmap, std::vector<unsigned short> &selection);
+
+} // namespace db
+
+#endif // __DB_PREDICATE_H__
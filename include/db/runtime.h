@@ -0,0 +1,197 @@
+////
+// @file runtime.h
+// @brief
+// 任务运行时
+// 引擎共用的执行环境，后台刷盘、预热、并行扫描等都作为任务提交，不再各自创建
+// 线程。每个worker线程有自己的双端队列，从尾部存取自己提交的任务，队列空时从
+// 其它worker队列的头部窃取。任务分前台和后台两个优先级，worker总是先取前台
+// 任务。定时任务挂在时间轮上，到期后按其优先级提交。
+//
+// 运行时在第1次提交任务时启动，worker个数为硬件线程数。停止时已提交的任务仍会
+// 执行完，未到期的定时任务丢弃；停止后提交的任务在调用线程中直接执行。
+//
+// @author niexw
+// @email niexiaowen@uestc.edu.cn
+//
+#ifndef __DB_RUNTIME_H__
+#define __DB_RUNTIME_H__
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace db {
+
+// 运行时统计
+struct RuntimeStats
+{
+    unsigned long long submitted; // 提交的任务数
+    unsigned long long executed;  // 执行的任务数
+    unsigned long long steals;    // 窃取的任务数
+    unsigned long long timers;    // 到期的定时任务数
+
+    RuntimeStats()
+        : submitted(0)
+        , executed(0)
+        , steals(0)
+        , timers(0)
+    {}
+};
+
+////
+// @brief
+// 一组任务，可以等待组内任务全部完成；定时任务从设定时起计入，取消或丢弃时
+// 计为完成
+//
+class TaskGroup
+{
+  private:
+    std::mutex lock_;              // 保护pending_
+    std::condition_variable cond_; // 组内任务全部完成时唤醒
+    size_t pending_;               // 未完成的任务数
+
+    friend class Runtime;
+
+  public:
+    TaskGroup()
+        : pending_(0)
+    {}
+
+    // 未完成的任务数
+    size_t pending();
+
+  private:
+    void add();
+    void done();
+};
+
+////
+// @brief
+// 任务运行时
+//
+class Runtime
+{
+  public:
+    // 任务优先级
+    enum Priority
+    {
+        FOREGROUND, // 前台查询
+        BACKGROUND, // 后台I/O
+        PRIORITIES, // 优先级个数
+    };
+    using Task = std::function<void()>;
+
+    static const unsigned int TICK = 1;          // 时间轮刻度，单位为毫秒
+    static const unsigned int WHEEL_SLOTS = 512; // 时间轮的槽数
+
+  private:
+    enum State
+    {
+        IDLE,     // 未启动
+        RUNNING,  // 运行中
+        STOPPING, // 正在停止，仍接受任务
+        STOPPED,  // 已停止
+    };
+    struct Item
+    {
+        Task task;        // 任务
+        TaskGroup *group; // 所属的组，可以为NULL
+    };
+    struct Worker
+    {
+        std::mutex lock;                    // 保护队列
+        std::deque<Item> tasks[PRIORITIES]; // 各优先级的任务
+    };
+    struct Timer
+    {
+        unsigned long long id;     // 定时任务id
+        unsigned long long rounds; // 还要转过的圈数
+        Priority priority;         // 到期后提交的优先级
+        Item item;                 // 任务
+    };
+    using Slot = std::list<Timer>;
+
+    std::mutex lock_;                   // 保护状态，空闲worker在此等待
+    std::condition_variable cond_;      // 有新任务或停止时唤醒worker
+    State state_;                       // 运行状态
+    std::vector<Worker *> workers_;     // 各worker的队列
+    std::vector<std::thread> threads_;  // worker线程
+    std::atomic<size_t> pending_;       // 队列中的任务数
+    std::atomic<size_t> next_;          // 外部提交时轮流选择worker
+    std::mutex timerLock_;              // 保护时间轮
+    std::condition_variable timerCond_; // 设定定时任务或停止时唤醒时钟线程
+    bool ticking_;                      // 时钟线程是否运行
+    std::vector<Slot> wheel_;           // 时间轮
+    size_t armed_;                      // 时间轮中的定时任务数
+    size_t cursor_;                     // 当前刻度所在的槽
+    unsigned long long timerId_;        // 上一个定时任务id
+    std::thread ticker_;                // 时钟线程
+
+    std::atomic<unsigned long long> submitted_; // 提交的任务数
+    std::atomic<unsigned long long> executed_;  // 执行的任务数
+    std::atomic<unsigned long long> steals_;    // 窃取的任务数
+    std::atomic<unsigned long long> timers_;    // 到期的定时任务数
+
+  public:
+    Runtime();
+    ~Runtime();
+    Runtime(const Runtime &) = delete;
+    Runtime &operator=(const Runtime &) = delete;
+
+    // 启动threads个worker，0表示硬件线程数；已经启动或停止返回EEXIST
+    int start(unsigned int threads = 0);
+    // 执行完已提交的任务后停止，丢弃未到期的定时任务；停止前应等待所有任务组
+    void stop();
+
+    // 提交一个任务，group不为NULL时计入该组
+    void submit(
+        const Task &task,
+        Priority priority = FOREGROUND,
+        TaskGroup *group = NULL);
+    // 等待组内任务全部完成；等待期间调用线程帮助执行前台任务
+    void wait(TaskGroup &group);
+    // delay毫秒后提交任务，返回定时任务id
+    unsigned long long schedule(
+        unsigned int delay,
+        const Task &task,
+        Priority priority = BACKGROUND,
+        TaskGroup *group = NULL);
+    // 取消未到期的定时任务，已到期或不存在返回false
+    bool cancel(unsigned long long id);
+
+    // worker个数
+    unsigned int workers();
+    // 统计
+    RuntimeStats stats();
+    // 当前线程的worker编号，不是worker线程返回-1
+    static int current();
+
+  private:
+    // 启动worker和时钟线程，调用者持有lock_
+    void launch(unsigned int threads);
+    // 将任务放入队列，运行时不在运行中时直接执行
+    void dispatch(Item &item, Priority priority);
+    // 取一个优先级不低于lowest的任务，先取自己的队列，再窃取其它队列
+    bool take(int self, Priority lowest, Item &item);
+    // 执行一个任务
+    void execute(Item &item);
+    // worker线程
+    void run(unsigned int index);
+    // 时钟线程，睡到最早的定时任务到期，再把时间轮转到当前刻度；没有定时任务
+    // 时一直等待
+    void tick();
+    // 最早到期的定时任务距cursor_的刻度数，调用者持有timerLock_且时间轮不空
+    unsigned long long nearest();
+};
+
+// 全局运行时
+extern Runtime kRuntime;
+
+} // namespace db
+
+#endif // __DB_RUNTIME_H__
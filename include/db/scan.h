@@ -0,0 +1,91 @@
+////
+// @file scan.h
+// @brief
+// 并行表扫描
+// 表按blockid切分为固定大小的morsel，按worker个数平均分成若干段，每个worker
+// 一个双端队列。worker从自己队列的头部取morsel，队列空时从其它worker队列的
+// 尾部窃取，处理慢的worker剩下的morsel由其它worker分担。
+//
+// @author niexw
+// @email niexiaowen@uestc.edu.cn
+//
+#ifndef __DB_SCAN_H__
+#define __DB_SCAN_H__
+
+#include <deque>
+#include <mutex>
+#include <vector>
+
+namespace db {
+
+// 并行扫描选项
+struct ScanOptions
+{
+    unsigned int threads; // worker个数，0表示硬件线程数
+    unsigned int morsel;  // 每个morsel的block个数
+    bool bulk;            // 各worker使用自己的BULKREAD访问策略
+
+    ScanOptions()
+        : threads(0)
+        , morsel(64)
+        , bulk(false)
+    {}
+};
+
+// 并行扫描统计
+struct ScanStats
+{
+    size_t morsels;       // 处理的morsel个数
+    size_t steals;        // 窃取的morsel个数
+    size_t blocks;        // 扫描的数据块个数
+    size_t records;       // 扫描的记录个数
+    unsigned int threads; // 实际的worker个数
+
+    ScanStats()
+        : morsels(0)
+        , steals(0)
+        , blocks(0)
+        , records(0)
+        , threads(0)
+    {}
+};
+
+// 一段连续的blockid，[begin, end)
+struct Morsel
+{
+    unsigned int begin; // 起始blockid
+    unsigned int end;   // 结束blockid，不含
+};
+
+////
+// @brief
+// 各worker的morsel队列
+//
+class MorselQueues
+{
+  private:
+    struct Queue
+    {
+        std::mutex lock;            // 保护morsels
+        std::deque<Morsel> morsels; // 待处理的morsel
+    };
+    std::vector<Queue> queues_; // 每个worker一个队列
+
+  public:
+    // 将[first, last]按size个block切分，依次平均分给workers个队列
+    MorselQueues(
+        unsigned int workers,
+        unsigned int first,
+        unsigned int last,
+        unsigned int size);
+
+    // 取下一个morsel，先取自己的队列头部，再从其它队列尾部窃取；
+    // 全部取完时返回false
+    bool pop(unsigned int worker, Morsel &morsel, bool &stolen);
+    // 剩余的morsel个数
+    size_t size();
+};
+
+} // namespace db
+
+#endif // __DB_SCAN_H__
@@ -8,6 +8,8 @@
 // 3. 域的个数；
 // 4. 各域的描述；（变长）
 // 5. 各种统计信息，表的大小，行数等；
+// 6. 所在的表空间id，以及在共享表空间中的段头页号；
+// 共享表空间本身也在meta.db中占一行，类型为TABLE_SPACE，没有域。
 //
 // @author niexw
 // @email niexiaowen@uestc.edu.cn
@@ -40,23 +42,39 @@ struct FieldInfo
     {}
     FieldInfo(const FieldInfo &o) = default;
 };
+// 关系的类型位
+const unsigned short TABLE_COMPRESSED = 0x1;   // 数据块压缩存放
+const unsigned short TABLE_SPACE = 0x2;        // 共享表空间，不是表
+const unsigned short TABLE_POOL_MASK = 0xff00; // 高8位是buffer池id
+const unsigned short TABLE_POOL_SHIFT = 8;
+// 表空间id，写在各block的头部
+const unsigned short SPACE_META = 0;    // meta.db
+const unsigned short SPACE_PRIVATE = 1; // 独占一个文件的表
+const unsigned short SPACE_SHARED = 2;  // 第1个共享表空间
+
 // 内存中描述关系
 struct RelationInfo
 {
     std::string path;              // 文件路径
     unsigned short count;          // 域的个数
-    unsigned short type;           // 类型
+    unsigned short type;           // 类型，TABLE_COMPRESSED等
     unsigned int key;              // 键的域
     unsigned long long size;       // 大小
     unsigned long long rows;       // 行数
+    unsigned short space;          // 表空间id
+    unsigned int root;             // 共享表空间中的段头页号
     std::vector<FieldInfo> fields; // 各域的描述
 
+    static const int HEADER_FIELDS = 9; // 域描述之前的iov数目
+
     RelationInfo()
         : count(0)
         , type(0)
         , key(0)
         , size(0)
         , rows(0)
+        , space(SPACE_PRIVATE)
+        , root(0)
     {}
     RelationInfo(const char *p)
         : path(p)
@@ -65,9 +83,23 @@ struct RelationInfo
         , key(0)
         , size(0)
         , rows(0)
+        , space(SPACE_PRIVATE)
+        , root(0)
     {}
     // 根据关系属性得到iov的维度
-    int iovSize() { return 7 + count * 4; }
+    int iovSize() { return HEADER_FIELDS + count * 4; }
+    // 是否存放在共享表空间中
+    inline bool shared()
+    {
+        return space >= SPACE_SHARED && !(type & TABLE_SPACE);
+    }
+    // buffer池id，0为缺省池
+    inline unsigned short pool() { return type >> TABLE_POOL_SHIFT; }
+    inline void setPool(unsigned short id)
+    {
+        type = (unsigned short) ((type & ~TABLE_POOL_MASK) |
+                                 (id << TABLE_POOL_SHIFT & TABLE_POOL_MASK));
+    }
 };
 
 ////
@@ -79,6 +111,7 @@ class Schema
 {
   public:
     using TableSpace = std::map<std::string, RelationInfo>;
+    using Spaces = std::map<unsigned short, std::string>; // id --> 表空间名
 
   public:
     static const char *META_FILE; // "_meta.db"
@@ -86,6 +119,8 @@ class Schema
   private:
     Buffer *buffer_;        // 缓冲层
     TableSpace tablespace_; // 表空间
+    Spaces spaces_;         // 共享表空间
+    unsigned short space_;  // 最大的共享表空间id
     unsigned int maxid_;    // 最大的blockid
     unsigned int idle_;     // 空闲链
     unsigned int first_;    // meta链
@@ -93,6 +128,7 @@ class Schema
   public:
     Schema()
         : buffer_(NULL)
+        , space_(SPACE_SHARED - 1)
         , maxid_(0)
         , idle_(0)
         , first_(0)
@@ -103,10 +139,14 @@ class Schema
 
     // 打开并加载元数据
     void open();
-    // 创建表
+    // 创建表，rel.space为共享表空间id时，在该表空间中分配段
     int create(const char *table, RelationInfo &rel);
+    // 创建共享表空间<name>.ts，分配新的表空间id
+    int createSpace(const char *name, unsigned short &id);
     // 搜索表
     std::pair<TableSpace::iterator, bool> lookup(const char *table);
+    // 按id搜索共享表空间
+    std::pair<TableSpace::iterator, bool> lookupSpace(unsigned short id);
 
   public:
     // 将table的关系的相关属性，塞到iov里
@@ -120,10 +160,17 @@ class Schema
         std::vector<struct iovec> &iov);
     void betoh(std::vector<struct iovec> &iov);
     void htobe(std::vector<struct iovec> &iov);
+
+  private:
+    // 将关系加入表空间，并写入meta块
+    int append(const char *table, RelationInfo &rel);
 };
 
-// 初始化数据库全局变量，缺省buffer大小为256MB
-void dbInit(size_t bufsize = 256);
+// 初始化数据库全局变量，缺省buffer大小为256MB，二级缓存cachesize单位为MB，缺省关闭
+void dbInit(size_t bufsize = 256, size_t cachesize = 0);
+// 退出前调用：完成未刷盘的提交，停止运行时，再回写buffer中的脏block；全局变量
+// 的析构顺序不确定，不能依赖析构函数停止运行时
+void dbExit();
 
 // 全局schema
 extern Schema kSchema;
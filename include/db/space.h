@@ -0,0 +1,106 @@
+////
+// @file space.h
+// @brief
+// 共享表空间
+// 多张小表存放在同一个表空间文件中，共用一个文件描述符和一次刷盘。表空间按页
+// 组织，页大小为BLOCK_SIZE，空间以SPACE_EXTENT页为单位的extent分配给各张表：
+//
+// +--------------------+ <--- 0
+// |     表空间头部      |
+// +--------------------+ <--- BLOCK_SIZE，第1页
+// |  extent(表A的段头)  |
+// +--------------------+
+// |  extent(表B的段头)  |
+// +--------------------+
+// |    extent(表A)     |
+// |        ...         |
+// +--------------------+
+//
+// 每张表是一个段，段的第1个extent的第1页是段头，记录段的所有extent，段头所在的
+// 页号作为段的根存放在schema中。表的blockid b位于段中第b + 1页，超块也占一页。
+//
+// @author niexw
+// @email niexiaowen@uestc.edu.cn
+//
+#ifndef __DB_SPACE_H__
+#define __DB_SPACE_H__
+
+#include <vector>
+#include "./file.h"
+#include "./block.h"
+
+namespace db {
+
+const unsigned int SPACE_EXTENT = 64; // extent的页数，1MB
+
+////
+// @brief
+// 共享表空间的分配状态
+//
+class SharedSpace
+{
+  private:
+    unsigned short id_; // 表空间id
+    unsigned int next_; // 下一个未分配的页
+
+  public:
+    SharedSpace()
+        : id_(0)
+        , next_(1)
+    {}
+
+    // 加载表空间头部，新文件写入初始的头部
+    int open(File *file, unsigned short id);
+    // 分配一个extent，返回起始页号，并预分配磁盘空间
+    int allocate(File *file, unsigned int &page);
+
+    // 表空间id
+    inline unsigned short id() { return id_; }
+    // 已分配的页数，含头部
+    inline unsigned int pages() { return next_; }
+};
+
+////
+// @brief
+// 表在共享表空间中的段
+//
+class Segment
+{
+  public:
+    // 段头最多记录的extent数目
+    static const size_t MAX_EXTENTS =
+        (BLOCK_SIZE - 3 * sizeof(int)) / sizeof(int);
+
+  private:
+    unsigned short spaceid_;            // 所在的表空间id
+    unsigned int root_;                 // 段头页号
+    std::vector<unsigned int> extents_; // 各extent的起始页号
+
+  public:
+    Segment()
+        : spaceid_(0)
+        , root_(0)
+    {}
+
+    // 加载段头，root是段的第1个extent的起始页号；新段写入初始的段头
+    int open(File *file, unsigned short spaceid, unsigned int root);
+    // blockid在表空间文件中的偏移量，超出段的范围时返回ENXIO
+    int offset(unsigned int blockid, unsigned long long &offset);
+    // 从表空间分配extent，直到段覆盖blockid
+    int extend(File *file, SharedSpace *space, unsigned int blockid);
+
+    // 所在的表空间id
+    inline unsigned short spaceid() { return spaceid_; }
+    // 段头页号
+    inline unsigned int root() { return root_; }
+    // 段的extent数目
+    inline size_t extents() { return extents_.size(); }
+
+  private:
+    // 回写段头
+    int save(File *file);
+};
+
+} // namespace db
+
+#endif // __DB_SPACE_H__
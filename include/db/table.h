@@ -9,12 +9,18 @@
 #ifndef __DB_TABLE_H__
 #define __DB_TABLE_H__
 
+#include <functional>
 #include <string>
 #include <vector>
 #include "./record.h"
 #include "./schema.h"
 #include "./block.h"
 #include "./buffer.h"
+#include "./zonemap.h"
+#include "./bloom.h"
+#include "./fence.h"
+#include "./scan.h"
+#include "./file.h"
 
 namespace db {
 
@@ -30,10 +36,15 @@ class Table
     {
         DataBlock block;
         BufDesp *bufdesp;
+        AccessStrategy *strategy; // 访问策略，NULL表示普通访问
 
         BlockIterator();
         ~BlockIterator();
+        // 复制时增加引用，移动时不增加
         BlockIterator(const BlockIterator &other);
+        BlockIterator(BlockIterator &&other);
+        BlockIterator &operator=(const BlockIterator &other);
+        BlockIterator &operator=(BlockIterator &&other);
 
         // 前置操作
         BlockIterator &operator++();
@@ -44,14 +55,52 @@ class Table
 
         // 释放buffer
         void release();
+        // 定位到blockid，映射表直接指向映射地址，否则从buffer借用
+        void fetch(unsigned int blockid);
+    };
+    // 带范围谓词的迭代器，根据zone map跳过不可能命中的block；
+    // 谓词为等值时(lo == hi)，还会检查Bloom过滤器
+    struct PrunedIterator : BlockIterator
+    {
+        ZoneRange range;      // 范围谓词
+        unsigned int skipped; // 未借用而跳过的block数目
+
+        PrunedIterator();
+
+        // 前置操作
+        PrunedIterator &operator++();
+        // 从blockid开始，定位到第1个可能命中的block
+        void seek(unsigned int blockid);
+    };
+
+  public:
+    // 打开方式
+    enum Mode
+    {
+        READWRITE, // 经过buffer读写
+        MAPPED,    // 只读，迭代器直接访问映射的数据文件
     };
 
+    // 并行扫描的回调，worker为worker的编号，可以用来按worker累计结果
+    using BlockCallback =
+        std::function<void(unsigned int worker, DataBlock &block)>;
+    using RecordCallback =
+        std::function<void(unsigned int worker, Record &record)>;
+
+  public:
+    static const size_t MIN_EXTENT = 1024 * 1024;      // 第1个extent的大小
+    static const size_t MAX_EXTENT = 64 * 1024 * 1024; // extent大小的上限
+
   public:
     std::string name_;   // 表名
     RelationInfo *info_; // 表的元数据
     unsigned int maxid_; // 最大的blockid
     unsigned int idle_;  // 空闲链
     unsigned int first_; // 数据链
+    ZoneMap zonemap_;    // block级摘要
+    BlockBloom blooms_;  // block级Bloom过滤器
+    FenceCache fences_;  // 键到block的定位缓存
+    MappedFile *mapped_; // 映射的数据文件，NULL表示未映射
 
   public:
     Table()
@@ -59,15 +108,33 @@ class Table
         , maxid_(0)
         , idle_(0)
         , first_(0)
+        , mapped_(NULL)
     {}
+    Table(const Table &) = delete;
+    Table &operator=(const Table &) = delete;
+    ~Table() { delete mapped_; }
 
-    // 打开一张表
-    int open(const char *name);
+    // 打开一张表；MAPPED方式先回写buffer中的脏块，再映射数据文件并预读，
+    // 压缩表不能映射，返回EINVAL
+    int open(const char *name, Mode mode = READWRITE);
+    // 映射表上block的地址，超出映射范围返回NULL
+    unsigned char *mappedBlock(unsigned int blockid);
 
-    // 采用枚举的方式定位一个key在哪个block
+    // 定位一个key在哪个block，先查fence缓存，缓存未建立时沿数据链枚举建立
     unsigned int locate(void *keybuf, unsigned int len);
-    // 定位一个block后，插入一条记录
-    int insert(unsigned int blkid, std::vector<struct iovec> &iov);
+    // 按主键点查，主键列的Bloom过滤器确定不存在时不借用block，返回ENOENT；
+    // 找到时guard持有该block(映射表不需要)，record指向记录
+    int lookup(
+        void *keybuf,
+        unsigned int len,
+        PageGuard &guard,
+        Record &record);
+    // 定位一个block后，插入一条记录；映射表只读，返回EPERM。批量装载可以指定
+    // BULKWRITE策略，数据块在策略的环上借用，脏块在环上复用前回写
+    int insert(
+        unsigned int blkid,
+        std::vector<struct iovec> &iov,
+        AccessStrategy *strategy = NULL);
     int remove(unsigned int blkid, void *keybuf, unsigned int len);
     int update(unsigned int blkid, std::vector<struct iovec> &iov);
     // btree搜索
@@ -80,14 +147,55 @@ class Table
     // 返回表上空闲块个数
     unsigned int idleCount();
 
-    // block迭代器
-    BlockIterator beginblock();
+    // block迭代器，大表扫描可以指定访问策略，数据块在策略的环上借用
+    BlockIterator beginblock(AccessStrategy *strategy = NULL);
     BlockIterator endblock();
-
-    // 新分配一个block，返回blockid，但并没有将该block插入数据链上
-    unsigned int allocate();
+    // 带范围谓词的block迭代器，结束时与endblock()相等
+    PrunedIterator
+    beginblock(const ZoneRange &range, AccessStrategy *strategy = NULL);
+
+    // 并行扫描，[1, maxid]按blockid切分为morsel，由多个worker窃取执行，每个
+    // 数据块调用一次fn；不沿数据链，数据块之间没有顺序，回调需要自己同步
+    int scan(
+        const BlockCallback &fn,
+        const ScanOptions &options = ScanOptions(),
+        ScanStats *stats = NULL);
+    // 并行扫描，每条记录调用一次fn
+    int scanRecords(
+        const RecordCallback &fn,
+        const ScanOptions &options = ScanOptions(),
+        ScanStats *stats = NULL);
+
+    // 对指定的列维护zone map
+    int trackZones(const std::vector<unsigned int> &fields);
+    // 对指定的列维护Bloom过滤器
+    int trackBlooms(
+        const std::vector<unsigned int> &fields,
+        const BloomOptions &options = BloomOptions());
+
+    // 新分配一个block，返回blockid，但并没有将该block插入数据链上；指定策略时
+    // 新block在策略的环上借用；无法扩展文件时返回0
+    unsigned int allocate(AccessStrategy *strategy = NULL);
+    // maxid_超出已预留的空间时，预留下一个extent，extent大小按几何增长
+    void reserve(SuperBlock &super);
     // 回收一个block
     void deallocate(unsigned int blockid);
+
+  private:
+    // 数据链上第1个blockid
+    unsigned int firstBlock();
+    // 沿数据链建立fence缓存
+    void buildFences();
+    // block的第1条记录可能改变，修改其fence
+    void refence(DataBlock &block);
+    // 并行扫描的worker，处理队列中的morsel直到取完，跳过idles中标记的block
+    void scanWorker(
+        MorselQueues *queues,
+        unsigned int worker,
+        const BlockCallback *fn,
+        const std::vector<bool> *idles,
+        bool bulk,
+        ScanStats *stats);
 };
 
 inline bool
@@ -0,0 +1,119 @@
+////
+// @file zonemap.h
+// @brief
+// block级摘要(zone map)
+// 对表上选定的列，按block记录最小值、最大值以及空值个数。范围扫描时，先查摘要，
+// 值域不可能与谓词相交的block直接跳过，不再向buffer借用。
+// 摘要只保存在内存中，block首次被扫描时根据其内容补齐；插入只会扩大值域，删除后
+// 摘要退化为包络，下次借用该block时再重算。
+//
+// @author niexw
+// @email niexiaowen@uestc.edu.cn
+//
+#ifndef __DB_ZONEMAP_H__
+#define __DB_ZONEMAP_H__
+
+#include <string>
+#include <map>
+#include <vector>
+#include "./record.h"
+#include "./schema.h"
+
+namespace db {
+
+// 单列摘要，值以记录中的大序原始字节保存
+struct ColumnZone
+{
+    std::string min;    // 最小值
+    std::string max;    // 最大值
+    unsigned int nulls; // 空值个数
+    bool empty;         // 还没有非空值
+
+    ColumnZone()
+        : nulls(0)
+        , empty(true)
+    {}
+};
+
+// block摘要
+struct BlockZone
+{
+    unsigned int next;               // 数据链上的后继block
+    bool exact;                      // 值域是否精确
+    std::vector<ColumnZone> columns; // 各跟踪列的摘要
+
+    BlockZone()
+        : next(0)
+        , exact(true)
+    {}
+};
+
+// 范围谓词：lo <= field <= hi，lo/hi为NULL表示该端无界
+struct ZoneRange
+{
+    unsigned int field; // 域的下标
+    const void *lo;     // 下界
+    unsigned int lolen; // 下界长度
+    const void *hi;     // 上界
+    unsigned int hilen; // 上界长度
+
+    ZoneRange()
+        : field(0)
+        , lo(NULL)
+        , lolen(0)
+        , hi(NULL)
+        , hilen(0)
+    {}
+};
+
+////
+// @brief
+// 表上所有block的摘要
+//
+class DataBlock;
+class ZoneMap
+{
+  public:
+    using Zones = std::map<unsigned int, BlockZone>; // blockid --> 摘要
+
+  private:
+    RelationInfo *info_;               // 表的元数据
+    std::vector<unsigned int> fields_; // 跟踪的列
+    Zones zones_;                      // 各block摘要
+
+  public:
+    ZoneMap()
+        : info_(NULL)
+    {}
+
+    // 设定需要跟踪的列，已有摘要全部作废
+    void init(RelationInfo *info, const std::vector<unsigned int> &fields);
+    // 是否打开
+    inline bool enabled() { return !fields_.empty(); }
+    // field在跟踪列中的位置，-1表示未跟踪
+    int column(unsigned int field);
+
+    // 新block，摘要为空且精确
+    void reset(unsigned int blkid, unsigned int next);
+    // 根据block内容重建摘要
+    void build(DataBlock &block);
+    // 将一条记录并入摘要，未知block不处理
+    void add(unsigned int blkid, Record &record);
+    // 删除一条记录，摘要退化为包络
+    void remove(unsigned int blkid);
+    // 修改数据链后继
+    void setNext(unsigned int blkid, unsigned int next);
+    // 丢弃block摘要
+    void drop(unsigned int blkid);
+    // 查找block摘要，NULL表示未知
+    BlockZone *find(unsigned int blkid);
+
+    // 判断block是否可能含有满足谓词的记录，未知block总是返回true
+    bool mayMatch(unsigned int blkid, const ZoneRange &range);
+    // 摘要个数
+    inline size_t size() { return zones_.size(); }
+};
+
+} // namespace db
+
+#endif // __DB_ZONEMAP_H__
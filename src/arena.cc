@@ -0,0 +1,212 @@
+////
+// @file arena.cc
+// @brief
+// 实现buffer内存分配
+//
+// @author niexw
+// @email niexiaowen@uestc.edu.cn
+//
+#include <db/arena.h>
+#if defined(WIN32)
+#    include <psapi.h>
+#else
+#    include <stdio.h>
+#    include <sys/mman.h>
+#    if defined(__linux__)
+#        include <sys/syscall.h>
+#        include <unistd.h>
+#    endif
+#endif
+
+namespace db {
+
+#if defined(WIN32)
+namespace {
+// 打开SeLockMemoryPrivilege，只尝试一次
+bool enableLockMemory()
+{
+    static int enabled = -1;
+    if (enabled >= 0) return enabled == 1;
+    enabled = 0;
+
+    HANDLE token;
+    if (!::OpenProcessToken(
+            ::GetCurrentProcess(),
+            TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY,
+            &token))
+        return false;
+    TOKEN_PRIVILEGES tp;
+    tp.PrivilegeCount = 1;
+    tp.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+    // AdjustTokenPrivileges部分成功时也返回TRUE，要再查GetLastError
+    if (::LookupPrivilegeValueA(
+            NULL, SE_LOCK_MEMORY_NAME, &tp.Privileges[0].Luid) &&
+        ::AdjustTokenPrivileges(token, FALSE, &tp, 0, NULL, NULL) &&
+        ::GetLastError() == ERROR_SUCCESS)
+        enabled = 1;
+    ::CloseHandle(token);
+    return enabled == 1;
+}
+
+void *virtualAlloc(size_t size, int node, DWORD type)
+{
+    if (node < 0)
+        return ::VirtualAlloc(NULL, size, type, PAGE_READWRITE);
+    return ::VirtualAllocExNuma(
+        ::GetCurrentProcess(), NULL, size, type, PAGE_READWRITE, (DWORD) node);
+}
+} // namespace
+
+size_t largePageSize() { return ::GetLargePageMinimum(); }
+
+unsigned short numaNodes()
+{
+    ULONG highest = 0;
+    if (!::GetNumaHighestNodeNumber(&highest)) return 1;
+    return (unsigned short) (highest + 1);
+}
+
+unsigned short currentNode()
+{
+    PROCESSOR_NUMBER number;
+    ::GetCurrentProcessorNumberEx(&number);
+    unsigned short node = 0;
+    if (!::GetNumaProcessorNodeEx(&number, &node)) return 0;
+    return node;
+}
+
+void *arenaAlloc(size_t size, int node, bool &large)
+{
+    DWORD type = MEM_RESERVE | MEM_COMMIT;
+    size_t page = largePageSize();
+    if (large && page && size % page == 0 && enableLockMemory()) {
+        void *ptr = virtualAlloc(size, node, type | MEM_LARGE_PAGES);
+        if (ptr) return ptr;
+    }
+    large = false;
+    return virtualAlloc(size, node, type);
+}
+
+void arenaFree(void *ptr, size_t, bool) { ::VirtualFree(ptr, 0, MEM_RELEASE); }
+
+int memoryNode(const void *ptr)
+{
+    PSAPI_WORKING_SET_EX_INFORMATION info;
+    info.VirtualAddress = (PVOID) ptr;
+    if (!::QueryWorkingSetEx(::GetCurrentProcess(), &info, sizeof(info)) ||
+        !info.VirtualAttributes.Valid)
+        return -1;
+    return (int) info.VirtualAttributes.Node;
+}
+
+#else
+// linux上不依赖libnuma，结点数从sysfs读取，绑定和查询直接用系统调用；
+// 其它系统不支持NUMA，只有一个结点
+#    if defined(__linux__)
+namespace {
+const int MPOL_PREFERRED_ = 1;   // 优先在指定结点分配，不够时可以用其它结点
+const int MPOL_F_NODE_ = 1;      // get_mempolicy返回结点号
+const int MPOL_F_ADDR_ = 2;      // get_mempolicy查询地址所在的页
+const int MAX_NODES = 1024;      // 支持的最大结点数
+const int MASK_BITS = 8 * sizeof(unsigned long);
+
+// 解析/sys/devices/system/node/online，如"0-3"、"0,2-3"，返回最大结点号+1
+unsigned short readNodes()
+{
+    FILE *fp = ::fopen("/sys/devices/system/node/online", "r");
+    if (fp == NULL) return 1;
+    int highest = 0, lo, hi;
+    while (::fscanf(fp, "%d", &lo) == 1) {
+        hi = lo;
+        int c = ::fgetc(fp);
+        if (c == '-' && ::fscanf(fp, "%d", &hi) == 1) c = ::fgetc(fp);
+        if (hi > highest) highest = hi;
+        if (c != ',') break;
+    }
+    ::fclose(fp);
+    return (unsigned short) (highest < MAX_NODES ? highest + 1 : MAX_NODES);
+}
+
+// 建议内核在node上分配[ptr, ptr + size)的页，必须在第1次访问前调用
+void bindNode(void *ptr, size_t size, int node)
+{
+    unsigned long mask[MAX_NODES / MASK_BITS] = {0};
+    mask[node / MASK_BITS] = 1UL << (node % MASK_BITS);
+    ::syscall(SYS_mbind, ptr, size, MPOL_PREFERRED_, mask, MAX_NODES + 1, 0);
+}
+} // namespace
+
+unsigned short numaNodes()
+{
+    static const unsigned short nodes = readNodes();
+    return nodes;
+}
+
+unsigned short currentNode()
+{
+    unsigned int cpu = 0, node = 0;
+    if (::syscall(SYS_getcpu, &cpu, &node, NULL) != 0) return 0;
+    return node < numaNodes() ? (unsigned short) node : 0;
+}
+
+int memoryNode(const void *ptr)
+{
+    int node = -1;
+    if (::syscall(
+            SYS_get_mempolicy,
+            &node,
+            NULL,
+            0,
+            ptr,
+            MPOL_F_NODE_ | MPOL_F_ADDR_) != 0)
+        return -1;
+    return node;
+}
+#    else
+unsigned short numaNodes() { return 1; }
+unsigned short currentNode() { return 0; }
+int memoryNode(const void *) { return 0; }
+#    endif
+
+size_t largePageSize() { return 2 * 1024 * 1024; }
+
+void *arenaAlloc(size_t size, int node, bool &large)
+{
+    void *ptr = MAP_FAILED;
+#    if defined(MAP_HUGETLB)
+    if (large && size % largePageSize() == 0)
+        ptr = ::mmap(
+            NULL,
+            size,
+            PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB,
+            -1,
+            0);
+#    endif
+    if (ptr == MAP_FAILED) {
+        // 退回普通页，再建议内核使用透明大页
+        ptr = ::mmap(
+            NULL,
+            size,
+            PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS,
+            -1,
+            0);
+        if (ptr == MAP_FAILED) return NULL;
+#    if defined(MADV_HUGEPAGE)
+        if (large) ::madvise(ptr, size, MADV_HUGEPAGE);
+#    endif
+        large = false;
+    }
+#    if defined(__linux__)
+    // 页在第1次访问时才分配，之前设定结点
+    if (node >= 0 && node < numaNodes()) bindNode(ptr, size, node);
+#    endif
+    return ptr;
+}
+
+void arenaFree(void *ptr, size_t size, bool) { ::munmap(ptr, size); }
+
+#endif
+
+} // namespace db
@@ -0,0 +1,176 @@
+////
+// @file async.cc
+// @brief
+// 实现基于协程的异步接口
+//
+// @author niexw
+// @email niexiaowen@uestc.edu.cn
+//
+#include <db/async.h>
+#include <db/runtime.h>
+
+namespace db {
+
+void AsyncLoop::spawn(Async<void> &&task)
+{
+    task.handle().promise().loop = this;
+    std::coroutine_handle<> handle = task.handle();
+    tasks_.push_back(std::move(task));
+    ++active_;
+    post(handle);
+}
+
+void AsyncLoop::run()
+{
+    std::unique_lock<std::mutex> lock(lock_);
+    while (active_) {
+        if (ready_.empty()) {
+            cond_.wait(lock);
+            continue;
+        }
+        std::coroutine_handle<> handle = ready_.front();
+        ready_.pop_front();
+        // 恢复时不持有锁，协程中可以再post
+        lock.unlock();
+        ++stats_.resumed;
+        handle.resume();
+        lock.lock();
+    }
+    lock.unlock();
+    tasks_.clear();
+}
+
+void AsyncLoop::post(std::coroutine_handle<> handle)
+{
+    // 持有锁通知，最后一个协程恢复后循环可能立即析构
+    std::lock_guard<std::mutex> lock(lock_);
+    ready_.push_back(handle);
+    cond_.notify_one();
+}
+
+void AsyncLoop::finish()
+{
+    std::lock_guard<std::mutex> lock(lock_);
+    --active_;
+}
+
+bool BorrowAwaiter::await_ready()
+{
+    desp_ = buffer_.probe(table_.c_str(), blockid_);
+    if (desp_) ++loop_.stats().hits;
+    return desp_ != NULL;
+}
+
+void BorrowAwaiter::await_suspend(std::coroutine_handle<> handle)
+{
+    ++loop_.stats().misses;
+    // 读盘在后台任务中执行，完成后回到循环线程恢复
+    kRuntime.submit(
+        [this, handle]() {
+            desp_ = buffer_.borrow(table_.c_str(), blockid_);
+            loop_.post(handle);
+        },
+        Runtime::BACKGROUND);
+}
+
+Async<unsigned int>
+locateAsync(AsyncLoop &loop, Table &table, void *keybuf, unsigned int len)
+{
+    // 建立fence缓存要读入整条数据链，先异步读入，再同步建立时全部命中
+    if (!table.fences_.valid() && !table.mapped_) {
+        AsyncBlockIterator it(loop, table);
+        while (co_await it.next())
+            ;
+    }
+    co_return table.locate(keybuf, len);
+}
+
+Async<int>
+insertAsync(AsyncLoop &loop, Table &table, std::vector<struct iovec> &iov)
+{
+    unsigned int key = table.info_->key;
+    void *keybuf = iov[key].iov_base;
+    unsigned int len = (unsigned int) iov[key].iov_len;
+    unsigned int blockid = co_await locateAsync(loop, table, keybuf, len);
+
+    // 持有目标block，恢复后重新定位；分裂出的新block刚刚写过，仍在池中
+    BufDesp *desp = NULL;
+    if (!table.mapped_)
+        desp = co_await borrowAsync(loop, table.name_.c_str(), blockid);
+    int ret = table.insert(table.locate(keybuf, len), iov);
+    if (desp) kBuffer.releaseBuf(desp);
+    co_return ret;
+}
+
+Async<int> removeAsync(
+    AsyncLoop &loop,
+    Table &table,
+    void *keybuf,
+    unsigned int len)
+{
+    unsigned int blockid = co_await locateAsync(loop, table, keybuf, len);
+    BufDesp *desp = NULL;
+    if (!table.mapped_)
+        desp = co_await borrowAsync(loop, table.name_.c_str(), blockid);
+    int ret = table.remove(table.locate(keybuf, len), keybuf, len);
+    if (desp) kBuffer.releaseBuf(desp);
+    co_return ret;
+}
+
+AsyncBlockIterator::AsyncBlockIterator(AsyncLoop &loop, Table &table)
+    : loop_(loop)
+    , table_(table)
+    , desp_(NULL)
+    , started_(false)
+{
+    block_.table_ = &table;
+}
+
+AsyncBlockIterator::~AsyncBlockIterator() { release(); }
+
+Async<bool> AsyncBlockIterator::next()
+{
+    unsigned int blockid;
+    if (!started_) {
+        // 从超块得到数据链头
+        started_ = true;
+        if (table_.mapped_)
+            blockid = table_.first_;
+        else {
+            BufDesp *desp =
+                co_await borrowAsync(loop_, table_.name_.c_str(), 0);
+            if (desp == NULL) co_return false;
+            SuperBlock super;
+            super.attach(desp->buffer);
+            blockid = super.getFirst();
+            kBuffer.releaseBuf(desp);
+        }
+    } else {
+        if (block_.buffer_ == NULL) co_return false;
+        blockid = block_.getNext();
+    }
+
+    release();
+    if (blockid == 0) co_return false;
+    co_await fetch(blockid);
+    co_return block_.buffer_ != NULL;
+}
+
+Async<void> AsyncBlockIterator::fetch(unsigned int blockid)
+{
+    if (table_.mapped_) {
+        block_.attach(table_.mappedBlock(blockid));
+        co_return;
+    }
+    desp_ = co_await borrowAsync(loop_, table_.name_.c_str(), blockid);
+    block_.attach(desp_ ? desp_->buffer : NULL);
+}
+
+void AsyncBlockIterator::release()
+{
+    if (desp_) kBuffer.releaseBuf(desp_);
+    desp_ = NULL;
+    block_.detach();
+}
+
+} // namespace db
@@ -0,0 +1,115 @@
+////
+// @file batch.cc
+// @brief
+// 实现向量化批量扫描
+//
+// @author niexw
+// @email niexiaowen@uestc.edu.cn
+//
+#include <db/batch.h>
+
+namespace db {
+
+void ColumnVector::init(DataType *type, unsigned int field, size_t capacity)
+{
+    type_ = type;
+    field_ = field;
+    // 整数类型定长，字符串类型的size为65535或负数
+    width_ = type->size > 0 && type->size <= 8 ? (unsigned int) type->size : 0;
+    if (width_) values_.resize(capacity * width_);
+    clear();
+}
+
+void ColumnVector::clear()
+{
+    size_ = 0;
+    offsets_.assign(1, 0);
+    bytes_.clear();
+}
+
+BatchScanner::BatchScanner(
+    Table &table,
+    const std::vector<unsigned int> &fields,
+    size_t capacity,
+    AccessStrategy *strategy)
+    : table_(&table)
+    , next_(0)
+    , capacity_(capacity ? capacity : 1)
+    , fields_(fields)
+    , offsets_(table.info_->count + 1)
+{
+    block_ = table.beginblock(strategy);
+}
+
+bool BatchScanner::next(Batch &batch)
+{
+    while (block_.block.buffer_) {
+        if (next_ < block_->getSlots()) {
+            decode(batch);
+            return true;
+        }
+        ++block_;
+        next_ = 0;
+    }
+    return false;
+}
+
+void BatchScanner::decode(Batch &batch)
+{
+    static const unsigned char zeros[8] = {0};
+    DataBlock &block = block_.block;
+    RelationInfo *info = table_->info_;
+    batch.columns.resize(fields_.size());
+    for (size_t i = 0; i < fields_.size(); ++i)
+        batch.columns[i].init(
+            info->fields[fields_[i]].type, fields_[i], capacity_);
+    batch.blockid = block.getSelf();
+    batch.first = next_;
+    batch.rows = 0;
+    batch.selection.clear();
+
+    size_t count = block.getSlots() - next_;
+    if (count > capacity_) count = capacity_;
+    for (size_t row = 0; row < count; ++row, ++next_) {
+        Record record;
+        block.refslots(next_, record);
+
+        // 总长度之后是逆序的各字段偏移，以第0个字段的偏移0结尾；每条记录只
+        // 解析一次，各投影列直接取用
+        Integer it;
+        bool ok = it.decode((char *) record.buffer_ + 1, record.length_ - 1);
+        size_t length = it.get();
+        size_t start = 1 + it.size();
+        size_t n = 0;
+        while (ok && n < offsets_.size()) {
+            ok = start < record.length_ &&
+                 it.decode(
+                     (char *) record.buffer_ + start, record.length_ - start);
+            if (!ok) break;
+            start += it.size();
+            offsets_[n++] = it.get();
+            if (it.get() == 0) break;
+        }
+        ok = ok && n == info->count;
+
+        for (size_t i = 0; i < fields_.size(); ++i) {
+            ColumnVector &column = batch.columns[i];
+            if (!ok) {
+                // 损坏的记录填0占位，不选中
+                column.append(zeros, 0);
+                continue;
+            }
+            unsigned int field = fields_[i];
+            size_t begin = offsets_[n - 1 - field];
+            size_t end =
+                field + 1 < n ? offsets_[n - 2 - field] : length - start;
+            column.append(
+                record.buffer_ + start + begin, (unsigned int) (end - begin));
+        }
+        if (ok && record.isactive())
+            batch.selection.push_back((unsigned short) row);
+        ++batch.rows;
+    }
+}
+
+} // namespace db
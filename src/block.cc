@@ -179,10 +179,8 @@ void MetaBlock::clear(
 }
 
 // TODO: 如果record非full，直接分配，不考虑slot
-std::pair<unsigned char *, bool>
-MetaBlock::allocate(unsigned short space, unsigned short index)
+unsigned char *MetaBlock::allocate(unsigned short space, unsigned short index)
 {
-    bool need_reorder = false;
     MetaHeader *header = reinterpret_cast<MetaHeader *>(buffer_);
     space = ALIGN_TO_SIZE(space); // 先将需要空间数对齐8B
 
@@ -196,19 +194,18 @@ MetaBlock::allocate(unsigned short space, unsigned short index)
         demand_space += ALIGN_TO_SIZE(sizeof(Slot)); // 需要的空间数目
 
     // 该block空间不够
-    if (freesize < demand_space)
-        return std::pair<unsigned char *, bool>(nullptr, false);
+    if (freesize < demand_space) return nullptr;
 
     // 如果freespace空间不够，先回收删除的记录
     unsigned short freespacesize = getFreespaceSize();
-    // freespace的空间要减去要分配的slot的空间
+    // freespace的空间要减去要分配的slot的空间，不够减时当作0，否则回绕后
+    // 不会回收，记录覆盖slots[]
     if (current_trailersize < demand_trailersize)
-        freespacesize -= ALIGN_TO_SIZE(sizeof(Slot));
-    // NOTE: 这里这里没法reorder，才分配还未填充记录
-    if (freespacesize < demand_space) {
-        shrink();
-        need_reorder = true;
-    }
+        freespacesize = freespacesize > ALIGN_TO_SIZE(sizeof(Slot))
+                            ? freespacesize - ALIGN_TO_SIZE(sizeof(Slot))
+                            : 0;
+    // 回收不改变slots[]的顺序，新槽位仍插在index处
+    if (freespacesize < demand_space) shrink();
 
     // 从freespace分配空间
     unsigned char *ret = buffer_ + getFreeSpace();
@@ -230,7 +227,7 @@ MetaBlock::allocate(unsigned short space, unsigned short index)
     // 设定freespace偏移量
     setFreeSpace(getFreeSpace() + space);
 
-    return std::pair<unsigned char *, bool>(ret, need_reorder);
+    return ret;
 }
 
 // TODO: 需要考虑record非full的情况
@@ -276,26 +273,24 @@ void MetaBlock::shrink()
 {
     MetaHeader *header = reinterpret_cast<MetaHeader *>(buffer_);
     Slot *slots = getSlotsPointer();
+    unsigned short count = getSlots();
 
-    // 按照偏移量重新排序slots[]函数
-    struct OffsetSort
-    {
-        bool operator()(const Slot &x, const Slot &y)
-        {
-            return be16toh(x.offset) < be16toh(y.offset);
-        }
-    };
-    OffsetSort osort;
-    std::sort(slots, slots + getSlots(), osort);
+    // 槽位按偏移量排列的临时置换，高16位为偏移量，低16位为槽位下标；
+    // slots[]本身不动，仍按键有序。每条记录对齐后至少8字节
+    unsigned int order[BLOCK_SIZE / (sizeof(Slot) + 8)];
+    for (unsigned short i = 0; i < count; ++i)
+        order[i] = (unsigned int) be16toh(slots[i].offset) << 16 | i;
+    std::sort(order, order + count);
 
-    // 枚举所有record，然后向前移动
+    // 按偏移量从小到大向前移动记录，只改写槽位中的偏移
     unsigned short offset = sizeof(MetaHeader);
     unsigned short space = 0;
-    for (unsigned short i = 0; i < getSlots(); ++i) {
-        unsigned short len = be16toh((slots + i)->length);
-        unsigned short off = be16toh((slots + i)->offset);
+    for (unsigned short i = 0; i < count; ++i) {
+        Slot *slot = slots + (order[i] & 0xffff);
+        unsigned short len = be16toh(slot->length);
+        unsigned short off = be16toh(slot->offset);
         if (offset < off) memmove(buffer_ + offset, buffer_ + off, len);
-        (slots + i)->offset = htobe16(offset);
+        slot->offset = htobe16(offset);
         offset += len;
         space += len;
     }
@@ -397,14 +392,17 @@ DataBlock::insertRecord(std::vector<struct iovec> &iov)
     if (blen < actlen + trailerlen)
         return std::pair<bool, unsigned short>(false, index);
 
-    // 分配空间
-    std::pair<unsigned char *, bool> alloc_ret = allocate(actlen, index);
+    // 分配空间，槽位已在index处，不需要重排
+    unsigned char *space = allocate(actlen, index);
     // 填写记录
-    record.attach(alloc_ret.first, actlen);
+    record.attach(space, actlen);
     unsigned char header = 0;
     record.set(iov, &header);
-    // 重新排序
-    if (alloc_ret.second) reorder(type, key);
+    // 扩大zone map值域，加入过滤器
+    if (table_) {
+        table_->zonemap_.add(getSelf(), record);
+        table_->blooms_.add(getSelf(), record);
+    }
 
     return std::pair<bool, unsigned short>(true, index);
 }
@@ -419,8 +417,14 @@ bool DataBlock::copyRecord(Record &record)
     if (blen < actlen + trailerlen) return false;
 
     // 分配空间，然后copy
-    std::pair<unsigned char *, bool> alloc_ret = allocate(actlen, getSlots());
-    memcpy(alloc_ret.first, record.buffer_, actlen);
+    unsigned char *space = allocate(actlen, getSlots());
+    memcpy(space, record.buffer_, actlen);
+    if (table_) {
+        Record copied;
+        copied.attach(space, actlen);
+        table_->zonemap_.add(getSelf(), copied);
+        table_->blooms_.add(getSelf(), copied);
+    }
 
 #if 0
     // 重新排序，最后才重拍？
@@ -432,6 +436,16 @@ bool DataBlock::copyRecord(Record &record)
     return true;
 }
 
+void DataBlock::deallocateRecord(unsigned short index)
+{
+    MetaBlock::deallocate(index);
+    // 删除后摘要只能作为包络，过滤器只计数
+    if (table_) {
+        table_->zonemap_.remove(getSelf());
+        table_->blooms_.remove(getSelf());
+    }
+}
+
 DataBlock::RecordIterator DataBlock::beginrecord()
 {
     RecordIterator ri;
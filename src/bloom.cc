@@ -0,0 +1,212 @@
+////
+// @file bloom.cc
+// @brief
+// 实现block级Bloom过滤器
+//
+// @author niexw
+// @email niexiaowen@uestc.edu.cn
+//
+#include <algorithm>
+#include <cmath>
+#include <db/bloom.h>
+#include <db/block.h>
+#include <db/predicate.h>
+#include "simd.h"
+
+namespace db {
+
+namespace {
+// 8个奇数salt，每个桶字用一个，将key的低32位散开
+const unsigned int kSalt[8] = {0x47b6137bU,
+                               0x44974d91U,
+                               0x8824ad5bU,
+                               0xa2b7289dU,
+                               0x705495c7U,
+                               0x2df1424bU,
+                               0x9efc4947U,
+                               0x5c6bfb31U};
+} // namespace
+
+unsigned long long hash64(const void *buf, size_t len)
+{
+    // FNV-1a，再用murmur3的fmix64打散
+    const unsigned char *p = (const unsigned char *) buf;
+    unsigned long long h = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < len; ++i) {
+        h ^= p[i];
+        h *= 0x100000001b3ULL;
+    }
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+size_t BloomFilter::bytesFor(size_t keys, double fpp)
+{
+    if (keys == 0) keys = 1;
+    if (fpp <= 0 || fpp >= 1) fpp = 0.01;
+    // 标准Bloom过滤器的位数 -n*ln(p)/ln(2)^2，按桶取整
+    double ln2 = std::log(2.0);
+    double bits = -(double) keys * std::log(fpp) / (ln2 * ln2);
+    size_t bytes = (size_t) std::ceil(bits / 8);
+    return (bytes + BUCKET_SIZE - 1) / BUCKET_SIZE * BUCKET_SIZE;
+}
+
+void BloomFilter::init(size_t keys, double fpp)
+{
+    buckets_ = bytesFor(keys, fpp) / BUCKET_SIZE;
+    bytes_.assign(buckets_ * BUCKET_SIZE + CACHELINE, 0);
+}
+
+void BloomFilter::initBytesPerKey(size_t keys, double bytesPerKey)
+{
+    if (keys == 0) keys = 1;
+    size_t bytes = (size_t) std::ceil(keys * bytesPerKey);
+    buckets_ = (bytes + BUCKET_SIZE - 1) / BUCKET_SIZE;
+    if (buckets_ == 0) buckets_ = 1;
+    bytes_.assign(buckets_ * BUCKET_SIZE + CACHELINE, 0);
+}
+
+void BloomFilter::clear()
+{
+    if (!bytes_.empty()) ::memset(&bytes_[0], 0, bytes_.size());
+}
+
+void BloomFilter::insert(unsigned long long hash)
+{
+    if (buckets_ == 0) return;
+    unsigned int *words = bucket(hash);
+    unsigned int key = (unsigned int) hash;
+#if DB_SIMD_X86
+    if (simdLevel() >= SIMD_AVX2) {
+        bloomInsertAvx2(words, key, kSalt);
+        return;
+    }
+#endif
+    for (int i = 0; i < 8; ++i)
+        words[i] |= 1U << ((key * kSalt[i]) >> 27);
+}
+
+bool BloomFilter::find(unsigned long long hash)
+{
+    if (buckets_ == 0) return true;
+    unsigned int *words = bucket(hash);
+    unsigned int key = (unsigned int) hash;
+#if DB_SIMD_X86
+    if (simdLevel() >= SIMD_AVX2) return bloomFindAvx2(words, key, kSalt);
+#endif
+    for (int i = 0; i < 8; ++i)
+        if (!(words[i] & (1U << ((key * kSalt[i]) >> 27)))) return false;
+    return true;
+}
+
+void BlockBloom::init(
+    RelationInfo *info,
+    const std::vector<unsigned int> &fields,
+    const BloomOptions &options)
+{
+    info_ = info;
+    fields_ = fields;
+    options_ = options;
+    filters_.clear();
+}
+
+int BlockBloom::column(unsigned int field)
+{
+    for (size_t i = 0; i < fields_.size(); ++i)
+        if (fields_[i] == field) return (int) i;
+    return -1;
+}
+
+void BlockBloom::reset(unsigned int blkid, unsigned int next, size_t keys)
+{
+    if (!enabled()) return;
+    BlockFilter &filter = filters_[blkid];
+    filter.next = next;
+    filter.keys = 0;
+    filter.removed = 0;
+    filter.capacity = std::max(keys, options_.keysPerBlock);
+    filter.filters.resize(fields_.size());
+    for (size_t c = 0; c < fields_.size(); ++c) {
+        if (options_.bytesPerKey > 0)
+            filter.filters[c].initBytesPerKey(
+                filter.capacity, options_.bytesPerKey);
+        else
+            filter.filters[c].init(filter.capacity, options_.fpp);
+    }
+}
+
+void BlockBloom::build(DataBlock &block)
+{
+    if (!enabled()) return;
+    unsigned int blkid = block.getSelf();
+    reset(blkid, block.getNext(), block.getSlots());
+
+    // 枚举所有记录
+    for (unsigned short i = 0; i < block.getSlots(); ++i) {
+        Record record;
+        block.refslots(i, record);
+        add(blkid, record);
+    }
+}
+
+void BlockBloom::add(unsigned int blkid, Record &record)
+{
+    BlockFilter *filter = find(blkid);
+    if (filter == NULL) return; // 未知block，等扫描时重建
+
+    for (size_t c = 0; c < fields_.size(); ++c) {
+        unsigned char *pval;
+        unsigned int len;
+        record.refByIndex(&pval, &len, fields_[c]);
+        filter->filters[c].insert(hash64(pval, len));
+    }
+    ++filter->keys;
+}
+
+void BlockBloom::remove(unsigned int blkid)
+{
+    BlockFilter *filter = find(blkid);
+    if (filter) ++filter->removed;
+}
+
+void BlockBloom::setNext(unsigned int blkid, unsigned int next)
+{
+    BlockFilter *filter = find(blkid);
+    if (filter) filter->next = next;
+}
+
+void BlockBloom::drop(unsigned int blkid) { filters_.erase(blkid); }
+
+BlockFilter *BlockBloom::find(unsigned int blkid)
+{
+    Filters::iterator it = filters_.find(blkid);
+    return it == filters_.end() ? NULL : &it->second;
+}
+
+bool BlockBloom::stale(unsigned int blkid)
+{
+    BlockFilter *filter = find(blkid);
+    if (filter == NULL) return true;
+    // 删除超过一半，或者插入超过预期，误判率已经偏离设定
+    return filter->removed * 2 > filter->keys ||
+           filter->keys > filter->capacity * 2;
+}
+
+bool BlockBloom::mayContain(
+    unsigned int blkid,
+    unsigned int field,
+    const void *val,
+    unsigned int len)
+{
+    BlockFilter *filter = find(blkid);
+    if (filter == NULL) return true;
+    int c = column(field);
+    if (c < 0) return true; // 该列没有过滤器
+    return filter->filters[c].find(hash64(val, len));
+}
+
+} // namespace db
@@ -0,0 +1,53 @@
+////
+// @file bloom_avx2.cc
+// @brief
+// Bloom过滤器桶操作的AVX2实现，以-mavx2编译，只在CPU支持时调用
+// 8个salt同时与key相乘，取高5位得到桶内8个字各自的位，一次置位或检查整个桶。
+//
+// @author niexw
+// @email niexiaowen@uestc.edu.cn
+//
+#include "simd.h"
+
+#if DB_SIMD_X86
+#    include <immintrin.h>
+
+namespace db {
+
+namespace {
+
+// 桶内8个字各1位的掩码
+inline __m256i bucketMask(unsigned int key, const unsigned int *salt)
+{
+    __m256i bits = _mm256_srli_epi32(
+        _mm256_mullo_epi32(
+            _mm256_set1_epi32((int) key),
+            _mm256_loadu_si256((const __m256i *) salt)),
+        27);
+    return _mm256_sllv_epi32(_mm256_set1_epi32(1), bits);
+}
+
+} // namespace
+
+void bloomInsertAvx2(
+    unsigned int *words,
+    unsigned int key,
+    const unsigned int *salt)
+{
+    __m256i old = _mm256_load_si256((const __m256i *) words);
+    _mm256_store_si256(
+        (__m256i *) words, _mm256_or_si256(old, bucketMask(key, salt)));
+}
+
+bool bloomFindAvx2(
+    const unsigned int *words,
+    unsigned int key,
+    const unsigned int *salt)
+{
+    __m256i old = _mm256_load_si256((const __m256i *) words);
+    return _mm256_testc_si256(old, bucketMask(key, salt)) != 0;
+}
+
+} // namespace db
+
+#endif // DB_SIMD_X86
@@ -6,62 +6,462 @@
 // @author niexw
 // @email niexiaowen@uestc.edu.cn
 //
-#include <malloc.h> // windows
+#include <new>
+#include <chrono>
+#include <algorithm>
 #include <db/buffer.h>
 #include <db/block.h>
 #include <db/file.h>
+#include <db/compress.h>
+#include <db/arena.h>
+#include <db/record.h>
 
 namespace db {
+namespace {
+// 描述符按cache line对齐存放，避免相邻描述符伪共享
+const size_t CACHELINE_SIZE = 64;
+const size_t DESP_STRIDE =
+    (sizeof(BufDesp) + CACHELINE_SIZE - 1) / CACHELINE_SIZE * CACHELINE_SIZE;
+// 各类访问策略缺省的环大小，单位为字节
+const size_t BULKREAD_RING = 256 * 1024;
+const size_t BULKWRITE_RING = 16 * 1024 * 1024;
+
+// 线程编号，用来选择计数器槽
+std::atomic<unsigned int> kThreads(0);
+size_t threadSlot()
+{
+    static thread_local size_t slot = kThreads++ % Buffer::COUNTER_SLOTS;
+    return slot;
+}
+
+// 计数器只在本线程增加，汇总时才读取
+inline void
+bump(std::atomic<unsigned long long> &counter, unsigned long long n = 1)
+{
+    counter.fetch_add(n, std::memory_order_relaxed);
+}
+
+// 从start到现在经过的纳秒数
+unsigned long long elapsed(std::chrono::steady_clock::time_point start)
+{
+    return (unsigned long long) std::chrono::duration_cast<
+               std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now() - start)
+        .count();
+}
+} // namespace
+
+struct Buffer::Counters
+{
+    std::atomic<unsigned long long> hits;
+    std::atomic<unsigned long long> misses;
+    std::atomic<unsigned long long> reads;
+    std::atomic<unsigned long long> readNanos;
+    std::atomic<unsigned long long> writes;
+    std::atomic<unsigned long long> writeIos;
+    std::atomic<unsigned long long> writeBytes;
+    std::atomic<unsigned long long> writeNanos;
+    std::atomic<unsigned long long> evictions;
+    std::atomic<unsigned long long> pins;
+    std::atomic<unsigned long long> unpins;
+
+    Counters()
+        : hits(0)
+        , misses(0)
+        , reads(0)
+        , readNanos(0)
+        , writes(0)
+        , writeIos(0)
+        , writeBytes(0)
+        , writeNanos(0)
+        , evictions(0)
+        , pins(0)
+        , unpins(0)
+    {}
+};
+
+namespace {
+// 解析驻留列表：大序的个数，随后每项为大序的表名长度、表名、blockid
+int loadResident(const char *path, std::vector<Buffer::Resident> &list)
+{
+    File file;
+    int ret = file.open(path);
+    if (ret) return ret;
+    unsigned long long len = 0;
+    ret = file.length(len);
+    if (ret) return ret;
+    if (len < sizeof(unsigned int)) return EINVAL;
+    std::vector<char> data((size_t) len);
+    ret = file.read(0, &data[0], data.size());
+    if (ret) return ret;
+
+    unsigned int count;
+    ::memcpy(&count, &data[0], sizeof(count));
+    count = be32toh(count);
+    size_t pos = sizeof(count);
+    list.clear();
+    for (unsigned int i = 0; i < count; ++i) {
+        unsigned short length;
+        if (pos + sizeof(length) > data.size()) return EINVAL;
+        ::memcpy(&length, &data[pos], sizeof(length));
+        length = be16toh(length);
+        pos += sizeof(length);
+
+        unsigned int blockid;
+        if (pos + length + sizeof(blockid) > data.size()) return EINVAL;
+        std::string table(&data[pos], length);
+        pos += length;
+        ::memcpy(&blockid, &data[pos], sizeof(blockid));
+        pos += sizeof(blockid);
+        list.push_back(Buffer::Resident(table, be32toh(blockid)));
+    }
+    return S_OK;
+}
+
+const size_t COUNTER_STRIDE = (sizeof(Buffer::Counters) + CACHELINE_SIZE - 1) /
+                              CACHELINE_SIZE * CACHELINE_SIZE;
+} // namespace
+
+AccessStrategy::AccessStrategy(Type type, size_t size)
+    : type_(type)
+    , pool_(NULL)
+    , current_(0)
+{
+    if (size == 0)
+        size = (type == BULKWRITE ? BULKWRITE_RING : BULKREAD_RING) /
+               BLOCK_SIZE;
+    ring_.assign(size, (unsigned int) NO_FRAME);
+    blocks_.resize(size);
+}
+
+AccessStrategy::~AccessStrategy()
+{
+    if (pool_ == NULL) return;
+    // 清除环标记，这些buffer仍在lru尾部，最先被淘汰；已经不属于环的不动
+    for (size_t i = 0; i < ring_.size(); ++i) {
+        if (ring_[i] == NO_FRAME || ring_[i] >= pool_->capacity()) continue;
+        BufDesp *desp = pool_->descriptor(ring_[i]);
+        if (owns(i, desp)) desp->type &= ~pool_->BUFFER_RING;
+    }
+}
+
+bool AccessStrategy::owns(size_t slot, BufDesp *desp)
+{
+    return (desp->type & pool_->BUFFER_RING) && desp->name &&
+           desp->blockid == blocks_[slot].second &&
+           blocks_[slot].first == desp->name;
+}
+
 Buffer::~Buffer()
 {
-    if (buffer_) {
-        // 释放所有lru上的描述符，TODO: 恢复？
-        while (lru_.next) {
-            BufDesp *descriptor = lru_.next;
-            lru_.next = descriptor->next;
-            delete (descriptor);
+    // 停止预热和定期保存，保存驻留列表；运行时停止时任务已全部结束
+    stopping_ = true;
+    if (warming_.pending()) kRuntime.wait(warming_);
+    if (background_.pending()) {
+        unsigned long long timer;
+        {
+            std::lock_guard<std::recursive_mutex> guard(latch_);
+            interval_ = 0;
+            timer = residentTimer_;
         }
+        kRuntime.cancel(timer);
+        kRuntime.wait(background_);
+    }
+    if (!residentPath_.empty()) saveResident(residentPath_.c_str());
+
+    // 释放命名池
+    for (size_t i = 1; i < pools_.size(); ++i)
+        delete pools_[i];
 
-        // 释放所有buffer内存
-        _aligned_free(buffer_);
+    // 释放所有buffer和描述符内存，TODO: 恢复？
+    size_t frames = chunkSize_ / BLOCK_SIZE;
+    for (size_t i = 0; i < chunks_.size(); ++i) {
+        arenaFree(chunks_[i].base, chunkSize_, chunks_[i].large);
+        arenaFree(chunks_[i].desps, frames * DESP_STRIDE, false);
     }
+    if (counters_) arenaFree(counters_, COUNTER_SLOTS * COUNTER_STRIDE, false);
 }
 
-void Buffer::init(FilePool *fp, size_t size)
+void Buffer::init(FilePool *fp, size_t size, const ArenaOptions &options)
 {
     // 已经初始化过
-    if (buffer_) return;
+    if (!chunks_.empty()) return;
     filepool_ = fp;
+    options_ = options;
 
-    // 按照4096B对齐，以1MB为单位分配内存
-    unsigned char *buffer_ =
-        (unsigned char *) _aligned_malloc(size * 1024 * 1024, 4096);
-
-    // 初始化所有block
-    BufDesp *prev = NULL;
-    idleCount_ = 0;
-    for (size_t i = 0; i < size * 1024 * 1024 / BLOCK_SIZE; ++i) {
-        idle_ = (BufDesp *) (buffer_ + i * BLOCK_SIZE);
-        idle_->next = prev;
-        prev = idle_;
-        idle_->prev = NULL;
-        idle_->size = BLOCK_SIZE;
-        idle_->name = NULL;
-        idle_->type = 0;
+    // 各线程的计数器
+    if (counters_ == NULL) {
+        bool large = false;
+        counters_ = (unsigned char *) arenaAlloc(
+            COUNTER_SLOTS * COUNTER_STRIDE, -1, large);
+        for (size_t i = 0; i < COUNTER_SLOTS; ++i)
+            new (counters_ + i * COUNTER_STRIDE) Counters;
+    }
+
+    // 大页时chunk取大页大小
+    chunkSize_ = CHUNK_SIZE;
+    size_t page = options.largePages ? largePageSize() : 0;
+    if (page > chunkSize_) chunkSize_ = page;
+
+    // 每个结点一条idle链
+    size_t nodes = options.numa ? numaNodes() : 1;
+    idles_.assign(nodes, NULL);
+    nodes_.assign(nodes, NodeStats());
+    resize(size);
+}
+
+int Buffer::addChunk()
+{
+    // 轮流分配到各结点，起始地址至少按页对齐
+    size_t frames = chunkSize_ / BLOCK_SIZE;
+    Chunk chunk;
+    int node = options_.numa ? (int) (chunks_.size() % idles_.size()) : -1;
+    chunk.node = (unsigned short) (chunks_.size() % idles_.size());
+    chunk.large = options_.largePages;
+    chunk.base =
+        (unsigned char *) arenaAlloc(chunkSize_, node, chunk.large);
+    if (chunk.base == NULL) return ENOMEM;
+
+    // 描述符数组与buffer分开存放，放在同一个结点上
+    bool large = false;
+    chunk.desps = (unsigned char *) arenaAlloc(
+        frames * DESP_STRIDE, node, large);
+    if (chunk.desps == NULL) {
+        arenaFree(chunk.base, chunkSize_, chunk.large);
+        return ENOMEM;
+    }
+
+    // 初始化所有描述符，挂到结点的idle上
+    unsigned int first = (unsigned int) (chunks_.size() * frames);
+    for (size_t i = 0; i < frames; ++i) {
+        BufDesp *desp = new (chunk.desps + i * DESP_STRIDE) BufDesp;
+        desp->buffer = chunk.base + i * BLOCK_SIZE;
+        desp->size = BLOCK_SIZE;
+        desp->pool = this;
+        desp->node = chunk.node;
+        desp->frame = first + (unsigned int) i;
+        desp->next = idles_[chunk.node];
+        idles_[chunk.node] = desp;
         ++idleCount_;
     }
+    chunks_.push_back(chunk);
+
+    NodeStats &stats = nodes_[chunk.node];
+    stats.frames += frames;
+    stats.idles += frames;
+    if (chunk.large) stats.largeFrames += frames;
+    return S_OK;
+}
+
+int Buffer::resize(size_t size)
+{
+    std::lock_guard<std::recursive_mutex> guard(latch_);
+    size_t count = (size * 1024 * 1024 + chunkSize_ - 1) / chunkSize_;
+
+    // 扩大
+    while (chunks_.size() < count)
+        if (addChunk()) return ENOMEM;
+
+    // 缩小，从最后一个chunk开始释放
+    size_t frames = chunkSize_ / BLOCK_SIZE;
+    while (chunks_.size() > count) {
+        Chunk &back = chunks_.back();
+        unsigned int first = (unsigned int) ((chunks_.size() - 1) * frames);
+
+        // chunk上有借出的block，放弃；在lru上的描述符prev不为NULL
+        for (size_t i = 0; i < frames; ++i) {
+            BufDesp *desp = descriptor(first + (unsigned int) i);
+            if (desp->prev && desp->ref.load()) return EBUSY;
+        }
+
+        // 淘汰chunk上的block
+        for (size_t i = 0; i < frames; ++i) {
+            BufDesp *desp = descriptor(first + (unsigned int) i);
+            if (desp->prev == NULL) continue;
+            int ret = writeBack(desp);
+            if (ret) return ret;
+            discard(desp);
+        }
+
+        // 从idle上摘下chunk上的描述符
+        NodeStats &stats = nodes_[back.node];
+        BufDesp **link = &idles_[back.node];
+        while (*link) {
+            if ((*link)->frame >= first) {
+                *link = (*link)->next;
+                --idleCount_;
+                --stats.idles;
+            } else
+                link = &(*link)->next;
+        }
+        stats.frames -= frames;
+        if (back.large) stats.largeFrames -= frames;
+
+        arenaFree(back.base, chunkSize_, back.large);
+        arenaFree(back.desps, frames * DESP_STRIDE, false);
+        chunks_.pop_back();
+    }
+    return S_OK;
+}
+
+size_t Buffer::capacity() { return chunks_.size() * chunkSize_ / BLOCK_SIZE; }
+
+BufDesp *Buffer::descriptor(unsigned int frame)
+{
+    size_t frames = chunkSize_ / BLOCK_SIZE;
+    Chunk &chunk = chunks_[frame / frames];
+    return (BufDesp *) (chunk.desps + frame % frames * DESP_STRIDE);
+}
+
+Buffer::Counters &Buffer::counters()
+{
+    return *(Counters *) (counters_ + threadSlot() * COUNTER_STRIDE);
+}
+
+BufferStats Buffer::stats()
+{
+    std::lock_guard<std::recursive_mutex> guard(latch_);
+    BufferStats stats;
+    for (size_t i = 0; counters_ && i < COUNTER_SLOTS; ++i) {
+        Counters *c = (Counters *) (counters_ + i * COUNTER_STRIDE);
+        stats.hits += c->hits.load(std::memory_order_relaxed);
+        stats.misses += c->misses.load(std::memory_order_relaxed);
+        stats.reads += c->reads.load(std::memory_order_relaxed);
+        stats.readNanos += c->readNanos.load(std::memory_order_relaxed);
+        stats.writes += c->writes.load(std::memory_order_relaxed);
+        stats.writeIos += c->writeIos.load(std::memory_order_relaxed);
+        stats.writeBytes += c->writeBytes.load(std::memory_order_relaxed);
+        stats.writeNanos += c->writeNanos.load(std::memory_order_relaxed);
+        stats.evictions += c->evictions.load(std::memory_order_relaxed);
+        stats.pins += c->pins.load(std::memory_order_relaxed);
+        stats.unpins += c->unpins.load(std::memory_order_relaxed);
+    }
+
+    // 遍历lru得到驻留、脏、借出的block
+    for (BufDesp *desp = lru_.next; desp; desp = desp->next) {
+        ++stats.resident;
+        if (desp->type & BUFFER_DIRTY) ++stats.dirty;
+        unsigned char ref = desp->ref.load();
+        if (ref) ++stats.pinned;
+        stats.refs += ref;
+    }
+    return stats;
+}
+
+void Buffer::snapshot(std::vector<BufEntry> &entries)
+{
+    std::lock_guard<std::recursive_mutex> guard(latch_);
+    entries.clear();
+    for (BufDesp *desp = lru_.next; desp; desp = desp->next) {
+        BufEntry entry;
+        entry.table = desp->name;
+        entry.blockid = desp->blockid;
+        entry.frame = desp->frame;
+        entry.dirty = (desp->type & BUFFER_DIRTY) != 0;
+        entry.ref = desp->ref.load();
+        entries.push_back(entry);
+    }
+}
+
+void Buffer::residency(std::map<std::string, size_t> &tables)
+{
+    std::lock_guard<std::recursive_mutex> guard(latch_);
+    tables.clear();
+    for (BlockMap::iterator it = map_.begin(); it != map_.end(); ++it)
+        ++tables[it->first.first];
+}
+
+void Buffer::report()
+{
+    BufferStats total = stats();
+    printf(
+        "%s: hits=%llu, misses=%llu, ratio=%.3f, reads=%llu(%.1fus), "
+        "writes=%llu(%.1fus, %.0fB/io), evictions=%llu, resident=%zd, "
+        "dirty=%zd, pinned=%zd\n",
+        name_.c_str(),
+        total.hits,
+        total.misses,
+        total.hitRatio(),
+        total.reads,
+        total.readLatency(),
+        total.writes,
+        total.writeLatency(),
+        total.writeSize(),
+        total.evictions,
+        total.resident,
+        total.dirty,
+        total.pinned);
+    for (size_t i = 0; i < nodes_.size(); ++i) {
+        NodeStats &stats = nodes_[i];
+        printf(
+            "%s node %zd: frames=%zd, large=%zd, idles=%zd, allocs=%llu, "
+            "remote=%llu\n",
+            name_.c_str(),
+            i,
+            stats.frames,
+            stats.largeFrames,
+            stats.idles,
+            stats.allocs,
+            stats.remoteAllocs);
+    }
+}
+
+int Buffer::createPool(const char *name, size_t size, unsigned short &id)
+{
+    if (findPool(name)) return EEXIST;
+    if (pools_.empty()) pools_.push_back(this); // 0号是缺省池
+    if (pools_.size() >= MAX_POOLS) return ENOSPC;
+
+    Buffer *pool = new Buffer;
+    pool->name_ = name;
+    pool->init(filepool_, size, options_);
+    if (pool->capacity() * BLOCK_SIZE < size * 1024 * 1024) {
+        delete pool;
+        return ENOMEM;
+    }
+    id = (unsigned short) pools_.size();
+    pools_.push_back(pool);
+    return S_OK;
+}
+
+Buffer *Buffer::findPool(const char *name, unsigned short *id)
+{
+    if (name_ == name) {
+        if (id) *id = 0;
+        return this;
+    }
+    for (size_t i = 1; i < pools_.size(); ++i)
+        if (pools_[i]->name_ == name) {
+            if (id) *id = (unsigned short) i;
+            return pools_[i];
+        }
+    return NULL;
+}
+
+Buffer *Buffer::pool(unsigned short id)
+{
+    if (id == 0 || id >= pools_.size()) return this;
+    return pools_[id];
 }
 
 BufDesp *Buffer::allocFromIdle()
 {
-    // 从idle头部摘下一个buffer
-    BufDesp *ptr = idle_;
-    idle_ = idle_->next;
+    // 优先从当前线程所在结点分配，没有空闲再找其它结点
+    unsigned short node =
+        options_.numa ? (unsigned short) (currentNode() % idles_.size()) : 0;
+    unsigned short from = node;
+    while (idles_[from] == NULL)
+        from = (unsigned short) ((from + 1) % idles_.size());
+    if (from != node) ++nodes_[node].remoteAllocs;
+    ++nodes_[from].allocs;
+    --nodes_[from].idles;
 
-    // 分配描述符
-    BufDesp *descriptor = new BufDesp;
-    descriptor->buffer = (unsigned char *) ptr;
-    descriptor->size = BLOCK_SIZE;
+    // 从idle头部摘下一个描述符
+    BufDesp *descriptor = idles_[from];
+    idles_[from] = descriptor->next;
+    --idleCount_;
+    descriptor->name = NULL;
+    descriptor->blockid = 0;
     descriptor->type = 0;
 
     // 插入lru
@@ -74,79 +474,724 @@ void Buffer::prependLru(BufDesp *descriptor)
 {
     descriptor->next = lru_.next;
     lru_.next = descriptor;
-    if (descriptor->next) descriptor->next->prev = descriptor;
+    if (descriptor->next)
+        descriptor->next->prev = descriptor;
+    else
+        lru_.prev = descriptor; // 第1个，也是尾部
     descriptor->prev = &lru_;
 }
 
-BufDesp *Buffer::borrow(const char *table, unsigned int blockid)
+void Buffer::appendLru(BufDesp *descriptor)
 {
-    // 利用文件池打开表
-    File *file = filepool_->open(table);
+    descriptor->next = NULL;
+    descriptor->prev = lru_.prev ? lru_.prev : &lru_;
+    descriptor->prev->next = descriptor;
+    lru_.prev = descriptor;
+}
 
-    // 根据表名+offset查找
-    std::pair<const char *, unsigned int> block(table, blockid);
-    BlockMap::iterator it = map_.find(block);
+void Buffer::unlinkLru(BufDesp *descriptor)
+{
+    BufDesp *prev = descriptor->prev;
+    prev->next = descriptor->next;
+    if (prev->next)
+        prev->next->prev = prev;
+    else
+        lru_.prev = prev == &lru_ ? NULL : prev; // 摘下的是尾部
+}
 
-    // 找到，将描述符移动到lru头部
-    if (it != map_.end()) {
-        // 将该描述符从队列中摘下
-        BufDesp *prev = it->second->prev;
-        prev->next = it->second->next;
-        if (prev->next) prev->next->prev = it->second->prev;
+int Buffer::evict()
+{
+    std::unique_lock<std::recursive_mutex> lock(latch_);
+    // 从lru尾部向前，找一个未借出的block
+    BufDesp *desp = lru_.prev;
+    while (desp && desp != &lru_) {
+        if (desp->ref.load()) {
+            desp = desp->prev;
+            continue;
+        }
+        if (!(desp->type & BUFFER_DIRTY)) {
+            discard(desp);
+            return S_OK;
+        }
 
-        // prepend到lru的头部
-        prependLru(it->second);
+        // 脏block持有引用回写，期间放开latch_；lru可能已经变化，回写成功后
+        // 从尾部重新找
+        desp->addref();
+        lock.unlock();
+        int ret = writeBack(desp);
+        lock.lock();
+        desp->relref();
+        desp = ret ? desp->prev : lru_.prev;
+    }
+    return ENOMEM;
+}
+
+void Buffer::discard(BufDesp *desp)
+{
+    bump(counters().evictions);
+
+    // 已经是干净的block，放入二级缓存
+    cache_.insert(desp->name, desp->blockid, desp->buffer);
 
-        // 增加引用计数
-        it->second->addref();
-        // 返回buffer指针
-        return it->second;
+    // 从lru和map上摘下，name指向map的key
+    unlinkLru(desp);
+    BlockMap::iterator it =
+        map_.find(BlockMap::key_type(desp->name, desp->blockid));
+    map_.erase(it);
+    desp->name = NULL;
+
+    // 归还到idle，prev为NULL表示不在lru上
+    desp->prev = NULL;
+    desp->next = idles_[desp->node];
+    idles_[desp->node] = desp;
+    ++nodes_[desp->node].idles;
+    ++idleCount_;
+}
+
+BufDesp *Buffer::allocFromRing(AccessStrategy *strategy, size_t &slot)
+{
+    // 环只属于一个池
+    if (strategy->pool_ == NULL) strategy->pool_ = this;
+    slot = strategy->current_;
+    strategy->current_ = (slot + 1) % strategy->ring_.size();
+
+    // 复用环上的buffer：仍属于环、未借出、能回写
+    unsigned int frame = strategy->ring_[slot];
+    if (frame != AccessStrategy::NO_FRAME && frame < capacity()) {
+        BufDesp *desp = descriptor(frame);
+        bool dirty = (desp->type & BUFFER_DIRTY) != 0;
+        if (strategy->owns(slot, desp) && desp->prev &&
+            desp->ref.load() == 0 && writeBack(desp) == S_OK) {
+            if (dirty) ++strategy->stats_.writes;
+            ++strategy->stats_.reused;
+            bump(counters().evictions);
+
+            // 从map上摘下，扫描的数据不放入二级缓存
+            BlockMap::iterator it =
+                map_.find(BlockMap::key_type(desp->name, desp->blockid));
+            map_.erase(it);
+            desp->name = NULL;
+            desp->blockid = 0;
+            desp->type = BUFFER_RING;
+            unlinkLru(desp);
+            appendLru(desp);
+            return desp;
+        }
     }
 
-    // TODO: 如果空闲空间不够，从lru队列上释放buffer
-    if (idle_ == NULL) {
-        printf("OOM!!!!");
-        return NULL;
+    // 空位或者buffer已被主池收回，从池中取一个新的放到环上
+    if (idleCount_ == 0 && evict()) return NULL;
+    BufDesp *desp = allocFromIdle();
+    desp->type = BUFFER_RING;
+    unlinkLru(desp);
+    appendLru(desp);
+    strategy->ring_[slot] = desp->frame;
+    ++strategy->stats_.added;
+    return desp;
+}
+
+BufDesp *Buffer::borrow(
+    const char *table,
+    unsigned int blockid,
+    AccessStrategy *strategy)
+{
+    // 表分配在命名池上，转给该池
+    if (pools_.size() > 1) {
+        unsigned short id = filepool_->poolOf(table);
+        if (id) return pool(id)->borrow(table, blockid, strategy);
     }
+    // 环在别的池上，不使用策略
+    if (strategy && strategy->pool_ && strategy->pool_ != this) strategy = NULL;
+    if (strategy) ++strategy->stats_.reads;
+    std::unique_lock<std::recursive_mutex> lock(latch_);
+    Counters &counter = counters();
+    bump(counter.pins);
 
-    // 然后从idle上分配一个block
-    BufDesp *descriptor = allocFromIdle();
-    descriptor->name = table;
-    descriptor->blockid = blockid;
-    // prepend到lru的头部
-    prependLru(descriptor);
+    // 根据表名+offset查找；空闲buffer不够时先放开latch_淘汰，再重新查找
+    std::pair<const char *, unsigned int> block(table, blockid);
+    for (;;) {
+        BlockMap::iterator it = map_.find(block);
+        if (it != map_.end()) {
+            // 找到，将描述符移动到lru头部；别的线程正在读入时等它读完
+            BufDesp *desp = pinHit(it->second, strategy);
+            if (desp->type & BUFFER_LOADING) {
+                lock.unlock();
+                desp->lockShared();
+                desp->unlockShared();
+            }
+            return desp;
+        }
+        if (strategy || idleCount_) break;
+        lock.unlock();
+        int ret = evict();
+        lock.lock();
+        if (ret) {
+            printf("OOM!!!!");
+            return NULL;
+        }
+    }
 
-    // 从文件读数据
-    unsigned long long offset =
-        blockid == 0 ? 0 : blockid * BLOCK_SIZE + SUPER_SIZE;
-    int ret = file->read(offset, (char *) descriptor->buffer, BLOCK_SIZE);
-    if (ret) memset(descriptor->buffer, 0, BLOCK_SIZE); // 读取出错，直接清零
+    bump(counter.misses);
+
+    // 按策略访问时在环上分配，挂在lru尾部
+    BufDesp *descriptor = NULL;
+    size_t slot = 0;
+    if (strategy) {
+        descriptor = allocFromRing(strategy, slot);
+        if (descriptor == NULL) {
+            printf("OOM!!!!");
+            return NULL;
+        }
+    } else {
+        // 从idle上分配一个block，allocFromIdle已经prepend到lru头部
+        descriptor = allocFromIdle();
+    }
+    descriptor->blockid = blockid;
 
-    // 将block加入map
+    // 将block加入map，表名指向map中的key，回写时调用者的字符串可能已经释放
     BlockMap::value_type val(
         std::pair<const char *, unsigned int>(table, blockid), descriptor);
-    map_.insert(val);
+    descriptor->name = map_.insert(val).first->first.first.c_str();
+    // 记下环上该位置装入的block
+    if (strategy) {
+        strategy->blocks_[slot].first = table;
+        strategy->blocks_[slot].second = blockid;
+    }
 
-    // 增加引用计数
+    // 增加引用计数，读入期间独占latch，放开latch_
     descriptor->addref();
+    descriptor->type |= BUFFER_LOADING;
+    descriptor->lockExclusive();
+    lock.unlock();
+
+    // 先查二级缓存，再从文件读数据，压缩表通过映射读取并解压；只有读盘时
+    // 才经文件池打开表，读盘期间持有引用
+    int ret = S_OK;
+    if (!cache_.lookup(table, blockid, descriptor->buffer)) {
+        std::chrono::steady_clock::time_point start =
+            std::chrono::steady_clock::now();
+        FileRef file(*filepool_, table);
+        BlockMapping *mapping = blockid ? filepool_->mapping(table) : NULL;
+        if (!file)
+            ret = ENOENT;
+        else if (mapping)
+            ret = mapping->read(file.get(), blockid, descriptor->buffer);
+        else {
+            unsigned long long offset = 0;
+            ret = filepool_->offset(table, blockid, offset);
+            if (ret == S_OK)
+                ret = file->read(
+                    offset, (char *) descriptor->buffer, BLOCK_SIZE);
+        }
+        bump(counter.reads);
+        bump(counter.readNanos, elapsed(start));
+    }
+    if (ret) memset(descriptor->buffer, 0, BLOCK_SIZE); // 读取出错，直接清零
+
+    lock.lock();
+    descriptor->type &= ~BUFFER_LOADING;
+    lock.unlock();
+    descriptor->unlockExclusive();
     return descriptor;
 }
 
+BufDesp *Buffer::probe(const char *table, unsigned int blockid)
+{
+    if (pools_.size() > 1) {
+        unsigned short id = filepool_->poolOf(table);
+        if (id) return pool(id)->probe(table, blockid);
+    }
+    std::lock_guard<std::recursive_mutex> guard(latch_);
+    std::pair<const char *, unsigned int> block(table, blockid);
+    BlockMap::iterator it = map_.find(block);
+    if (it == map_.end() || (it->second->type & BUFFER_LOADING)) return NULL;
+
+    // 与borrow命中时相同，未命中留给随后的borrow计数
+    bump(counters().pins);
+    return pinHit(it->second, NULL);
+}
+
+BufDesp *Buffer::pinHit(BufDesp *desp, AccessStrategy *strategy)
+{
+    bump(counters().hits);
+    // 按策略访问时不改变lru位置
+    if (strategy)
+        ++strategy->stats_.hits;
+    else {
+        // 普通访问命中环上的buffer，归还主池
+        desp->type &= ~BUFFER_RING;
+
+        // 将该描述符从队列中摘下
+        unlinkLru(desp);
+
+        // prepend到lru的头部
+        prependLru(desp);
+    }
+
+    // 增加引用计数
+    desp->addref();
+    return desp;
+}
+
+void Buffer::releaseBuf(BufDesp *desp)
+{
+    desp->relref();
+    if (desp->pool) bump(desp->pool->counters().unpins);
+}
+
 void Buffer::writeBuf(BufDesp *desp)
 {
-    // 设定dirty
+    // 属于其它池
+    if (desp->pool && desp->pool != this) {
+        desp->pool->writeBuf(desp);
+        return;
+    }
+
+    std::lock_guard<std::recursive_mutex> guard(latch_);
+
+    // 设定dirty，环上的buffer留在lru尾部
     desp->type |= BUFFER_DIRTY;
+    if (desp->type & BUFFER_RING) return;
 
     // 将该描述符从队列中摘下
-    BufDesp *prev = desp->prev;
-    prev->next = desp->next;
-    prev->next->prev = desp->prev;
+    unlinkLru(desp);
 
     // prepend到lru的头部
     prependLru(desp);
 }
 
+int Buffer::writeBack(BufDesp *desp)
+{
+    std::unique_lock<std::recursive_mutex> lock(latch_);
+    if (!(desp->type & BUFFER_DIRTY)) return S_OK;
+    // 独占守卫正在修改，写出去的可能是半个更新
+    if (!desp->tryLockShared()) return EBUSY;
+
+    // 先清除脏标记再复制，写的期间再标脏的修改留到下次回写；引用防止block
+    // 在放开latch_时被淘汰，调用者持有latch_时仍然持有
+    desp->type &= ~BUFFER_DIRTY;
+    desp->addref();
+    lock.unlock();
+    int ret;
+    std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    FileRef file(*filepool_, desp->name);
+    BlockMapping *mapping =
+        file && desp->blockid ? filepool_->mapping(desp->name) : NULL;
+    size_t length = desp->blockid ? BLOCK_SIZE : SUPER_SIZE;
+    if (!file)
+        ret = ENOENT;
+    else if (mapping)
+        ret = mapping->write(file.get(), desp->blockid, desp->buffer);
+    else {
+        // 超块不压缩，只写SUPER_SIZE
+        unsigned long long offset = 0;
+        ret = filepool_->offset(desp->name, desp->blockid, offset);
+        if (ret == S_OK)
+            ret = file->write(offset, (const char *) desp->buffer, length);
+    }
+    lock.lock();
+    desp->relref();
+    desp->unlockShared();
+    if (ret == S_OK)
+        ++epoch_;
+    else
+        desp->type |= BUFFER_DIRTY;
+    Counters &counter = counters();
+    bump(counter.writes);
+    bump(counter.writeIos);
+    bump(counter.writeBytes, length);
+    bump(counter.writeNanos, elapsed(start));
+    return ret;
+}
+
+int Buffer::writeRun(DirtyBlock *run, size_t count)
+{
+    // 压缩表、超块逐个回写，被独占的block不算错误
+    if (count == 1 || run[0].desp->blockid == 0 ||
+        filepool_->mapping(run[0].desp->name)) {
+        int ret = S_OK;
+        for (size_t i = 0; i < count; ++i) {
+            int r = writeBack(run[i].desp);
+            if (r && r != EBUSY && ret == S_OK) ret = r;
+        }
+        return ret;
+    }
+
+    // 同一文件，共享表空间中可能属于不同的表
+    FileRef file(*filepool_, run[0].desp->name);
+    if (!file) return ENOENT;
+
+    // 写的期间持有各block的共享latch；遇到被独占的block，从它断开，两边
+    // 分别回写
+    size_t locked = 0;
+    while (locked < count && run[locked].desp->tryLockShared())
+        ++locked;
+    if (locked < count) {
+        for (size_t i = 0; i < locked; ++i)
+            run[i].desp->unlockShared();
+        int ret = locked ? writeRun(run, locked) : S_OK;
+        size_t rest = count - locked - 1;
+        int r = rest ? writeRun(run + locked + 1, rest) : S_OK;
+        return ret ? ret : r;
+    }
+
+    // 先清除脏标记再复制，写的期间再标脏的修改留到下次回写
+    for (size_t i = 0; i < count; ++i)
+        run[i].desp->type &= ~BUFFER_DIRTY;
+    std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    std::vector<struct iovec> iov(count);
+    for (size_t i = 0; i < count; ++i) {
+        iov[i].iov_base = run[i].desp->buffer;
+        iov[i].iov_len = BLOCK_SIZE;
+    }
+    int ret = file->writev(run[0].offset, &iov[0], count);
+    for (size_t i = 0; i < count; ++i) {
+        if (ret) run[i].desp->type |= BUFFER_DIRTY;
+        run[i].desp->unlockShared();
+    }
+    if (ret == S_OK) ++epoch_;
+    Counters &counter = counters();
+    bump(counter.writes, count);
+    bump(counter.writeIos);
+    bump(counter.writeBytes, count * BLOCK_SIZE);
+    bump(counter.writeNanos, elapsed(start));
+    return ret;
+}
+
+int Buffer::flush(const char *file)
+{
+    std::lock_guard<std::recursive_mutex> guard(latch_);
+
+    // 收集脏block，按所在文件+偏移量排序；共享表空间中各表的block排成一个写流
+    std::vector<DirtyBlock> dirty;
+    for (BufDesp *desp = lru_.next; desp; desp = desp->next) {
+        if (!(desp->type & BUFFER_DIRTY)) continue;
+        DirtyBlock block;
+        block.desp = desp;
+        block.file = filepool_->fileName(desp->name);
+        block.offset = 0;
+        // 找不到文件的block单独回写，由writeBack报告错误
+        if (block.file == NULL ||
+            filepool_->offset(desp->name, desp->blockid, block.offset))
+            block.file = desp->name;
+        if (file && ::strcmp(block.file, file) != 0) continue;
+        dirty.push_back(block);
+    }
+    std::sort(
+        dirty.begin(),
+        dirty.end(),
+        [](const DirtyBlock &x, const DirtyBlock &y) {
+            int cmp = ::strcmp(x.file, y.file);
+            return cmp < 0 || (cmp == 0 && x.offset < y.offset);
+        });
+
+    // 同一文件中偏移量连续的block合并回写，超块不参与合并
+    int ret = S_OK;
+    size_t i = 0;
+    while (i < dirty.size()) {
+        size_t count = 1;
+        while (i + count < dirty.size() && count < MAX_COALESCE &&
+               dirty[i].desp->blockid && dirty[i + count].desp->blockid &&
+               dirty[i + count].offset ==
+                   dirty[i].offset + count * BLOCK_SIZE &&
+               ::strcmp(dirty[i + count].file, dirty[i].file) == 0)
+            ++count;
+        int r = writeRun(&dirty[i], count);
+        if (r && ret == S_OK) ret = r; // 记录第1个错误，继续回写
+        i += count;
+    }
+    // 回写命名池
+    for (size_t i = 1; i < pools_.size(); ++i) {
+        int r = pools_[i]->flush(file);
+        if (r && ret == S_OK) ret = r;
+    }
+    return ret;
+}
+
 // 全局变量
 Buffer kBuffer;
 
+int Buffer::saveResident(const char *path)
+{
+    std::lock_guard<std::recursive_mutex> guard(latch_);
+
+    // 从lru头部开始，最热的在前
+    std::vector<char> data(sizeof(unsigned int));
+    unsigned int count = 0;
+    for (BufDesp *desp = lru_.next; desp; desp = desp->next, ++count) {
+        size_t pos = data.size();
+        unsigned short length = (unsigned short) ::strlen(desp->name);
+        data.resize(pos + sizeof(length) + length + sizeof(unsigned int));
+        unsigned short belength = htobe16(length);
+        ::memcpy(&data[pos], &belength, sizeof(belength));
+        pos += sizeof(belength);
+        ::memcpy(&data[pos], desp->name, length);
+        pos += length;
+        unsigned int blockid = htobe32(desp->blockid);
+        ::memcpy(&data[pos], &blockid, sizeof(blockid));
+    }
+    count = htobe32(count);
+    ::memcpy(&data[0], &count, sizeof(count));
+
+    // 先删除旧文件，File打开时不截断
+    File::remove(path);
+    File file;
+    int ret = file.open(path);
+    if (ret) return ret;
+    return file.write(0, &data[0], data.size());
+}
+
+void Buffer::keepResident(const char *path, unsigned int interval)
+{
+    std::lock_guard<std::recursive_mutex> guard(latch_);
+    residentPath_ = path;
+    interval_ = interval;
+
+    // 重新设定定时任务，正在执行的任务看到新的interval_后自行设定
+    if (residentTimer_ && kRuntime.cancel(residentTimer_)) residentTimer_ = 0;
+    if (interval_ && residentTimer_ == 0)
+        residentTimer_ = kRuntime.schedule(
+            interval_ * 1000,
+            [this]() { persist(); },
+            Runtime::BACKGROUND,
+            &background_);
+}
+
+void Buffer::persist()
+{
+    std::lock_guard<std::recursive_mutex> guard(latch_);
+    residentTimer_ = 0;
+    if (interval_ == 0) return;
+    saveResident(residentPath_.c_str());
+    residentTimer_ = kRuntime.schedule(
+        interval_ * 1000,
+        [this]() { persist(); },
+        Runtime::BACKGROUND,
+        &background_);
+}
+
+int Buffer::warmup(const char *path, const WarmupOptions &options)
+{
+    if (!warmupStats().done) return EBUSY;
+
+    std::vector<Resident> list;
+    int ret = loadResident(path, list);
+    if (ret) return ret;
+
+    // 只取空闲buffer能容纳的最热部分，再按表名+blockid排序，便于合并读取
+    std::lock_guard<std::recursive_mutex> guard(latch_);
+    warmup_ = WarmupStats();
+    warmup_.listed = list.size();
+    if (list.size() > idleCount_) {
+        warmup_.skipped = list.size() - idleCount_;
+        list.resize(idleCount_);
+    }
+    std::sort(list.begin(), list.end());
+    warmup_.done = false;
+    stopping_ = false;
+    kRuntime.submit(
+        [this, list, options]() { warm(list, options); },
+        Runtime::BACKGROUND,
+        &warming_);
+    return S_OK;
+}
+
+void Buffer::waitWarmup() { kRuntime.wait(warming_); }
+
+WarmupStats Buffer::warmupStats()
+{
+    std::lock_guard<std::recursive_mutex> guard(latch_);
+    return warmup_;
+}
+
+void Buffer::warm(std::vector<Resident> list, WarmupOptions options)
+{
+    size_t batch = options.batch ? options.batch : 1;
+    std::vector<unsigned char> stage(batch * BLOCK_SIZE);
+    std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    unsigned long long bytes = 0;
+
+    size_t i = 0;
+    while (i < list.size() && !stopping_.load()) {
+        // 合并同一张表上连续的block，超块单独读；共享表空间中跨extent时断开
+        const std::string &table = list[i].first;
+        unsigned int blockid = list[i].second;
+        unsigned long long offset = 0;
+        unsigned long long next = 0;
+        int ret = filepool_->offset(table.c_str(), blockid, offset);
+        size_t count = 1;
+        if (blockid && ret == S_OK)
+            while (i + count < list.size() && count < batch &&
+                   list[i + count].first == table &&
+                   list[i + count].second == blockid + count &&
+                   filepool_->offset(
+                       table.c_str(), blockid + (unsigned int) count, next) ==
+                       S_OK &&
+                   next == offset + count * BLOCK_SIZE)
+                ++count;
+        size_t length = count * BLOCK_SIZE;
+
+        unsigned long long epoch;
+        {
+            std::lock_guard<std::recursive_mutex> guard(latch_);
+            epoch = epoch_;
+        }
+
+        // 打开文件和读取时都不持有latch，普通表一次读入，压缩表逐个解压
+        FileRef file;
+        BlockMapping *mapping = NULL;
+        if (ret == S_OK) {
+            file = FileRef(*filepool_, table.c_str());
+            if (!file)
+                ret = ENOENT;
+            else if (blockid)
+                mapping = filepool_->mapping(table.c_str());
+        }
+        ::memset(&stage[0], 0, length);
+        if (ret == S_OK && mapping) {
+            for (size_t k = 0; k < count && ret == S_OK; ++k)
+                ret = mapping->read(
+                    file.get(),
+                    blockid + (unsigned int) k,
+                    &stage[k * BLOCK_SIZE]);
+        } else if (ret == S_OK)
+            ret = file->read(offset, (char *) &stage[0], length);
+
+        {
+            std::lock_guard<std::recursive_mutex> guard(latch_);
+            ++warmup_.reads;
+            warmup_.bytes += length;
+            // 读取期间有回写，数据可能已过时，放弃这一批
+            if (ret || epoch != epoch_)
+                warmup_.skipped += count;
+            else
+                install(table, blockid, count, &stage[0]);
+        }
+        i += count;
+
+        // 限速，不挤占前台的I/O
+        bytes += length;
+        if (options.rate)
+            std::this_thread::sleep_until(
+                start + std::chrono::microseconds(
+                            bytes * 1000000 / (options.rate * 1024 * 1024)));
+    }
+
+    std::lock_guard<std::recursive_mutex> guard(latch_);
+    warmup_.skipped += list.size() - i;
+    warmup_.done = true;
+}
+
+void Buffer::install(
+    const std::string &table,
+    unsigned int blockid,
+    size_t count,
+    const unsigned char *data)
+{
+    for (size_t k = 0; k < count; ++k) {
+        // 已被前台读入，或者池已满
+        BlockMap::key_type key(table, blockid + (unsigned int) k);
+        if (idleCount_ == 0 || map_.find(key) != map_.end()) {
+            ++warmup_.skipped;
+            continue;
+        }
+
+        // 预热的block比前台访问过的冷，挂在lru尾部
+        BufDesp *desp = allocFromIdle();
+        unlinkLru(desp);
+        appendLru(desp);
+        ::memcpy(desp->buffer, data + k * BLOCK_SIZE, BLOCK_SIZE);
+        desp->blockid = key.second;
+        BlockMap::iterator it =
+            map_.insert(BlockMap::value_type(key, desp)).first;
+        desp->name = it->first.first.c_str();
+        cache_.erase(table.c_str(), key.second);
+        ++warmup_.loaded;
+    }
+}
+
+void BufDesp::lockShared()
+{
+    for (unsigned int spin = 0;; ++spin) {
+        int held = latch.load();
+        if (held >= 0 && latch.compare_exchange_weak(held, held + 1)) return;
+        if (spin >= 64) std::this_thread::yield();
+    }
+}
+
+bool BufDesp::tryLockShared()
+{
+    int held = latch.load();
+    while (held >= 0)
+        if (latch.compare_exchange_weak(held, held + 1)) return true;
+    return false;
+}
+
+void BufDesp::lockExclusive()
+{
+    for (unsigned int spin = 0;; ++spin) {
+        int held = 0;
+        if (latch.compare_exchange_weak(held, -1)) return;
+        if (spin >= 64) std::this_thread::yield();
+    }
+}
+
+PageGuard::PageGuard(
+    Buffer &buffer,
+    const char *table,
+    unsigned int blockid,
+    Mode mode,
+    AccessStrategy *strategy)
+    : buffer_(&buffer)
+    , desp_(buffer.borrow(table, blockid, strategy))
+    , mode_(mode)
+{
+    if (desp_ == NULL) return;
+    if (mode_ == EXCLUSIVE)
+        desp_->lockExclusive();
+    else
+        desp_->lockShared();
+}
+
+PageGuard::PageGuard(PageGuard &&other)
+    : buffer_(other.buffer_)
+    , desp_(other.desp_)
+    , mode_(other.mode_)
+{
+    other.desp_ = NULL;
+}
+
+PageGuard &PageGuard::operator=(PageGuard &&other)
+{
+    if (this != &other) {
+        release();
+        buffer_ = other.buffer_;
+        desp_ = other.desp_;
+        mode_ = other.mode_;
+        other.desp_ = NULL;
+    }
+    return *this;
+}
+
+int PageGuard::dirty()
+{
+    if (desp_ == NULL || mode_ != EXCLUSIVE) return EPERM;
+    buffer_->writeBuf(desp_);
+    return S_OK;
+}
+
+void PageGuard::release()
+{
+    if (desp_ == NULL) return;
+    if (mode_ == EXCLUSIVE)
+        desp_->unlockExclusive();
+    else
+        desp_->unlockShared();
+    buffer_->releaseBuf(desp_);
+    desp_ = NULL;
+}
+
 } // namespace db
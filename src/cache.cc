@@ -0,0 +1,132 @@
+////
+// @file cache.cc
+// @brief
+// 实现二级缓存
+//
+// @author niexw
+// @email niexiaowen@uestc.edu.cn
+//
+#include <db/cache.h>
+#include <db/block.h>
+#include <db/compress.h>
+
+namespace db {
+
+void SecondaryCache::init(size_t capacity)
+{
+    std::lock_guard<std::mutex> guard(lock_);
+    capacity_ = capacity;
+    shrink();
+}
+
+void SecondaryCache::insert(
+    const char *table,
+    unsigned int blockid,
+    const unsigned char *buffer)
+{
+    std::lock_guard<std::mutex> guard(lock_);
+    if (!enabled()) return;
+    remove(table, blockid);
+
+    // 压缩，压不下来就原样存放
+    stage_.resize(lzBound(BLOCK_SIZE));
+    size_t len = lzCompress(buffer, BLOCK_SIZE, &stage_[0], BLOCK_SIZE - 1);
+
+    // 插入lru头部
+    lru_.push_front(Entry());
+    Entry &entry = lru_.front();
+    entry.key = Key(table, blockid);
+    if (len)
+        entry.data.assign(stage_.begin(), stage_.begin() + len);
+    else
+        entry.data.assign(buffer, buffer + BLOCK_SIZE);
+    used_ += entry.data.size();
+    index_[entry.key] = lru_.begin();
+    ++stats_.inserts;
+
+    shrink();
+}
+
+bool SecondaryCache::lookup(
+    const char *table,
+    unsigned int blockid,
+    unsigned char *buffer)
+{
+    // 取出数据并移除，block回到Buffer中
+    std::vector<unsigned char> data;
+    {
+        std::lock_guard<std::mutex> guard(lock_);
+        if (!enabled()) return false;
+        Index::iterator it = index_.find(Key(table, blockid));
+        if (it == index_.end()) {
+            ++stats_.misses;
+            return false;
+        }
+        data.swap(it->second->data);
+        used_ -= data.size();
+        lru_.erase(it->second);
+        index_.erase(it);
+    }
+
+    // 在锁外解压，未压缩直接拷贝
+    bool ret;
+    if (data.size() == BLOCK_SIZE) {
+        ::memcpy(buffer, &data[0], BLOCK_SIZE);
+        ret = true;
+    } else
+        ret = lzDecompress(&data[0], data.size(), buffer, BLOCK_SIZE) ==
+              BLOCK_SIZE;
+
+    std::lock_guard<std::mutex> guard(lock_);
+    if (ret)
+        ++stats_.hits;
+    else
+        ++stats_.misses; // 数据损坏，当作未命中
+    return ret;
+}
+
+void SecondaryCache::erase(const char *table, unsigned int blockid)
+{
+    std::lock_guard<std::mutex> guard(lock_);
+    remove(table, blockid);
+}
+
+size_t SecondaryCache::used()
+{
+    std::lock_guard<std::mutex> guard(lock_);
+    return used_;
+}
+
+size_t SecondaryCache::size()
+{
+    std::lock_guard<std::mutex> guard(lock_);
+    return index_.size();
+}
+
+CacheStats SecondaryCache::stats()
+{
+    std::lock_guard<std::mutex> guard(lock_);
+    return stats_;
+}
+
+void SecondaryCache::remove(const char *table, unsigned int blockid)
+{
+    Index::iterator it = index_.find(Key(table, blockid));
+    if (it == index_.end()) return;
+    used_ -= it->second->data.size();
+    lru_.erase(it->second);
+    index_.erase(it);
+}
+
+void SecondaryCache::shrink()
+{
+    while (used_ > capacity_ && !lru_.empty()) {
+        Entry &entry = lru_.back();
+        used_ -= entry.data.size();
+        index_.erase(entry.key);
+        lru_.pop_back();
+        ++stats_.evictions;
+    }
+}
+
+} // namespace db
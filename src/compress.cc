@@ -0,0 +1,300 @@
+////
+// @file compress.cc
+// @brief
+// 实现block压缩
+//
+// @author niexw
+// @email niexiaowen@uestc.edu.cn
+//
+#include <chrono>
+#include <string>
+#include <db/compress.h>
+
+namespace db {
+
+namespace {
+const size_t MIN_MATCH = 4;      // 最短匹配
+const size_t LAST_LITERALS = 5;  // 尾部至少保留的字面数
+const size_t MATCH_LIMIT = 12;   // 距尾部不足该长度时不再查找匹配
+const int HASH_BITS = 12;        // hash表大小
+const size_t MAX_OFFSET = 65535; // offset用2B表示
+
+inline unsigned int read32(const unsigned char *p)
+{
+    unsigned int v;
+    ::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline unsigned int hash4(unsigned int v)
+{
+    return (v * 2654435761U) >> (32 - HASH_BITS);
+}
+
+// 输出变长长度的扩展字节
+inline bool
+putLength(unsigned char *dst, size_t &op, size_t cap, size_t length)
+{
+    while (length >= 255) {
+        if (op >= cap) return false;
+        dst[op++] = 255;
+        length -= 255;
+    }
+    if (op >= cap) return false;
+    dst[op++] = (unsigned char) length;
+    return true;
+}
+
+// 读取变长长度的扩展字节
+inline bool
+getLength(const unsigned char *src, size_t &ip, size_t len, size_t &length)
+{
+    unsigned char b;
+    do {
+        if (ip >= len) return false;
+        b = src[ip++];
+        length += b;
+    } while (b == 255);
+    return true;
+}
+
+// 输出一个sequence，match为0表示最后一个sequence
+bool putSequence(
+    unsigned char *dst,
+    size_t &op,
+    size_t cap,
+    const unsigned char *literal,
+    size_t litlen,
+    size_t offset,
+    size_t match)
+{
+    if (op >= cap) return false;
+    size_t token = op++;
+    unsigned char hi = (unsigned char) (litlen >= 15 ? 15 : litlen);
+    if (litlen >= 15 && !putLength(dst, op, cap, litlen - 15)) return false;
+    if (op + litlen > cap) return false;
+    ::memcpy(dst + op, literal, litlen);
+    op += litlen;
+
+    unsigned char lo = 0;
+    if (match) {
+        if (op + 2 > cap) return false;
+        dst[op++] = (unsigned char) (offset & 0xff);
+        dst[op++] = (unsigned char) (offset >> 8);
+        size_t m = match - MIN_MATCH;
+        lo = (unsigned char) (m >= 15 ? 15 : m);
+        if (m >= 15 && !putLength(dst, op, cap, m - 15)) return false;
+    }
+    dst[token] = (unsigned char) (hi << 4 | lo);
+    return true;
+}
+} // namespace
+
+size_t lzCompress(
+    const unsigned char *src,
+    size_t len,
+    unsigned char *dst,
+    size_t cap)
+{
+    size_t op = 0;
+    size_t anchor = 0;
+    size_t ip = 0;
+
+    if (len > MATCH_LIMIT) {
+        unsigned int table[1 << HASH_BITS] = {};
+        size_t limit = len - MATCH_LIMIT;
+        while (ip < limit) {
+            unsigned int seq = read32(src + ip);
+            unsigned int h = hash4(seq);
+            size_t ref = table[h];
+            table[h] = (unsigned int) ip;
+
+            // 候选位置不匹配，前进一个字节
+            if (ref >= ip || ip - ref > MAX_OFFSET ||
+                read32(src + ref) != seq) {
+                ++ip;
+                continue;
+            }
+
+            // 向后扩展匹配，尾部留出字面
+            size_t match = MIN_MATCH;
+            while (ip + match < len - LAST_LITERALS &&
+                   src[ref + match] == src[ip + match])
+                ++match;
+
+            if (!putSequence(
+                    dst, op, cap, src + anchor, ip - anchor, ip - ref, match))
+                return 0;
+            ip += match;
+            anchor = ip;
+        }
+    }
+
+    // 最后的字面
+    if (!putSequence(dst, op, cap, src + anchor, len - anchor, 0, 0)) return 0;
+    return op;
+}
+
+size_t lzDecompress(
+    const unsigned char *src,
+    size_t len,
+    unsigned char *dst,
+    size_t cap)
+{
+    size_t ip = 0;
+    size_t op = 0;
+
+    while (ip < len) {
+        unsigned char token = src[ip++];
+
+        // 字面
+        size_t litlen = token >> 4;
+        if (litlen == 15 && !getLength(src, ip, len, litlen)) return 0;
+        if (ip + litlen > len || op + litlen > cap) return 0;
+        ::memcpy(dst + op, src + ip, litlen);
+        ip += litlen;
+        op += litlen;
+        if (ip >= len) break; // 最后一个sequence
+
+        // 匹配
+        if (ip + 2 > len) return 0;
+        size_t offset = src[ip] | (src[ip + 1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > op) return 0;
+        size_t match = token & 0x0f;
+        if (match == 15 && !getLength(src, ip, len, match)) return 0;
+        match += MIN_MATCH;
+        if (op + match > cap) return 0;
+        // 允许重叠，逐字节拷贝
+        for (size_t i = 0; i < match; ++i, ++op)
+            dst[op] = dst[op - offset];
+    }
+    return op;
+}
+
+int BlockMapping::open(const char *path, File *data)
+{
+    // 打开map文件
+    std::string mpath(path);
+    mpath += ".map";
+    int ret = map_.open(mpath.c_str());
+    if (ret) return ret;
+
+    // 加载所有条目，大序存放
+    unsigned long long len = 0;
+    ret = map_.length(len);
+    if (ret) return ret;
+    size_t count = (size_t) (len / sizeof(BlockExtent));
+    extents_.assign(count, BlockExtent());
+    tail_ = SUPER_SIZE;
+    if (count) {
+        ret = map_.read(
+            0, (char *) &extents_[0], count * sizeof(BlockExtent));
+        if (ret) return ret;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        BlockExtent &extent = extents_[i];
+        extent.offset = be64toh(extent.offset);
+        extent.length = be32toh(extent.length);
+        extent.capacity = be32toh(extent.capacity);
+        if (extent.offset + extent.capacity > tail_)
+            tail_ = extent.offset + extent.capacity;
+    }
+
+    // 数据文件尾部按扇区对齐
+    ret = data->length(len);
+    if (ret) return ret;
+    len = (len + SECTOR - 1) / SECTOR * SECTOR;
+    if (len > tail_) tail_ = len;
+    return S_OK;
+}
+
+int BlockMapping::read(File *data, unsigned int blockid, unsigned char *buffer)
+{
+    std::lock_guard<std::mutex> guard(lock_);
+    // 从未写过
+    if (blockid >= extents_.size() || extents_[blockid].length == 0) {
+        ::memset(buffer, 0, BLOCK_SIZE);
+        return S_OK;
+    }
+
+    // 未压缩
+    BlockExtent &extent = extents_[blockid];
+    if (extent.length == BLOCK_SIZE)
+        return data->read(extent.offset, (char *) buffer, BLOCK_SIZE);
+
+    stage_.resize(extent.length);
+    int ret = data->read(extent.offset, (char *) &stage_[0], extent.length);
+    if (ret) return ret;
+
+    std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    size_t len = lzDecompress(&stage_[0], extent.length, buffer, BLOCK_SIZE);
+    stats_.decompressNs +=
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start)
+            .count();
+    ++stats_.reads;
+    return len == BLOCK_SIZE ? S_OK : EIO;
+}
+
+int BlockMapping::write(
+    File *data,
+    unsigned int blockid,
+    const unsigned char *buffer)
+{
+    std::lock_guard<std::mutex> guard(lock_);
+    // 压缩，压不下来就原样存放
+    stage_.resize(lzBound(BLOCK_SIZE));
+    std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    size_t len = lzCompress(buffer, BLOCK_SIZE, &stage_[0], BLOCK_SIZE - 1);
+    stats_.compressNs +=
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start)
+            .count();
+    const unsigned char *out = len ? &stage_[0] : buffer;
+    unsigned int length = len ? (unsigned int) len : BLOCK_SIZE;
+
+    // 原地放不下，追加到文件尾部，旧空间暂不回收
+    if (blockid >= extents_.size()) extents_.resize(blockid + 1, BlockExtent());
+    BlockExtent &extent = extents_[blockid];
+    if (extent.capacity < length) {
+        extent.offset = tail_;
+        extent.capacity = (length + SECTOR - 1) / SECTOR * SECTOR;
+        tail_ += extent.capacity;
+    }
+    extent.length = length;
+    int ret = data->write(extent.offset, (const char *) out, length);
+    if (ret) return ret;
+
+    // 更新map条目
+    BlockExtent entry;
+    entry.offset = htobe64(extent.offset);
+    entry.length = htobe32(extent.length);
+    entry.capacity = htobe32(extent.capacity);
+    ret = map_.write(
+        (unsigned long long) blockid * sizeof(BlockExtent),
+        (const char *) &entry,
+        sizeof(BlockExtent));
+    if (ret) return ret;
+
+    ++stats_.blocks;
+    stats_.rawBytes += BLOCK_SIZE;
+    stats_.storedBytes += length;
+    return S_OK;
+}
+
+CompressStats BlockMapping::stats()
+{
+    std::lock_guard<std::mutex> guard(lock_);
+    return stats_;
+}
+
+unsigned long long BlockMapping::tail()
+{
+    std::lock_guard<std::mutex> guard(lock_);
+    return tail_;
+}
+
+} // namespace db
@@ -5,214 +5,24 @@
 // @author niexw
 // @email niexiaowen@uestc.edu.cn
 //
+#include <string.h>
 #include <algorithm>
+#include <vector>
 #include <db/datatype.h>
 #include <db/block.h>
 #include <db/endian.h>
+#include <db/integer.h>
 
 namespace db {
 
+static bool charless(
+    unsigned char *x,
+    unsigned int xlen,
+    unsigned char *y,
+    unsigned int ylen);
+
 // 匿名空间
 namespace {
-struct CharCompare
-{
-    unsigned char *buffer; // buffer指针
-    unsigned int key;      // 键的位置
-
-    bool operator()(const Slot &sx, const Slot &sy)
-    {
-        // 先转化为主机字节序
-        unsigned short x = be16toh(sx.offset);
-        unsigned short y = be16toh(sy.offset);
-
-        // 引用两条记录
-        Record rx, ry;
-        rx.attach(buffer + x, 8);
-        ry.attach(buffer + y, 8);
-        std::vector<struct iovec> iovrx;
-        std::vector<struct iovec> iovry;
-        unsigned char xheader;
-        unsigned char yheader;
-        rx.ref(iovrx, &xheader);
-        ry.ref(iovry, &yheader);
-
-        // 得到x，y
-        const char *xchar = (const char *) iovrx[key].iov_base;
-        const char *ychar = (const char *) iovry[key].iov_base;
-
-        // CHAR长度固定
-        size_t xsize = iovrx[key].iov_len; // 字符串长度
-        return strncmp(xchar, ychar, xsize) < 0;
-    }
-};
-
-struct VarCharCompare
-{
-    unsigned char *buffer; // buffer指针
-    unsigned int key;      // 键的位置
-
-    bool operator()(const Slot &sx, const Slot &sy)
-    {
-        // 先转化为主机字节序
-        unsigned short x = be16toh(sx.offset);
-        unsigned short y = be16toh(sy.offset);
-
-        // 引用两条记录
-        Record rx, ry;
-        rx.attach(buffer + x, 8);
-        ry.attach(buffer + y, 8);
-        std::vector<struct iovec> iovrx;
-        std::vector<struct iovec> iovry;
-        unsigned char xheader;
-        unsigned char yheader;
-        rx.ref(iovrx, &xheader);
-        ry.ref(iovry, &yheader);
-
-        // 得到x，y
-        const char *xchar = (const char *) iovrx[key].iov_base;
-        const char *ychar = (const char *) iovry[key].iov_base;
-        size_t xsize = iovrx[key].iov_len; // x字符串长度
-        size_t ysize = iovry[key].iov_len; // y字符串长度
-
-        // 比较字符串
-        int ret = strncmp(xchar, ychar, xsize);
-        if (ret != 0)
-            return ret == -1 ? true : false; // 已经有结果
-        else if (xsize == ysize)             // 相同
-            return false;
-        else if (xsize < ysize)
-            return true;
-        else
-            return false;
-    }
-};
-
-struct TinyIntCompare
-{
-    unsigned char *buffer; // buffer指针
-    unsigned int key;      // 键的位置
-
-    bool operator()(const Slot &sx, const Slot &sy)
-    {
-        // 先转化为主机字节序
-        unsigned short x = be16toh(sx.offset);
-        unsigned short y = be16toh(sy.offset);
-
-        // 引用两条记录
-        Record rx, ry;
-        rx.attach(buffer + x, 8);
-        ry.attach(buffer + y, 8);
-        std::vector<struct iovec> iovrx;
-        std::vector<struct iovec> iovry;
-        unsigned char xheader;
-        unsigned char yheader;
-        rx.ref(iovrx, &xheader);
-        ry.ref(iovry, &yheader);
-
-        // 得到x，y
-        unsigned char ix = *((const unsigned char *) iovrx[key].iov_base);
-        unsigned char iy = *((const unsigned char *) iovry[key].iov_base);
-
-        return ix < iy;
-    }
-};
-
-struct SmallIntCompare
-{
-    unsigned char *buffer; // buffer指针
-    unsigned int key;      // 键的位置
-
-    bool operator()(const Slot &sx, const Slot &sy)
-    {
-        // 先转化为主机字节序
-        unsigned short x = be16toh(sx.offset);
-        unsigned short y = be16toh(sy.offset);
-
-        // 引用两条记录
-        Record rx, ry;
-        rx.attach(buffer + x, 8);
-        ry.attach(buffer + y, 8);
-        std::vector<struct iovec> iovrx;
-        std::vector<struct iovec> iovry;
-        unsigned char xheader;
-        unsigned char yheader;
-        rx.ref(iovrx, &xheader);
-        ry.ref(iovry, &yheader);
-
-        // 得到x，y
-        unsigned short ix =
-            be16toh(*((const unsigned short *) iovrx[key].iov_base));
-        unsigned short iy =
-            be16toh(*((const unsigned short *) iovry[key].iov_base));
-
-        return ix < iy;
-    }
-};
-
-struct IntCompare
-{
-    unsigned char *buffer; // buffer指针
-    unsigned int key;      // 键的位置
-
-    bool operator()(const Slot &sx, const Slot &sy)
-    {
-        // 先转化为主机字节序
-        unsigned short x = be16toh(sx.offset);
-        unsigned short y = be16toh(sy.offset);
-
-        // 引用两条记录
-        Record rx, ry;
-        rx.attach(buffer + x, 8);
-        ry.attach(buffer + y, 8);
-        std::vector<struct iovec> iovrx;
-        std::vector<struct iovec> iovry;
-        unsigned char xheader;
-        unsigned char yheader;
-        rx.ref(iovrx, &xheader);
-        ry.ref(iovry, &yheader);
-
-        // 得到x，y
-        unsigned int ix =
-            be32toh(*((const unsigned int *) iovrx[key].iov_base));
-        unsigned int iy =
-            be32toh(*((const unsigned int *) iovry[key].iov_base));
-
-        return ix < iy;
-    }
-};
-
-struct BigIntCompare
-{
-    unsigned char *buffer; // buffer指针
-    unsigned int key;      // 键的位置
-
-    bool operator()(const Slot &sx, const Slot &sy)
-    {
-        // 先转化为主机字节序
-        unsigned short x = be16toh(sx.offset);
-        unsigned short y = be16toh(sy.offset);
-
-        // 引用两条记录
-        Record rx, ry;
-        rx.attach(buffer + x, 8);
-        ry.attach(buffer + y, 8);
-        std::vector<struct iovec> iovrx;
-        std::vector<struct iovec> iovry;
-        unsigned char xheader;
-        unsigned char yheader;
-        rx.ref(iovrx, &xheader);
-        ry.ref(iovry, &yheader);
-
-        // 得到x，y
-        unsigned long long ix =
-            be64toh(*((const unsigned long long *) iovrx[key].iov_base));
-        unsigned long long iy =
-            be64toh(*((const unsigned long long *) iovry[key].iov_base));
-
-        return ix < iy;
-    }
-};
-
 struct CharCompare2
 {
     unsigned char *buffer; // buffer指针
@@ -235,9 +45,13 @@ struct CharCompare2
         // 得到x
         const char *xchar = (const char *) iovrx[key].iov_base;
 
-        // CHAR长度固定
+        // CHAR长度固定，与排序一样按charless比较
         size_t xsize = iovrx[key].iov_len; // 字符串长度
-        return strncmp(xchar, val, xsize) < 0;
+        return charless(
+            (unsigned char *) xchar,
+            (unsigned int) xsize,
+            (unsigned char *) val,
+            (unsigned int) size);
     }
 };
 
@@ -264,16 +78,12 @@ struct VarCharCompare2
         const char *xchar = (const char *) iovrx[key].iov_base;
         size_t xsize = iovrx[key].iov_len; // x字符串长度
 
-        // 比较字符串
-        int ret = strncmp(xchar, val, xsize);
-        if (ret != 0)
-            return ret == -1 ? true : false; // 已经有结果
-        else if (xsize == size)              // 相同
-            return false;
-        else if (xsize < size)
-            return true;
-        else
-            return false;
+        // 比较字符串，不能越过任何一方的长度
+        return charless(
+            (unsigned char *) xchar,
+            (unsigned int) xsize,
+            (unsigned char *) val,
+            (unsigned int) size);
     }
 };
 
@@ -379,90 +189,238 @@ struct BigIntCompare2
         return ix < val;
     }
 };
-} // namespace
 
-static void CharSort(unsigned char *block, unsigned int key)
+// 基数排序至多的趟数，再多不如比较排序
+const int RADIX_PASSES = 2;
+
+// 排序的条目：规范化的键和原来的槽位
+struct SortEntry
 {
-    DataHeader *header = reinterpret_cast<DataHeader *>(block);
-    unsigned count = be16toh(header->slots);
-    Slot *slots = reinterpret_cast<Slot *>(
-        block + BLOCK_SIZE - sizeof(int) - count * sizeof(Slot));
+    unsigned long long key; // 规范化的键
+    unsigned short slot;    // 在slots[]中的下标
+};
 
-    CharCompare compare;
-    compare.buffer = block;
-    compare.key = key;
+inline bool operator<(const SortEntry &x, const SortEntry &y)
+{
+    return x.key < y.key;
+}
 
-    std::sort(slots, slots + count, compare);
+// 不分配内存地取出记录的第key个字段，字段偏移的解码与Record::refByIndex一致
+bool keyOf(
+    unsigned char *record,
+    unsigned short length,
+    unsigned int key,
+    unsigned char **pkey,
+    unsigned int *len)
+{
+    // 总长度之后是逆序的各字段偏移，以第0个字段的偏移0结尾；先数出字段个数
+    Integer it;
+    if (!it.decode((char *) record + 1, length - 1)) return false;
+    size_t total = it.get();
+    size_t first = 1 + it.size();
+    size_t start = first;
+    unsigned int count = 0;
+    do {
+        if (start >= length ||
+            !it.decode((char *) record + start, length - start))
+            return false;
+        start += it.size();
+        ++count;
+    } while (it.get() != 0);
+    if (key >= count) return false;
+
+    // 再取第key个和第key + 1个字段的偏移
+    size_t begin = 0, end = total - start;
+    size_t pos = first;
+    for (unsigned int i = 0; i < count; ++i) {
+        it.decode((char *) record + pos, length - pos);
+        pos += it.size();
+        if (i == count - 1 - key)
+            begin = it.get();
+        else if (i + 2 + key == count)
+            end = it.get();
+    }
+    *pkey = record + start + begin;
+    *len = (unsigned int) (end - begin);
+    return true;
 }
 
-static void VarCharSort(unsigned char *block, unsigned int key)
-{
-    DataHeader *header = reinterpret_cast<DataHeader *>(block);
-    unsigned count = be16toh(header->slots);
-    Slot *slots = reinterpret_cast<Slot *>(
-        block + BLOCK_SIZE - sizeof(int) - count * sizeof(Slot));
+// 规范化键：整数键右对齐，值就是键本身；字符串取前8个字节左对齐，不足补0，
+// 按大序读出的整数顺序与memcmp一致，前缀相同的再比较完整的键
+inline unsigned long long
+normalize(unsigned char *pkey, unsigned int len, bool fixed)
+{
+    unsigned char bytes[8] = {0};
+    if (fixed)
+        ::memcpy(bytes + 8 - len, pkey, len);
+    else
+        ::memcpy(bytes, pkey, len < 8 ? len : 8);
+    unsigned long long value;
+    ::memcpy(&value, bytes, sizeof(value));
+    return be64toh(value);
+}
 
-    VarCharCompare compare;
-    compare.buffer = block;
-    compare.key = key;
+// 按键升序排列entries，swap为同样大小的临时空间。一个block中的键通常落在
+// 很窄的区间里，高位字节都相同，只有不同的字节才需要一趟LSD基数排序；需要的
+// 趟数不多于RADIX_PASSES时用基数排序，否则用std::sort
+void sortEntries(SortEntry *entries, SortEntry *swap, unsigned int count)
+{
+    unsigned long long ones = 0, zeros = ~0ULL;
+    for (unsigned int i = 0; i < count; ++i) {
+        ones |= entries[i].key;
+        zeros &= entries[i].key;
+    }
+    unsigned long long diff = ones ^ zeros;
+    int bytes[8], passes = 0;
+    for (int b = 0; b < 8; ++b)
+        if ((diff >> (b * 8)) & 0xff) bytes[passes++] = b;
+    if (passes > RADIX_PASSES) {
+        std::sort(entries, entries + count);
+        return;
+    }
 
-    std::sort(slots, slots + count, compare);
+    unsigned int counts[RADIX_PASSES][256];
+    ::memset(counts, 0, sizeof(counts));
+    for (unsigned int i = 0; i < count; ++i)
+        for (int p = 0; p < passes; ++p)
+            ++counts[p][(entries[i].key >> (bytes[p] * 8)) & 0xff];
+
+    SortEntry *from = entries, *to = swap;
+    for (int p = 0; p < passes; ++p) {
+        unsigned int *c = counts[p];
+        unsigned int sum = 0;
+        for (int d = 0; d < 256; ++d) {
+            unsigned int n = c[d];
+            c[d] = sum;
+            sum += n;
+        }
+        int shift = bytes[p] * 8;
+        for (unsigned int i = 0; i < count; ++i)
+            to[c[(from[i].key >> shift) & 0xff]++] = from[i];
+        std::swap(from, to);
+    }
+    if (from != entries) ::memcpy(entries, from, count * sizeof(SortEntry));
 }
 
-static void TinyIntSort(unsigned char *block, unsigned int key)
+// 前缀相同时按完整的字符串比较，键在block中的位置和长度已取出
+struct FullKeyLess
 {
-    DataHeader *header = reinterpret_cast<DataHeader *>(block);
-    unsigned count = be16toh(header->slots);
-    Slot *slots = reinterpret_cast<Slot *>(
-        block + BLOCK_SIZE - sizeof(int) - count * sizeof(Slot));
+    unsigned char *block;  // block缓冲
+    unsigned short *where; // 键的偏移
+    unsigned short *lens;  // 键的长度
 
-    TinyIntCompare compare;
-    compare.buffer = block;
-    compare.key = key;
+    bool operator()(const SortEntry &x, const SortEntry &y)
+    {
+        return charless(
+            block + where[x.slot],
+            lens[x.slot],
+            block + where[y.slot],
+            lens[y.slot]);
+    }
+};
 
-    std::sort(slots, slots + count, compare);
-}
+// 排序用的临时空间，每个线程一份，按block的记录数增长，不放在栈上
+struct SortScratch
+{
+    std::vector<SortEntry> entries;    // (规范化前缀, 槽位)
+    std::vector<SortEntry> swap;       // 基数排序的另一半
+    std::vector<unsigned short> where; // 键的偏移
+    std::vector<unsigned short> lens;  // 键的长度
 
-static void SmallIntSort(unsigned char *block, unsigned int key)
+    void reserve(unsigned int count)
+    {
+        if (entries.size() >= count) return;
+        entries.resize(count);
+        swap.resize(count);
+        where.resize(count);
+        lens.resize(count);
+    }
+};
+
+// slots[]按键排序：取出(规范化前缀, 槽位)放在线程的临时空间中，排序后写回
+// slots[]，比较时不再解码记录；fixed表示定长整数键
+void normalizedSort(unsigned char *block, unsigned int key, bool fixed)
 {
     DataHeader *header = reinterpret_cast<DataHeader *>(block);
     unsigned count = be16toh(header->slots);
     Slot *slots = reinterpret_cast<Slot *>(
         block + BLOCK_SIZE - sizeof(int) - count * sizeof(Slot));
+    if (count < 2) return;
+
+    static thread_local SortScratch scratch;
+    scratch.reserve(count);
+    SortEntry *entries = scratch.entries.data();
+    SortEntry *swap = scratch.swap.data();
+    unsigned short *where = scratch.where.data();
+    unsigned short *lens = scratch.lens.data();
+    for (unsigned int i = 0; i < count; ++i) {
+        unsigned char *pkey = block;
+        unsigned int len = 0;
+        keyOf(
+            block + be16toh(slots[i].offset),
+            be16toh(slots[i].length),
+            key,
+            &pkey,
+            &len);
+        if (fixed && len > 8) len = 8;
+        entries[i].key = normalize(pkey, len, fixed);
+        entries[i].slot = (unsigned short) i;
+        where[i] = (unsigned short) (pkey - block);
+        lens[i] = (unsigned short) len;
+    }
+    sortEntries(entries, swap, count);
+
+    // 字符串前缀相同的段按完整的键排序
+    if (!fixed) {
+        FullKeyLess less;
+        less.block = block;
+        less.where = where;
+        less.lens = lens;
+        for (unsigned int i = 0; i < count;) {
+            unsigned int j = i + 1;
+            while (j < count && entries[j].key == entries[i].key)
+                ++j;
+            if (j - i > 1) std::sort(entries + i, entries + j, less);
+            i = j;
+        }
+    }
 
-    SmallIntCompare compare;
-    compare.buffer = block;
-    compare.key = key;
-
-    std::sort(slots, slots + count, compare);
+    // swap已用完，借来存放原来的slots[]
+    Slot *copy = reinterpret_cast<Slot *>(swap);
+    ::memcpy(copy, slots, count * sizeof(Slot));
+    for (unsigned int i = 0; i < count; ++i)
+        slots[i] = copy[entries[i].slot];
 }
+} // namespace
 
-static void IntSort(unsigned char *block, unsigned int key)
+static void CharSort(unsigned char *block, unsigned int key)
 {
-    DataHeader *header = reinterpret_cast<DataHeader *>(block);
-    unsigned count = be16toh(header->slots);
-    Slot *slots = reinterpret_cast<Slot *>(
-        block + BLOCK_SIZE - sizeof(int) - count * sizeof(Slot));
+    normalizedSort(block, key, false);
+}
 
-    IntCompare compare;
-    compare.buffer = block;
-    compare.key = key;
+static void VarCharSort(unsigned char *block, unsigned int key)
+{
+    normalizedSort(block, key, false);
+}
 
-    std::sort(slots, slots + count, compare);
+static void TinyIntSort(unsigned char *block, unsigned int key)
+{
+    normalizedSort(block, key, true);
 }
 
-static void BigIntSort(unsigned char *block, unsigned int key)
+static void SmallIntSort(unsigned char *block, unsigned int key)
 {
-    DataHeader *header = reinterpret_cast<DataHeader *>(block);
-    unsigned count = be16toh(header->slots);
-    Slot *slots = reinterpret_cast<Slot *>(
-        block + BLOCK_SIZE - sizeof(int) - count * sizeof(Slot));
+    normalizedSort(block, key, true);
+}
 
-    BigIntCompare compare;
-    compare.buffer = block;
-    compare.key = key;
+static void IntSort(unsigned char *block, unsigned int key)
+{
+    normalizedSort(block, key, true);
+}
 
-    std::sort(slots, slots + count, compare);
+static void BigIntSort(unsigned char *block, unsigned int key)
+{
+    normalizedSort(block, key, true);
 }
 
 static unsigned short
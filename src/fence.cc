@@ -0,0 +1,125 @@
+////
+// @file fence.cc
+// @brief
+// 实现键到block的定位缓存
+//
+// @author niexw
+// @email niexiaowen@uestc.edu.cn
+//
+#include <algorithm>
+#include <db/fence.h>
+
+namespace db {
+
+void FenceCache::init(DataType *type, unsigned int head)
+{
+    type_ = type;
+    head_ = head;
+    valid_ = false;
+    fences_.clear();
+    keys_.clear();
+}
+
+void FenceCache::append(unsigned int blockid, const void *key, unsigned int len)
+{
+    Fence fence;
+    fence.key.assign((const char *) key, len);
+    fence.blockid = blockid;
+    fences_.push_back(fence);
+    keys_[blockid] = fence.key;
+}
+
+void FenceCache::finish()
+{
+    valid_ = true;
+    ++stats_.builds;
+}
+
+void FenceCache::invalidate()
+{
+    valid_ = false;
+    fences_.clear();
+    keys_.clear();
+}
+
+unsigned int FenceCache::find(const void *key, unsigned int len)
+{
+    ++stats_.hits;
+    // 第1个大于key的fence，其前一个即为目标
+    size_t index = upper(key, len);
+    return index ? fences_[index - 1].blockid : head_;
+}
+
+void FenceCache::set(unsigned int blockid, const void *key, unsigned int len)
+{
+    if (!valid_) return;
+    ++stats_.updates;
+
+    // 数据链有序，fence的相对顺序不变，已有的fence原地修改
+    Fences::iterator it = position(blockid);
+    if (it != fences_.end()) {
+        it->key.assign((const char *) key, len);
+        keys_[blockid] = it->key;
+        return;
+    }
+    // 新block按key插入
+    Fence fence;
+    fence.key.assign((const char *) key, len);
+    fence.blockid = blockid;
+    fences_.insert(fences_.begin() + upper(key, len), fence);
+    keys_[blockid] = fence.key;
+}
+
+void FenceCache::drop(unsigned int blockid)
+{
+    if (!valid_) return;
+    Fences::iterator it = position(blockid);
+    if (it == fences_.end()) return;
+    ++stats_.updates;
+    fences_.erase(it);
+    keys_.erase(blockid);
+}
+
+size_t FenceCache::upper(const void *key, unsigned int len)
+{
+    size_t lo = 0, hi = fences_.size();
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        Fence &fence = fences_[mid];
+        if (type_->less(
+                (unsigned char *) key,
+                len,
+                (unsigned char *) fence.key.data(),
+                (unsigned int) fence.key.size()))
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+    return lo;
+}
+
+FenceCache::Fences::iterator FenceCache::position(unsigned int blockid)
+{
+    Keys::iterator kit = keys_.find(blockid);
+    if (kit == keys_.end()) return fences_.end();
+
+    // 第1个不小于该key的fence，key相同时再比较blockid
+    const std::string &key = kit->second;
+    DataType *type = type_;
+    Fences::iterator it = std::lower_bound(
+        fences_.begin(),
+        fences_.end(),
+        key,
+        [type](const Fence &fence, const std::string &key) {
+            return type->less(
+                (unsigned char *) fence.key.data(),
+                (unsigned int) fence.key.size(),
+                (unsigned char *) key.data(),
+                (unsigned int) key.size());
+        });
+    for (; it != fences_.end() && it->key == key; ++it)
+        if (it->blockid == blockid) return it;
+    return fences_.end();
+}
+
+} // namespace db
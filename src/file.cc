@@ -6,8 +6,22 @@
 // @author niexw
 // @email niexiaowen@uestc.edu.cn
 //
+#include <vector>
+#include <chrono>
 #include <db/file.h>
 #include <db/schema.h>
+#include <db/compress.h>
+#include <db/space.h>
+#include <db/runtime.h>
+#include <db/record.h>
+#include <db/buffer.h>
+#if !defined(WIN32)
+#    include <sys/mman.h>
+#    include <sys/stat.h>
+#    include <fcntl.h>
+#    include <unistd.h>
+#    include <errno.h>
+#endif
 
 namespace db {
 
@@ -71,6 +85,26 @@ int File::write(unsigned long long offset, const char *buffer, size_t length)
     // TODO: len == length??
 }
 
+int File::writev(
+    unsigned long long offset,
+    const struct iovec *iov,
+    size_t count)
+{
+    // WriteFileGather要求无缓冲I/O且按页对齐，这里拼接成一段，一次WriteFile
+    if (count == 1)
+        return write(offset, (const char *) iov[0].iov_base, iov[0].iov_len);
+    size_t length = 0;
+    for (size_t i = 0; i < count; ++i)
+        length += iov[i].iov_len;
+    std::vector<char> stage(length);
+    size_t pos = 0;
+    for (size_t i = 0; i < count; ++i) {
+        ::memcpy(&stage[pos], iov[i].iov_base, iov[i].iov_len);
+        pos += iov[i].iov_len;
+    }
+    return write(offset, &stage[0], length);
+}
+
 int File::remove(const char *path)
 {
     // TODO: DeleteFile
@@ -92,28 +126,627 @@ int File::length(unsigned long long &len)
     }
 }
 
+int File::allocate(unsigned long long length)
+{
+    // https://docs.microsoft.com/zh-cn/windows/win32/api/fileapi/nf-fileapi-setfileinformationbyhandle
+    FILE_ALLOCATION_INFO info;
+    info.AllocationSize.QuadPart = (LONGLONG) length;
+    bool ret = ::SetFileInformationByHandle(
+        handle_, FileAllocationInfo, &info, sizeof(info));
+    return ret ? S_OK : ::GetLastError();
+}
+
+int File::sync()
+{
+    // https://docs.microsoft.com/zh-cn/windows/win32/api/fileapi/nf-fileapi-flushfilebuffers
+    bool ret = ::FlushFileBuffers(handle_);
+    return ret ? S_OK : ::GetLastError();
+}
+
+namespace {
+// ntdll中的NtFlushBuffersFileEx，windows 8之前没有
+using NtFlushBuffersFileEx_t =
+    LONG(NTAPI *)(HANDLE, ULONG, PVOID, ULONG, PVOID);
+using RtlNtStatusToDosError_t = ULONG(NTAPI *)(LONG);
+const ULONG FLUSH_FLAGS_FILE_DATA_SYNC_ONLY_ = 0x00000004;
+
+struct NtFlush
+{
+    NtFlushBuffersFileEx_t flush;
+    RtlNtStatusToDosError_t error;
+
+    NtFlush()
+        : flush(NULL)
+        , error(NULL)
+    {
+        HMODULE ntdll = ::GetModuleHandleA("ntdll.dll");
+        if (ntdll == NULL) return;
+        flush = (NtFlushBuffersFileEx_t) ::GetProcAddress(
+            ntdll, "NtFlushBuffersFileEx");
+        error = (RtlNtStatusToDosError_t) ::GetProcAddress(
+            ntdll, "RtlNtStatusToDosError");
+        if (error == NULL) flush = NULL;
+    }
+};
+} // namespace
+
+int File::datasync()
+{
+    // https://docs.microsoft.com/zh-cn/windows-hardware/drivers/ddi/ntifs/nf-ntifs-ntflushbuffersfileex
+    // 只同步数据和读回数据所需的元数据，相当于fdatasync；系统不支持时退回
+    // FlushFileBuffers
+    static const NtFlush nt;
+    if (nt.flush == NULL) return sync();
+    // IO_STATUS_BLOCK为一个指针加一个ULONG_PTR
+    ULONG_PTR iosb[2] = {0, 0};
+    LONG status =
+        nt.flush(handle_, FLUSH_FLAGS_FILE_DATA_SYNC_ONLY_, NULL, 0, iosb);
+    return status >= 0 ? S_OK : (int) nt.error(status);
+}
+
+#if defined(WIN32)
+int MappedFile::open(const char *path)
+{
+    // 顺序扫描标志让缓存管理器加大预读，相当于MADV_SEQUENTIAL
+    file_ = ::CreateFileA(
+        path,
+        GENERIC_READ,
+        FILE_SHARE_READ | FILE_SHARE_WRITE,
+        NULL,
+        OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN,
+        NULL);
+    if (file_ == INVALID_HANDLE_VALUE) return ::GetLastError();
+
+    int ret = S_OK;
+    LARGE_INTEGER size;
+    if (!::GetFileSizeEx(file_, &size))
+        ret = ::GetLastError();
+    else if (size.QuadPart == 0)
+        ret = EINVAL;
+    else if (
+        (mapping_ = ::CreateFileMappingA(
+             file_, NULL, PAGE_READONLY, 0, 0, NULL)) == NULL)
+        ret = ::GetLastError();
+    else if (
+        (base_ = (unsigned char *) ::MapViewOfFile(
+             mapping_, FILE_MAP_READ, 0, 0, 0)) == NULL)
+        ret = ::GetLastError();
+    if (ret) {
+        close();
+        return ret;
+    }
+    length_ = (unsigned long long) size.QuadPart;
+    return S_OK;
+}
+
+void MappedFile::close()
+{
+    if (base_) ::UnmapViewOfFile(base_);
+    if (mapping_) ::CloseHandle(mapping_);
+    if (file_ != INVALID_HANDLE_VALUE) ::CloseHandle(file_);
+    base_ = NULL;
+    length_ = 0;
+    mapping_ = NULL;
+    file_ = INVALID_HANDLE_VALUE;
+}
+
+int MappedFile::prefetch(unsigned long long offset, unsigned long long length)
+{
+    if (offset >= length_) return S_OK;
+    if (length > length_ - offset) length = length_ - offset;
+    // https://docs.microsoft.com/zh-cn/windows/win32/api/memoryapi/nf-memoryapi-prefetchvirtualmemory
+    WIN32_MEMORY_RANGE_ENTRY entry;
+    entry.VirtualAddress = base_ + offset;
+    entry.NumberOfBytes = (SIZE_T) length;
+    bool ret = ::PrefetchVirtualMemory(::GetCurrentProcess(), 1, &entry, 0);
+    return ret ? S_OK : ::GetLastError();
+}
+
+#else
+int MappedFile::open(const char *path)
+{
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0) return errno;
+    struct stat st;
+    int ret = ::fstat(fd, &st) ? errno : S_OK;
+    if (ret == S_OK && st.st_size == 0) ret = EINVAL;
+    if (ret == S_OK) {
+        // 映射建立后即可关闭描述符
+        void *ptr =
+            ::mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (ptr == MAP_FAILED)
+            ret = errno;
+        else {
+            base_ = (unsigned char *) ptr;
+            length_ = (unsigned long long) st.st_size;
+            ::madvise(base_, (size_t) length_, MADV_SEQUENTIAL);
+        }
+    }
+    ::close(fd);
+    return ret;
+}
+
+void MappedFile::close()
+{
+    if (base_) ::munmap(base_, (size_t) length_);
+    base_ = NULL;
+    length_ = 0;
+}
+
+int MappedFile::prefetch(unsigned long long offset, unsigned long long length)
+{
+    if (offset >= length_) return S_OK;
+    if (length > length_ - offset) length = length_ - offset;
+    // madvise要求起始地址按页对齐
+    unsigned long long page = (unsigned long long) ::sysconf(_SC_PAGESIZE);
+    unsigned long long start = offset / page * page;
+    int ret = ::madvise(
+        base_ + start, (size_t) (offset + length - start), MADV_WILLNEED);
+    return ret ? errno : S_OK;
+}
+
+#endif
+
+FilePool::~FilePool()
+{
+    for (Mappings::iterator it = mappings_.begin(); it != mappings_.end();
+         ++it)
+        delete it->second;
+    for (Spaces::iterator it = spaces_.begin(); it != spaces_.end(); ++it)
+        delete it->second;
+    for (Segments::iterator it = segments_.begin(); it != segments_.end();
+         ++it)
+        delete it->second;
+}
+
 void FilePool ::init(Schema *schema) { schema_ = schema; }
 
-File *FilePool::open(const char *table)
+FilePool::Handle *FilePool::acquire(const char *table)
 {
-    // 先查询表是否打开
-    std::map<const char *, File>::iterator it = map_.find(table);
-    // 找到，直接返回
-    if (it != map_.end()) return &it->second;
+    std::lock_guard<std::mutex> lock(lock_);
+    Handle *handle = lookup(table);
+    if (handle && handle->refs++ == 0) ++stats_.pinned;
+    return handle;
+}
+
+void FilePool::release(Handle *handle)
+{
+    std::lock_guard<std::mutex> lock(lock_);
+    if (--handle->refs == 0) --stats_.pinned;
+    // 引用期间可能超出容量，释放后补关
+    if (capacity_ && map_.size() > capacity_) shrink(capacity_);
+}
+
+void FilePool::setCapacity(size_t capacity)
+{
+    std::lock_guard<std::mutex> lock(lock_);
+    capacity_ = capacity;
+    if (capacity_) shrink(capacity_);
+}
+
+FileStats FilePool::stats()
+{
+    std::lock_guard<std::mutex> lock(lock_);
+    stats_.opened = map_.size();
+    return stats_;
+}
+
+FilePool::Handle *FilePool::lookup(const char *table)
+{
+    // 先查询表是否打开，共享表空间中的表再按表空间名查询
+    Handles::iterator it = map_.find(table);
+    if (it == map_.end()) {
+        table = fileName(table);
+        if (table == NULL) return NULL; // 表不存在
+        it = map_.find(table);
+    }
+    // 找到则移动到lru头部
+    if (it != map_.end()) {
+        ++stats_.hits;
+        lru_.splice(lru_.begin(), lru_, it->second.lru);
+        return &it->second;
+    }
+    ++stats_.misses;
 
     // 未找到，先查schema得到路径
     std::pair<Schema::TableSpace::iterator, bool> bret = schema_->lookup(table);
+
+    // 为新文件腾出位置
+    if (capacity_) shrink(capacity_ - 1);
+
+    // 在map中增加项，直接在项中打开表文件
+    Handle &handle = map_[table];
+    int ret = handle.file.open(bret.first->second.path.c_str());
+    if (ret) {
+        map_.erase(table);
+        return NULL; // 文件打开失败
+    }
+    handle.lru = lru_.insert(lru_.begin(), table);
+    return &handle;
+}
+
+SharedSpace *FilePool::space(unsigned short spaceid, File *file)
+{
+    Spaces::iterator it = spaces_.find(spaceid);
+    if (it != spaces_.end()) return it->second;
+
+    SharedSpace *space = new SharedSpace;
+    if (space->open(file, spaceid)) {
+        delete space;
+        return NULL;
+    }
+    spaces_[spaceid] = space;
+    return space;
+}
+
+void FilePool::shrink(size_t limit)
+{
+    // 从lru尾部找没有引用的文件关闭
+    Lru::iterator it = lru_.end();
+    while (map_.size() > limit && it != lru_.begin()) {
+        --it;
+        Handles::iterator hit = map_.find(*it);
+        if (hit->second.refs) continue;
+        it = lru_.erase(it);
+        map_.erase(hit);
+        ++stats_.closes;
+    }
+}
+
+BlockMapping *FilePool::mapping(const char *table)
+{
+    std::lock_guard<std::mutex> lock(lock_);
+    // 先查缓存，非压缩表也缓存为NULL
+    Mappings::iterator it = mappings_.find(table);
+    if (it != mappings_.end()) return it->second;
+
+    // 查schema，确定是否为压缩表
+    std::pair<Schema::TableSpace::iterator, bool> bret = schema_->lookup(table);
     if (!bret.second) return NULL; // 表不存在
+    RelationInfo &info = bret.first->second;
+    if (!(info.type & TABLE_COMPRESSED)) {
+        mappings_[table] = NULL;
+        return NULL;
+    }
+
+    // 打开数据文件和map文件
+    Handle *handle = lookup(table);
+    if (handle == NULL) return NULL;
+    BlockMapping *mapping = new BlockMapping;
+    if (mapping->open(info.path.c_str(), &handle->file)) {
+        delete mapping;
+        return NULL;
+    }
+    mappings_[table] = mapping;
+    return mapping;
+}
+
+unsigned short FilePool::poolOf(const char *table)
+{
+    std::pair<Schema::TableSpace::iterator, bool> bret = schema_->lookup(table);
+    return bret.second ? bret.first->second.pool() : 0;
+}
+
+void FilePool::report()
+{
+    // 在锁内复制各压缩表的统计，mapping()可能同时插入
+    std::vector<std::pair<std::string, CompressStats>> tables;
+    {
+        std::lock_guard<std::mutex> lock(lock_);
+        for (Mappings::iterator it = mappings_.begin(); it != mappings_.end();
+             ++it)
+            if (it->second)
+                tables.push_back(
+                    std::make_pair(it->first, it->second->stats()));
+    }
+    for (size_t i = 0; i < tables.size(); ++i) {
+        CompressStats &stats = tables[i].second;
+        printf(
+            "%s: blocks=%llu, ratio=%.2f, compress=%.1fMB/s, "
+            "decompress=%.1fMB/s\n",
+            tables[i].first.c_str(),
+            stats.blocks,
+            stats.ratio(),
+            stats.compressMBps(),
+            stats.decompressMBps());
+    }
+}
+
+const char *FilePool::fileName(const char *table)
+{
+    std::pair<Schema::TableSpace::iterator, bool> bret = schema_->lookup(table);
+    if (!bret.second) return NULL;
+    if (!bret.first->second.shared()) return bret.first->first.c_str();
+    bret = schema_->lookupSpace(bret.first->second.space);
+    return bret.second ? bret.first->first.c_str() : NULL;
+}
+
+int FilePool::segment(const char *table, Segment *&segment)
+{
+    // 先查缓存，独占文件的表也缓存为NULL
+    Segments::iterator it = segments_.find(table);
+    if (it != segments_.end())
+        segment = it->second;
+    else {
+        std::pair<Schema::TableSpace::iterator, bool> bret =
+            schema_->lookup(table);
+        if (!bret.second) return ENOENT; // 表不存在
+        RelationInfo &info = bret.first->second;
+        segment = NULL;
+        if (info.shared()) {
+            Handle *handle = lookup(table);
+            if (handle == NULL) return ENOENT;
+            segment = new Segment;
+            int ret = segment->open(&handle->file, info.space, info.root);
+            if (ret) {
+                delete segment;
+                return ret;
+            }
+        }
+        segments_[table] = segment;
+    }
+    return S_OK;
+}
+
+int FilePool::offset(
+    const char *table,
+    unsigned int blockid,
+    unsigned long long &offset)
+{
+    std::lock_guard<std::mutex> lock(lock_);
+    Segment *seg;
+    int ret = segment(table, seg);
+    if (ret) return ret;
+
+    // 独占文件，超块在头部，其后依次存放block
+    if (seg == NULL) {
+        offset = 0;
+        if (blockid)
+            offset = (unsigned long long) blockid * BLOCK_SIZE + SUPER_SIZE;
+        return S_OK;
+    }
+    // 共享表空间，段内换算
+    return seg->offset(blockid, offset);
+}
+
+int FilePool::extend(const char *table, unsigned int blockid)
+{
+    std::lock_guard<std::mutex> lock(lock_);
+    Segment *seg;
+    int ret = segment(table, seg);
+    if (ret || seg == NULL) return ret;
+
+    Handle *handle = lookup(table);
+    if (handle == NULL) return ENOENT;
+    SharedSpace *shared = space(seg->spaceid(), &handle->file);
+    if (shared == NULL) return EIO;
+    return seg->extend(&handle->file, shared, blockid);
+}
+
+int FilePool::extend(unsigned short spaceid, unsigned int &page)
+{
+    std::lock_guard<std::mutex> lock(lock_);
+    std::pair<Schema::TableSpace::iterator, bool> bret =
+        schema_->lookupSpace(spaceid);
+    if (!bret.second) return ENOENT;
+    Handle *handle = lookup(bret.first->first.c_str());
+    if (handle == NULL) return ENOENT;
+    SharedSpace *shared = space(spaceid, &handle->file);
+    if (shared == NULL) return EIO;
+    return shared->allocate(&handle->file, page);
+}
+
+void FilePool::setCommitOptions(const CommitOptions &options)
+{
+    std::lock_guard<std::mutex> lock(commitLock_);
+    commitOptions_ = options;
+}
+
+int FilePool::commit(const char *table)
+{
+    // 持有引用，刷盘期间文件不会被关闭
+    FileRef file(*this, table);
+    if (!file) return ENOENT;
+    std::unique_lock<std::mutex> lock(commitLock_);
+
+    // 领取票号，唤醒可能在等待队列深度的刷盘线程；同一表空间中的表共用队列
+    std::string name(fileName(table));
+    CommitQueue &queue = queues_[name];
+    if (queue.table.empty()) queue.table = table;
+    unsigned long long ticket = ++queue.ticket;
+    ++commitStats_.requests;
+    commitCond_.notify_all();
+
+    while (queue.synced < ticket) {
+        if (queue.syncing) {
+            commitCond_.wait(lock);
+            continue;
+        }
+
+        // 负责刷盘，先等待更多的请求
+        queue.syncing = true;
+        std::chrono::steady_clock::time_point deadline =
+            std::chrono::steady_clock::now() +
+            std::chrono::microseconds(commitOptions_.interval);
+        commitCond_.wait_until(lock, deadline, [&queue, this]() {
+            return queue.ticket - queue.synced >= commitOptions_.depth;
+        });
+
+        // 刷盘时不持有锁，新来的请求留给下一次
+        unsigned long long upto = queue.ticket;
+        lock.unlock();
+        int ret = syncFile(table);
+        lock.lock();
+        complete(name, queue, upto, ret, lock);
+    }
+
+    // 取走所在一轮的结果，最后一个取走的请求删除该轮
+    std::map<unsigned long long, CommitQueue::Round>::iterator it =
+        queue.rounds.lower_bound(ticket);
+    int ret = it->second.status;
+    if (--it->second.pending == 0) queue.rounds.erase(it);
+    return ret;
+}
+
+void FilePool::commitAsync(const char *table, const CommitCallback &done)
+{
+    if (fileName(table) == NULL) {
+        if (done) done(ENOENT);
+        return;
+    }
+    std::unique_lock<std::mutex> lock(commitLock_);
+    std::string name(fileName(table));
+    CommitQueue &queue = queues_[name];
+    if (queue.table.empty()) queue.table = table;
+    unsigned long long ticket = ++queue.ticket;
+    ++commitStats_.requests;
+    queue.callbacks.push_back(std::make_pair(ticket, done));
+    // 同步请求的刷盘线程可能在等待队列深度
+    commitCond_.notify_all();
 
-    // 打开表文件
-    File file;
-    int ret = file.open(bret.first->second.path.c_str());
-    if (ret) return NULL; // 文件打开失败
+    // 正在刷盘时，本轮结束后由complete再设定；否则设定定时任务，达到深度时
+    // 另外立即提交一个刷盘任务
+    if (queue.syncing) return;
+    bool timer = !queue.armed;
+    bool now = !queue.kicked &&
+               queue.ticket - queue.synced >= commitOptions_.depth;
+    queue.armed = true;
+    if (now) queue.kicked = true;
+    unsigned int delay = (commitOptions_.interval + 999) / 1000;
+    lock.unlock();
 
-    // 在map中增加项
-    map_[table] = file;
-    file.handle_ = INVALID_HANDLE_VALUE; // 防止析构函数动作
-    return &map_[table];
+    if (now) arm(name, true, 0);
+    if (timer) arm(name, false, delay);
+}
+
+void FilePool::flushCommits()
+{
+    std::vector<std::string> files;
+    {
+        std::lock_guard<std::mutex> lock(commitLock_);
+        for (CommitQueues::iterator it = queues_.begin(); it != queues_.end();
+             ++it)
+            if (it->second.synced < it->second.ticket)
+                files.push_back(it->first);
+    }
+    for (size_t i = 0; i < files.size(); ++i)
+        syncRound(files[i], false);
+}
+
+int FilePool::syncFile(const char *table)
+{
+    // 持有引用，刷盘期间文件不会被关闭；buffer中的脏block先落到文件
+    FileRef file(*this, table);
+    if (!file) return ENOENT;
+    int ret = S_OK;
+    if (kBuffer.filePool() == this) ret = kBuffer.flush(fileName(table));
+    int sret = file->datasync();
+    return ret == S_OK ? sret : ret;
+}
+
+void FilePool::syncRound(const std::string &file, bool timer)
+{
+    std::unique_lock<std::mutex> lock(commitLock_);
+    CommitQueue &queue = queues_[file];
+    if (timer)
+        queue.armed = false;
+    else
+        queue.kicked = false;
+    // 同步请求的刷盘线程正在负责，或者没有未刷盘的请求
+    if (queue.syncing || queue.synced == queue.ticket) return;
+
+    queue.syncing = true;
+    unsigned long long upto = queue.ticket;
+    std::string table(queue.table);
+    lock.unlock();
+    int ret = syncFile(table.c_str());
+    lock.lock();
+    complete(file, queue, upto, ret, lock);
+}
+
+void FilePool::complete(
+    const std::string &file,
+    CommitQueue &queue,
+    unsigned long long upto,
+    int ret,
+    std::unique_lock<std::mutex> &lock)
+{
+    // 本轮覆盖的异步请求直接取走结果，其余留给同步等待者
+    std::vector<CommitCallback> done;
+    while (!queue.callbacks.empty() && queue.callbacks.front().first <= upto) {
+        done.push_back(queue.callbacks.front().second);
+        queue.callbacks.pop_front();
+    }
+    unsigned long long pending = upto - queue.synced - done.size();
+    if (pending) {
+        CommitQueue::Round &round = queue.rounds[upto];
+        round.status = ret;
+        round.pending = pending;
+    }
+    queue.synced = upto;
+    queue.syncing = false;
+    ++commitStats_.syncs;
+    commitCond_.notify_all();
+
+    // 刷盘期间到达的异步请求还没有定时任务
+    bool timer = false, now = false;
+    if (!queue.callbacks.empty()) {
+        timer = !queue.armed;
+        now = !queue.kicked &&
+              queue.ticket - queue.synced >= commitOptions_.depth;
+        queue.armed = true;
+        if (now) queue.kicked = true;
+    }
+    unsigned int delay = (commitOptions_.interval + 999) / 1000;
+
+    lock.unlock();
+    for (size_t i = 0; i < done.size(); ++i)
+        if (done[i]) done[i](ret);
+    if (now) arm(file, true, 0);
+    if (timer) arm(file, false, delay);
+    lock.lock();
+}
+
+void FilePool::arm(const std::string &file, bool now, unsigned int delay)
+{
+    Runtime::Task task = [this, file, now]() { syncRound(file, !now); };
+    if (now)
+        kRuntime.submit(task, Runtime::BACKGROUND);
+    // 运行时已停止时定时任务不会执行，直接刷盘
+    else if (kRuntime.schedule(delay, task) == 0)
+        task();
+}
+
+CommitStats FilePool::commitStats()
+{
+    std::lock_guard<std::mutex> lock(commitLock_);
+    return commitStats_;
+}
+
+FileRef::FileRef(FileRef &&other)
+    : pool_(other.pool_)
+    , handle_(other.handle_)
+{
+    other.handle_ = NULL;
+}
+
+FileRef &FileRef::operator=(FileRef &&other)
+{
+    if (this != &other) {
+        release();
+        pool_ = other.pool_;
+        handle_ = other.handle_;
+        other.handle_ = NULL;
+    }
+    return *this;
+}
+
+void FileRef::release()
+{
+    if (handle_ == NULL) return;
+    pool_->release(handle_);
+    handle_ = NULL;
 }
 
 // 全局文件池
@@ -0,0 +1,276 @@
+////
+// @file predicate.cc
+// @brief
+// 谓词核函数的标量实现和运行时分派
+//
+// @author niexw
+// @email niexiaowen@uestc.edu.cn
+//
+#include <string.h>
+#include <db/predicate.h>
+#include "simd.h"
+#if DB_SIMD_X86 && defined(_MSC_VER)
+#    include <intrin.h>
+#endif
+
+namespace db {
+
+namespace {
+
+template <typename T>
+void compareScalar(
+    const void *values,
+    size_t rows,
+    CompareOp op,
+    unsigned long long value,
+    unsigned long long *bitmap)
+{
+    compareTail((const T *) values, 0, rows, op, (T) value, bitmap);
+}
+
+template <typename T>
+void betweenScalar(
+    const void *values,
+    size_t rows,
+    unsigned long long lo,
+    unsigned long long hi,
+    unsigned long long *bitmap)
+{
+    betweenTail((const T *) values, 0, rows, (T) lo, (T) hi, bitmap);
+}
+
+template <typename T>
+void inScalar(
+    const void *values,
+    size_t rows,
+    const unsigned long long *list,
+    size_t count,
+    unsigned long long *bitmap)
+{
+    inTail((const T *) values, 0, rows, list, count, bitmap);
+}
+
+const IntKernels kScalarKernels[4] = {
+    {compareScalar<unsigned char>,
+     betweenScalar<unsigned char>,
+     inScalar<unsigned char>},
+    {compareScalar<unsigned short>,
+     betweenScalar<unsigned short>,
+     inScalar<unsigned short>},
+    {compareScalar<unsigned int>,
+     betweenScalar<unsigned int>,
+     inScalar<unsigned int>},
+    {compareScalar<unsigned long long>,
+     betweenScalar<unsigned long long>,
+     inScalar<unsigned long long>},
+};
+
+// 检测CPU和操作系统都支持的指令集
+SimdLevel detect()
+{
+#if DB_SIMD_X86 && defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    int max = info[0];
+    __cpuid(info, 1);
+    bool sse42 = (info[2] >> 20) & 1;
+    bool osxsave = (info[2] >> 27) & 1;
+    // 操作系统保存了YMM(位1、2)和ZMM(位5、6、7)状态才能用AVX2/AVX-512
+    unsigned long long xcr0 = osxsave ? _xgetbv(0) : 0;
+    bool avx2 = false, avx512 = false;
+    if (max >= 7) {
+        __cpuidex(info, 7, 0);
+        avx2 = (xcr0 & 0x6) == 0x6 && ((info[1] >> 5) & 1);
+        avx512 = (xcr0 & 0xe6) == 0xe6 && ((info[1] >> 16) & 1) &&
+                 ((info[1] >> 30) & 1);
+    }
+    if (avx512) return SIMD_AVX512;
+    if (avx2) return SIMD_AVX2;
+    if (sse42) return SIMD_SSE42;
+#elif DB_SIMD_X86 && (defined(__GNUC__) || defined(__clang__))
+    // gcc的检测已包含操作系统是否保存了相应的寄存器状态
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw"))
+        return SIMD_AVX512;
+    if (__builtin_cpu_supports("avx2")) return SIMD_AVX2;
+    if (__builtin_cpu_supports("sse4.2")) return SIMD_SSE42;
+#endif
+    return SIMD_SCALAR;
+}
+
+const SimdLevel kCpuLevel = detect(); // CPU支持的指令集
+SimdLevel gLevel = kCpuLevel;         // 当前使用的指令集
+
+// 各指令集的核函数表
+const IntKernels *kernelsOf(SimdLevel level)
+{
+    switch (level) {
+#if DB_SIMD_X86
+    case SIMD_AVX512:
+        return kAvx512Kernels;
+    case SIMD_AVX2:
+        return kAvx2Kernels;
+    case SIMD_SSE42:
+        return kSse42Kernels;
+#endif
+    default:
+        return kScalarKernels;
+    }
+}
+
+// 按列向量准备位图，返回整数核函数
+const IntKernels *prepare(ColumnVector &column, Bitmap &bitmap)
+{
+    bitmap.assign((column.size() + 63) / 64, 0);
+    return findKernels(column.type_);
+}
+} // namespace
+
+SimdLevel cpuSimdLevel() { return kCpuLevel; }
+SimdLevel simdLevel() { return gLevel; }
+
+SimdLevel setSimdLevel(SimdLevel level)
+{
+    gLevel = level < kCpuLevel ? level : kCpuLevel;
+    return gLevel;
+}
+
+const IntKernels *findKernels(DataType *type)
+{
+    // 按宽度选择，与ColumnVector::init中的定长判断一致
+    const IntKernels *kernels = kernelsOf(gLevel);
+    switch (type->size) {
+    case 1:
+        return &kernels[0];
+    case 2:
+        return &kernels[1];
+    case 4:
+        return &kernels[2];
+    case 8:
+        return &kernels[3];
+    default:
+        return NULL;
+    }
+}
+
+void filterCompare(
+    ColumnVector &column,
+    CompareOp op,
+    unsigned long long value,
+    Bitmap &bitmap)
+{
+    const IntKernels *kernels = prepare(column, bitmap);
+    if (kernels)
+        kernels->compare(
+            column.values_.data(), column.size(), op, value, bitmap.data());
+}
+
+void filterBetween(
+    ColumnVector &column,
+    unsigned long long lo,
+    unsigned long long hi,
+    Bitmap &bitmap)
+{
+    const IntKernels *kernels = prepare(column, bitmap);
+    if (kernels)
+        kernels->between(
+            column.values_.data(), column.size(), lo, hi, bitmap.data());
+}
+
+void filterIn(
+    ColumnVector &column,
+    const std::vector<unsigned long long> &list,
+    Bitmap &bitmap)
+{
+    const IntKernels *kernels = prepare(column, bitmap);
+    if (kernels)
+        kernels->in(
+            column.values_.data(),
+            column.size(),
+            list.data(),
+            list.size(),
+            bitmap.data());
+}
+
+void filterCompare(
+    ColumnVector &column,
+    CompareOp op,
+    const void *value,
+    unsigned int len,
+    Bitmap &bitmap)
+{
+    bitmap.assign((column.size() + 63) / 64, 0);
+    if (column.width_) return;
+    // 字符串长度不一，逐个调用类型的less，x op y由两次less得到
+    unsigned char *y = (unsigned char *) value;
+    for (size_t row = 0; row < column.size(); ++row) {
+        unsigned int xlen;
+        unsigned char *x = (unsigned char *) column.string(row, &xlen);
+        bool lt = column.type_->less(x, xlen, y, len);
+        bool gt = column.type_->less(y, len, x, xlen);
+        bool hit;
+        switch (op) {
+        case CMP_EQ:
+            hit = !lt && !gt;
+            break;
+        case CMP_NE:
+            hit = lt || gt;
+            break;
+        case CMP_LT:
+            hit = lt;
+            break;
+        case CMP_LE:
+            hit = !gt;
+            break;
+        case CMP_GT:
+            hit = gt;
+            break;
+        default:
+            hit = !lt;
+            break;
+        }
+        bitmap[row / 64] |= (unsigned long long) hit << (row % 64);
+    }
+}
+
+void filterPrefix(
+    ColumnVector &column,
+    const void *prefix,
+    unsigned int len,
+    Bitmap &bitmap)
+{
+    bitmap.assign((column.size() + 63) / 64, 0);
+    if (column.width_) return;
+#if DB_SIMD_X86
+    if (gLevel >= SIMD_SSE42) {
+        prefixSse42(
+            column.bytes_.data(),
+            column.bytes_.size(),
+            column.offsets_.data(),
+            column.size(),
+            (const unsigned char *) prefix,
+            len,
+            bitmap.data());
+        return;
+    }
+#endif
+    for (size_t row = 0; row < column.size(); ++row) {
+        unsigned int xlen;
+        const unsigned char *x = column.string(row, &xlen);
+        bool hit = xlen >= len && ::memcmp(x, prefix, len) == 0;
+        bitmap[row / 64] |= (unsigned long long) hit << (row % 64);
+    }
+}
+
+void select(const Bitmap &bitmap, std::vector<unsigned short> &selection)
+{
+    size_t n = 0;
+    for (size_t i = 0; i < selection.size(); ++i) {
+        unsigned short row = selection[i];
+        selection[n] = row;
+        n += (bitmap[row / 64] >> (row % 64)) & 1;
+    }
+    selection.resize(n);
+}
+
+} // namespace db
@@ -0,0 +1,152 @@
+////
+// @file predicate_avx2.cc
+// @brief
+// AVX2谓词核函数，以-mavx2编译，只在CPU支持时调用
+// 与SSE4.2的实现一样异或符号位后按有符号比较，每次处理32字节。
+//
+// @author niexw
+// @email niexiaowen@uestc.edu.cn
+//
+#include "simd.h"
+
+#if DB_SIMD_X86
+#    include <immintrin.h>
+
+namespace db {
+
+namespace {
+
+struct U8
+{
+    typedef unsigned char Value;
+    typedef __m256i Vec;
+    static const size_t LANES = 32;
+
+    static inline Vec flip() { return _mm256_set1_epi8((char) 0x80); }
+    static inline Vec set1(Value v)
+    {
+        return _mm256_xor_si256(_mm256_set1_epi8((char) v), flip());
+    }
+    static inline Vec load(const Value *p)
+    {
+        return _mm256_xor_si256(
+            _mm256_loadu_si256((const __m256i *) p), flip());
+    }
+    static inline unsigned long long eq(Vec a, Vec b)
+    {
+        return (unsigned) _mm256_movemask_epi8(_mm256_cmpeq_epi8(a, b));
+    }
+    static inline unsigned long long gt(Vec a, Vec b)
+    {
+        return (unsigned) _mm256_movemask_epi8(_mm256_cmpgt_epi8(a, b));
+    }
+};
+
+struct U16
+{
+    typedef unsigned short Value;
+    typedef __m256i Vec;
+    static const size_t LANES = 16;
+
+    static inline Vec flip() { return _mm256_set1_epi16((short) 0x8000); }
+    static inline Vec set1(Value v)
+    {
+        return _mm256_xor_si256(_mm256_set1_epi16((short) v), flip());
+    }
+    static inline Vec load(const Value *p)
+    {
+        return _mm256_xor_si256(
+            _mm256_loadu_si256((const __m256i *) p), flip());
+    }
+    // packs在两个128位的lane内各自压缩，再把两个lane的低64位拼到一起
+    static inline unsigned long long mask(Vec m)
+    {
+        Vec packed = _mm256_permute4x64_epi64(
+            _mm256_packs_epi16(m, _mm256_setzero_si256()), 0xd8);
+        return (unsigned) _mm256_movemask_epi8(packed) & 0xffffu;
+    }
+    static inline unsigned long long eq(Vec a, Vec b)
+    {
+        return mask(_mm256_cmpeq_epi16(a, b));
+    }
+    static inline unsigned long long gt(Vec a, Vec b)
+    {
+        return mask(_mm256_cmpgt_epi16(a, b));
+    }
+};
+
+struct U32
+{
+    typedef unsigned int Value;
+    typedef __m256i Vec;
+    static const size_t LANES = 8;
+
+    static inline Vec flip() { return _mm256_set1_epi32((int) 0x80000000); }
+    static inline Vec set1(Value v)
+    {
+        return _mm256_xor_si256(_mm256_set1_epi32((int) v), flip());
+    }
+    static inline Vec load(const Value *p)
+    {
+        return _mm256_xor_si256(
+            _mm256_loadu_si256((const __m256i *) p), flip());
+    }
+    static inline unsigned long long mask(Vec m)
+    {
+        return (unsigned) _mm256_movemask_ps(_mm256_castsi256_ps(m));
+    }
+    static inline unsigned long long eq(Vec a, Vec b)
+    {
+        return mask(_mm256_cmpeq_epi32(a, b));
+    }
+    static inline unsigned long long gt(Vec a, Vec b)
+    {
+        return mask(_mm256_cmpgt_epi32(a, b));
+    }
+};
+
+struct U64
+{
+    typedef unsigned long long Value;
+    typedef __m256i Vec;
+    static const size_t LANES = 4;
+
+    static inline Vec flip()
+    {
+        return _mm256_set1_epi64x((long long) 0x8000000000000000ULL);
+    }
+    static inline Vec set1(Value v)
+    {
+        return _mm256_xor_si256(_mm256_set1_epi64x((long long) v), flip());
+    }
+    static inline Vec load(const Value *p)
+    {
+        return _mm256_xor_si256(
+            _mm256_loadu_si256((const __m256i *) p), flip());
+    }
+    static inline unsigned long long mask(Vec m)
+    {
+        return (unsigned) _mm256_movemask_pd(_mm256_castsi256_pd(m));
+    }
+    static inline unsigned long long eq(Vec a, Vec b)
+    {
+        return mask(_mm256_cmpeq_epi64(a, b));
+    }
+    static inline unsigned long long gt(Vec a, Vec b)
+    {
+        return mask(_mm256_cmpgt_epi64(a, b));
+    }
+};
+
+} // namespace
+
+const IntKernels kAvx2Kernels[4] = {
+    {compareKernel<U8>, betweenKernel<U8>, inKernel<U8>},
+    {compareKernel<U16>, betweenKernel<U16>, inKernel<U16>},
+    {compareKernel<U32>, betweenKernel<U32>, inKernel<U32>},
+    {compareKernel<U64>, betweenKernel<U64>, inKernel<U64>},
+};
+
+} // namespace db
+
+#endif // DB_SIMD_X86
@@ -0,0 +1,106 @@
+////
+// @file predicate_avx512.cc
+// @brief
+// AVX-512谓词核函数，以-mavx512f -mavx512bw编译，只在CPU支持时调用
+// AVX-512直接有无符号比较，结果就是掩码寄存器，不需要异或符号位和movemask；
+// 8位和16位的比较需要BW。
+//
+// @author niexw
+// @email niexiaowen@uestc.edu.cn
+//
+#include "simd.h"
+
+#if DB_SIMD_X86
+#    include <immintrin.h>
+
+namespace db {
+
+namespace {
+
+struct U8
+{
+    typedef unsigned char Value;
+    typedef __m512i Vec;
+    static const size_t LANES = 64;
+
+    static inline Vec set1(Value v) { return _mm512_set1_epi8((char) v); }
+    static inline Vec load(const Value *p) { return _mm512_loadu_si512(p); }
+    static inline unsigned long long eq(Vec a, Vec b)
+    {
+        return _mm512_cmpeq_epu8_mask(a, b);
+    }
+    static inline unsigned long long gt(Vec a, Vec b)
+    {
+        return _mm512_cmpgt_epu8_mask(a, b);
+    }
+};
+
+struct U16
+{
+    typedef unsigned short Value;
+    typedef __m512i Vec;
+    static const size_t LANES = 32;
+
+    static inline Vec set1(Value v) { return _mm512_set1_epi16((short) v); }
+    static inline Vec load(const Value *p) { return _mm512_loadu_si512(p); }
+    static inline unsigned long long eq(Vec a, Vec b)
+    {
+        return _mm512_cmpeq_epu16_mask(a, b);
+    }
+    static inline unsigned long long gt(Vec a, Vec b)
+    {
+        return _mm512_cmpgt_epu16_mask(a, b);
+    }
+};
+
+struct U32
+{
+    typedef unsigned int Value;
+    typedef __m512i Vec;
+    static const size_t LANES = 16;
+
+    static inline Vec set1(Value v) { return _mm512_set1_epi32((int) v); }
+    static inline Vec load(const Value *p) { return _mm512_loadu_si512(p); }
+    static inline unsigned long long eq(Vec a, Vec b)
+    {
+        return _mm512_cmpeq_epu32_mask(a, b);
+    }
+    static inline unsigned long long gt(Vec a, Vec b)
+    {
+        return _mm512_cmpgt_epu32_mask(a, b);
+    }
+};
+
+struct U64
+{
+    typedef unsigned long long Value;
+    typedef __m512i Vec;
+    static const size_t LANES = 8;
+
+    static inline Vec set1(Value v)
+    {
+        return _mm512_set1_epi64((long long) v);
+    }
+    static inline Vec load(const Value *p) { return _mm512_loadu_si512(p); }
+    static inline unsigned long long eq(Vec a, Vec b)
+    {
+        return _mm512_cmpeq_epu64_mask(a, b);
+    }
+    static inline unsigned long long gt(Vec a, Vec b)
+    {
+        return _mm512_cmpgt_epu64_mask(a, b);
+    }
+};
+
+} // namespace
+
+const IntKernels kAvx512Kernels[4] = {
+    {compareKernel<U8>, betweenKernel<U8>, inKernel<U8>},
+    {compareKernel<U16>, betweenKernel<U16>, inKernel<U16>},
+    {compareKernel<U32>, betweenKernel<U32>, inKernel<U32>},
+    {compareKernel<U64>, betweenKernel<U64>, inKernel<U64>},
+};
+
+} // namespace db
+
+#endif // DB_SIMD_X86
@@ -0,0 +1,188 @@
+////
+// @file predicate_sse42.cc
+// @brief
+// SSE4.2谓词核函数，以-msse4.2编译，只在CPU支持时调用
+// SSE只有有符号比较，载入时异或符号位，按有符号比较的结果即无符号的结果；
+// 64位比较用SSE4.2的pcmpgtq。
+//
+// @author niexw
+// @email niexiaowen@uestc.edu.cn
+//
+#include "simd.h"
+
+#if DB_SIMD_X86
+#    include <string.h>
+#    include <nmmintrin.h>
+
+namespace db {
+
+namespace {
+
+struct U8
+{
+    typedef unsigned char Value;
+    typedef __m128i Vec;
+    static const size_t LANES = 16;
+
+    static inline Vec flip() { return _mm_set1_epi8((char) 0x80); }
+    static inline Vec set1(Value v)
+    {
+        return _mm_xor_si128(_mm_set1_epi8((char) v), flip());
+    }
+    static inline Vec load(const Value *p)
+    {
+        return _mm_xor_si128(_mm_loadu_si128((const __m128i *) p), flip());
+    }
+    static inline unsigned long long eq(Vec a, Vec b)
+    {
+        return (unsigned) _mm_movemask_epi8(_mm_cmpeq_epi8(a, b));
+    }
+    static inline unsigned long long gt(Vec a, Vec b)
+    {
+        return (unsigned) _mm_movemask_epi8(_mm_cmpgt_epi8(a, b));
+    }
+};
+
+struct U16
+{
+    typedef unsigned short Value;
+    typedef __m128i Vec;
+    static const size_t LANES = 8;
+
+    static inline Vec flip() { return _mm_set1_epi16((short) 0x8000); }
+    static inline Vec set1(Value v)
+    {
+        return _mm_xor_si128(_mm_set1_epi16((short) v), flip());
+    }
+    static inline Vec load(const Value *p)
+    {
+        return _mm_xor_si128(_mm_loadu_si128((const __m128i *) p), flip());
+    }
+    // 16位的掩码压成8位后取字节掩码
+    static inline unsigned long long mask(Vec m)
+    {
+        return (unsigned) _mm_movemask_epi8(
+            _mm_packs_epi16(m, _mm_setzero_si128()));
+    }
+    static inline unsigned long long eq(Vec a, Vec b)
+    {
+        return mask(_mm_cmpeq_epi16(a, b));
+    }
+    static inline unsigned long long gt(Vec a, Vec b)
+    {
+        return mask(_mm_cmpgt_epi16(a, b));
+    }
+};
+
+struct U32
+{
+    typedef unsigned int Value;
+    typedef __m128i Vec;
+    static const size_t LANES = 4;
+
+    static inline Vec flip() { return _mm_set1_epi32((int) 0x80000000); }
+    static inline Vec set1(Value v)
+    {
+        return _mm_xor_si128(_mm_set1_epi32((int) v), flip());
+    }
+    static inline Vec load(const Value *p)
+    {
+        return _mm_xor_si128(_mm_loadu_si128((const __m128i *) p), flip());
+    }
+    static inline unsigned long long mask(Vec m)
+    {
+        return (unsigned) _mm_movemask_ps(_mm_castsi128_ps(m));
+    }
+    static inline unsigned long long eq(Vec a, Vec b)
+    {
+        return mask(_mm_cmpeq_epi32(a, b));
+    }
+    static inline unsigned long long gt(Vec a, Vec b)
+    {
+        return mask(_mm_cmpgt_epi32(a, b));
+    }
+};
+
+struct U64
+{
+    typedef unsigned long long Value;
+    typedef __m128i Vec;
+    static const size_t LANES = 2;
+
+    static inline Vec flip()
+    {
+        return _mm_set1_epi64x((long long) 0x8000000000000000ULL);
+    }
+    static inline Vec set1(Value v)
+    {
+        return _mm_xor_si128(_mm_set1_epi64x((long long) v), flip());
+    }
+    static inline Vec load(const Value *p)
+    {
+        return _mm_xor_si128(_mm_loadu_si128((const __m128i *) p), flip());
+    }
+    static inline unsigned long long mask(Vec m)
+    {
+        return (unsigned) _mm_movemask_pd(_mm_castsi128_pd(m));
+    }
+    static inline unsigned long long eq(Vec a, Vec b)
+    {
+        return mask(_mm_cmpeq_epi64(a, b));
+    }
+    static inline unsigned long long gt(Vec a, Vec b)
+    {
+        return mask(_mm_cmpgt_epi64(a, b));
+    }
+};
+
+} // namespace
+
+const IntKernels kSse42Kernels[4] = {
+    {compareKernel<U8>, betweenKernel<U8>, inKernel<U8>},
+    {compareKernel<U16>, betweenKernel<U16>, inKernel<U16>},
+    {compareKernel<U32>, betweenKernel<U32>, inKernel<U32>},
+    {compareKernel<U64>, betweenKernel<U64>, inKernel<U64>},
+};
+
+void prefixSse42(
+    const unsigned char *bytes,
+    size_t size,
+    const unsigned int *offsets,
+    size_t rows,
+    const unsigned char *prefix,
+    unsigned int len,
+    unsigned long long *bitmap)
+{
+    // 前缀不超过16字节时，一次比较16字节，只看前len个字节的结果；载入不能
+    // 越过bytes的末尾，最后几个字符串退回memcmp
+    unsigned char pad[16] = {0};
+    if (len <= 16) ::memcpy(pad, prefix, len);
+    __m128i want = _mm_loadu_si128((const __m128i *) pad);
+    unsigned int need = len >= 16 ? 0xffffu : (1u << len) - 1;
+
+    for (size_t i = 0; i < rows; i += 64) {
+        unsigned long long word = 0;
+        size_t n = rows - i < 64 ? rows - i : 64;
+        for (size_t j = 0; j < n; ++j) {
+            unsigned int begin = offsets[i + j];
+            unsigned int length = offsets[i + j + 1] - begin;
+            bool hit;
+            if (length < len)
+                hit = false;
+            else if (len <= 16 && begin + 16 <= size) {
+                __m128i got =
+                    _mm_loadu_si128((const __m128i *) (bytes + begin));
+                unsigned int same =
+                    (unsigned) _mm_movemask_epi8(_mm_cmpeq_epi8(got, want));
+                hit = (same & need) == need;
+            } else
+                hit = ::memcmp(bytes + begin, prefix, len) == 0;
+            word |= (unsigned long long) hit << j;
+        }
+        bitmap[i / 64] = word;
+    }
+}
+
+} // namespace db
+
+#endif // DB_SIMD_X86
@@ -110,7 +110,7 @@ bool Record::set(std::vector<struct iovec> &iov, const unsigned char *header)
     // 输出padding
     if (total < length_)
         for (size_t i = 0; i < length_ - total; ++i)
-            this->buffer_[length_ - i] = 0;
+            this->buffer_[length_ - 1 - i] = 0;
 
     return true;
 }
@@ -0,0 +1,390 @@
+////
+// @file runtime.cc
+// @brief
+// 实现任务运行时
+//
+// @author niexw
+// @email niexiaowen@uestc.edu.cn
+//
+#include <db/runtime.h>
+#include <db/config.h>
+#include <algorithm>
+#include <chrono>
+
+namespace db {
+
+namespace {
+// 当前线程所属的运行时和worker编号
+thread_local Runtime *tlsRuntime = NULL;
+thread_local int tlsWorker = -1;
+} // namespace
+
+size_t TaskGroup::pending()
+{
+    std::lock_guard<std::mutex> lock(lock_);
+    return pending_;
+}
+
+void TaskGroup::add()
+{
+    std::lock_guard<std::mutex> lock(lock_);
+    ++pending_;
+}
+
+void TaskGroup::done()
+{
+    std::lock_guard<std::mutex> lock(lock_);
+    if (--pending_ == 0) cond_.notify_all();
+}
+
+// 类内给出初值的常量，按引用使用时需要定义
+const unsigned int Runtime::TICK;
+const unsigned int Runtime::WHEEL_SLOTS;
+
+Runtime::Runtime()
+    : state_(IDLE)
+    , pending_(0)
+    , next_(0)
+    , ticking_(false)
+    , wheel_(WHEEL_SLOTS)
+    , armed_(0)
+    , cursor_(0)
+    , timerId_(0)
+    , submitted_(0)
+    , executed_(0)
+    , steals_(0)
+    , timers_(0)
+{}
+
+Runtime::~Runtime()
+{
+    stop();
+    for (size_t i = 0; i < workers_.size(); ++i)
+        delete workers_[i];
+    workers_.clear();
+}
+
+int Runtime::start(unsigned int threads)
+{
+    std::lock_guard<std::mutex> lock(lock_);
+    if (state_ != IDLE) return EEXIST;
+    launch(threads);
+    return S_OK;
+}
+
+void Runtime::launch(unsigned int threads)
+{
+    if (threads == 0) threads = std::thread::hardware_concurrency();
+    if (threads == 0) threads = 1;
+    for (unsigned int i = 0; i < threads; ++i)
+        workers_.push_back(new Worker);
+    state_ = RUNNING;
+    for (unsigned int i = 0; i < threads; ++i)
+        threads_.push_back(std::thread(&Runtime::run, this, i));
+
+    std::lock_guard<std::mutex> lock(timerLock_);
+    ticking_ = true;
+    ticker_ = std::thread(&Runtime::tick, this);
+}
+
+void Runtime::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(lock_);
+        if (state_ == IDLE) state_ = STOPPED;
+        if (state_ != RUNNING) return;
+        state_ = STOPPING;
+    }
+
+    // 先停时钟，丢弃未到期的定时任务，已到期的仍在队列中
+    std::vector<TaskGroup *> groups;
+    {
+        std::lock_guard<std::mutex> lock(timerLock_);
+        ticking_ = false;
+    }
+    timerCond_.notify_all();
+    ticker_.join();
+    {
+        std::lock_guard<std::mutex> lock(timerLock_);
+        for (size_t i = 0; i < wheel_.size(); ++i) {
+            for (Slot::iterator it = wheel_[i].begin(); it != wheel_[i].end();
+                 ++it)
+                if (it->item.group) groups.push_back(it->item.group);
+            wheel_[i].clear();
+        }
+        armed_ = 0;
+    }
+    for (size_t i = 0; i < groups.size(); ++i)
+        groups[i]->done();
+
+    // worker执行完队列中的任务后退出
+    {
+        std::lock_guard<std::mutex> lock(lock_);
+        state_ = STOPPED;
+    }
+    cond_.notify_all();
+    for (size_t i = 0; i < threads_.size(); ++i)
+        threads_[i].join();
+    threads_.clear();
+}
+
+void Runtime::submit(const Task &task, Priority priority, TaskGroup *group)
+{
+    if (group) group->add();
+    ++submitted_;
+    Item item;
+    item.task = task;
+    item.group = group;
+    dispatch(item, priority);
+}
+
+void Runtime::dispatch(Item &item, Priority priority)
+{
+    bool queued;
+    {
+        std::lock_guard<std::mutex> lock(lock_);
+        if (state_ == IDLE) launch(0);
+        // 先计数再入队，worker看到计数不为0就不会退出
+        queued = state_ != STOPPED;
+        if (queued) ++pending_;
+    }
+    if (!queued) {
+        execute(item);
+        return;
+    }
+
+    // worker线程放入自己的队列，外部线程轮流放入各worker的队列
+    size_t index = tlsRuntime == this ? (size_t) tlsWorker
+                                      : next_++ % workers_.size();
+    Worker *worker = workers_[index];
+    {
+        std::lock_guard<std::mutex> lock(worker->lock);
+        worker->tasks[priority].push_back(item);
+    }
+    cond_.notify_one();
+}
+
+void Runtime::wait(TaskGroup &group)
+{
+    {
+        // 还没有启动时，组内不会有任务
+        std::lock_guard<std::mutex> lock(lock_);
+        if (state_ == IDLE) return;
+    }
+    int self = tlsRuntime == this ? tlsWorker : -1;
+    while (true) {
+        {
+            std::lock_guard<std::mutex> lock(group.lock_);
+            if (group.pending_ == 0) return;
+        }
+        // 帮助执行前台任务，worker中等待子任务时不会占住worker
+        Item item;
+        if (take(self, FOREGROUND, item)) {
+            execute(item);
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(group.lock_);
+        group.cond_.wait_for(
+            lock, std::chrono::milliseconds(TICK), [&group]() {
+                return group.pending_ == 0;
+            });
+    }
+}
+
+unsigned long long Runtime::schedule(
+    unsigned int delay,
+    const Task &task,
+    Priority priority,
+    TaskGroup *group)
+{
+    {
+        std::lock_guard<std::mutex> lock(lock_);
+        if (state_ == IDLE) launch(0);
+    }
+
+    std::lock_guard<std::mutex> lock(timerLock_);
+    if (!ticking_) return 0;
+    if (group) group->add();
+    ++submitted_;
+
+    // 到期时刻落在第ticks个刻度，转过的圈数之前每次经过只减圈数
+    unsigned long long ticks = (delay + TICK - 1) / TICK;
+    if (ticks == 0) ticks = 1;
+    Timer timer;
+    timer.id = ++timerId_;
+    timer.rounds = (ticks - 1) / WHEEL_SLOTS;
+    timer.priority = priority;
+    timer.item.task = task;
+    timer.item.group = group;
+    wheel_[(cursor_ + ticks) % WHEEL_SLOTS].push_back(timer);
+    ++armed_;
+    // 时钟线程可能在空等，或者睡到更晚的定时任务
+    timerCond_.notify_one();
+    return timer.id;
+}
+
+bool Runtime::cancel(unsigned long long id)
+{
+    std::lock_guard<std::mutex> lock(timerLock_);
+    for (size_t i = 0; i < wheel_.size(); ++i) {
+        for (Slot::iterator it = wheel_[i].begin(); it != wheel_[i].end();
+             ++it) {
+            if (it->id != id) continue;
+            if (it->item.group) it->item.group->done();
+            wheel_[i].erase(it);
+            --armed_;
+            return true;
+        }
+    }
+    return false;
+}
+
+unsigned int Runtime::workers()
+{
+    std::lock_guard<std::mutex> lock(lock_);
+    return (unsigned int) workers_.size();
+}
+
+RuntimeStats Runtime::stats()
+{
+    RuntimeStats stats;
+    stats.submitted = submitted_.load();
+    stats.executed = executed_.load();
+    stats.steals = steals_.load();
+    stats.timers = timers_.load();
+    return stats;
+}
+
+int Runtime::current() { return tlsWorker; }
+
+bool Runtime::take(int self, Priority lowest, Item &item)
+{
+    size_t count = workers_.size();
+    if (count == 0) return false;
+    for (int priority = FOREGROUND; priority <= lowest; ++priority) {
+        // 自己的队列从尾部取，最近提交的任务数据还在cache中
+        if (self >= 0) {
+            Worker *own = workers_[self];
+            std::lock_guard<std::mutex> lock(own->lock);
+            std::deque<Item> &tasks = own->tasks[priority];
+            if (!tasks.empty()) {
+                item = tasks.back();
+                tasks.pop_back();
+                --pending_;
+                return true;
+            }
+        }
+        // 从其它队列的头部窃取最早提交的任务
+        size_t start = self >= 0 ? (size_t) self + 1 : next_.load();
+        for (size_t i = 0; i < count; ++i) {
+            size_t index = (start + i) % count;
+            if ((int) index == self) continue;
+            Worker *victim = workers_[index];
+            std::lock_guard<std::mutex> lock(victim->lock);
+            std::deque<Item> &tasks = victim->tasks[priority];
+            if (!tasks.empty()) {
+                item = tasks.front();
+                tasks.pop_front();
+                --pending_;
+                if (self >= 0) ++steals_;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+void Runtime::execute(Item &item)
+{
+    item.task();
+    ++executed_;
+    if (item.group) item.group->done();
+}
+
+void Runtime::run(unsigned int index)
+{
+    tlsRuntime = this;
+    tlsWorker = (int) index;
+    while (true) {
+        Item item;
+        if (take((int) index, BACKGROUND, item)) {
+            execute(item);
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(lock_);
+        if (pending_ == 0) {
+            if (state_ == STOPPED) break;
+            cond_.wait(lock);
+        }
+    }
+    tlsRuntime = NULL;
+    tlsWorker = -1;
+}
+
+void Runtime::tick()
+{
+    // base为cursor_所在刻度的时刻
+    std::chrono::steady_clock::time_point base =
+        std::chrono::steady_clock::now();
+    std::unique_lock<std::mutex> lock(timerLock_);
+    while (ticking_) {
+        // 没有定时任务时时间轮不转，设定定时任务时从当前时刻重新计时
+        if (armed_ == 0) {
+            timerCond_.wait(lock);
+            base = std::chrono::steady_clock::now();
+            continue;
+        }
+
+        // 睡到最早的定时任务到期，期间设定新的定时任务时醒来重新计算
+        timerCond_.wait_until(
+            lock, base + std::chrono::milliseconds(nearest() * TICK));
+        if (!ticking_) break;
+
+        // 转到当前刻度，每转一格，圈数为0的到期，其余减一圈
+        std::vector<Timer> due;
+        std::chrono::steady_clock::duration elapsed =
+            std::chrono::steady_clock::now() - base;
+        long long ticks = elapsed / std::chrono::milliseconds(TICK);
+        for (; ticks > 0; --ticks) {
+            base += std::chrono::milliseconds(TICK);
+            cursor_ = (cursor_ + 1) % WHEEL_SLOTS;
+            Slot &slot = wheel_[cursor_];
+            for (Slot::iterator it = slot.begin(); it != slot.end();) {
+                if (it->rounds) {
+                    --it->rounds;
+                    ++it;
+                    continue;
+                }
+                due.push_back(*it);
+                it = slot.erase(it);
+                --armed_;
+            }
+        }
+        if (due.empty()) continue;
+
+        // 提交时不持有时间轮的锁，任务可以再设定定时任务
+        lock.unlock();
+        for (size_t i = 0; i < due.size(); ++i) {
+            ++timers_;
+            dispatch(due[i].item, due[i].priority);
+        }
+        lock.lock();
+    }
+}
+
+unsigned long long Runtime::nearest()
+{
+    // 第d格上的定时任务还要转rounds圈
+    unsigned long long best = ~0ULL;
+    for (unsigned long long d = 1; d <= WHEEL_SLOTS && d < best; ++d) {
+        Slot &slot = wheel_[(cursor_ + d) % WHEEL_SLOTS];
+        for (Slot::iterator it = slot.begin(); it != slot.end(); ++it)
+            best = std::min(best, it->rounds * WHEEL_SLOTS + d);
+    }
+    return best;
+}
+
+// 全局运行时
+Runtime kRuntime;
+
+} // namespace db
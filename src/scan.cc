@@ -0,0 +1,73 @@
+////
+// @file scan.cc
+// @brief
+// 实现并行表扫描的morsel队列
+//
+// @author niexw
+// @email niexiaowen@uestc.edu.cn
+//
+#include <db/scan.h>
+
+namespace db {
+
+MorselQueues::MorselQueues(
+    unsigned int workers,
+    unsigned int first,
+    unsigned int last,
+    unsigned int size)
+    : queues_(workers ? workers : 1)
+{
+    if (size == 0) size = 1;
+    std::vector<Morsel> morsels;
+    for (unsigned long long begin = first; begin <= last; begin += size) {
+        Morsel morsel;
+        morsel.begin = (unsigned int) begin;
+        unsigned long long end = begin + size;
+        morsel.end = (unsigned int) (end > last ? last + 1ULL : end);
+        morsels.push_back(morsel);
+    }
+
+    // 连续的morsel分给同一个worker，顺序读的局部性更好
+    size_t count = queues_.size();
+    for (size_t i = 0; i < morsels.size(); ++i)
+        queues_[i * count / morsels.size()].morsels.push_back(morsels[i]);
+}
+
+bool MorselQueues::pop(unsigned int worker, Morsel &morsel, bool &stolen)
+{
+    stolen = false;
+    Queue &own = queues_[worker % queues_.size()];
+    {
+        std::lock_guard<std::mutex> lock(own.lock);
+        if (!own.morsels.empty()) {
+            morsel = own.morsels.front();
+            own.morsels.pop_front();
+            return true;
+        }
+    }
+
+    // 从下一个worker开始轮流窃取
+    for (size_t i = 1; i < queues_.size(); ++i) {
+        Queue &victim = queues_[(worker + i) % queues_.size()];
+        std::lock_guard<std::mutex> lock(victim.lock);
+        if (!victim.morsels.empty()) {
+            morsel = victim.morsels.back();
+            victim.morsels.pop_back();
+            stolen = true;
+            return true;
+        }
+    }
+    return false;
+}
+
+size_t MorselQueues::size()
+{
+    size_t total = 0;
+    for (size_t i = 0; i < queues_.size(); ++i) {
+        std::lock_guard<std::mutex> lock(queues_[i].lock);
+        total += queues_[i].morsels.size();
+    }
+    return total;
+}
+
+} // namespace db
@@ -12,6 +12,7 @@
 #include <db/record.h>
 #include <db/file.h>
 #include <db/buffer.h>
+#include <db/runtime.h>
 
 namespace db {
 
@@ -23,6 +24,7 @@ void Schema::init(Buffer *buffer)
     buffer_ = buffer;
     // 加入meta
     RelationInfo kMetaInfo(META_FILE);
+    kMetaInfo.space = SPACE_META;
     tablespace_[META_FILE] = kMetaInfo;
     // 打开meta
     open();
@@ -30,10 +32,10 @@ void Schema::init(Buffer *buffer)
 
 void Schema::open()
 {
-    // 读取超块
+    // 读取超块，守卫析构时释放
     SuperBlock super;
-    BufDesp *desp = buffer_->borrow(META_FILE, 0);
-    super.attach(desp->buffer);
+    PageGuard guard(*buffer_, META_FILE, 0, PageGuard::EXCLUSIVE);
+    super.attach(guard.buffer());
 
     // meta未初始化，初始化超块
     if (super.getMagic() != MAGIC_NUMBER) {
@@ -42,7 +44,7 @@ void Schema::open()
         super.setMaxid(1);   // 设定maxid
         super.setChecksum(); // 重新计算校验和
 
-        buffer_->writeBuf(desp); // 写超块
+        guard.dirty(); // 写超块
         first_ = 1;
         maxid_ = 1;
     } else {
@@ -50,12 +52,11 @@ void Schema::open()
         maxid_ = super.getMaxid(); // 最大的blockid
     }
     super.detach(); // 分离超块指针
-    desp->relref(); // 释放超块
 
     // 读第1个meta块
     MetaBlock block;
-    desp = buffer_->borrow(META_FILE, first_);
-    block.attach(desp->buffer);
+    guard = PageGuard(*buffer_, META_FILE, first_);
+    block.attach(guard.buffer());
     if (block.getMagic() != MAGIC_NUMBER)
         block.clear(0, first_, BLOCK_TYPE_META);
 
@@ -67,7 +68,7 @@ void Schema::open()
 
         // 得到记录
         Record record;
-        unsigned char *rb = desp->buffer + be16toh(slots[i].offset);
+        unsigned char *rb = guard.buffer() + be16toh(slots[i].offset);
         record.attach(rb, BLOCK_SIZE);
 
         // 先分配iovec
@@ -80,26 +81,91 @@ void Schema::open()
         std::string table;
         retrieveInfo(table, info, iov); // 填充info
 
-        // 插入tablespace
+        // 插入tablespace，记录共享表空间
+        if (info.type & TABLE_SPACE) {
+            spaces_[info.space] = table;
+            if (info.space > space_) space_ = info.space;
+        }
         tablespace_.insert(std::pair<std::string, RelationInfo>(table, info));
     }
 
-    block.detach(); // 分离超块指针
-    desp->relref(); // 释放超块
+    block.detach(); // 分离meta块指针
 }
 
 int Schema::create(const char *table, RelationInfo &info)
 {
     if ((size_t) info.count != info.fields.size()) return EINVAL;
+    if (info.type & TABLE_SPACE) return EINVAL;
+
+    if (info.shared()) {
+        // 压缩表的block变长存放，不能放入共享表空间
+        if (info.type & TABLE_COMPRESSED) return EINVAL;
+        std::pair<TableSpace::iterator, bool> space = lookupSpace(info.space);
+        if (!space.second) return ENOENT;
+        if (lookup(table).second) return EEXIST;
+
+        // 表空间文件即表的文件，分配段的第1个extent
+        info.path = space.first->second.path;
+        int ret = kFiles.extend(info.space, info.root);
+        if (ret) return ret;
+    } else {
+        // NOTE: 强制修改路径名
+        info.space = SPACE_PRIVATE;
+        info.root = 0;
+        info.path = table;
+        info.path += ".dat";
+    }
+
+    int ret = append(table, info);
+    if (ret) return ret;
+
+    // 创建新表的超块
+    SuperBlock super;
+    PageGuard guard(*buffer_, table, 0, PageGuard::EXCLUSIVE);
+    super.attach(guard.buffer());
+    super.clear(info.space);
+    super.setFirst(1);
+    super.setMaxid(1);
+    super.setChecksum();
+    guard.dirty();  // 写超块
+    super.detach(); // 分离超块指针
+
+    // 新表的第1个数据块，move赋值时释放超块
+    DataBlock data;
+    guard = PageGuard(*buffer_, table, 1, PageGuard::EXCLUSIVE);
+    data.attach(guard.buffer());
+    data.clear(info.space, 1, BLOCK_TYPE_DATA);
+    guard.dirty(); // 写数据块
+    data.detach(); // 分离数据块指针
 
+    return S_OK;
+}
+
+int Schema::createSpace(const char *name, unsigned short &id)
+{
+    if (lookup(name).second) return EEXIST;
+    if (space_ == (unsigned short) -1) return ENOSPC;
+
+    RelationInfo info;
+    info.path = name;
+    info.path += ".ts";
+    info.type = TABLE_SPACE;
+    info.space = (unsigned short) (space_ + 1);
+    int ret = append(name, info);
+    if (ret) return ret;
+
+    space_ = info.space;
+    spaces_[space_] = name;
+    id = space_;
+    return S_OK;
+}
+
+int Schema::append(const char *table, RelationInfo &info)
+{
     // 先将info转化iov
     int total = info.iovSize();
     std::vector<struct iovec> iov(total);
 
-    // NOTE: 强制修改路径名
-    info.path = table;
-    info.path += ".dat";
-
     // 初始化iov
     initIov(table, info, iov);
 
@@ -111,17 +177,17 @@ int Schema::create(const char *table, RelationInfo &info)
 
     // 读1个meta块
     MetaBlock meta;
-    BufDesp *desp = buffer_->borrow(META_FILE, first_);
-    meta.attach(desp->buffer);
+    PageGuard guard(*buffer_, META_FILE, first_, PageGuard::EXCLUSIVE);
+    meta.attach(guard.buffer());
     unsigned short length = (unsigned short) Record::size(iov);
-    std::pair<unsigned char *, bool> alloc_ret = meta.allocate(length, 0);
-    if (alloc_ret.first == NULL) {
+    unsigned char *space = meta.allocate(length, 0);
+    if (space == NULL) {
         // TODO: 再分配一个block
     }
 
     // 将关系信息写入buf，这里不需要排序，因为有tablespace_
     Record record;
-    record.attach(alloc_ret.first, length);
+    record.attach(space, length);
     unsigned char header;
     htobe(iov);
     record.set(iov, &header);
@@ -131,32 +197,8 @@ int Schema::create(const char *table, RelationInfo &info)
     meta.setChecksum();
 
     // 写meta文件
-    buffer_->writeBuf(desp); // 写meta块
-    meta.detach();           // 分离超块指针
-    desp->relref();          // 释放超块
-
-    // 创建新表的超块
-    SuperBlock super;
-    desp = buffer_->borrow(table, 0);
-    super.attach(desp->buffer);
-    // TODO: spaceid
-    super.clear(1);
-    super.setFirst(1);
-    super.setMaxid(1);
-    super.setChecksum();
-    buffer_->writeBuf(desp); // 写meta块
-    super.detach();          // 分离超块指针
-    desp->relref();          // 释放超块
-
-    // 新表的第1个数据块
-    DataBlock data;
-    desp = buffer_->borrow(table, 1);
-    data.attach(desp->buffer);
-    data.clear(1, 1, BLOCK_TYPE_DATA);
-    buffer_->writeBuf(desp); // 写meta块
-    data.detach();           // 分离超块指针
-    desp->relref();          // 释放超块
-
+    guard.dirty(); // 写meta块
+    meta.detach(); // 分离meta块指针
     return S_OK;
 }
 
@@ -168,6 +210,15 @@ std::pair<Schema::TableSpace::iterator, bool> Schema::lookup(const char *table)
     return std::pair<TableSpace::iterator, bool>(it, ret);
 }
 
+std::pair<Schema::TableSpace::iterator, bool>
+Schema::lookupSpace(unsigned short id)
+{
+    Spaces::iterator it = spaces_.find(id);
+    if (it == spaces_.end())
+        return std::pair<TableSpace::iterator, bool>(tablespace_.end(), false);
+    return lookup(it->second.c_str());
+}
+
 void Schema::initIov(
     const char *table,
     RelationInfo &info,
@@ -194,21 +245,28 @@ void Schema::initIov(
     // rows
     iov[6].iov_base = &info.rows; // 初始化为0，不需要转化为big endian
     iov[6].iov_len = sizeof(unsigned long long);
+    // space
+    iov[7].iov_base = &info.space;
+    iov[7].iov_len = sizeof(unsigned short);
+    // root
+    iov[8].iov_base = &info.root;
+    iov[8].iov_len = sizeof(unsigned int);
 
     // 初始化field
+    const int base = RelationInfo::HEADER_FIELDS;
     for (unsigned short i = 0; i < info.count; ++i) {
         // 字段的名字
-        iov[7 + i * 4 + 0].iov_base = (void *) info.fields[i].name.c_str();
-        iov[7 + i * 4 + 0].iov_len = info.fields[i].name.size() + 1;
+        iov[base + i * 4 + 0].iov_base = (void *) info.fields[i].name.c_str();
+        iov[base + i * 4 + 0].iov_len = info.fields[i].name.size() + 1;
         // 字段的位置
-        iov[7 + i * 4 + 1].iov_base = (void *) &info.fields[i].index;
-        iov[7 + i * 4 + 1].iov_len = sizeof(unsigned long long);
+        iov[base + i * 4 + 1].iov_base = (void *) &info.fields[i].index;
+        iov[base + i * 4 + 1].iov_len = sizeof(unsigned long long);
         // 字段的长度
-        iov[7 + i * 4 + 2].iov_base = (void *) &info.fields[i].length;
-        iov[7 + i * 4 + 2].iov_len = sizeof(long long);
+        iov[base + i * 4 + 2].iov_base = (void *) &info.fields[i].length;
+        iov[base + i * 4 + 2].iov_len = sizeof(long long);
         // 字段的类型
-        iov[7 + i * 4 + 3].iov_base = (void *) info.fields[i].type->name;
-        iov[7 + i * 4 + 3].iov_len = strlen(info.fields[i].type->name) + 1;
+        iov[base + i * 4 + 3].iov_base = (void *) info.fields[i].type->name;
+        iov[base + i * 4 + 3].iov_len = strlen(info.fields[i].type->name) + 1;
     }
 }
 void Schema::betoh(std::vector<struct iovec> &iov)
@@ -229,14 +287,21 @@ void Schema::betoh(std::vector<struct iovec> &iov)
     // rows
     l = (unsigned long long *) iov[6].iov_base;
     *l = be64toh(*l);
+    // space
+    s = (unsigned short *) iov[7].iov_base;
+    *s = be16toh(*s);
+    // root
+    i = (unsigned int *) iov[8].iov_base;
+    *i = be32toh(*i);
 
     // 初始化field
+    const int base = RelationInfo::HEADER_FIELDS;
     for (unsigned short i = 0; i < count; ++i) {
         // 字段的位置
-        l = (unsigned long long *) iov[7 + i * 4 + 1].iov_base;
+        l = (unsigned long long *) iov[base + i * 4 + 1].iov_base;
         *l = be64toh(*l);
         // 字段的长度
-        l = (unsigned long long *) iov[7 + i * 4 + 2].iov_base;
+        l = (unsigned long long *) iov[base + i * 4 + 2].iov_base;
         *l = be64toh(*l);
     }
 }
@@ -258,14 +323,21 @@ void Schema::htobe(std::vector<struct iovec> &iov)
     // rows
     l = (unsigned long long *) iov[6].iov_base;
     *l = htobe64(*l);
+    // space
+    s = (unsigned short *) iov[7].iov_base;
+    *s = htobe16(*s);
+    // root
+    i = (unsigned int *) iov[8].iov_base;
+    *i = htobe32(*i);
 
     // 初始化field
+    const int base = RelationInfo::HEADER_FIELDS;
     for (unsigned short i = 0; i < count; ++i) {
         // 字段的位置
-        l = (unsigned long long *) iov[7 + i * 4 + 1].iov_base;
+        l = (unsigned long long *) iov[base + i * 4 + 1].iov_base;
         *l = htobe64(*l);
         // 字段的长度
-        l = (unsigned long long *) iov[7 + i * 4 + 2].iov_base;
+        l = (unsigned long long *) iov[base + i * 4 + 2].iov_base;
         *l = htobe64(*l);
     }
 }
@@ -294,42 +366,66 @@ void Schema::retrieveInfo(
     ::memcpy(&info.rows, iov[6].iov_base, sizeof(unsigned long long));
     info.rows = be64toh(info.rows);
 
-    // 返回各个字段
+    // 早期的记录没有space和root，都是独占文件的表
     size_t count = info.count;
+    size_t base = RelationInfo::HEADER_FIELDS;
+    if (iov.size() == 7 + count * 4) {
+        base = 7;
+        info.space = SPACE_PRIVATE;
+        info.root = 0;
+    } else {
+        ::memcpy(&info.space, iov[7].iov_base, sizeof(unsigned short));
+        info.space = be16toh(info.space);
+        ::memcpy(&info.root, iov[8].iov_base, sizeof(unsigned int));
+        info.root = be32toh(info.root);
+    }
+
+    // 返回各个字段
     info.fields.clear();
     for (size_t i = 0; i < count; ++i) {
         FieldInfo field;
 
         // 字段名字
-        field.name = (const char *) iov[7 + i * 4].iov_base;
+        field.name = (const char *) iov[base + i * 4].iov_base;
         // 字段位置
         ::memcpy(
             &field.index,
-            iov[7 + i * 4 + 1].iov_base,
+            iov[base + i * 4 + 1].iov_base,
             sizeof(unsigned long long));
         field.index = be64toh(field.index);
         // 字段长度
-        ::memcpy(&field.length, iov[7 + i * 4 + 2].iov_base, sizeof(long long));
+        ::memcpy(
+            &field.length, iov[base + i * 4 + 2].iov_base, sizeof(long long));
         field.length = be64toh(field.length);
         // 字段类型
-        const char *tname = (const char *) iov[7 + i * 4 + 3].iov_base;
+        const char *tname = (const char *) iov[base + i * 4 + 3].iov_base;
         field.type = findDataType(tname);
 
         info.fields.push_back(field);
     }
 }
 
-void dbInit(size_t bufsize)
+void dbInit(size_t bufsize, size_t cachesize)
 {
     static bool inited = false;
     if (!inited) {
         // 初始化全局变量
         kBuffer.init(&kFiles, bufsize);
+        kBuffer.cache().init(cachesize * 1024 * 1024);
         kFiles.init(&kSchema);
         kSchema.init(&kBuffer);
     }
 }
 
+void dbExit()
+{
+    // 异步提交的定时任务在运行时停止时会被丢弃，先刷盘；运行时停止后buffer的
+    // 预热和定期保存任务都已结束，再回写脏block
+    kFiles.flushCommits();
+    kRuntime.stop();
+    kBuffer.flush();
+}
+
 Schema kSchema;
 
 } // namespace db
\ No newline at end of file
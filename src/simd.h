@@ -0,0 +1,282 @@
+////
+// @file simd.h
+// @brief
+// 谓词核函数的公共模板，以及各指令集编译单元导出的函数，只在src中使用
+// 各指令集的编译单元定义自己的Ops，实例化这里的循环；模板都在匿名名字空间中，
+// 每个编译单元各有一份，以AVX2编译的实例不会被链接器拿去替换标量的实例。
+// 同样的原因，这些编译单元里不要使用标准库的内联函数。
+//
+// Ops需要提供：
+//   Value       - 值的类型，无符号整数
+//   Vec         - 向量寄存器类型
+//   LANES       - 每个向量的值个数，整除64
+//   set1(v)     - 广播常量
+//   load(p)     - 载入LANES个值
+//   eq(a, b)    - a == b的各lane位掩码
+//   gt(a, b)    - a > b（无符号）的各lane位掩码
+//
+// @author niexw
+// @email niexiaowen@uestc.edu.cn
+//
+#ifndef __DB_SIMD_H__
+#define __DB_SIMD_H__
+
+#include <db/kernel.h>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || \
+    defined(_M_IX86)
+#    define DB_SIMD_X86 1
+#else
+#    define DB_SIMD_X86 0
+#endif
+
+namespace db {
+
+#if DB_SIMD_X86
+// 各指令集编译单元导出的核函数表，下标0/1/2/3对应宽度1/2/4/8
+extern const IntKernels kSse42Kernels[4];
+extern const IntKernels kAvx2Kernels[4];
+extern const IntKernels kAvx512Kernels[4];
+
+// 前缀匹配，offsets有rows + 1项，bytes有size字节
+void prefixSse42(
+    const unsigned char *bytes,
+    size_t size,
+    const unsigned int *offsets,
+    size_t rows,
+    const unsigned char *prefix,
+    unsigned int len,
+    unsigned long long *bitmap);
+
+// Bloom过滤器的桶操作，words为按32字节对齐的桶，salt为8个奇数
+void bloomInsertAvx2(
+    unsigned int *words,
+    unsigned int key,
+    const unsigned int *salt);
+bool bloomFindAvx2(
+    const unsigned int *words,
+    unsigned int key,
+    const unsigned int *salt);
+#endif
+
+namespace {
+
+// 标量比较
+template <typename T>
+inline bool compareValue(T x, CompareOp op, T y)
+{
+    switch (op) {
+    case CMP_EQ:
+        return x == y;
+    case CMP_NE:
+        return x != y;
+    case CMP_LT:
+        return x < y;
+    case CMP_LE:
+        return x <= y;
+    case CMP_GT:
+        return x > y;
+    default:
+        return x >= y;
+    }
+}
+
+// 标量处理[from, rows)，用于不足64行的尾部
+template <typename T>
+inline void compareTail(
+    const T *values,
+    size_t from,
+    size_t rows,
+    CompareOp op,
+    T value,
+    unsigned long long *bitmap)
+{
+    for (size_t i = from; i < rows; i += 64) {
+        unsigned long long word = 0;
+        size_t n = rows - i < 64 ? rows - i : 64;
+        for (size_t j = 0; j < n; ++j)
+            word |= (unsigned long long) compareValue(values[i + j], op, value)
+                    << j;
+        bitmap[i / 64] = word;
+    }
+}
+
+template <typename T>
+inline void betweenTail(
+    const T *values,
+    size_t from,
+    size_t rows,
+    T lo,
+    T hi,
+    unsigned long long *bitmap)
+{
+    for (size_t i = from; i < rows; i += 64) {
+        unsigned long long word = 0;
+        size_t n = rows - i < 64 ? rows - i : 64;
+        for (size_t j = 0; j < n; ++j) {
+            T v = values[i + j];
+            word |= (unsigned long long) (lo <= v && v <= hi) << j;
+        }
+        bitmap[i / 64] = word;
+    }
+}
+
+template <typename T>
+inline void inTail(
+    const T *values,
+    size_t from,
+    size_t rows,
+    const unsigned long long *list,
+    size_t count,
+    unsigned long long *bitmap)
+{
+    for (size_t i = from; i < rows; i += 64) {
+        unsigned long long word = 0;
+        size_t n = rows - i < 64 ? rows - i : 64;
+        for (size_t j = 0; j < n; ++j) {
+            bool found = false;
+            for (size_t k = 0; k < count && !found; ++k)
+                found = values[i + j] == (T) list[k];
+            word |= (unsigned long long) found << j;
+        }
+        bitmap[i / 64] = word;
+    }
+}
+
+// 一个向量的lane掩码
+template <typename Ops>
+inline unsigned long long laneMask()
+{
+    return Ops::LANES == 64 ? ~0ULL : (1ULL << Ops::LANES) - 1;
+}
+
+// 按比较运算求一个向量的位掩码，OP为模板参数，内层循环中没有分支
+template <typename Ops, int OP>
+inline unsigned long long
+compareVec(typename Ops::Vec v, typename Ops::Vec c)
+{
+    switch (OP) {
+    case CMP_EQ:
+        return Ops::eq(v, c);
+    case CMP_NE:
+        return ~Ops::eq(v, c) & laneMask<Ops>();
+    case CMP_LT:
+        return Ops::gt(c, v);
+    case CMP_LE:
+        return ~Ops::gt(v, c) & laneMask<Ops>();
+    case CMP_GT:
+        return Ops::gt(v, c);
+    default:
+        return ~Ops::gt(c, v) & laneMask<Ops>();
+    }
+}
+
+template <typename Ops, int OP>
+inline void compareLoop(
+    const typename Ops::Value *values,
+    size_t rows,
+    typename Ops::Value value,
+    unsigned long long *bitmap)
+{
+    typename Ops::Vec c = Ops::set1(value);
+    size_t full = rows / 64 * 64;
+    for (size_t i = 0; i < full; i += 64) {
+        unsigned long long word = 0;
+        for (size_t k = 0; k < 64; k += Ops::LANES)
+            word |= compareVec<Ops, OP>(Ops::load(values + i + k), c) << k;
+        bitmap[i / 64] = word;
+    }
+    compareTail(values, full, rows, (CompareOp) OP, value, bitmap);
+}
+
+// IntKernels::compare的实现
+template <typename Ops>
+void compareKernel(
+    const void *values,
+    size_t rows,
+    CompareOp op,
+    unsigned long long value,
+    unsigned long long *bitmap)
+{
+    typedef typename Ops::Value Value;
+    const Value *p = (const Value *) values;
+    Value v = (Value) value;
+    switch (op) {
+    case CMP_EQ:
+        compareLoop<Ops, CMP_EQ>(p, rows, v, bitmap);
+        break;
+    case CMP_NE:
+        compareLoop<Ops, CMP_NE>(p, rows, v, bitmap);
+        break;
+    case CMP_LT:
+        compareLoop<Ops, CMP_LT>(p, rows, v, bitmap);
+        break;
+    case CMP_LE:
+        compareLoop<Ops, CMP_LE>(p, rows, v, bitmap);
+        break;
+    case CMP_GT:
+        compareLoop<Ops, CMP_GT>(p, rows, v, bitmap);
+        break;
+    default:
+        compareLoop<Ops, CMP_GE>(p, rows, v, bitmap);
+        break;
+    }
+}
+
+// IntKernels::between的实现，lo <= v && v <= hi即!(lo > v) && !(v > hi)
+template <typename Ops>
+void betweenKernel(
+    const void *values,
+    size_t rows,
+    unsigned long long lo,
+    unsigned long long hi,
+    unsigned long long *bitmap)
+{
+    typedef typename Ops::Value Value;
+    const Value *p = (const Value *) values;
+    typename Ops::Vec l = Ops::set1((Value) lo);
+    typename Ops::Vec h = Ops::set1((Value) hi);
+    size_t full = rows / 64 * 64;
+    for (size_t i = 0; i < full; i += 64) {
+        unsigned long long word = 0;
+        for (size_t k = 0; k < 64; k += Ops::LANES) {
+            typename Ops::Vec v = Ops::load(p + i + k);
+            unsigned long long out = Ops::gt(l, v) | Ops::gt(v, h);
+            word |= (~out & laneMask<Ops>()) << k;
+        }
+        bitmap[i / 64] = word;
+    }
+    betweenTail(p, full, rows, (Value) lo, (Value) hi, bitmap);
+}
+
+// IntKernels::in的实现，逐个常量比较相等再求或；列表很短，每次广播即可
+template <typename Ops>
+void inKernel(
+    const void *values,
+    size_t rows,
+    const unsigned long long *list,
+    size_t count,
+    unsigned long long *bitmap)
+{
+    typedef typename Ops::Value Value;
+    const Value *p = (const Value *) values;
+    size_t full = rows / 64 * 64;
+    for (size_t i = 0; i < full; i += 64) {
+        unsigned long long word = 0;
+        for (size_t k = 0; k < 64; k += Ops::LANES) {
+            typename Ops::Vec v = Ops::load(p + i + k);
+            unsigned long long hit = 0;
+            for (size_t j = 0; j < count; ++j)
+                hit |= Ops::eq(v, Ops::set1((Value) list[j]));
+            word |= hit << k;
+        }
+        bitmap[i / 64] = word;
+    }
+    inTail(p, full, rows, list, count, bitmap);
+}
+
+} // namespace
+
+} // namespace db
+
+#endif // __DB_SIMD_H__
@@ -0,0 +1,136 @@
+////
+// @file space.cc
+// @brief
+// 实现共享表空间
+//
+// @author niexw
+// @email niexiaowen@uestc.edu.cn
+//
+#include <db/space.h>
+#include <db/endian.h>
+
+namespace db {
+
+namespace {
+// 表空间头部，大序存放
+struct SpaceHeader
+{
+    unsigned int magic; // magic number
+    unsigned int id;    // 表空间id
+    unsigned int next;  // 下一个未分配的页
+};
+} // namespace
+
+int SharedSpace::open(File *file, unsigned short id)
+{
+    // 文件尾部之外读不到数据，当作全0
+    SpaceHeader header = {};
+    unsigned long long length = 0;
+    int ret = file->length(length);
+    if (ret) return ret;
+    if (length >= sizeof(header)) {
+        ret = file->read(0, (char *) &header, sizeof(header));
+        if (ret) return ret;
+    }
+
+    id_ = id;
+    if (be32toh(header.magic) != (unsigned int) MAGIC_NUMBER) {
+        // 新表空间，第0页是头部
+        next_ = 1;
+        header.magic = htobe32((unsigned int) MAGIC_NUMBER);
+        header.id = htobe32(id_);
+        header.next = htobe32(next_);
+        return file->write(0, (const char *) &header, sizeof(header));
+    }
+    if (be32toh(header.id) != id) return EINVAL; // 不是该表空间的文件
+    next_ = be32toh(header.next);
+    return S_OK;
+}
+
+int SharedSpace::allocate(File *file, unsigned int &page)
+{
+    SpaceHeader header;
+    header.magic = htobe32((unsigned int) MAGIC_NUMBER);
+    header.id = htobe32(id_);
+    header.next = htobe32(next_ + SPACE_EXTENT);
+    int ret = file->write(0, (const char *) &header, sizeof(header));
+    if (ret) return ret;
+
+    page = next_;
+    next_ += SPACE_EXTENT;
+    // 预分配失败只是退化为逐块增长
+    file->allocate((unsigned long long) next_ * BLOCK_SIZE);
+    return S_OK;
+}
+
+int Segment::open(File *file, unsigned short spaceid, unsigned int root)
+{
+    spaceid_ = spaceid;
+    root_ = root;
+    extents_.clear();
+
+    // 读段头，新分配的页可能在文件尾部之外，当作全0
+    std::vector<unsigned int> page(BLOCK_SIZE / sizeof(int), 0);
+    unsigned long long offset = (unsigned long long) root * BLOCK_SIZE;
+    unsigned long long length = 0;
+    int ret = file->length(length);
+    if (ret) return ret;
+    if (length > offset) {
+        size_t size = (size_t) (length - offset);
+        if (size > BLOCK_SIZE) size = BLOCK_SIZE;
+        ret = file->read(offset, (char *) &page[0], size);
+        if (ret) return ret;
+    }
+    if (be32toh(page[0]) != (unsigned int) MAGIC_NUMBER) {
+        extents_.push_back(root);
+        return save(file);
+    }
+    if (be32toh(page[1]) != spaceid) return EINVAL;
+    size_t count = be32toh(page[2]);
+    if (count == 0 || count > MAX_EXTENTS) return EINVAL;
+    for (size_t i = 0; i < count; ++i)
+        extents_.push_back(be32toh(page[3 + i]));
+    return S_OK;
+}
+
+int Segment::offset(unsigned int blockid, unsigned long long &offset)
+{
+    // 段头占第0页，block依次后移一页
+    unsigned long long pos = (unsigned long long) blockid + 1;
+    size_t index = (size_t) (pos / SPACE_EXTENT);
+    if (index >= extents_.size()) return ENXIO;
+    offset = ((unsigned long long) extents_[index] + pos % SPACE_EXTENT) *
+             BLOCK_SIZE;
+    return S_OK;
+}
+
+int Segment::extend(File *file, SharedSpace *space, unsigned int blockid)
+{
+    size_t index = (size_t) (((unsigned long long) blockid + 1) / SPACE_EXTENT);
+    if (index >= MAX_EXTENTS) return EFBIG;
+    while (index >= extents_.size()) {
+        unsigned int page;
+        int ret = space->allocate(file, page);
+        if (ret) return ret;
+        extents_.push_back(page);
+        ret = save(file);
+        if (ret) return ret;
+    }
+    return S_OK;
+}
+
+int Segment::save(File *file)
+{
+    std::vector<unsigned int> page(3 + extents_.size());
+    page[0] = htobe32((unsigned int) MAGIC_NUMBER);
+    page[1] = htobe32(spaceid_);
+    page[2] = htobe32((unsigned int) extents_.size());
+    for (size_t i = 0; i < extents_.size(); ++i)
+        page[3 + i] = htobe32(extents_[i]);
+    return file->write(
+        (unsigned long long) root_ * BLOCK_SIZE,
+        (const char *) &page[0],
+        page.size() * sizeof(int));
+}
+
+} // namespace db
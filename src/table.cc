@@ -7,11 +7,15 @@
 // @email niexiaowen@uestc.edu.cn
 //
 #include <db/table.h>
+#include <db/file.h>
+#include <db/runtime.h>
+#include <thread>
 
 namespace db {
 
 Table::BlockIterator::BlockIterator()
     : bufdesp(nullptr)
+    , strategy(nullptr)
 {}
 Table::BlockIterator::~BlockIterator()
 {
@@ -20,171 +24,328 @@ Table::BlockIterator::~BlockIterator()
 Table::BlockIterator::BlockIterator(const BlockIterator &other)
     : block(other.block)
     , bufdesp(other.bufdesp)
+    , strategy(other.strategy)
 {
     if (bufdesp) bufdesp->addref();
 }
+Table::BlockIterator::BlockIterator(BlockIterator &&other)
+    : block(other.block)
+    , bufdesp(other.bufdesp)
+    , strategy(other.strategy)
+{
+    other.bufdesp = nullptr;
+    other.block.detach();
+}
+Table::BlockIterator &
+Table::BlockIterator::operator=(const BlockIterator &other)
+{
+    if (this != &other) {
+        if (other.bufdesp) other.bufdesp->addref();
+        if (bufdesp) kBuffer.releaseBuf(bufdesp);
+        block = other.block;
+        bufdesp = other.bufdesp;
+        strategy = other.strategy;
+    }
+    return *this;
+}
+Table::BlockIterator &Table::BlockIterator::operator=(BlockIterator &&other)
+{
+    if (this != &other) {
+        if (bufdesp) kBuffer.releaseBuf(bufdesp);
+        block = other.block;
+        bufdesp = other.bufdesp;
+        strategy = other.strategy;
+        other.bufdesp = nullptr;
+        other.block.detach();
+    }
+    return *this;
+}
 
 // 前置操作
 Table::BlockIterator &Table::BlockIterator::operator++()
 {
     if (block.buffer_ == nullptr) return *this;
     unsigned int blockid = block.getNext();
-    kBuffer.releaseBuf(bufdesp);
-    if (blockid) {
-        bufdesp = kBuffer.borrow(block.table_->name_.c_str(), blockid);
-        block.attach(bufdesp->buffer);
-    } else
-        block.buffer_ = nullptr;
+    release();
+    if (blockid) fetch(blockid);
     return *this;
 }
 // 后置操作
 Table::BlockIterator Table::BlockIterator::operator++(int)
 {
     BlockIterator tmp(*this);
-    if (block.buffer_ == nullptr) return *this;
-    unsigned int blockid = block.getNext();
-    kBuffer.releaseBuf(bufdesp);
-    if (blockid) {
-        bufdesp = kBuffer.borrow(block.table_->name_.c_str(), blockid);
-        block.attach(bufdesp->buffer);
-    } else
-        block.buffer_ = nullptr;
+    ++*this;
     return tmp;
 }
 // 数据块指针
 DataBlock *Table::BlockIterator::operator->() { return &block; }
 void Table::BlockIterator::release()
 {
-    bufdesp->relref();
+    if (bufdesp) kBuffer.releaseBuf(bufdesp);
+    bufdesp = nullptr;
     block.detach();
 }
+void Table::BlockIterator::fetch(unsigned int blockid)
+{
+    Table *table = block.table_;
+    if (table->mapped_) {
+        block.attach(table->mappedBlock(blockid));
+        return;
+    }
+    bufdesp = kBuffer.borrow(table->name_.c_str(), blockid, strategy);
+    block.attach(bufdesp ? bufdesp->buffer : NULL);
+}
 
-int Table::open(const char *name)
+Table::PrunedIterator::PrunedIterator()
+    : skipped(0)
+{}
+Table::PrunedIterator &Table::PrunedIterator::operator++()
+{
+    if (block.buffer_ == nullptr) return *this;
+    unsigned int blockid = block.getNext();
+    release();
+    seek(blockid);
+    return *this;
+}
+void Table::PrunedIterator::seek(unsigned int blockid)
+{
+    Table *table = block.table_;
+    // 等值谓词才能使用Bloom过滤器
+    bool equal = range.lo && range.hi && range.lolen == range.hilen &&
+                 ::memcmp(range.lo, range.hi, range.lolen) == 0;
+
+    while (blockid) {
+        // 摘要或过滤器表明不会命中，沿缓存的后继跳过，不借用该block
+        BlockZone *zone = table->zonemap_.find(blockid);
+        if (zone && !table->zonemap_.mayMatch(blockid, range)) {
+            blockid = zone->next;
+            ++skipped;
+            continue;
+        }
+        BlockFilter *filter = table->blooms_.find(blockid);
+        if (equal && filter &&
+            !table->blooms_.mayContain(
+                blockid, range.field, range.lo, range.lolen)) {
+            blockid = filter->next;
+            ++skipped;
+            continue;
+        }
+
+        // 借用block，摘要未知或者不精确则重算
+        fetch(blockid);
+        if (block.buffer_ == nullptr) break;
+        bool rebuilt = false;
+        if (zone == NULL || !zone->exact) {
+            table->zonemap_.build(block);
+            rebuilt = true;
+        }
+        if (table->blooms_.enabled() && table->blooms_.stale(blockid)) {
+            table->blooms_.build(block);
+            rebuilt = true;
+        }
+        if (rebuilt &&
+            (!table->zonemap_.mayMatch(blockid, range) ||
+             (equal && !table->blooms_.mayContain(
+                           blockid, range.field, range.lo, range.lolen)))) {
+            blockid = block.getNext();
+            release();
+            continue;
+        }
+        return;
+    }
+
+    // 到达数据链尾部
+    bufdesp = nullptr;
+    block.buffer_ = nullptr;
+}
+
+int Table::open(const char *name, Mode mode)
 {
     // 查找table
     std::pair<Schema::TableSpace::iterator, bool> bret = kSchema.lookup(name);
     if (!bret.second) return EEXIST; // 表不存在
+    RelationInfo &info = bret.first->second;
+    if (info.type & TABLE_SPACE) return EINVAL; // 共享表空间不是表
+    // 压缩表和共享表空间中的表，block不按blockid存放
+    if (mode == MAPPED && ((info.type & TABLE_COMPRESSED) || info.shared()))
+        return EINVAL;
 
     // 填充结构
     name_ = name;
     info_ = &bret.first->second;
+    delete mapped_;
+    mapped_ = NULL;
+    fences_.invalidate();
 
-    // 加载超块
+    // 加载超块，守卫析构时释放
     SuperBlock super;
-    BufDesp *desp = kBuffer.borrow(name, 0);
-    super.attach(desp->buffer);
+    PageGuard guard;
+    if (mode == MAPPED) {
+        // 映射前回写脏块，映射后整个文件预读
+        int ret = kBuffer.flush();
+        if (ret) return ret;
+        mapped_ = new MappedFile;
+        ret = mapped_->open(info_->path.c_str());
+        if (ret) {
+            delete mapped_;
+            mapped_ = NULL;
+            return ret;
+        }
+        mapped_->prefetch(0, mapped_->length_);
+        super.attach(mapped_->base_);
+    } else {
+        guard = PageGuard(kBuffer, name, 0);
+        super.attach(guard.buffer());
+    }
 
     // 获取元数据
     maxid_ = super.getMaxid();
     idle_ = super.getIdle();
     first_ = super.getFirst();
-
-    // 释放超块
-    super.detach();
-    desp->relref();
     return S_OK;
 }
 
-unsigned int Table::allocate()
+unsigned int Table::allocate(AccessStrategy *strategy)
 {
     // 空闲链上有block
     DataBlock data;
     SuperBlock super;
-    BufDesp *desp;
+    PageGuard guard;
 
     if (idle_) {
         // 读idle块，获得下一个空闲块
-        desp = kBuffer.borrow(name_.c_str(), idle_);
-        data.attach(desp->buffer);
+        guard = PageGuard(kBuffer, name_.c_str(), idle_);
+        data.attach(guard.buffer());
         unsigned int next = data.getNext();
         data.detach();
-        desp->relref();
 
         // 读超块，设定空闲块
-        desp = kBuffer.borrow(name_.c_str(), 0);
-        super.attach(desp->buffer);
+        guard = PageGuard(kBuffer, name_.c_str(), 0, PageGuard::EXCLUSIVE);
+        super.attach(guard.buffer());
         super.setIdle(next);
         super.setIdleCounts(super.getIdleCounts() - 1);
         super.setDataCounts(super.getDataCounts() + 1);
         super.setChecksum();
         super.detach();
-        kBuffer.writeBuf(desp);
-        desp->relref();
+        guard.dirty();
 
         unsigned int current = idle_;
         idle_ = next;
 
-        desp = kBuffer.borrow(name_.c_str(), current);
-        data.attach(desp->buffer);
-        data.clear(1, current, BLOCK_TYPE_DATA);
-        desp->relref();
+        guard = PageGuard(
+            kBuffer, name_.c_str(), current, PageGuard::EXCLUSIVE, strategy);
+        data.attach(guard.buffer());
+        data.clear(info_->space, current, BLOCK_TYPE_DATA);
+        guard.dirty();
+        zonemap_.reset(current, 0);
+        blooms_.reset(current, 0);
 
         return current;
     }
 
-    // 没有空闲块
+    // 没有空闲块，从当前extent上分配；共享表空间中的表先扩展段
+    if (kFiles.extend(name_.c_str(), maxid_ + 1)) return 0;
     ++maxid_;
     // 读超块，设定空闲块
-    desp = kBuffer.borrow(name_.c_str(), 0);
-    super.attach(desp->buffer);
+    guard = PageGuard(kBuffer, name_.c_str(), 0, PageGuard::EXCLUSIVE);
+    super.attach(guard.buffer());
     super.setMaxid(maxid_);
+    reserve(super);
     super.setDataCounts(super.getDataCounts() + 1);
     super.setChecksum();
     super.detach();
-    kBuffer.writeBuf(desp);
-    desp->relref();
+    guard.dirty();
     // 初始化数据块
-    desp = kBuffer.borrow(name_.c_str(), maxid_);
-    data.attach(desp->buffer);
-    data.clear(1, maxid_, BLOCK_TYPE_DATA);
-    desp->relref();
+    guard = PageGuard(
+        kBuffer, name_.c_str(), maxid_, PageGuard::EXCLUSIVE, strategy);
+    data.attach(guard.buffer());
+    data.clear(info_->space, maxid_, BLOCK_TYPE_DATA);
+    guard.dirty();
+    zonemap_.reset(maxid_, 0);
+    blooms_.reset(maxid_, 0);
 
     return maxid_;
 }
 
+void Table::reserve(SuperBlock &super)
+{
+    if (maxid_ <= super.getReserved()) return;
+
+    // extent从MIN_EXTENT开始每次翻倍，直到MAX_EXTENT
+    unsigned int extents = super.getExtents();
+    size_t size = MIN_EXTENT;
+    for (unsigned int i = 0; i < extents && size < MAX_EXTENT; ++i)
+        size *= 2;
+    unsigned int reserved = maxid_ - 1 + (unsigned int) (size / BLOCK_SIZE);
+    super.setReserved(reserved);
+    super.setExtents(extents + 1);
+
+    // 预分配磁盘空间，失败时只是退化为逐块增长；压缩表的block不按blockid存放，
+    // 共享表空间按extent预分配
+    FileRef file(kFiles, name_.c_str());
+    if (file && !info_->shared() && kFiles.mapping(name_.c_str()) == NULL)
+        file->allocate(
+            (unsigned long long) (reserved + 1) * BLOCK_SIZE + SUPER_SIZE);
+}
+
 void Table::deallocate(unsigned int blockid)
 {
     // 读idle块，获得下一个空闲块
     DataBlock data;
-    BufDesp *desp = kBuffer.borrow(name_.c_str(), blockid);
-    data.attach(desp->buffer);
+    PageGuard guard(kBuffer, name_.c_str(), blockid, PageGuard::EXCLUSIVE);
+    data.attach(guard.buffer());
     data.setNext(idle_);
+    data.setType(BLOCK_TYPE_IDLE); // 并行扫描按类型跳过空闲块
     data.setChecksum();
     data.detach();
-    kBuffer.writeBuf(desp);
-    desp->relref();
+    guard.dirty();
 
     // 读超块，设定空闲块
     SuperBlock super;
-    desp = kBuffer.borrow(name_.c_str(), 0);
-    super.attach(desp->buffer);
+    guard = PageGuard(kBuffer, name_.c_str(), 0, PageGuard::EXCLUSIVE);
+    super.attach(guard.buffer());
     super.setIdle(blockid);
     super.setIdleCounts(super.getIdleCounts() + 1);
     super.setDataCounts(super.getDataCounts() - 1);
     super.setChecksum();
     super.detach();
-    kBuffer.writeBuf(desp);
-    desp->relref();
+    guard.dirty();
 
     // 设定自己
     idle_ = blockid;
+    zonemap_.drop(blockid);
+    blooms_.drop(blockid);
+    fences_.drop(blockid);
 }
 
-Table::BlockIterator Table::beginblock()
+unsigned int Table::firstBlock()
 {
+    // 映射表只读，数据链头不会改变
+    if (mapped_) return first_;
+
     // 通过超块找到第1个数据块的id
+    PageGuard guard(kBuffer, name_.c_str(), 0);
+    SuperBlock super;
+    super.attach(guard.buffer());
+    return super.getFirst();
+}
+
+unsigned char *Table::mappedBlock(unsigned int blockid)
+{
+    unsigned long long offset =
+        blockid ? (unsigned long long) blockid * BLOCK_SIZE + SUPER_SIZE : 0;
+    size_t length = blockid ? BLOCK_SIZE : SUPER_SIZE;
+    if (mapped_ == NULL || offset + length > mapped_->length_) return NULL;
+    return mapped_->base_ + offset;
+}
+
+Table::BlockIterator Table::beginblock(AccessStrategy *strategy)
+{
     BlockIterator bi;
     bi.block.table_ = this;
+    bi.strategy = strategy;
 
-    // 获取第1个blockid
-    BufDesp *bd = kBuffer.borrow(name_.c_str(), 0);
-    SuperBlock super;
-    super.attach(bd->buffer);
-    unsigned int blockid = super.getFirst();
-    kBuffer.releaseBuf(bd);
-
-    bi.bufdesp = kBuffer.borrow(name_.c_str(), blockid);
-    bi.block.attach(bi.bufdesp->buffer);
+    bi.fetch(firstBlock());
     return bi;
 }
 
@@ -195,59 +356,262 @@ Table::BlockIterator Table::endblock()
     return bi;
 }
 
+Table::PrunedIterator
+Table::beginblock(const ZoneRange &range, AccessStrategy *strategy)
+{
+    PrunedIterator pi;
+    pi.block.table_ = this;
+    pi.strategy = strategy;
+    pi.range = range;
+
+    pi.seek(firstBlock());
+    return pi;
+}
+
+int Table::scan(
+    const BlockCallback &fn,
+    const ScanOptions &options,
+    ScanStats *stats)
+{
+    // 从超块获得最大blockid和数据块个数
+    SuperBlock super;
+    PageGuard guard;
+    if (mapped_)
+        super.attach(mappedBlock(0));
+    else {
+        guard = PageGuard(kBuffer, name_.c_str(), 0);
+        super.attach(guard.buffer());
+    }
+    unsigned int maxid = super.getMaxid();
+    unsigned int blocks = super.getDataCounts();
+    unsigned int idle = super.getIdle();
+    guard.release();
+
+    // 早期版本回收block时不改类型，空闲链上的block仍标为数据块，扫描前沿空闲
+    // 链标记出来；链上有环或越界时停止
+    std::vector<bool> idles(maxid + 1, false);
+    BlockIterator bi;
+    bi.block.table_ = this;
+    while (idle && idle <= maxid && !idles[idle]) {
+        idles[idle] = true;
+        bi.fetch(idle);
+        if (bi.block.buffer_ == NULL) break;
+        idle = bi->getNext();
+        bi.release();
+    }
+    bi.release();
+
+    // 数据块不多时减少worker，每个worker至少一个morsel
+    unsigned int morsel = options.morsel ? options.morsel : 1;
+    unsigned int threads = options.threads;
+    if (threads == 0) threads = std::thread::hardware_concurrency();
+    unsigned int needed = (blocks + morsel - 1) / morsel;
+    if (threads > needed) threads = needed;
+    if (threads == 0) threads = 1;
+
+    MorselQueues queues(threads, 1, maxid, morsel);
+    std::vector<ScanStats> partial(threads);
+    TaskGroup group;
+    for (unsigned int i = 1; i < threads; ++i)
+        kRuntime.submit(
+            [this, &queues, i, &fn, &idles, &options, &partial]() {
+                scanWorker(
+                    &queues, i, &fn, &idles, options.bulk, &partial[i]);
+            },
+            Runtime::FOREGROUND,
+            &group);
+    // 当前线程是0号worker，做完自己的部分后帮助执行其它任务
+    scanWorker(&queues, 0, &fn, &idles, options.bulk, &partial[0]);
+    kRuntime.wait(group);
+
+    if (stats) {
+        *stats = ScanStats();
+        stats->threads = threads;
+        for (size_t i = 0; i < partial.size(); ++i) {
+            stats->morsels += partial[i].morsels;
+            stats->steals += partial[i].steals;
+            stats->blocks += partial[i].blocks;
+            stats->records += partial[i].records;
+        }
+    }
+    return S_OK;
+}
+
+int Table::scanRecords(
+    const RecordCallback &fn,
+    const ScanOptions &options,
+    ScanStats *stats)
+{
+    return scan(
+        [&fn](unsigned int worker, DataBlock &block) {
+            for (unsigned short i = 0; i < block.getSlots(); ++i) {
+                Record record;
+                block.refslots(i, record);
+                fn(worker, record);
+            }
+        },
+        options,
+        stats);
+}
+
+void Table::scanWorker(
+    MorselQueues *queues,
+    unsigned int worker,
+    const BlockCallback *fn,
+    const std::vector<bool> *idles,
+    bool bulk,
+    ScanStats *stats)
+{
+    // 每个worker一个访问策略，扫描不冲掉热点数据
+    AccessStrategy *strategy = NULL;
+    if (bulk && mapped_ == NULL)
+        strategy = new AccessStrategy(AccessStrategy::BULKREAD);
+    BlockIterator bi;
+    bi.block.table_ = this;
+    bi.strategy = strategy;
+
+    Morsel morsel;
+    bool stolen;
+    while (queues->pop(worker, morsel, stolen)) {
+        ++stats->morsels;
+        if (stolen) ++stats->steals;
+        for (unsigned int id = morsel.begin; id < morsel.end; ++id) {
+            // 空闲块和未映射的block跳过
+            if ((*idles)[id]) continue;
+            bi.fetch(id);
+            if (bi.block.buffer_ && bi->getType() == BLOCK_TYPE_DATA) {
+                ++stats->blocks;
+                stats->records += bi->getSlots();
+                (*fn)(worker, bi.block);
+            }
+            bi.release();
+        }
+    }
+    delete strategy;
+}
+
+int Table::trackZones(const std::vector<unsigned int> &fields)
+{
+    for (size_t i = 0; i < fields.size(); ++i)
+        if (fields[i] >= info_->count) return EINVAL;
+    zonemap_.init(info_, fields);
+    return S_OK;
+}
+
+int Table::trackBlooms(
+    const std::vector<unsigned int> &fields,
+    const BloomOptions &options)
+{
+    for (size_t i = 0; i < fields.size(); ++i)
+        if (fields[i] >= info_->count) return EINVAL;
+    blooms_.init(info_, fields, options);
+    return S_OK;
+}
+
 unsigned int Table::locate(void *keybuf, unsigned int len)
 {
+    if (!fences_.valid()) buildFences();
+    return fences_.find(keybuf, len);
+}
+
+int Table::lookup(
+    void *keybuf,
+    unsigned int len,
+    PageGuard &guard,
+    Record &record)
+{
+    unsigned int blkid = locate(keybuf, len);
     unsigned int key = info_->key;
-    DataType *type = info_->fields[key].type;
+    // 过滤器确定block上没有该key，不借用
+    if (!blooms_.mayContain(blkid, key, keybuf, len)) return ENOENT;
+
+    DataBlock data;
+    data.setTable(this);
+    if (mapped_)
+        data.attach(mappedBlock(blkid));
+    else {
+        guard = PageGuard(kBuffer, name_.c_str(), blkid);
+        data.attach(guard.buffer());
+    }
+    if (data.buffer_ == NULL) return EIO;
 
-    BlockIterator prev = beginblock();
+    unsigned short index = data.searchRecord(keybuf, len);
+    if (index < data.getSlots()) {
+        data.refslots(index, record);
+        unsigned char *pkey;
+        unsigned int klen;
+        record.refByIndex(&pkey, &klen, key);
+        DataType *type = info_->fields[key].type;
+        if (!type->less(pkey, klen, (unsigned char *) keybuf, len) &&
+            !type->less((unsigned char *) keybuf, len, pkey, klen))
+            return S_OK;
+    }
+    guard.release();
+    return ENOENT;
+}
+
+void Table::buildFences()
+{
+    unsigned int key = info_->key;
+    fences_.init(info_->fields[key].type, firstBlock());
     for (BlockIterator bi = beginblock(); bi != endblock(); ++bi) {
+        // 空block没有fence，只有空表的第1个block或链尾才会出现
+        if (bi->getSlots() == 0) continue;
         // 获取第1个记录
         Record record;
         bi->refslots(0, record);
-
-        // 与参数比较
         unsigned char *pkey;
         unsigned int klen;
         record.refByIndex(&pkey, &klen, key);
-        bool bret = type->less(pkey, klen, (unsigned char *) keybuf, len);
-        if (bret) {
-            prev = bi;
-            continue;
-        }
-        // 要排除相等的情况
-        bret = type->less((unsigned char *) keybuf, len, pkey, klen);
-        if (bret)
-            return prev->getSelf(); //
-        else
-            return bi->getSelf(); // 相等
+        fences_.append(bi->getSelf(), pkey, klen);
     }
-    return prev->getSelf();
+    fences_.finish();
 }
 
-int Table::insert(unsigned int blkid, std::vector<struct iovec> &iov)
+void Table::refence(DataBlock &block)
 {
+    if (!fences_.valid()) return;
+    if (block.getSlots() == 0) {
+        fences_.drop(block.getSelf());
+        return;
+    }
+    Record record;
+    block.refslots(0, record);
+    unsigned char *pkey;
+    unsigned int klen;
+    record.refByIndex(&pkey, &klen, info_->key);
+    fences_.set(block.getSelf(), pkey, klen);
+}
+
+int Table::insert(
+    unsigned int blkid,
+    std::vector<struct iovec> &iov,
+    AccessStrategy *strategy)
+{
+    if (mapped_) return EPERM;
     DataBlock data;
     SuperBlock super;
     data.setTable(this);
 
-    // 从buffer中借用
-    BufDesp *bd = kBuffer.borrow(name_.c_str(), blkid);
-    data.attach(bd->buffer);
+    // 从buffer中借用，守卫析构时释放；超块是热点，不经过策略
+    PageGuard guard(
+        kBuffer, name_.c_str(), blkid, PageGuard::EXCLUSIVE, strategy);
+    data.attach(guard.buffer());
     // 尝试插入
     std::pair<bool, unsigned short> ret = data.insertRecord(iov);
     if (ret.first) {
-        kBuffer.releaseBuf(bd); // 释放buffer
+        // 插在第1条记录之前，fence随之改变
+        if (ret.second == 0) refence(data);
+        guard.dirty();
+        guard.release(); // 释放buffer
         // 修改表头统计
-        bd = kBuffer.borrow(name_.c_str(), 0);
-        super.attach(bd->buffer);
+        guard = PageGuard(kBuffer, name_.c_str(), 0, PageGuard::EXCLUSIVE);
+        super.attach(guard.buffer());
         super.setRecords(super.getRecords() + 1);
-        bd->relref();
+        guard.dirty();
         return S_OK; // 插入成功
-    } else if (ret.second == (unsigned short) -1) {
-        kBuffer.releaseBuf(bd); // 释放buffer
-        return EEXIST;          // key已经存在
-    }
+    } else if (ret.second == (unsigned short) -1)
+        return EEXIST; // key已经存在
 
     // 分裂block
     unsigned short insert_position = ret.second;
@@ -256,16 +620,18 @@ int Table::insert(unsigned int blkid, std::vector<struct iovec> &iov)
     // 先分配一个block
     DataBlock next;
     next.setTable(this);
-    blkid = allocate();
-    BufDesp *bd2 = kBuffer.borrow(name_.c_str(), blkid);
-    next.attach(bd2->buffer);
+    blkid = allocate(strategy);
+    if (blkid == 0) return ENOSPC;
+    PageGuard guard2(
+        kBuffer, name_.c_str(), blkid, PageGuard::EXCLUSIVE, strategy);
+    next.attach(guard2.buffer());
 
     // 移动记录到新的block上
     while (data.getSlots() > split_position.first) {
         Record record;
         data.refslots(split_position.first, record);
         next.copyRecord(record);
-        data.deallocate(split_position.first);
+        data.deallocateRecord(split_position.first);
     }
     // 插入新记录，不需要再重排顺序
     if (split_position.second)
@@ -275,23 +641,35 @@ int Table::insert(unsigned int blkid, std::vector<struct iovec> &iov)
     // 维持数据链
     next.setNext(data.getNext());
     data.setNext(next.getSelf());
-    bd2->relref();
-
-    bd = kBuffer.borrow(name_.c_str(), 0);
-    super.attach(bd->buffer);
+    zonemap_.setNext(next.getSelf(), next.getNext());
+    zonemap_.setNext(data.getSelf(), data.getNext());
+    blooms_.setNext(next.getSelf(), next.getNext());
+    blooms_.setNext(data.getSelf(), data.getNext());
+    refence(data);
+    refence(next);
+    guard.dirty();
+    guard2.dirty();
+    guard.release();
+    guard2.release();
+
+    guard = PageGuard(kBuffer, name_.c_str(), 0, PageGuard::EXCLUSIVE);
+    super.attach(guard.buffer());
     super.setRecords(super.getRecords() + 1);
-    bd->relref();
+    guard.dirty();
     return S_OK;
 }
 int Table::remove(unsigned int blkid, void *keybuf, unsigned int len)
 {
+    if (mapped_) return EPERM;
+    // 过滤器确定block上没有该key，不借用
+    if (!blooms_.mayContain(blkid, info_->key, keybuf, len)) return S_FALSE;
     DataBlock data;
     SuperBlock super;
     data.setTable(this);
 
-    // 从buffer中借用
-    BufDesp *bd = kBuffer.borrow(name_.c_str(), blkid);
-    data.attach(bd->buffer);
+    // 从buffer中借用，守卫析构时释放
+    PageGuard guard(kBuffer, name_.c_str(), blkid, PageGuard::EXCLUSIVE);
+    data.attach(guard.buffer());
     RelationInfo *info = data.table_->info_;
     unsigned int key = info->key;
     DataType *type = info->fields[key].type;
@@ -307,7 +685,9 @@ int Table::remove(unsigned int blkid, void *keybuf, unsigned int len)
     if(!    (!type->less(pkey, klen, (unsigned char *) keybuf, len)
         &&  !type->less((unsigned char *) keybuf, len, pkey, klen)   ))
     return S_FALSE;
-    data.deallocate(getIndex);
+    data.deallocateRecord(getIndex);
+    if (getIndex == 0) refence(data);
+    guard.dirty();
     //考虑是否合并block
     //如果需要，先清扫TombStone记录
     if(data.getFreeSize() > 8172) //每个block总空间为16344B，空闲空间超过一半时考虑合并
@@ -316,27 +696,33 @@ int Table::remove(unsigned int blkid, void *keybuf, unsigned int len)
         {
             DataBlock next;
             next.setTable(this);
-            BufDesp *bd2 = kBuffer.borrow(name_.c_str(), data.getNext());
-            next.attach(bd2->buffer);
+            PageGuard guard2(
+                kBuffer, name_.c_str(), data.getNext(), PageGuard::EXCLUSIVE);
+            next.attach(guard2.buffer());
             if(16344 - (next.getFreeSize()) <= (data.getFreeSize())) //可以合并
             {
                 if((16344 - (next.getFreeSize())) > (data.getFreespaceSize())) //需要清理
                 {
                     data.shrink();
-                    data.reorder(type,key);
                 }
                 while(next.getSlots())
                 {
                     Record record;
                     next.refslots(0,record);
                     data.copyRecord(record);
-                    next.deallocate(0);
+                    next.deallocateRecord(0);
                 }
+                refence(data);
                 //维持数据链
                 data.setNext(next.getNext());
-                //将空block放置在idle链上
-                deallocate(next.getSelf());
-                bd2->relref();
+                zonemap_.setNext(data.getSelf(), data.getNext());
+                blooms_.setNext(data.getSelf(), data.getNext());
+                guard2.dirty();
+                //将空block放置在idle链上，deallocate自己独占该block
+                unsigned int merged = next.getSelf();
+                next.detach();
+                guard2.release();
+                deallocate(merged);
             }
             else if(next.getSlots() > data.getSlots()) //尝试两个block均分slots
             {
@@ -350,30 +736,36 @@ int Table::remove(unsigned int blkid, void *keybuf, unsigned int len)
                     if(!ret && !sig) //空间不足,且未清理
                     {
                         data.shrink();
-                        data.reorder(type,key);
                         sig = 1; //已清理标记
                         ret = data.copyRecord(record); //重新尝试插入
                     }
                     if(!ret) break; //无法插入，终止
-                    next.deallocate(0);
+                    next.deallocateRecord(0);
                 }
+                refence(data);
+                refence(next);
+                guard2.dirty();
             }
         }
     }
-    bd = kBuffer.borrow(name_.c_str(), 0);
-    super.attach(bd->buffer);
+    guard.dirty();
+    guard.release();
+
+    guard = PageGuard(kBuffer, name_.c_str(), 0, PageGuard::EXCLUSIVE);
+    super.attach(guard.buffer());
     super.setRecords(super.getRecords() - 1);
-    bd->relref();
+    guard.dirty();
     return S_OK;
 }
 
 int Table::update(unsigned int blkid, std::vector<struct iovec> &iov){
+    if (mapped_) return EPERM;
     DataBlock data;
     data.setTable(this);
     // 从buffer中借用
 
-    BufDesp *bd = kBuffer.borrow(name_.c_str(), blkid);
-    data.attach(bd->buffer);
+    PageGuard guard(kBuffer, name_.c_str(), blkid, PageGuard::EXCLUSIVE);
+    data.attach(guard.buffer());
 
     RelationInfo *info = data.table_->info_;
     unsigned int key = info->key;
@@ -381,6 +773,7 @@ int Table::update(unsigned int blkid, std::vector<struct iovec> &iov){
 
     //先备份旧记录，如果删除后无法插入更新的记录，则恢复旧记录
     unsigned short getIndex = data.searchRecord(iov[key].iov_base, iov[key].iov_len);
+    if (getIndex >= data.getSlots()) return S_FALSE;
     Record record;
     data.refslots(getIndex, record);
     unsigned char *pkey;
@@ -389,13 +782,22 @@ int Table::update(unsigned int blkid, std::vector<struct iovec> &iov){
     if(!    (!type->less(pkey, klen, (unsigned char *) iov[key].iov_base, unsigned int(iov[key].iov_len))
         &&  !type->less((unsigned char *) iov[key].iov_base, unsigned int(iov[key].iov_len), pkey, klen)   ))
     return S_FALSE;
+    std::vector<unsigned char> backup(
+        record.buffer_, record.buffer_ + record.length());
+    // remove和insert自己独占block，先释放
+    data.detach();
+    guard.release();
 
     int flag = remove(blkid, iov[key].iov_base, unsigned int(iov[key].iov_len));
     if(flag == S_FALSE) return S_FALSE;
     else flag = insert(blkid, iov);
     if(flag == S_FALSE)
     {
+        guard = PageGuard(kBuffer, name_.c_str(), blkid, PageGuard::EXCLUSIVE);
+        data.attach(guard.buffer());
+        record.attach(&backup[0], (unsigned short) backup.size());
         data.copyRecord(record);
+        guard.dirty();
         return S_FALSE;
     }
     else return S_OK;
@@ -404,31 +806,28 @@ int Table::update(unsigned int blkid, std::vector<struct iovec> &iov){
 
 size_t Table::recordCount()
 {
-    BufDesp *bd = kBuffer.borrow(name_.c_str(), 0);
+    PageGuard guard(kBuffer, name_.c_str(), 0);
     SuperBlock super;
-    super.attach(bd->buffer);
+    super.attach(guard.buffer());
     size_t count = super.getRecords();
-    kBuffer.releaseBuf(bd);
     return count;
 }
 
 unsigned int Table::dataCount()
 {
-    BufDesp *bd = kBuffer.borrow(name_.c_str(), 0);
+    PageGuard guard(kBuffer, name_.c_str(), 0);
     SuperBlock super;
-    super.attach(bd->buffer);
+    super.attach(guard.buffer());
     unsigned int count = super.getDataCounts();
-    kBuffer.releaseBuf(bd);
     return count;
 }
 
 unsigned int Table::idleCount()
 {
-    BufDesp *bd = kBuffer.borrow(name_.c_str(), 0);
+    PageGuard guard(kBuffer, name_.c_str(), 0);
     SuperBlock super;
-    super.attach(bd->buffer);
+    super.attach(guard.buffer());
     unsigned int count = super.getIdleCounts();
-    kBuffer.releaseBuf(bd);
     return count;
 }
 
@@ -0,0 +1,154 @@
+////
+// @file zonemap.cc
+// @brief
+// 实现block级摘要
+//
+// @author niexw
+// @email niexiaowen@uestc.edu.cn
+//
+#include <db/zonemap.h>
+#include <db/block.h>
+
+namespace db {
+
+namespace {
+// 将一个值并入列摘要
+void widen(
+    ColumnZone &zone,
+    DataType *type,
+    unsigned char *val,
+    unsigned int len)
+{
+    // 长度为0的域视为空值
+    if (len == 0) {
+        ++zone.nulls;
+        return;
+    }
+    if (zone.empty) {
+        zone.min.assign((const char *) val, len);
+        zone.max.assign((const char *) val, len);
+        zone.empty = false;
+        return;
+    }
+    if (type->less(
+            val,
+            len,
+            (unsigned char *) zone.min.data(),
+            (unsigned int) zone.min.size()))
+        zone.min.assign((const char *) val, len);
+    if (type->less(
+            (unsigned char *) zone.max.data(),
+            (unsigned int) zone.max.size(),
+            val,
+            len))
+        zone.max.assign((const char *) val, len);
+}
+} // namespace
+
+void ZoneMap::init(RelationInfo *info, const std::vector<unsigned int> &fields)
+{
+    info_ = info;
+    fields_ = fields;
+    zones_.clear();
+}
+
+int ZoneMap::column(unsigned int field)
+{
+    for (size_t i = 0; i < fields_.size(); ++i)
+        if (fields_[i] == field) return (int) i;
+    return -1;
+}
+
+void ZoneMap::reset(unsigned int blkid, unsigned int next)
+{
+    if (!enabled()) return;
+    BlockZone &zone = zones_[blkid];
+    zone.next = next;
+    zone.exact = true;
+    zone.columns.assign(fields_.size(), ColumnZone());
+}
+
+void ZoneMap::build(DataBlock &block)
+{
+    if (!enabled()) return;
+    unsigned int blkid = block.getSelf();
+    reset(blkid, block.getNext());
+
+    // 枚举所有记录
+    BlockZone &zone = zones_[blkid];
+    for (unsigned short i = 0; i < block.getSlots(); ++i) {
+        Record record;
+        block.refslots(i, record);
+        for (size_t c = 0; c < fields_.size(); ++c) {
+            unsigned char *pval;
+            unsigned int len;
+            record.refByIndex(&pval, &len, fields_[c]);
+            widen(zone.columns[c], info_->fields[fields_[c]].type, pval, len);
+        }
+    }
+}
+
+void ZoneMap::add(unsigned int blkid, Record &record)
+{
+    BlockZone *zone = find(blkid);
+    if (zone == NULL) return; // 未知block，等扫描时重建
+
+    for (size_t c = 0; c < fields_.size(); ++c) {
+        unsigned char *pval;
+        unsigned int len;
+        record.refByIndex(&pval, &len, fields_[c]);
+        widen(zone->columns[c], info_->fields[fields_[c]].type, pval, len);
+    }
+}
+
+void ZoneMap::remove(unsigned int blkid)
+{
+    BlockZone *zone = find(blkid);
+    if (zone) zone->exact = false;
+}
+
+void ZoneMap::setNext(unsigned int blkid, unsigned int next)
+{
+    BlockZone *zone = find(blkid);
+    if (zone) zone->next = next;
+}
+
+void ZoneMap::drop(unsigned int blkid) { zones_.erase(blkid); }
+
+BlockZone *ZoneMap::find(unsigned int blkid)
+{
+    Zones::iterator it = zones_.find(blkid);
+    return it == zones_.end() ? NULL : &it->second;
+}
+
+bool ZoneMap::mayMatch(unsigned int blkid, const ZoneRange &range)
+{
+    BlockZone *zone = find(blkid);
+    if (zone == NULL) return true;
+    int c = column(range.field);
+    if (c < 0) return true; // 该列没有摘要
+
+    // 全是空值，范围谓词不会命中
+    ColumnZone &column = zone->columns[c];
+    if (column.empty) return false;
+
+    // hi < min，或者 max < lo，则不相交
+    DataType *type = info_->fields[range.field].type;
+    if (range.hi &&
+        type->less(
+            (unsigned char *) range.hi,
+            range.hilen,
+            (unsigned char *) column.min.data(),
+            (unsigned int) column.min.size()))
+        return false;
+    if (range.lo &&
+        type->less(
+            (unsigned char *) column.max.data(),
+            (unsigned int) column.max.size(),
+            (unsigned char *) range.lo,
+            range.lolen))
+        return false;
+    return true;
+}
+
+} // namespace db
@@ -0,0 +1,88 @@
+////
+// @file arenaTest.cc
+// @brief
+// 测试buffer内存分配
+//
+// @author niexw
+// @email niexiaowen@uestc.edu.cn
+//
+#include "../catch.hpp"
+#include <db/arena.h>
+#include <db/buffer.h>
+#include <db/block.h>
+#include <db/file.h>
+#include <db/schema.h>
+using namespace db;
+
+TEST_CASE("db/arena.h")
+{
+    SECTION("alloc")
+    {
+        REQUIRE(numaNodes() >= 1);
+        REQUIRE(currentNode() < numaNodes());
+
+        // 普通页
+        bool large = false;
+        size_t size = 4 * 1024 * 1024;
+        unsigned char *ptr = (unsigned char *) arenaAlloc(size, -1, large);
+        REQUIRE(ptr);
+        REQUIRE((size_t) ptr % 4096 == 0);
+        ptr[0] = 1;
+        ptr[size - 1] = 1;
+        arenaFree(ptr, size, large);
+
+        // 大页，不支持时退回普通页
+        large = true;
+        ptr = (unsigned char *) arenaAlloc(size, 0, large);
+        REQUIRE(ptr);
+        ptr[size - 1] = 1;
+        arenaFree(ptr, size, large);
+
+        // 绑定到最后一个结点，访问后页在该结点上，无法查询时返回-1
+        int last = numaNodes() - 1;
+        large = false;
+        ptr = (unsigned char *) arenaAlloc(size, last, large);
+        REQUIRE(ptr);
+        ptr[0] = 1;
+        int node = memoryNode(ptr);
+        REQUIRE((node == -1 || node == last));
+        arenaFree(ptr, size, large);
+    }
+
+    SECTION("buffer")
+    {
+        ArenaOptions options;
+        options.largePages = true;
+        options.numa = true;
+        Buffer buffer;
+        buffer.init(&kFiles, 4, options);
+        REQUIRE(buffer.capacity() * BLOCK_SIZE >= 4 * 1024 * 1024);
+        REQUIRE(buffer.nodes() == numaNodes());
+
+        // 各结点buffer之和
+        size_t frames = 0;
+        for (unsigned short i = 0; i < buffer.nodes(); ++i)
+            frames += buffer.nodeStats(i).frames;
+        REQUIRE(frames == buffer.capacity());
+
+        // 优先从本结点分配
+        BufDesp *bd = buffer.borrow(Schema::META_FILE, 0);
+        REQUIRE(bd);
+        unsigned short node = currentNode();
+        REQUIRE(
+            buffer.nodeStats(node).allocs +
+                buffer.nodeStats(node).remoteAllocs ==
+            1);
+        NodeStats &stats = buffer.nodeStats(bd->node);
+        REQUIRE(stats.idles + 1 == stats.frames);
+        buffer.releaseBuf(bd);
+
+        // 缩小后结点统计随之减少
+        REQUIRE(buffer.resize(0) == S_OK);
+        REQUIRE(buffer.capacity() == 0);
+        for (unsigned short i = 0; i < buffer.nodes(); ++i) {
+            REQUIRE(buffer.nodeStats(i).frames == 0);
+            REQUIRE(buffer.nodeStats(i).idles == 0);
+        }
+    }
+}
@@ -0,0 +1,232 @@
+////
+// @file asyncTest.cc
+// @brief
+// 测试基于协程的异步接口，需要C++20，单独编译为atest
+//
+// @author niexw
+// @email niexiaowen@uestc.edu.cn
+//
+#include "../catch.hpp"
+#include "./fixture.h"
+#include <db/async.h>
+#include <db/table.h>
+#include <db/schema.h>
+#include <db/file.h>
+#include <chrono>
+using namespace db;
+
+namespace {
+// 插入[first, last)中步长为step的key
+Async<void> inserter(
+    AsyncLoop &loop,
+    Table &table,
+    long long first,
+    long long last,
+    long long step,
+    int &failed)
+{
+    DataType *type = table.info_->fields[0].type;
+    std::vector<char> payload(100, 'a');
+    for (long long i = first; i < last; i += step) {
+        long long key = i;
+        type->htobe(&key);
+        std::vector<struct iovec> iov(2);
+        iov[0].iov_base = &key;
+        iov[0].iov_len = 8;
+        iov[1].iov_base = &payload[0];
+        iov[1].iov_len = payload.size();
+        if (co_await insertAsync(loop, table, iov) != S_OK) ++failed;
+    }
+}
+
+// 删除[first, last)中步长为step的key
+Async<void> remover(
+    AsyncLoop &loop,
+    Table &table,
+    long long first,
+    long long last,
+    long long step,
+    int &failed)
+{
+    DataType *type = table.info_->fields[0].type;
+    for (long long i = first; i < last; i += step) {
+        long long key = i;
+        type->htobe(&key);
+        if (co_await removeAsync(loop, table, &key, 8) != S_OK) ++failed;
+    }
+}
+
+// 沿数据链统计记录数，检查key的顺序
+Async<void>
+counter(AsyncLoop &loop, Table &table, size_t &records, bool &ordered)
+{
+    AsyncBlockIterator it(loop, table);
+    DataType *type = table.info_->fields[0].type;
+    std::vector<unsigned char> last;
+    while (co_await it.next()) {
+        DataBlock &block = it.block();
+        for (unsigned short i = 0; i < block.getSlots(); ++i) {
+            Record record;
+            block.refslots(i, record);
+            unsigned char *pkey;
+            unsigned int klen;
+            record.refByIndex(&pkey, &klen, 0);
+            if (!last.empty() && !type->less(&last[0], 8, pkey, klen))
+                ordered = false;
+            last.assign(pkey, pkey + klen);
+            ++records;
+        }
+    }
+}
+
+// 异步定位key，key已是大端
+Async<void>
+locator(AsyncLoop &loop, Table &table, long long key, unsigned int &blockid)
+{
+    blockid = co_await locateAsync(loop, table, &key, 8);
+}
+
+// 轮流取下一个伪随机的blockid借用，共lookups次
+Async<void> reader(
+    AsyncLoop &loop,
+    Buffer &buffer,
+    Table &table,
+    unsigned int &next,
+    unsigned int lookups)
+{
+    while (next < lookups) {
+        unsigned int blockid = (next++ * 2654435761u) % table.maxid_ + 1;
+        BufDesp *desp =
+            co_await borrowAsync(loop, table.name_.c_str(), blockid, buffer);
+        if (desp) buffer.releaseBuf(desp);
+    }
+}
+
+// 借用blockid后立即归还
+Async<void> touch(
+    AsyncLoop &loop,
+    Buffer &buffer,
+    const char *table,
+    unsigned int blockid,
+    bool &ok)
+{
+    BufDesp *desp = co_await borrowAsync(loop, table, blockid, buffer);
+    ok = desp != NULL;
+    if (desp) buffer.releaseBuf(desp);
+}
+} // namespace
+
+TEST_CASE("db/async.h")
+{
+    dbInit();
+
+    SECTION("borrow")
+    {
+        // 新池中没有任何block，第1次挂起，第2次命中
+        Buffer buffer;
+        buffer.init(&kFiles, 1);
+        AsyncLoop loop;
+        bool first = false, second = false;
+        loop.spawn(touch(loop, buffer, Schema::META_FILE, 0, first));
+        loop.run();
+        REQUIRE(first);
+        REQUIRE(loop.stats().misses == 1);
+        REQUIRE(loop.stats().hits == 0);
+
+        loop.spawn(touch(loop, buffer, Schema::META_FILE, 0, second));
+        loop.run();
+        REQUIRE(second);
+        REQUIRE(loop.stats().misses == 1);
+        REQUIRE(loop.stats().hits == 1);
+    }
+
+    SECTION("table")
+    {
+        Column payload = {"payload", "CHAR", 100, nullptr};
+        createTable("async", {payload});
+        Table table;
+        REQUIRE(table.open("async") == S_OK);
+
+        // 16个协程交错插入，挂起期间block可能被其它协程分裂
+        AsyncLoop loop;
+        int failed = 0;
+        for (int i = 0; i < 16; ++i)
+            loop.spawn(inserter(loop, table, i, 4000, 16, failed));
+        loop.run();
+        REQUIRE(failed == 0);
+
+        size_t records = 0;
+        bool ordered = true;
+        loop.spawn(counter(loop, table, records, ordered));
+        loop.run();
+        REQUIRE(records == 4000);
+        REQUIRE(ordered);
+        REQUIRE(table.recordCount() == 4000);
+
+        // 删除一半
+        for (int i = 0; i < 8; ++i)
+            loop.spawn(remover(loop, table, i * 2, 4000, 16, failed));
+        loop.run();
+        REQUIRE(failed == 0);
+        records = 0;
+        loop.spawn(counter(loop, table, records, ordered));
+        loop.run();
+        REQUIRE(records == 2000);
+        REQUIRE(ordered);
+
+        // 重新打开后fence缓存失效，异步定位与同步定位一致
+        Table reopened;
+        REQUIRE(reopened.open("async") == S_OK);
+        REQUIRE(!reopened.fences_.valid());
+        long long key = 1999;
+        reopened.info_->fields[0].type->htobe(&key);
+        unsigned int blockid = 0;
+        loop.spawn(locator(loop, reopened, key, blockid));
+        loop.run();
+        REQUIRE(reopened.fences_.valid());
+        REQUIRE(blockid == table.locate(&key, 8));
+    }
+}
+
+TEST_CASE("db/async.h bench", "[.]")
+{
+    dbInit();
+    Column payload = {"payload", "CHAR", 1000, nullptr};
+    createTable("asyncbench", {payload});
+    Table table;
+    REQUIRE(table.open("asyncbench") == S_OK);
+    for (long long i = (long long) table.recordCount(); i < 100000; ++i) {
+        long long key = i;
+        table.info_->fields[0].type->htobe(&key);
+        std::vector<char> payload(1000, 'x');
+        std::vector<struct iovec> iov(2);
+        iov[0].iov_base = &key;
+        iov[0].iov_len = 8;
+        iov[1].iov_base = &payload[0];
+        iov[1].iov_len = payload.size();
+        table.insert(table.locate(&key, 8), iov);
+    }
+    REQUIRE(kBuffer.flush() == S_OK);
+
+    // 每轮用新的池，block都不在池中；并发数为1时相当于同步读
+    const unsigned int LOOKUPS = 4096;
+    for (unsigned int concurrency = 1; concurrency <= 256; concurrency *= 4) {
+        Buffer buffer;
+        buffer.init(&kFiles, 128);
+        AsyncLoop loop;
+        unsigned int next = 0;
+        std::chrono::steady_clock::time_point start =
+            std::chrono::steady_clock::now();
+        for (unsigned int i = 0; i < concurrency; ++i)
+            loop.spawn(reader(loop, buffer, table, next, LOOKUPS));
+        loop.run();
+        double seconds = std::chrono::duration<double>(
+                             std::chrono::steady_clock::now() - start)
+                             .count();
+        printf(
+            "concurrency=%u: %.0f lookups/s, %llu misses\n",
+            concurrency,
+            LOOKUPS / seconds,
+            loop.stats().misses);
+    }
+}
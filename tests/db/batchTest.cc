@@ -0,0 +1,85 @@
+////
+// @file batchTest.cc
+// @brief
+// 测试向量化批量扫描
+//
+// @author niexw
+// @email niexiaowen@uestc.edu.cn
+//
+#include "../catch.hpp"
+#include "./fixture.h"
+#include <db/batch.h>
+#include <db/table.h>
+#include <db/schema.h>
+#include <string>
+using namespace db;
+
+TEST_CASE("db/batch.h")
+{
+    SECTION("scan")
+    {
+        fillOrders("batched", 3000);
+        Table table;
+        REQUIRE(table.open("batched") == S_OK);
+
+        // 投影顺序与表中不同，每批至多100行
+        std::vector<unsigned int> fields;
+        fields.push_back(2);
+        fields.push_back(0);
+        fields.push_back(1);
+        BatchScanner scanner(table, fields, 100);
+        Batch batch;
+        size_t rows = 0, batches = 0;
+        long long expect = 0;
+        while (scanner.next(batch)) {
+            ++batches;
+            REQUIRE(batch.rows > 0);
+            REQUIRE(batch.rows <= 100);
+            REQUIRE(batch.columns.size() == 3);
+            REQUIRE(batch.selection.size() == batch.rows);
+
+            ColumnVector &names = batch.columns[0];
+            ColumnVector &ids = batch.columns[1];
+            ColumnVector &qtys = batch.columns[2];
+            REQUIRE(names.width_ == 0);
+            REQUIRE(ids.width_ == 8);
+            REQUIRE(qtys.width_ == 4);
+            REQUIRE(ids.size() == batch.rows);
+            for (size_t i = 0; i < batch.selection.size(); ++i) {
+                unsigned short row = batch.selection[i];
+                REQUIRE(row == i);
+                long long id = (long long) ids.data<unsigned long long>()[row];
+                REQUIRE(id == expect++);
+                REQUIRE(qtys.data<unsigned int>()[row] == id * 3);
+                unsigned int len;
+                const unsigned char *text = names.string(row, &len);
+                REQUIRE(
+                    std::string((const char *) text, len) ==
+                    "name" + std::to_string(id));
+            }
+            rows += batch.rows;
+        }
+        REQUIRE(rows == 3000);
+        REQUIRE(batches > table.dataCount());
+        REQUIRE(!scanner.next(batch));
+
+        // 过滤收缩选择向量，聚合只处理选中的行
+        BatchScanner again(table, std::vector<unsigned int>(1, 0));
+        long long sum = 0;
+        size_t selected = 0;
+        while (again.next(batch)) {
+            const unsigned long long *ids =
+                batch.columns[0].data<unsigned long long>();
+            size_t n = 0;
+            for (size_t i = 0; i < batch.selection.size(); ++i)
+                if (ids[batch.selection[i]] % 7 == 0)
+                    batch.selection[n++] = batch.selection[i];
+            batch.selection.resize(n);
+            for (size_t i = 0; i < n; ++i)
+                sum += (long long) ids[batch.selection[i]];
+            selected += n;
+        }
+        REQUIRE(selected == 429);
+        REQUIRE(sum == 7LL * 428 * 429 / 2);
+    }
+}
@@ -0,0 +1,384 @@
+////
+// @file benchTest.cc
+// @brief
+// 性能测试，默认不运行，按名字或用"[.]"标签选择运行，如utest "[.]"
+//
+// @author niexw
+// @email niexiaowen@uestc.edu.cn
+//
+#include "../catch.hpp"
+#include "./fixture.h"
+#include <db/batch.h>
+#include <db/block.h>
+#include <db/file.h>
+#include <db/predicate.h>
+#include <db/runtime.h>
+#include <db/scan.h>
+#include <db/schema.h>
+#include <db/table.h>
+#include <chrono>
+#include <random>
+#include <thread>
+#include <vector>
+using namespace db;
+
+TEST_CASE("db/runtime.h bench", "[.]")
+{
+    dbInit();
+
+    // 外部线程提交空任务，以及worker中fork-join，测量每个任务的开销
+    const int TASKS = 200000;
+    TaskGroup group;
+    std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    for (int i = 0; i < TASKS; ++i)
+        kRuntime.submit([]() {}, Runtime::FOREGROUND, &group);
+    kRuntime.wait(group);
+    double seconds = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+    printf(
+        "external: workers=%u, %.0fns/task\n",
+        kRuntime.workers(),
+        seconds * 1e9 / TASKS);
+
+    RuntimeStats before = kRuntime.stats();
+    start = std::chrono::steady_clock::now();
+    kRuntime.submit(
+        [&group]() {
+            TaskGroup children;
+            for (int i = 0; i < TASKS; ++i)
+                kRuntime.submit([]() {}, Runtime::FOREGROUND, &children);
+            kRuntime.wait(children);
+        },
+        Runtime::FOREGROUND,
+        &group);
+    kRuntime.wait(group);
+    seconds = std::chrono::duration<double>(
+                  std::chrono::steady_clock::now() - start)
+                  .count();
+    printf(
+        "fork-join: %.0fns/task, %llu steals\n",
+        seconds * 1e9 / TASKS,
+        kRuntime.stats().steals - before.steals);
+}
+
+TEST_CASE("db/file.h commit bench", "[.]")
+{
+    dbInit();
+
+    // 每个线程连续提交，比较不同并发度下每秒的提交数
+    const int COMMITS = 200;
+    for (int n = 1; n <= 16; n *= 2) {
+        CommitStats before = kFiles.commitStats();
+        std::chrono::steady_clock::time_point start =
+            std::chrono::steady_clock::now();
+        std::vector<std::thread> threads;
+        for (int i = 0; i < n; ++i)
+            threads.push_back(std::thread([]() {
+                for (int j = 0; j < COMMITS; ++j)
+                    kFiles.commit(Schema::META_FILE);
+            }));
+        for (size_t i = 0; i < threads.size(); ++i)
+            threads[i].join();
+        double seconds = std::chrono::duration<double>(
+                             std::chrono::steady_clock::now() - start)
+                             .count();
+
+        CommitStats after = kFiles.commitStats();
+        CommitStats delta;
+        delta.requests = after.requests - before.requests;
+        delta.syncs = after.syncs - before.syncs;
+        printf(
+            "%d threads: %.0f commits/s, %.2f commits/sync\n",
+            n,
+            delta.requests / seconds,
+            delta.batch());
+    }
+}
+
+TEST_CASE("db/block.h reorder bench", "[.]")
+{
+    // 随机的id和只有低2个字节不同的id
+    const unsigned long long ranges[] = {0, 60000};
+    const char *names[] = {"BIGINT", "VARCHAR"};
+    const int ROUNDS = 2000;
+    for (int r = 0; r < 2; ++r) {
+        DataBlock data;
+        unsigned char buffer[BLOCK_SIZE];
+        data.attach(buffer);
+        data.clear(1, 3, BLOCK_TYPE_DATA);
+        std::mt19937_64 rng(1);
+        unsigned short count = fillUnordered(data, rng, ranges[r]);
+
+        // 每轮先按另一列打乱，再计时按目标列重排
+        for (unsigned int key = 0; key < 2; ++key) {
+            DataType *type = findDataType(names[key]);
+            DataType *other = findDataType(names[1 - key]);
+            double seconds = 0;
+            for (int round = 0; round < ROUNDS; ++round) {
+                data.reorder(other, 1 - key);
+                std::chrono::steady_clock::time_point start =
+                    std::chrono::steady_clock::now();
+                data.reorder(type, key);
+                seconds += std::chrono::duration<double>(
+                               std::chrono::steady_clock::now() - start)
+                               .count();
+            }
+            REQUIRE(ordered(data, type, key));
+            printf(
+                "reorder %u slots by %s%s: %.2f us\n",
+                count,
+                names[key],
+                ranges[r] ? " (dense id)" : "",
+                seconds / ROUNDS * 1e6);
+        }
+    }
+}
+
+TEST_CASE("db/block.h insert bench", "[.]")
+{
+    // 装满后随机删掉一半，再按键插入直到装满，按槽位数分段统计插入的耗时
+    const int ROUNDS = 2000;
+    const unsigned short BUCKET = 100;
+    std::vector<double> seconds;
+    std::vector<unsigned long long> inserts;
+    DataBlock data;
+    unsigned char buffer[BLOCK_SIZE];
+    data.attach(buffer);
+    std::mt19937_64 rng(1);
+    for (int round = 0; round < ROUNDS; ++round) {
+        data.clear(1, 3, BLOCK_TYPE_DATA);
+        while (insertSorted(data, rng())) {}
+        for (unsigned short i = data.getSlots(); i-- > 0;)
+            if (rng() % 2) data.deallocateRecord(i);
+        while (true) {
+            unsigned short bucket = data.getSlots() / BUCKET;
+            if (bucket >= seconds.size()) {
+                seconds.resize(bucket + 1);
+                inserts.resize(bucket + 1);
+            }
+            std::chrono::steady_clock::time_point start =
+                std::chrono::steady_clock::now();
+            bool inserted = insertSorted(data, rng());
+            seconds[bucket] += std::chrono::duration<double>(
+                                   std::chrono::steady_clock::now() - start)
+                                   .count();
+            if (!inserted) break;
+            ++inserts[bucket];
+        }
+    }
+    for (size_t i = 0; i < seconds.size(); ++i)
+        if (inserts[i])
+            printf(
+                "insert at %zu-%zu slots: %.0f ns\n",
+                i * BUCKET,
+                (i + 1) * BUCKET - 1,
+                seconds[i] / inserts[i] * 1e9);
+}
+
+TEST_CASE("db/table.h mmap bench", "[.]")
+{
+    dbInit();
+
+    // 顺序插入，填满约200个block
+    fillPayload("mmapbench", 20000, 120);
+    Table table;
+    REQUIRE(table.open("mmapbench") == S_OK);
+
+    // 比较buffer扫描与映射扫描的吞吐率
+    Table mapped;
+    REQUIRE(mapped.open("mmapbench", Table::MAPPED) == S_OK);
+    Table *tables[] = {&table, &mapped};
+    const char *names[] = {"buffer", "mmap"};
+    for (int t = 0; t < 2; ++t) {
+        std::chrono::steady_clock::time_point start =
+            std::chrono::steady_clock::now();
+        size_t blocks = 0;
+        size_t records = 0;
+        for (int round = 0; round < 50; ++round)
+            for (Table::BlockIterator bi = tables[t]->beginblock();
+                 bi != tables[t]->endblock();
+                 ++bi, ++blocks)
+                for (DataBlock::RecordIterator ri = bi->beginrecord();
+                     ri != bi->endrecord();
+                     ++ri)
+                    ++records;
+        double seconds = std::chrono::duration<double>(
+                             std::chrono::steady_clock::now() - start)
+                             .count();
+        printf(
+            "%s: %zd records, %.1fMB/s\n",
+            names[t],
+            records,
+            blocks * (double) BLOCK_SIZE / seconds / 1024 / 1024);
+    }
+}
+
+TEST_CASE("db/scan.h bench", "[.]")
+{
+    dbInit();
+    fillPayload("scanbench", 400000, 120);
+    Table table;
+    REQUIRE(table.open("scanbench") == S_OK);
+
+    // filter + count：统计key能被7整除的记录
+    unsigned int cores = std::thread::hardware_concurrency();
+    if (cores == 0) cores = 1;
+    for (unsigned int threads = 1; threads <= cores; threads *= 2) {
+        ScanOptions options;
+        options.threads = threads;
+        // 各worker的计数隔开一个cache line，避免伪共享
+        std::vector<size_t> counts(threads * 8, 0);
+        ScanStats stats;
+        std::chrono::steady_clock::time_point start =
+            std::chrono::steady_clock::now();
+        size_t blocks = 0;
+        for (int round = 0; round < 20; ++round) {
+            table.scanRecords(
+                [&](unsigned int worker, Record &record) {
+                    if (keyOf(record) % 7 == 0) ++counts[worker * 8];
+                },
+                options,
+                &stats);
+            blocks += stats.blocks;
+        }
+        double seconds = std::chrono::duration<double>(
+                             std::chrono::steady_clock::now() - start)
+                             .count();
+        size_t count = 0;
+        for (unsigned int i = 0; i < threads; ++i)
+            count += counts[i * 8];
+        printf(
+            "threads=%u: %zd matched, %zd steals, %.2fGB/s\n",
+            threads,
+            count / 20,
+            stats.steals,
+            blocks * (double) BLOCK_SIZE / seconds / 1024 / 1024 / 1024);
+    }
+}
+
+TEST_CASE("db/batch.h bench", "[.]")
+{
+    dbInit();
+    fillOrders("batchbench", 400000);
+    Table table;
+    REQUIRE(table.open("batchbench") == S_OK);
+    const int ROUNDS = 10;
+
+    // 逐条迭代，每个字段调用一次refByIndex
+    std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    long long sum = 0;
+    size_t rows = 0;
+    for (int round = 0; round < ROUNDS; ++round) {
+        for (Table::BlockIterator bi = table.beginblock();
+             bi != table.endblock();
+             ++bi) {
+            for (DataBlock::RecordIterator ri = bi->beginrecord();
+                 ri != bi->endrecord();
+                 ++ri) {
+                unsigned char *pkey, *pqty;
+                unsigned int klen, qlen;
+                ri->refByIndex(&pkey, &klen, 0);
+                ri->refByIndex(&pqty, &qlen, 1);
+                unsigned long long id;
+                unsigned int qty;
+                ::memcpy(&id, pkey, sizeof(id));
+                ::memcpy(&qty, pqty, sizeof(qty));
+                if (be64toh(id) % 7 == 0) sum += be32toh(qty);
+                ++rows;
+            }
+        }
+    }
+    double seconds = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+    printf("iterator: %.0f rows/s, sum=%lld\n", rows / seconds, sum);
+
+    // 批量解码两列，在列向量上过滤和聚合
+    std::vector<unsigned int> fields;
+    fields.push_back(0);
+    fields.push_back(1);
+    start = std::chrono::steady_clock::now();
+    sum = 0;
+    rows = 0;
+    Batch batch;
+    for (int round = 0; round < ROUNDS; ++round) {
+        BatchScanner scanner(table, fields);
+        while (scanner.next(batch)) {
+            const unsigned long long *ids =
+                batch.columns[0].data<unsigned long long>();
+            const unsigned int *qtys = batch.columns[1].data<unsigned int>();
+            size_t n = 0;
+            for (size_t i = 0; i < batch.selection.size(); ++i) {
+                unsigned short row = batch.selection[i];
+                batch.selection[n] = row;
+                n += ids[row] % 7 == 0;
+            }
+            for (size_t i = 0; i < n; ++i)
+                sum += qtys[batch.selection[i]];
+            rows += batch.rows;
+        }
+    }
+    seconds = std::chrono::duration<double>(
+                  std::chrono::steady_clock::now() - start)
+                  .count();
+    printf("batch: %.0f rows/s, sum=%lld\n", rows / seconds, sum);
+}
+
+TEST_CASE("db/predicate.h bench", "[.]")
+{
+    // 4M个INT，qty < 阈值的选择率约50%
+    const size_t ROWS = 4 << 20;
+    std::vector<unsigned int> values(ROWS);
+    std::mt19937 rng(1);
+    for (size_t i = 0; i < ROWS; ++i)
+        values[i] = rng() % 1000;
+    Bitmap bitmap((ROWS + 63) / 64);
+    std::vector<unsigned long long> list;
+    for (unsigned long long i = 0; i < 8; ++i)
+        list.push_back(i * 97);
+
+    const char *names[] = {"scalar", "sse4.2", "avx2", "avx512"};
+    const int ROUNDS = 20;
+    for (int level = SIMD_SCALAR; level <= cpuSimdLevel(); ++level) {
+        setSimdLevel((SimdLevel) level);
+        const IntKernels *kernels = findKernels(findDataType("INT"));
+        unsigned long long hits = 0;
+        std::chrono::steady_clock::time_point start =
+            std::chrono::steady_clock::now();
+        for (int round = 0; round < ROUNDS; ++round) {
+            kernels->compare(values.data(), ROWS, CMP_LT, 500, bitmap.data());
+            hits += bitmap[round];
+        }
+        double compare = std::chrono::duration<double>(
+                             std::chrono::steady_clock::now() - start)
+                             .count();
+        start = std::chrono::steady_clock::now();
+        for (int round = 0; round < ROUNDS; ++round) {
+            kernels->between(values.data(), ROWS, 200, 700, bitmap.data());
+            hits += bitmap[round];
+        }
+        double between = std::chrono::duration<double>(
+                             std::chrono::steady_clock::now() - start)
+                             .count();
+        start = std::chrono::steady_clock::now();
+        for (int round = 0; round < ROUNDS; ++round) {
+            kernels->in(
+                values.data(), ROWS, list.data(), list.size(), bitmap.data());
+            hits += bitmap[round];
+        }
+        double in = std::chrono::duration<double>(
+                        std::chrono::steady_clock::now() - start)
+                        .count();
+        printf(
+            "%s: compare %.0f, between %.0f, in(8) %.0f Mrows/s (%llu)\n",
+            names[level],
+            ROWS * ROUNDS / compare / 1e6,
+            ROWS * ROUNDS / between / 1e6,
+            ROWS * ROUNDS / in / 1e6,
+            hits);
+    }
+    setSimdLevel(cpuSimdLevel());
+}
@@ -6,11 +6,14 @@
 // @email niexiaowen@uestc.edu.cn
 //
 #include "../catch.hpp"
+#include "./fixture.h"
 #include <db/block.h>
 #include <db/record.h>
 #include <db/buffer.h>
 #include <db/file.h>
 #include <db/table.h>
+#include <algorithm>
+#include <random>
 
 using namespace db;
 
@@ -23,7 +26,7 @@ TEST_CASE("db/block.h")
         REQUIRE(sizeof(Trailer) % 8 == 0);
         REQUIRE(
             sizeof(SuperHeader) ==
-            sizeof(CommonHeader) + sizeof(TimeStamp) + 9 * sizeof(int));
+            sizeof(CommonHeader) + sizeof(TimeStamp) + 11 * sizeof(int));
         REQUIRE(sizeof(SuperHeader) % 8 == 0);
         REQUIRE(sizeof(IdleHeader) == sizeof(CommonHeader) + sizeof(int));
         REQUIRE(sizeof(IdleHeader) % 8 == 0);
@@ -138,8 +141,8 @@ TEST_CASE("db/block.h")
         data.clear(1, 3, BLOCK_TYPE_DATA);
 
         // 分配8字节
-        std::pair<unsigned char *, bool> alloc_ret = data.allocate(8, 0);
-        REQUIRE(alloc_ret.first == buffer + sizeof(DataHeader));
+        unsigned char *space = data.allocate(8, 0);
+        REQUIRE(space == buffer + sizeof(DataHeader));
         REQUIRE(data.getFreeSpace() == sizeof(DataHeader) + 8);
         REQUIRE(
             data.getFreeSize() ==
@@ -164,8 +167,8 @@ TEST_CASE("db/block.h")
         record.set(iov, &h);
 
         // 分配5字节
-        alloc_ret = data.allocate(5, 0);
-        REQUIRE(alloc_ret.first == buffer + sizeof(DataHeader) + 8);
+        space = data.allocate(5, 0);
+        REQUIRE(space == buffer + sizeof(DataHeader) + 8);
         REQUIRE(data.getFreeSpace() == sizeof(DataHeader) + 2 * 8);
         REQUIRE(
             data.getFreeSize() ==
@@ -188,8 +191,8 @@ TEST_CASE("db/block.h")
         record.set(iov, &h);
 
         // 分配711字节
-        alloc_ret = data.allocate(711, 0);
-        REQUIRE(alloc_ret.first == buffer + sizeof(DataHeader) + 8 * 2);
+        space = data.allocate(711, 0);
+        REQUIRE(space == buffer + sizeof(DataHeader) + 8 * 2);
         REQUIRE(data.getFreeSpace() == sizeof(DataHeader) + 2 * 8 + 712);
         REQUIRE(
             data.getFreeSize() ==
@@ -241,10 +244,11 @@ TEST_CASE("db/block.h")
         REQUIRE(
             (unsigned char *) pslots ==
             buffer + BLOCK_SIZE - sizeof(int) - 2 * sizeof(Slot));
-        REQUIRE(be16toh(pslots[0].offset) == sizeof(DataHeader));
-        REQUIRE(be16toh(pslots[0].length) == 8);
-        REQUIRE(be16toh(pslots[1].offset) == sizeof(DataHeader) + 8);
-        REQUIRE(be16toh(pslots[1].length) == 712);
+        // 记录向前移动，slots[]的顺序不变
+        REQUIRE(be16toh(pslots[0].offset) == sizeof(DataHeader) + 8);
+        REQUIRE(be16toh(pslots[0].length) == 712);
+        REQUIRE(be16toh(pslots[1].offset) == sizeof(DataHeader));
+        REQUIRE(be16toh(pslots[1].length) == 8);
         REQUIRE(data.getTrailerSize() == 16);
 
         record.attach(buffer + sizeof(DataHeader) + 8, 8);
@@ -252,7 +256,7 @@ TEST_CASE("db/block.h")
 
         // 回收第3个空间
         size = data.getFreeSize();
-        data.deallocate(1);
+        data.deallocate(0);
         REQUIRE(data.getFreeSize() == size + 712 + 8);
         record.attach(buffer + sizeof(DataHeader) + 8, 8);
         REQUIRE(!record.isactive());
@@ -318,10 +322,10 @@ TEST_CASE("db/block.h")
 
         // 分配空间
         unsigned short len = (unsigned short) Record::size(iov);
-        std::pair<unsigned char *, bool> alloc_ret = data.allocate(len, 0);
+        unsigned char *space = data.allocate(len, 0);
         // 填充记录
         Record record;
-        record.attach(alloc_ret.first, len);
+        record.attach(space, len);
         unsigned char header = 0;
         record.set(iov, &header);
         // 重新排序
@@ -350,9 +354,9 @@ TEST_CASE("db/block.h")
         // 分配空间
         unsigned short len2 = len;
         len = (unsigned short) Record::size(iov);
-        alloc_ret = data.allocate(len, 0);
+        space = data.allocate(len, 0);
         // 填充记录
-        record.attach(alloc_ret.first, len);
+        record.attach(space, len);
         record.set(iov, &header);
         REQUIRE(be16toh(slot->offset) == sizeof(DataHeader));
         REQUIRE(be16toh(slot->length) == len + 5);
@@ -380,6 +384,109 @@ TEST_CASE("db/block.h")
         REQUIRE(be16toh(slot->length) == len + 5);
     }
 
+    SECTION("radix")
+    {
+        DataBlock data;
+        unsigned char buffer[BLOCK_SIZE];
+        data.attach(buffer);
+        data.clear(1, 3, BLOCK_TYPE_DATA);
+        std::mt19937_64 rng(7);
+        unsigned short count = fillUnordered(data, rng, 0);
+        REQUIRE(count > 300);
+
+        DataType *bigint = findDataType("BIGINT");
+        DataType *varchar = findDataType("VARCHAR");
+        REQUIRE(!ordered(data, bigint, 0));
+        data.reorder(bigint, 0);
+        REQUIRE(data.getSlots() == count);
+        REQUIRE(ordered(data, bigint, 0));
+
+        // 按name重排，前缀相同的按完整的键比较，重排后能查找到每个name
+        data.reorder(varchar, 1);
+        REQUIRE(ordered(data, varchar, 1));
+        for (unsigned short i = 0; i < count; ++i) {
+            Record record;
+            data.refslots(i, record);
+            unsigned char *pkey;
+            unsigned int len;
+            record.refByIndex(&pkey, &len, 1);
+            unsigned short index = varchar->search(buffer, 1, pkey, len);
+            REQUIRE(index <= i);
+            Record found;
+            data.refslots(index, found);
+            unsigned char *pfound;
+            unsigned int flen;
+            found.refByIndex(&pfound, &flen, 1);
+            REQUIRE(flen == len);
+            REQUIRE(memcmp(pfound, pkey, len) == 0);
+        }
+
+        // 再按id重排，slots[]仍是同一组记录
+        data.reorder(bigint, 0);
+        REQUIRE(ordered(data, bigint, 0));
+        REQUIRE(data.getSlots() == count);
+
+        // id只有低2个字节不同时走基数排序
+        data.clear(1, 3, BLOCK_TYPE_DATA);
+        count = fillUnordered(data, rng, 60000);
+        data.reorder(bigint, 0);
+        REQUIRE(ordered(data, bigint, 0));
+        data.reorder(varchar, 1);
+        REQUIRE(ordered(data, varchar, 1));
+        data.reorder(bigint, 0);
+        REQUIRE(ordered(data, bigint, 0));
+        REQUIRE(data.getSlots() == count);
+    }
+
+    SECTION("compact")
+    {
+        DataBlock data;
+        unsigned char buffer[BLOCK_SIZE];
+        data.attach(buffer);
+        data.clear(1, 3, BLOCK_TYPE_DATA);
+        std::mt19937_64 rng(11);
+        DataType *bigint = findDataType("BIGINT");
+        unsigned short count = fillUnordered(data, rng, 0);
+        data.reorder(bigint, 0);
+
+        // 隔一个删一个，留下空洞，后面的分配要先回收
+        for (unsigned short i = count; i-- > 0;)
+            if (i % 2) data.deallocate(i);
+        count = data.getSlots();
+        std::vector<unsigned long long> ids;
+        for (unsigned short i = 0; i < count; ++i) {
+            Record record;
+            data.refslots(i, record);
+            unsigned char *pkey;
+            unsigned int len;
+            record.refByIndex(&pkey, &len, 0);
+            ids.push_back(be64toh(*(unsigned long long *) pkey));
+        }
+
+        // 按键插入直到装满，不调用reorder，slots[]始终有序
+        while (true) {
+            unsigned long long id = rng();
+            if (!insertSorted(data, id)) break;
+            ids.push_back(id);
+            REQUIRE(ordered(data, bigint, 0));
+        }
+        REQUIRE(data.getSlots() > count);
+        REQUIRE(data.getFreeSpace() > data.getFreeSize());
+
+        // 回收后记录完好
+        std::sort(ids.begin(), ids.end());
+        REQUIRE(data.getSlots() == ids.size());
+        for (unsigned short i = 0; i < data.getSlots(); ++i) {
+            Record record;
+            data.refslots(i, record);
+            unsigned char *pkey;
+            unsigned int len;
+            record.refByIndex(&pkey, &len, 0);
+            REQUIRE(len == 8);
+            REQUIRE(be64toh(*(unsigned long long *) pkey) == ids[i]);
+        }
+    }
+
     SECTION("lowerbound")
     {
         char x[4] = {'a', 'c', 'e', 'k'};
@@ -431,10 +538,10 @@ TEST_CASE("db/block.h")
 
         // 分配空间
         unsigned short len = (unsigned short) Record::size(iov);
-        std::pair<unsigned char *, bool> alloc_ret = data.allocate(len, 0);
+        unsigned char *space = data.allocate(len, 0);
         // 填充记录
         Record record;
-        record.attach(alloc_ret.first, len);
+        record.attach(space, len);
         unsigned char header = 0;
         record.set(iov, &header);
         // 重新排序
@@ -458,9 +565,9 @@ TEST_CASE("db/block.h")
         // 分配空间
         unsigned short len2 = len;
         len = (unsigned short) Record::size(iov);
-        alloc_ret = data.allocate(len, 0);
+        space = data.allocate(len, 0);
         // 填充记录
-        record.attach(alloc_ret.first, len);
+        record.attach(space, len);
         record.set(iov, &header);
         // 重新排序
         data.reorder(type, 0);
@@ -736,4 +843,4 @@ TEST_CASE("db/block.h")
 
         kBuffer.releaseBuf(bd);
     }
-}
\ No newline at end of file
+}
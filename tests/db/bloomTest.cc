@@ -0,0 +1,148 @@
+////
+// @file bloomTest.cc
+// @brief
+// 测试block级Bloom过滤器
+//
+// @author niexw
+// @email niexiaowen@uestc.edu.cn
+//
+#include "../catch.hpp"
+#include <db/bloom.h>
+#include <db/predicate.h>
+#include <db/table.h>
+using namespace db;
+
+TEST_CASE("db/bloom.h")
+{
+    SECTION("filter")
+    {
+        BloomFilter filter;
+        filter.init(1000, 0.01);
+        REQUIRE(filter.size() % BloomFilter::BUCKET_SIZE == 0);
+        REQUIRE(filter.size() == BloomFilter::bytesFor(1000, 0.01));
+
+        // 没有漏判
+        for (long long i = 0; i < 1000; ++i)
+            filter.insert(hash64(&i, sizeof(i)));
+        for (long long i = 0; i < 1000; ++i)
+            REQUIRE(filter.find(hash64(&i, sizeof(i))));
+
+        // 误判率接近设定值
+        int positive = 0;
+        for (long long i = 1000; i < 101000; ++i)
+            if (filter.find(hash64(&i, sizeof(i)))) ++positive;
+        REQUIRE(positive < 100000 * 0.03);
+
+        filter.clear();
+        long long zero = 0;
+        REQUIRE(!filter.find(hash64(&zero, sizeof(zero))));
+    }
+
+    SECTION("simd")
+    {
+        // 标量和AVX2置的位相同，互相查找没有漏判，误判也一样
+        BloomFilter scalar, vector;
+        scalar.init(1000, 0.01);
+        vector.init(1000, 0.01);
+        SimdLevel level = simdLevel();
+        for (long long i = 0; i < 1000; ++i) {
+            setSimdLevel(SIMD_SCALAR);
+            scalar.insert(hash64(&i, sizeof(i)));
+            setSimdLevel(level);
+            vector.insert(hash64(&i, sizeof(i)));
+        }
+        for (long long i = 0; i < 20000; ++i) {
+            unsigned long long hash = hash64(&i, sizeof(i));
+            bool expected = scalar.find(hash);
+            REQUIRE(vector.find(hash) == expected);
+            setSimdLevel(SIMD_SCALAR);
+            REQUIRE(vector.find(hash) == expected);
+            setSimdLevel(level);
+        }
+    }
+
+    SECTION("bytesPerKey")
+    {
+        BloomFilter filter;
+        filter.initBytesPerKey(100, 2);
+        REQUIRE(filter.size() == 224); // 200B按桶取整
+        filter.initBytesPerKey(0, 0);
+        REQUIRE(filter.size() == BloomFilter::BUCKET_SIZE);
+        REQUIRE(
+            BloomFilter::bytesFor(1000, 0.001) >
+            BloomFilter::bytesFor(1000, 0.01));
+    }
+
+    SECTION("lookup")
+    {
+        // NOTE: schemaTest.cc中创建，tableTest.cc中插入记录
+        Table table;
+        REQUIRE(table.open("table") == S_OK);
+        std::vector<unsigned int> fields(1, 0);
+        BloomOptions options;
+        options.fpp = 0.001;
+        REQUIRE(table.trackBlooms(fields, options) == S_OK);
+
+        // 第1遍扫描，建立过滤器
+        ZoneRange all;
+        unsigned int blocks = 0;
+        for (Table::PrunedIterator pi = table.beginblock(all);
+             pi != table.endblock();
+             ++pi, ++blocks)
+            ;
+        REQUIRE(table.blooms_.size() == blocks);
+
+        // 查找一个不存在的key，绝大部分block不需要借用
+        long long nid = htobe64(0x7ffffffffffeLL);
+        ZoneRange range;
+        range.field = 0;
+        range.lo = &nid;
+        range.lolen = sizeof(nid);
+        range.hi = &nid;
+        range.hilen = sizeof(nid);
+        unsigned int visited = 0;
+        Table::PrunedIterator pi = table.beginblock(range);
+        for (; pi != table.endblock(); ++pi, ++visited)
+            ;
+        REQUIRE(pi.skipped + visited == blocks);
+        REQUIRE(visited <= blocks / 10);
+
+        // 存在的key一定能找到
+        Table::BlockIterator bi = table.beginblock();
+        Record record;
+        bi->refslots(0, record);
+        unsigned char *pkey;
+        unsigned int len;
+        record.refByIndex(&pkey, &len, 0);
+        REQUIRE(table.blooms_.mayContain(bi->getSelf(), 0, pkey, len));
+
+        // 点查不存在的key，过滤器拦下，不借用block
+        table.locate(&nid, sizeof(nid)); // 先建立fence缓存
+        BufferStats before = kBuffer.stats();
+        PageGuard guard;
+        Record found;
+        REQUIRE(table.lookup(&nid, sizeof(nid), guard, found) == ENOENT);
+        REQUIRE(!guard);
+        BufferStats after = kBuffer.stats();
+        REQUIRE(after.pins == before.pins);
+        REQUIRE(after.hits == before.hits);
+        REQUIRE(after.misses == before.misses);
+        // 删除同样不借用
+        REQUIRE(
+            table.remove(table.locate(&nid, sizeof(nid)), &nid, sizeof(nid)) ==
+            S_FALSE);
+        REQUIRE(kBuffer.stats().pins == before.pins);
+
+        // 存在的key借用block并找到记录
+        std::vector<unsigned char> copy(pkey, pkey + len);
+        bi.release();
+        REQUIRE(table.lookup(&copy[0], len, guard, found) == S_OK);
+        REQUIRE(guard);
+        REQUIRE(kBuffer.stats().pins == before.pins + 1);
+        unsigned char *pfound;
+        unsigned int flen;
+        found.refByIndex(&pfound, &flen, 0);
+        REQUIRE(flen == len);
+        REQUIRE(memcmp(pfound, &copy[0], len) == 0);
+    }
+}
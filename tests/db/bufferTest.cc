@@ -7,9 +7,13 @@
 // @email niexiaowen@uestc.edu.cn
 //
 #include "../catch.hpp"
+#include "./fixture.h"
+#include <thread>
 #include <db/buffer.h>
 #include <db/file.h>
 #include <db/block.h>
+#include <db/schema.h>
+#include <db/table.h>
 using namespace db;
 
 TEST_CASE("db/buffer.h")
@@ -17,7 +21,8 @@ TEST_CASE("db/buffer.h")
     SECTION("init")
     {
         kBuffer.init(&kFiles);
-        REQUIRE(kBuffer.idles() == 256 * 1024 * 1024 / BLOCK_SIZE);
+        REQUIRE(kBuffer.capacity() == 256 * 1024 * 1024 / BLOCK_SIZE);
+        REQUIRE(kBuffer.idles() <= kBuffer.capacity());
 
         BufDesp *bd = kBuffer.borrow(Schema::META_FILE, 0);
         REQUIRE(bd);
@@ -25,5 +30,532 @@ TEST_CASE("db/buffer.h")
         REQUIRE(bd->ref.load() == 1);
         kBuffer.releaseBuf(bd);
         REQUIRE(bd->ref.load() == 0);
+
+        // 命中不经过文件池
+        FileStats files = kFiles.stats();
+        bd = kBuffer.borrow(Schema::META_FILE, 0);
+        kBuffer.releaseBuf(bd);
+        REQUIRE(kFiles.stats().hits == files.hits);
+        REQUIRE(kFiles.stats().misses == files.misses);
+    }
+
+    SECTION("resize")
+    {
+        Buffer buffer;
+        buffer.init(&kFiles, 2);
+        REQUIRE(buffer.capacity() == 128);
+        REQUIRE(buffer.idles() == 128);
+
+        // 借出的block在第2个chunk上，不能缩小
+        std::vector<BufDesp *> desps;
+        for (unsigned int i = 1; i <= 10; ++i)
+            desps.push_back(buffer.borrow(Schema::META_FILE, i));
+        REQUIRE(buffer.resize(1) == EBUSY);
+        REQUIRE(buffer.capacity() == 128);
+        REQUIRE(buffer.idles() == 118);
+
+        // 归还后可以缩小，chunk上的block被淘汰
+        for (size_t i = 0; i < desps.size(); ++i)
+            buffer.releaseBuf(desps[i]);
+        REQUIRE(buffer.resize(1) == S_OK);
+        REQUIRE(buffer.capacity() == 64);
+        REQUIRE(buffer.idles() == 64);
+
+        // 扩大
+        REQUIRE(buffer.resize(3) == S_OK);
+        REQUIRE(buffer.capacity() == 192);
+        REQUIRE(buffer.idles() == 192);
+        BufDesp *bd = buffer.borrow(Schema::META_FILE, 0);
+        REQUIRE(bd);
+        buffer.releaseBuf(bd);
+    }
+
+    SECTION("descriptor")
+    {
+        Buffer buffer;
+        buffer.init(&kFiles, 2);
+
+        // 描述符按编号索引，按cache line对齐
+        for (unsigned int i = 0; i < buffer.capacity(); ++i) {
+            BufDesp *desp = buffer.descriptor(i);
+            REQUIRE(desp->frame == i);
+            REQUIRE((size_t) desp % 64 == 0);
+            REQUIRE(desp->pool == &buffer);
+        }
+
+        // 空闲buffer的内容不会被描述符覆盖
+        BufDesp *bd = buffer.borrow(Schema::META_FILE, 1);
+        REQUIRE(buffer.descriptor(bd->frame) == bd);
+        ::memset(bd->buffer, 0x5a, BLOCK_SIZE);
+        buffer.releaseBuf(bd);
+        REQUIRE(buffer.evict() == S_OK);
+        REQUIRE(bd->buffer[0] == 0x5a);
+        REQUIRE(bd->buffer[BLOCK_SIZE - 1] == 0x5a);
+
+        // 淘汰后描述符被重用
+        BufDesp *bd2 = buffer.borrow(Schema::META_FILE, 2);
+        REQUIRE(bd2 == bd);
+        REQUIRE(bd2->blockid == 2);
+        buffer.releaseBuf(bd2);
+    }
+
+    SECTION("pools")
+    {
+        kBuffer.init(&kFiles);
+        unsigned short id;
+        REQUIRE(kBuffer.createPool("scan", 1, id) == S_OK);
+        REQUIRE(id == 1);
+        REQUIRE(kBuffer.createPool("scan", 1, id) == EEXIST);
+        REQUIRE(kBuffer.findPool("default") == &kBuffer);
+        Buffer *scan = kBuffer.findPool("scan", &id);
+        REQUIRE(scan);
+        REQUIRE(id == 1);
+        REQUIRE(scan->capacity() == 64);
+
+        // 表分配到scan池
+        RelationInfo relation = relationOf();
+        relation.setPool(id);
+        REQUIRE(relation.pool() == 1);
+        REQUIRE(kSchema.create("pooled", relation) == S_OK);
+
+        // 超块和第1个数据块都在scan池中
+        REQUIRE(scan->idles() == 62);
+        BufDesp *bd = kBuffer.borrow("pooled", 1);
+        REQUIRE(bd->pool == scan);
+        kBuffer.writeBuf(bd);
+        kBuffer.releaseBuf(bd);
+        REQUIRE(kBuffer.flush() == S_OK);
+    }
+
+    SECTION("strategy")
+    {
+        REQUIRE(AccessStrategy(AccessStrategy::BULKREAD).size() == 16);
+        REQUIRE(AccessStrategy(AccessStrategy::BULKWRITE).size() == 1024);
+
+        REQUIRE(createTable("ringed") == S_OK);
+
+        // 8个热点block
+        Buffer buffer;
+        buffer.init(&kFiles, 1);
+        BufDesp *hot[8];
+        for (unsigned int i = 0; i < 8; ++i) {
+            hot[i] = buffer.borrow("ringed", i + 1);
+            buffer.releaseBuf(hot[i]);
+        }
+        REQUIRE(buffer.idles() == 56);
+
+        // 扫描100个block，只用到环上的4个buffer
+        AccessStrategy scan(AccessStrategy::BULKREAD, 4);
+        for (unsigned int i = 100; i < 200; ++i) {
+            BufDesp *bd = buffer.borrow("ringed", i, &scan);
+            REQUIRE(bd->blockid == i);
+            REQUIRE((bd->type & buffer.BUFFER_RING));
+            buffer.releaseBuf(bd);
+        }
+        REQUIRE(scan.stats().reads == 100);
+        REQUIRE(scan.stats().added == 4);
+        REQUIRE(scan.stats().reused == 96);
+        REQUIRE(buffer.idles() == 52);
+
+        // 扫描命中热点block，不占用环
+        BufDesp *bd = buffer.borrow("ringed", 3, &scan);
+        REQUIRE(bd == hot[2]);
+        REQUIRE(!(bd->type & buffer.BUFFER_RING));
+        buffer.releaseBuf(bd);
+        REQUIRE(scan.stats().hits == 1);
+        REQUIRE(scan.stats().touched() == 5);
+
+        // 热点block仍在池中
+        for (unsigned int i = 0; i < 8; ++i) {
+            bd = buffer.borrow("ringed", i + 1);
+            REQUIRE(bd == hot[i]);
+            buffer.releaseBuf(bd);
+        }
+
+        // 借出的buffer不会被环复用
+        BufDesp *pinned = buffer.borrow("ringed", 200, &scan);
+        for (unsigned int i = 201; i < 210; ++i)
+            buffer.releaseBuf(buffer.borrow("ringed", i, &scan));
+        REQUIRE(pinned->blockid == 200);
+        REQUIRE(scan.stats().added == 5);
+        buffer.releaseBuf(pinned);
+
+        // 批量装载，复用前回写脏buffer
+        AccessStrategy load(AccessStrategy::BULKWRITE, 2);
+        for (unsigned int i = 1; i <= 4; ++i) {
+            bd = buffer.borrow("ringed", 300 + i, &load);
+            ::memset(bd->buffer, (int) i, BLOCK_SIZE);
+            buffer.writeBuf(bd);
+            buffer.releaseBuf(bd);
+        }
+        REQUIRE(load.stats().writes == 2);
+        REQUIRE(buffer.flush() == S_OK);
+
+        // 环上的buffer归还主池后被淘汰，又分给了别的环，原来的环析构时不能
+        // 清除它的环标记
+        {
+            Buffer small;
+            small.init(&kFiles, 1);
+            unsigned int frames = (unsigned int) small.capacity();
+            for (unsigned int i = 0; i < frames; ++i)
+                small.releaseBuf(small.borrow("ringed", 400 + i));
+            REQUIRE(small.idles() == 0);
+            AccessStrategy *first =
+                new AccessStrategy(AccessStrategy::BULKREAD, 1);
+            BufDesp *owned = small.borrow("ringed", 500, first);
+            small.releaseBuf(owned);
+            small.releaseBuf(small.borrow("ringed", 500));
+            REQUIRE(!(owned->type & small.BUFFER_RING));
+            // 其余buffer都换一遍，owned落到lru尾部
+            for (unsigned int i = 1; i < frames; ++i)
+                small.releaseBuf(small.borrow("ringed", 600 + i));
+            AccessStrategy second(AccessStrategy::BULKREAD, 1);
+            bd = small.borrow("ringed", 700, &second);
+            REQUIRE(bd == owned);
+            small.releaseBuf(bd);
+            delete first;
+            REQUIRE((owned->type & small.BUFFER_RING));
+        }
+
+        // 批量装载一张表，数据块都在环上借用，不占用主池
+        REQUIRE(createTable("loaded") == S_OK);
+        Table loaded;
+        REQUIRE(loaded.open("loaded") == S_OK);
+        BufferStats before = kBuffer.stats();
+        AccessStrategy bulk(AccessStrategy::BULKWRITE, 4);
+        std::vector<struct iovec> iov(1);
+        const long long RECORDS = 5000;
+        for (long long i = 0; i < RECORDS; ++i) {
+            long long key = (long long) htobe64(i);
+            iov[0].iov_base = &key;
+            iov[0].iov_len = 8;
+            REQUIRE(
+                loaded.insert(loaded.locate(&key, 8), iov, &bulk) == S_OK);
+        }
+        REQUIRE(loaded.recordCount() == RECORDS);
+        REQUIRE(loaded.dataCount() > bulk.size());
+        REQUIRE(bulk.stats().reads >= RECORDS);
+        REQUIRE(bulk.stats().added <= bulk.size() + 2);
+        REQUIRE(bulk.stats().writes > 0);
+        REQUIRE(kBuffer.stats().resident <= before.resident + bulk.size() + 3);
+        REQUIRE(kBuffer.flush() == S_OK);
+
+        // 表扫描使用策略
+        Table table;
+        REQUIRE(table.open("ringed") == S_OK);
+        AccessStrategy tscan(AccessStrategy::BULKREAD);
+        unsigned int count = 0;
+        for (Table::BlockIterator bi = table.beginblock(&tscan);
+             bi != table.endblock();
+             ++bi)
+            ++count;
+        REQUIRE(count >= 1);
+        REQUIRE(tscan.stats().reads == count);
+    }
+
+    SECTION("stats")
+    {
+        REQUIRE(createTable("observed") == S_OK);
+
+        Buffer buffer;
+        REQUIRE(buffer.stats().pins == 0);
+        buffer.init(&kFiles, 1);
+
+        // 一次未命中，一次命中
+        BufDesp *bd = buffer.borrow("observed", 1);
+        buffer.writeBuf(bd);
+        buffer.releaseBuf(buffer.borrow("observed", 1));
+        BufferStats stats = buffer.stats();
+        REQUIRE(stats.hits == 1);
+        REQUIRE(stats.misses == 1);
+        REQUIRE(stats.hitRatio() == 0.5);
+        REQUIRE(stats.reads == 1);
+        REQUIRE(stats.pins == 2);
+        REQUIRE(stats.unpins == 1);
+        REQUIRE(stats.resident == 1);
+        REQUIRE(stats.dirty == 1);
+        REQUIRE(stats.pinned == 1);
+        REQUIRE(stats.refs == 1);
+
+        // 快照列出未归还的block
+        std::vector<BufEntry> entries;
+        buffer.snapshot(entries);
+        REQUIRE(entries.size() == 1);
+        REQUIRE(entries[0].table == "observed");
+        REQUIRE(entries[0].blockid == 1);
+        REQUIRE(entries[0].frame == bd->frame);
+        REQUIRE(entries[0].dirty);
+        REQUIRE(entries[0].ref == 1);
+
+        // 回写后干净
+        buffer.releaseBuf(bd);
+        REQUIRE(buffer.flush() == S_OK);
+        stats = buffer.stats();
+        REQUIRE(stats.writes == 1);
+        REQUIRE(stats.dirty == 0);
+        REQUIRE(stats.pinned == 0);
+
+        // 快照按lru顺序，各表驻留个数
+        buffer.releaseBuf(buffer.borrow("observed", 2));
+        buffer.releaseBuf(buffer.borrow(Schema::META_FILE, 0));
+        buffer.snapshot(entries);
+        REQUIRE(entries.size() == 3);
+        REQUIRE(entries[0].table == Schema::META_FILE);
+        REQUIRE(entries[1].blockid == 2);
+        REQUIRE(entries[2].blockid == 1);
+        std::map<std::string, size_t> tables;
+        buffer.residency(tables);
+        REQUIRE(tables.size() == 2);
+        REQUIRE(tables["observed"] == 2);
+
+        // 淘汰计数
+        REQUIRE(buffer.evict() == S_OK);
+        REQUIRE(buffer.stats().evictions == 1);
+        REQUIRE(buffer.stats().resident == 2);
+
+        // 其它线程的计数器一起汇总
+        std::thread worker(
+            [&buffer]() { buffer.releaseBuf(buffer.borrow("observed", 3)); });
+        worker.join();
+        stats = buffer.stats();
+        REQUIRE(stats.pins == 5);
+        REQUIRE(stats.unpins == 5);
+        REQUIRE(stats.misses == 4);
+    }
+
+    SECTION("warmup")
+    {
+        REQUIRE(createTable("warmed") == S_OK);
+
+        // 写10个block，再访问第5个，lru顺序为5,10,9,...,1
+        {
+            Buffer buffer;
+            buffer.init(&kFiles, 1);
+            buffer.keepResident("warmed.resident");
+            for (unsigned int i = 1; i <= 10; ++i) {
+                BufDesp *bd = buffer.borrow("warmed", i);
+                ::memset(bd->buffer, (int) i, BLOCK_SIZE);
+                buffer.writeBuf(bd);
+                buffer.releaseBuf(bd);
+            }
+            buffer.releaseBuf(buffer.borrow("warmed", 5));
+            REQUIRE(buffer.flush() == S_OK);
+        }
+
+        // 连续的block合并成一次读
+        Buffer buffer;
+        buffer.init(&kFiles, 1);
+        REQUIRE(buffer.warmup("nonexist.resident") != S_OK);
+        REQUIRE(buffer.warmup("warmed.resident") == S_OK);
+        buffer.waitWarmup();
+        WarmupStats stats = buffer.warmupStats();
+        REQUIRE(stats.done);
+        REQUIRE(stats.listed == 10);
+        REQUIRE(stats.loaded == 10);
+        REQUIRE(stats.reads == 1);
+        REQUIRE(buffer.idles() == 54);
+
+        // 预热后直接命中
+        for (unsigned int i = 1; i <= 10; ++i) {
+            BufDesp *bd = buffer.borrow("warmed", i);
+            REQUIRE(bd->buffer[0] == (unsigned char) i);
+            REQUIRE(bd->buffer[BLOCK_SIZE - 1] == (unsigned char) i);
+            buffer.releaseBuf(bd);
+        }
+        REQUIRE(buffer.stats().misses == 0);
+        REQUIRE(buffer.warmup("warmed.resident") == S_OK);
+        buffer.waitWarmup();
+        REQUIRE(buffer.warmupStats().skipped == 10);
+
+        // 空闲不够时只装入最热的5,10,9，排序后合并成两次读
+        Buffer small;
+        small.init(&kFiles, 1);
+        for (unsigned int i = 100; i < 161; ++i)
+            small.releaseBuf(small.borrow("warmed", i));
+        REQUIRE(small.idles() == 3);
+        WarmupOptions options;
+        options.batch = 2;
+        options.rate = 0;
+        REQUIRE(small.warmup("warmed.resident", options) == S_OK);
+        small.waitWarmup();
+        stats = small.warmupStats();
+        REQUIRE(stats.loaded == 3);
+        REQUIRE(stats.skipped == 7);
+        REQUIRE(stats.reads == 2);
+        BufferStats before = small.stats();
+        small.releaseBuf(small.borrow("warmed", 5));
+        small.releaseBuf(small.borrow("warmed", 9));
+        small.releaseBuf(small.borrow("warmed", 10));
+        REQUIRE(small.stats().hits == before.hits + 3);
+    }
+
+    SECTION("guard")
+    {
+        Buffer buffer;
+        buffer.init(&kFiles, 1);
+
+        // 构造时pin，析构时unpin
+        BufDesp *desp;
+        {
+            PageGuard guard(buffer, Schema::META_FILE, 1);
+            REQUIRE(guard);
+            desp = guard.desp();
+            REQUIRE(desp->ref == 1);
+            REQUIRE(guard.buffer() == desp->buffer);
+
+            // 共享守卫不能写
+            REQUIRE(guard.dirty() == EPERM);
+            REQUIRE(!(desp->type & buffer.BUFFER_DIRTY));
+
+            // 移动不增加引用
+            PageGuard moved(std::move(guard));
+            REQUIRE(!guard);
+            REQUIRE(moved.desp() == desp);
+            REQUIRE(desp->ref == 1);
+
+            // move赋值先释放原来的block
+            PageGuard other(buffer, Schema::META_FILE, 2, PageGuard::EXCLUSIVE);
+            BufDesp *desp2 = other.desp();
+            REQUIRE(other.dirty() == S_OK);
+            REQUIRE((desp2->type & buffer.BUFFER_DIRTY));
+            other = std::move(moved);
+            REQUIRE(desp2->ref == 0);
+            REQUIRE(other.desp() == desp);
+            REQUIRE(desp->ref == 1);
+        }
+        REQUIRE(desp->ref == 0);
+
+        // 共享守卫可以并存，独占守卫等到它们都释放
+        {
+            PageGuard reader1(buffer, Schema::META_FILE, 1);
+            PageGuard reader2(buffer, Schema::META_FILE, 1);
+            std::atomic<bool> acquired(false);
+            std::thread writer([&buffer, &acquired]() {
+                PageGuard guard(
+                    buffer, Schema::META_FILE, 1, PageGuard::EXCLUSIVE);
+                acquired = true;
+            });
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            REQUIRE(!acquired);
+            reader1.release();
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            REQUIRE(!acquired);
+            reader2.release();
+            writer.join();
+            REQUIRE(acquired);
+            REQUIRE(desp->latch == 0);
+        }
+        BufferStats stats = buffer.stats();
+        REQUIRE(stats.pins == stats.unpins);
+        REQUIRE(stats.refs == 0);
+        REQUIRE(buffer.flush() == S_OK);
+
+        // 扫描和locate不会遗留引用
+        REQUIRE(createTable("guarded") == S_OK);
+        Table table;
+        REQUIRE(table.open("guarded") == S_OK);
+        size_t refs = kBuffer.stats().refs;
+        for (Table::BlockIterator bi = table.beginblock();
+             bi != table.endblock();
+             ++bi)
+            ;
+        long long key = 1;
+        REQUIRE(table.locate(&key, sizeof(key)) == 1);
+        Table::BlockIterator bi = table.beginblock();
+        Table::BlockIterator moved(std::move(bi));
+        REQUIRE(moved.bufdesp->ref == 1);
+        REQUIRE(bi == table.endblock());
+        moved.release();
+        REQUIRE(kBuffer.stats().refs == refs);
+    }
+
+    SECTION("coalesce")
+    {
+        REQUIRE(createTable("flushed") == S_OK);
+
+        // 乱序写两段连续的block：1-10和20-22
+        Buffer buffer;
+        buffer.init(&kFiles, 1);
+        unsigned int blocks[] = {22, 3, 7, 1, 20, 10, 2, 9, 4, 21, 5, 8, 6};
+        for (size_t i = 0; i < sizeof(blocks) / sizeof(blocks[0]); ++i) {
+            BufDesp *bd = buffer.borrow("flushed", blocks[i]);
+            ::memset(bd->buffer, (int) blocks[i], BLOCK_SIZE);
+            buffer.writeBuf(bd);
+            buffer.releaseBuf(bd);
+        }
+        REQUIRE(buffer.flush() == S_OK);
+        BufferStats stats = buffer.stats();
+        REQUIRE(stats.dirty == 0);
+        REQUIRE(stats.writes == 13);
+        REQUIRE(stats.writeIos == 2);
+        REQUIRE(stats.writeBytes == 13 * BLOCK_SIZE);
+        REQUIRE(stats.writeSize() == 13 * BLOCK_SIZE / 2.0);
+
+        // 每个block写到自己的位置
+        Buffer reader;
+        reader.init(&kFiles, 1);
+        for (size_t i = 0; i < sizeof(blocks) / sizeof(blocks[0]); ++i) {
+            BufDesp *bd = reader.borrow("flushed", blocks[i]);
+            REQUIRE(bd->buffer[0] == (unsigned char) blocks[i]);
+            REQUIRE(bd->buffer[BLOCK_SIZE - 1] == (unsigned char) blocks[i]);
+            reader.releaseBuf(bd);
+        }
+
+        // 独占守卫持有的block不回写，两边的block分成两次写
+        for (unsigned int id = 4; id <= 6; ++id) {
+            BufDesp *bd = buffer.borrow("flushed", id);
+            buffer.writeBuf(bd);
+            buffer.releaseBuf(bd);
+        }
+        {
+            PageGuard guard(buffer, "flushed", 5, PageGuard::EXCLUSIVE);
+            REQUIRE(buffer.writeBack(guard.desp()) == EBUSY);
+            REQUIRE(buffer.flush() == S_OK);
+            stats = buffer.stats();
+            REQUIRE(stats.dirty == 1);
+            REQUIRE(stats.writes == 15);
+            REQUIRE(stats.writeIos == 4);
+            REQUIRE((guard.desp()->type & buffer.BUFFER_DIRTY));
+        }
+        REQUIRE(buffer.flush() == S_OK);
+        stats = buffer.stats();
+        REQUIRE(stats.dirty == 0);
+        REQUIRE(stats.writes == 16);
+    }
+
+    SECTION("concurrent")
+    {
+        // 多个线程在放不下的小池中借用同一组block，读盘与淘汰交错；正在读入
+        // 的block，其它线程等它读完
+        Buffer buffer;
+        buffer.init(&kFiles, 1);
+        const unsigned int BLOCKS = 160;
+        std::atomic<int> wrong(0);
+        std::vector<std::thread> threads;
+        for (unsigned int t = 0; t < 4; ++t)
+            threads.push_back(std::thread([&buffer, &wrong, t, BLOCKS]() {
+                unsigned int seed = t + 1;
+                for (int i = 0; i < 2000; ++i) {
+                    seed = seed * 1103515245 + 12345;
+                    unsigned int id = (seed >> 8) % BLOCKS + 1;
+                    BufDesp *bd = buffer.borrow("flushed", id);
+                    // coalesce写过1-10和20-22，其余为空洞或超出文件
+                    unsigned char want =
+                        id <= 10 || (id >= 20 && id <= 22) ? id : 0;
+                    if (bd->buffer[0] != want ||
+                        bd->buffer[BLOCK_SIZE - 1] != want)
+                        ++wrong;
+                    buffer.releaseBuf(bd);
+                }
+            }));
+        for (size_t t = 0; t < threads.size(); ++t)
+            threads[t].join();
+        REQUIRE(wrong == 0);
+        BufferStats stats = buffer.stats();
+        REQUIRE(stats.pins == 8000);
+        REQUIRE(stats.pins == stats.unpins);
+        REQUIRE(stats.refs == 0);
+        REQUIRE(stats.evictions > 0);
+        REQUIRE(stats.resident <= buffer.capacity());
     }
-}
\ No newline at end of file
+}
@@ -0,0 +1,100 @@
+////
+// @file cacheTest.cc
+// @brief
+// 测试二级缓存
+//
+// @author niexw
+// @email niexiaowen@uestc.edu.cn
+//
+#include "../catch.hpp"
+#include "./fixture.h"
+#include <db/cache.h>
+#include <db/buffer.h>
+#include <db/block.h>
+#include <db/file.h>
+#include <db/schema.h>
+using namespace db;
+
+TEST_CASE("db/cache.h")
+{
+    SECTION("lru")
+    {
+        SecondaryCache cache;
+        std::vector<unsigned char> block(BLOCK_SIZE, 'a');
+        std::vector<unsigned char> out(BLOCK_SIZE);
+
+        // 未打开时不缓存
+        REQUIRE(!cache.enabled());
+        cache.insert("t", 1, &block[0]);
+        REQUIRE(cache.size() == 0);
+
+        // 可压缩的block占用很少空间
+        cache.init(BLOCK_SIZE);
+        for (unsigned int i = 1; i <= 10; ++i) {
+            block[0] = (unsigned char) i;
+            cache.insert("t", i, &block[0]);
+        }
+        REQUIRE(cache.size() == 10);
+        REQUIRE(cache.used() < BLOCK_SIZE);
+
+        // 命中后移除
+        REQUIRE(cache.lookup("t", 3, &out[0]));
+        REQUIRE(out[0] == 3);
+        REQUIRE(out[1] == 'a');
+        REQUIRE(!cache.lookup("t", 3, &out[0]));
+        REQUIRE(cache.size() == 9);
+
+        // 不可压缩的block占满容量，挤掉其它block
+        for (size_t i = 0; i < block.size(); ++i)
+            block[i] = (unsigned char) rand();
+        cache.insert("t", 100, &block[0]);
+        REQUIRE(cache.size() == 1);
+        REQUIRE(cache.used() == BLOCK_SIZE);
+        REQUIRE(cache.stats().evictions == 9);
+        REQUIRE(cache.lookup("t", 100, &out[0]));
+        REQUIRE(out == block);
+        REQUIRE(cache.stats().hits == 2);
+        REQUIRE(cache.stats().misses == 1);
+    }
+
+    SECTION("evict")
+    {
+        REQUIRE(createTable("cached") == S_OK);
+
+        // 1MB的buffer只有64个block
+        Buffer buffer;
+        buffer.init(&kFiles, 1);
+        buffer.cache().init(1024 * 1024);
+        REQUIRE(buffer.idles() == 64);
+
+        // 写128个block，前64个被淘汰到二级缓存
+        for (unsigned int i = 1; i <= 128; ++i) {
+            BufDesp *bd = buffer.borrow("cached", i);
+            REQUIRE(bd);
+            ::memset(bd->buffer, (int) i, BLOCK_SIZE);
+            buffer.writeBuf(bd);
+            buffer.releaseBuf(bd);
+        }
+        REQUIRE(buffer.idles() == 0);
+        REQUIRE(buffer.cache().size() == 64);
+
+        // 再读前64个，全部来自二级缓存
+        for (unsigned int i = 1; i <= 64; ++i) {
+            BufDesp *bd = buffer.borrow("cached", i);
+            REQUIRE(bd);
+            REQUIRE(bd->buffer[0] == (unsigned char) i);
+            REQUIRE(bd->buffer[BLOCK_SIZE - 1] == (unsigned char) i);
+            buffer.releaseBuf(bd);
+        }
+        REQUIRE(buffer.cache().stats().hits == 64);
+        REQUIRE(buffer.cache().size() == 64);
+
+        // 借出的block不会被淘汰
+        BufDesp *pinned = buffer.borrow("cached", 1);
+        for (unsigned int i = 65; i <= 128; ++i)
+            buffer.releaseBuf(buffer.borrow("cached", i));
+        REQUIRE(pinned->blockid == 1);
+        REQUIRE(pinned->buffer[0] == 1);
+        buffer.releaseBuf(pinned);
+    }
+}
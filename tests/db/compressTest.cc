@@ -0,0 +1,104 @@
+////
+// @file compressTest.cc
+// @brief
+// 测试block压缩
+//
+// @author niexw
+// @email niexiaowen@uestc.edu.cn
+//
+#include "../catch.hpp"
+#include "./fixture.h"
+#include <db/compress.h>
+#include <db/table.h>
+#include <db/buffer.h>
+using namespace db;
+
+TEST_CASE("db/compress.h")
+{
+    SECTION("codec")
+    {
+        // 类似文本的数据
+        std::vector<unsigned char> src(BLOCK_SIZE);
+        const char *words[] = {"select ", "from ", "where ", "table ", "id "};
+        for (size_t i = 0, w = 0; i < src.size(); ++w) {
+            const char *word = words[w * 7 % 5];
+            for (; *word && i < src.size(); ++word, ++i)
+                src[i] = (unsigned char) *word;
+        }
+
+        std::vector<unsigned char> dst(lzBound(src.size()));
+        size_t len = lzCompress(&src[0], src.size(), &dst[0], dst.size());
+        REQUIRE(len > 0);
+        REQUIRE(len < src.size() / 3);
+
+        std::vector<unsigned char> out(BLOCK_SIZE);
+        REQUIRE(lzDecompress(&dst[0], len, &out[0], out.size()) == src.size());
+        REQUIRE(out == src);
+
+        // 截断的数据不能完整解压
+        REQUIRE(lzDecompress(&dst[0], len / 2, &out[0], out.size()) < src.size());
+        // 输出空间不够
+        REQUIRE(lzDecompress(&dst[0], len, &out[0], out.size() / 2) == 0);
+    }
+
+    SECTION("incompressible")
+    {
+        std::vector<unsigned char> src(BLOCK_SIZE);
+        for (size_t i = 0; i < src.size(); ++i)
+            src[i] = (unsigned char) rand();
+
+        // 随机数据压不下来
+        std::vector<unsigned char> dst(lzBound(src.size()));
+        REQUIRE(lzCompress(&src[0], src.size(), &dst[0], src.size() - 1) == 0);
+
+        // 给足空间时仍然可以还原
+        size_t len = lzCompress(&src[0], src.size(), &dst[0], dst.size());
+        REQUIRE(len > 0);
+        std::vector<unsigned char> out(BLOCK_SIZE);
+        REQUIRE(lzDecompress(&dst[0], len, &out[0], out.size()) == src.size());
+        REQUIRE(out == src);
+    }
+
+    SECTION("table")
+    {
+        // id(BIGINT) + name(VARCHAR)，压缩存放
+        Column text = {"name", "VARCHAR", -255, nullptr};
+        RelationInfo relation = relationOf({text});
+        relation.type = TABLE_COMPRESSED;
+        REQUIRE(kSchema.create("ctable", relation) == S_OK);
+
+        Table table;
+        REQUIRE(table.open("ctable") == S_OK);
+        DataType *type = table.info_->fields[0].type;
+        char name[] = "select name from table where id = ?";
+        std::vector<struct iovec> iov(2);
+        for (long long i = 1; i <= 300; ++i) {
+            long long nid = i;
+            type->htobe(&nid);
+            iov[0].iov_base = &nid;
+            iov[0].iov_len = 8;
+            iov[1].iov_base = name;
+            iov[1].iov_len = sizeof(name);
+            unsigned int blkid =
+                table.locate(iov[0].iov_base, (unsigned int) iov[0].iov_len);
+            REQUIRE(table.insert(blkid, iov) == S_OK);
+        }
+        REQUIRE(kBuffer.flush() == S_OK);
+
+        // 写回的block都经过压缩
+        BlockMapping *mapping = kFiles.mapping("ctable");
+        REQUIRE(mapping);
+        REQUIRE(kFiles.mapping("table") == NULL);
+        CompressStats stats = mapping->stats();
+        REQUIRE(stats.blocks >= table.dataCount());
+        REQUIRE(stats.ratio() > 2);
+
+        // 从文件解压的内容与buffer一致
+        Table::BlockIterator bi = table.beginblock();
+        std::vector<unsigned char> out(BLOCK_SIZE);
+        FileRef file(kFiles, "ctable");
+        REQUIRE(mapping->read(file.get(), bi->getSelf(), &out[0]) == S_OK);
+        REQUIRE(::memcmp(&out[0], bi->buffer_, BLOCK_SIZE) == 0);
+        kFiles.report();
+    }
+}
@@ -6,9 +6,15 @@
 // @email niexiaowen@uestc.edu.cn
 //
 #include "../catch.hpp"
+#include "./fixture.h"
 #include <db/file.h>
 #include <db/buffer.h>
+#include <db/block.h>
 #include <db/schema.h>
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <chrono>
 using namespace db;
 
 TEST_CASE("db/file.h")
@@ -80,7 +86,156 @@ TEST_CASE("db/file.h")
 
     SECTION("open")
     {
-        File *meta = kFiles.open(Schema::META_FILE);
+        FileRef meta(kFiles, Schema::META_FILE);
         REQUIRE(meta);
+        REQUIRE(kFiles.stats().pinned == 1);
+        meta.release();
+        REQUIRE(kFiles.stats().pinned == 0);
     }
-}
\ No newline at end of file
+
+    SECTION("sync")
+    {
+        FileRef meta(kFiles, Schema::META_FILE);
+        REQUIRE(meta);
+        REQUIRE(meta->sync() == S_OK);
+        REQUIRE(meta->datasync() == S_OK);
+    }
+
+    SECTION("pool")
+    {
+        const char *tables[] = {"pool0", "pool1", "pool2", "pool3"};
+        for (int i = 0; i < 4; ++i)
+            REQUIRE(createTable(tables[i]) == S_OK);
+
+        // 有引用的文件不会被关闭
+        kFiles.setCapacity(1);
+        FileRef pinned(kFiles, "pool0");
+        REQUIRE(pinned);
+        REQUIRE(kFiles.stats().opened == 1);
+        kFiles.setCapacity(2);
+        File *file = pinned.get();
+        FileStats before = kFiles.stats();
+        for (int i = 1; i < 4; ++i)
+            REQUIRE(FileRef(kFiles, tables[i]));
+        FileStats stats = kFiles.stats();
+        REQUIRE(stats.opened == 2);
+        REQUIRE(stats.pinned == 1);
+        REQUIRE(stats.misses - before.misses == 3);
+        REQUIRE(stats.closes - before.closes == 2);
+
+        // 不同的字符串指向同一张表，复用描述符
+        std::string name("pool0");
+        REQUIRE(FileRef(kFiles, name.c_str()).get() == file);
+        REQUIRE(kFiles.stats().hits - stats.hits == 1);
+
+        // 引用可以转移
+        FileRef moved(std::move(pinned));
+        REQUIRE(!pinned);
+        REQUIRE(moved.get() == file);
+        moved.release();
+        REQUIRE(kFiles.stats().pinned == 0);
+
+        // 缩小容量，关闭空闲文件
+        kFiles.setCapacity(1);
+        REQUIRE(kFiles.stats().opened == 1);
+        kFiles.setCapacity(FilePool::DEFAULT_CAPACITY);
+        REQUIRE(!FileRef(kFiles, "nosuchtable"));
+    }
+
+    SECTION("commit")
+    {
+        REQUIRE(kFiles.commit("nosuchtable") == ENOENT);
+
+        // 等待数达到depth时立即刷盘，8个线程至多刷盘8次
+        CommitOptions options;
+        options.interval = 100000;
+        options.depth = 8;
+        kFiles.setCommitOptions(options);
+        CommitStats before = kFiles.commitStats();
+
+        std::vector<std::thread> threads;
+        std::vector<int> rets(8, -1);
+        for (size_t i = 0; i < rets.size(); ++i)
+            threads.push_back(std::thread(
+                [&rets, i]() { rets[i] = kFiles.commit(Schema::META_FILE); }));
+        for (size_t i = 0; i < threads.size(); ++i)
+            threads[i].join();
+        for (size_t i = 0; i < rets.size(); ++i)
+            REQUIRE(rets[i] == S_OK);
+
+        CommitStats after = kFiles.commitStats();
+        REQUIRE(after.requests - before.requests == 8);
+        REQUIRE(after.syncs - before.syncs >= 1);
+        REQUIRE(after.syncs - before.syncs <= 8);
+        kFiles.setCommitOptions(CommitOptions());
+
+        // 提交前回写该文件在kBuffer中的脏block
+        BufDesp *desp = kBuffer.borrow(Schema::META_FILE, 0);
+        REQUIRE(desp != NULL);
+        kBuffer.writeBuf(desp);
+        kBuffer.releaseBuf(desp);
+        REQUIRE((desp->type & kBuffer.BUFFER_DIRTY));
+        unsigned long long writes = kBuffer.stats().writes;
+        REQUIRE(kFiles.commit(Schema::META_FILE) == S_OK);
+        REQUIRE(!(desp->type & kBuffer.BUFFER_DIRTY));
+        REQUIRE(kBuffer.stats().writes == writes + 1);
+
+        std::vector<char> block(BLOCK_SIZE);
+        unsigned long long offset = 0;
+        REQUIRE(kFiles.offset(Schema::META_FILE, 0, offset) == S_OK);
+        FileRef file(kFiles, Schema::META_FILE);
+        REQUIRE(file->read(offset, &block[0], BLOCK_SIZE) == S_OK);
+        REQUIRE(::memcmp(&block[0], desp->buffer, BLOCK_SIZE) == 0);
+    }
+
+    SECTION("commitAsync")
+    {
+        std::atomic<int> done(0), failed(0);
+        FilePool::CommitCallback callback = [&done, &failed](int ret) {
+            if (ret != S_OK) ++failed;
+            ++done;
+        };
+        // 等待回调，最多等待1秒
+        auto finished = [&done](int count) {
+            for (int i = 0; i < 1000 && done < count; ++i)
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            return done == count;
+        };
+        kFiles.commitAsync("nosuchtable", callback);
+        REQUIRE(done == 1);
+        REQUIRE(failed == 1);
+        done = failed = 0;
+
+        // 调用者不等待刷盘，interval到期后运行时的定时任务合并刷盘一次
+        CommitOptions options;
+        options.interval = 50000;
+        options.depth = 1000;
+        kFiles.setCommitOptions(options);
+        CommitStats before = kFiles.commitStats();
+        for (int i = 0; i < 4; ++i)
+            kFiles.commitAsync(Schema::META_FILE, callback);
+        REQUIRE(done == 0);
+        REQUIRE(finished(4));
+        REQUIRE(failed == 0);
+        CommitStats after = kFiles.commitStats();
+        REQUIRE(after.requests - before.requests == 4);
+        REQUIRE(after.syncs - before.syncs == 1);
+
+        // 未刷盘的请求达到depth时立即提交刷盘任务，不等interval
+        options.interval = 10000000;
+        options.depth = 4;
+        kFiles.setCommitOptions(options);
+        for (int i = 0; i < 4; ++i)
+            kFiles.commitAsync(Schema::META_FILE, callback);
+        REQUIRE(finished(8));
+        REQUIRE(failed == 0);
+        REQUIRE(kFiles.commitStats().syncs - after.syncs == 1);
+
+        // 同步请求与异步请求共用队列
+        kFiles.setCommitOptions(CommitOptions());
+        kFiles.commitAsync(Schema::META_FILE, callback);
+        REQUIRE(kFiles.commit(Schema::META_FILE) == S_OK);
+        REQUIRE(finished(9));
+        kFiles.flushCommits();
+    }
+}
@@ -0,0 +1,168 @@
+////
+// @file fixture.cc
+// @brief
+// 实现测试共用的数据
+//
+// @author niexw
+// @email niexiaowen@uestc.edu.cn
+//
+#include "../catch.hpp"
+#include "./fixture.h"
+#include <string.h>
+#include <db/endian.h>
+#include <db/table.h>
+
+namespace db {
+
+RelationInfo relationOf(const std::vector<Column> &columns)
+{
+    RelationInfo relation;
+    FieldInfo field;
+    field.name = "id";
+    field.index = 0;
+    field.length = 8;
+    field.type = findDataType("BIGINT");
+    relation.fields.push_back(field);
+    for (size_t i = 0; i < columns.size(); ++i) {
+        field.name = columns[i].name;
+        field.index = i + 1;
+        field.length = columns[i].length;
+        field.type = findDataType(columns[i].type);
+        relation.fields.push_back(field);
+    }
+    relation.count = (unsigned short) relation.fields.size();
+    relation.key = 0;
+    return relation;
+}
+
+int createTable(const char *name, const std::vector<Column> &columns)
+{
+    RelationInfo relation = relationOf(columns);
+    return kSchema.create(name, relation);
+}
+
+void fillTable(
+    const char *name,
+    const std::vector<Column> &columns,
+    long long count)
+{
+    createTable(name, columns);
+
+    Table table;
+    REQUIRE(table.open(name) == S_OK);
+    std::vector<struct iovec> iov(columns.size() + 1);
+    std::vector<std::string> values(columns.size() + 1);
+    for (long long i = (long long) table.recordCount(); i < count; ++i) {
+        values[0] = bytesOf(i);
+        for (size_t j = 0; j < columns.size(); ++j)
+            values[j + 1] = columns[j].value(i);
+        // 转为大序后插入
+        for (size_t j = 0; j < values.size(); ++j) {
+            table.info_->fields[j].type->htobe(&values[j][0]);
+            iov[j].iov_base = &values[j][0];
+            iov[j].iov_len = values[j].size();
+        }
+        REQUIRE(table.insert(table.locate(iov[0].iov_base, 8), iov) == S_OK);
+    }
+}
+
+void fillPayload(const char *name, long long count, size_t payload)
+{
+    Column column = {"payload", "CHAR", (unsigned int) payload, nullptr};
+    column.value = [payload](long long) { return std::string(payload, 'x'); };
+    fillTable(name, {column}, count);
+}
+
+void fillOrders(const char *name, long long count)
+{
+    Column qty = {"qty", "INT", 4, nullptr};
+    qty.value = [](long long i) { return bytesOf((int) (i * 3)); };
+    Column text = {"name", "VARCHAR", 32, nullptr};
+    text.value = [](long long i) { return "name" + std::to_string(i); };
+    fillTable(name, {qty, text}, count);
+}
+
+long long keyOf(Record &record)
+{
+    unsigned char *pkey;
+    unsigned int len;
+    record.refByIndex(&pkey, &len, 0);
+    long long key;
+    ::memcpy(&key, pkey, sizeof(key));
+    return (long long) be64toh(key);
+}
+
+unsigned short
+fillUnordered(DataBlock &data, std::mt19937_64 &rng, unsigned long long range)
+{
+    std::vector<struct iovec> iov(2);
+    while (true) {
+        unsigned long long id = range ? rng() % range : rng();
+        unsigned long long be = htobe64(id);
+        std::string name;
+        switch (id % 4) {
+        case 0:
+            name = std::string("customer-") + std::to_string(id % 1000);
+            break;
+        case 1:
+            name = std::string("customer-") + std::to_string(id % 1000) + "x";
+            break;
+        case 2:
+            name = std::string("cust").substr(0, id % 5);
+            break;
+        default:
+            name = std::to_string(id % 100000);
+            break;
+        }
+        iov[0].iov_base = &be;
+        iov[0].iov_len = 8;
+        iov[1].iov_base = (void *) name.data();
+        iov[1].iov_len = name.size();
+        unsigned short len = (unsigned short) Record::size(iov);
+        unsigned char *space = data.allocate(len, data.getSlots());
+        if (space == nullptr) break;
+        Record record;
+        record.attach(space, len);
+        unsigned char header = 0;
+        record.set(iov, &header);
+    }
+    return data.getSlots();
+}
+
+bool ordered(DataBlock &data, DataType *type, unsigned int key)
+{
+    for (unsigned short i = 1; i < data.getSlots(); ++i) {
+        Record x, y;
+        data.refslots(i - 1, x);
+        data.refslots(i, y);
+        unsigned char *px, *py;
+        unsigned int xlen, ylen;
+        x.refByIndex(&px, &xlen, key);
+        y.refByIndex(&py, &ylen, key);
+        if (type->less(py, ylen, px, xlen)) return false;
+    }
+    return true;
+}
+
+bool insertSorted(DataBlock &data, unsigned long long id)
+{
+    std::vector<struct iovec> iov(2);
+    unsigned long long be = htobe64(id);
+    std::string name = std::string("name-") + std::to_string(id % 100000);
+    iov[0].iov_base = &be;
+    iov[0].iov_len = 8;
+    iov[1].iov_base = (void *) name.data();
+    iov[1].iov_len = name.size();
+    unsigned short index =
+        findDataType("BIGINT")->search(data.buffer_, 0, &be, 8);
+    unsigned short len = (unsigned short) Record::size(iov);
+    unsigned char *space = data.allocate(len, index);
+    if (space == nullptr) return false;
+    Record record;
+    record.attach(space, len);
+    unsigned char header = 0;
+    record.set(iov, &header);
+    return true;
+}
+
+} // namespace db
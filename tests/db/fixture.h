@@ -0,0 +1,70 @@
+////
+// @file fixture.h
+// @brief
+// 测试共用的数据
+// 建表并顺序插入记录，以及在单个block上构造记录，供单元测试和benchTest使用。
+//
+// @author niexw
+// @email niexiaowen@uestc.edu.cn
+//
+#ifndef __TESTS_DB_FIXTURE_H__
+#define __TESTS_DB_FIXTURE_H__
+
+#include <functional>
+#include <random>
+#include <string>
+#include <vector>
+#include <db/block.h>
+#include <db/record.h>
+#include <db/schema.h>
+
+namespace db {
+
+// 测试表的一列，value由行号生成该列主机字节序的值
+struct Column
+{
+    const char *name;                             // 列名
+    const char *type;                             // 类型名
+    long long length;                             // 列长度，同FieldInfo
+    std::function<std::string(long long)> value; // 由行号生成列值
+};
+
+// 定长整数的主机字节序表示
+template <typename T>
+inline std::string bytesOf(T value)
+{
+    return std::string((const char *) &value, sizeof(value));
+}
+
+// 第1列id(BIGINT)为主键，其后为columns的表结构，columns的value可为空
+RelationInfo relationOf(const std::vector<Column> &columns = {});
+// 按relationOf(columns)创建空表name，返回kSchema.create的结果
+int createTable(const char *name, const std::vector<Column> &columns = {});
+
+// 创建表name，第1列id(BIGINT)为主键，取值为行号，其后为columns；表中已有记录
+// 时接着插入，直到共count条记录
+void fillTable(
+    const char *name,
+    const std::vector<Column> &columns,
+    long long count);
+
+// id(BIGINT)+payload(CHAR)的表，payload为payload个'x'
+void fillPayload(const char *name, long long count, size_t payload);
+// id(BIGINT)+qty(INT)+name(VARCHAR)的表，qty = id * 3，name = "name" + id
+void fillOrders(const char *name, long long count);
+
+// 记录第1个字段的BIGINT key
+long long keyOf(Record &record);
+
+// 向block追加id(BIGINT)+name(VARCHAR)的记录直到装满，不按键排列；range
+// 非0时id取自[0, range)。name的前8个字节大多相同，排序时要比较完整的键
+unsigned short
+fillUnordered(DataBlock &data, std::mt19937_64 &rng, unsigned long long range);
+// slots[]是否按第key个字段有序
+bool ordered(DataBlock &data, DataType *type, unsigned int key);
+// 按id在slots[]中的位置插入一条id+name的记录，空间不够返回false
+bool insertSorted(DataBlock &data, unsigned long long id);
+
+} // namespace db
+
+#endif // __TESTS_DB_FIXTURE_H__
@@ -0,0 +1,229 @@
+////
+// @file predicateTest.cc
+// @brief
+// 测试列向量上的谓词核函数
+//
+// @author niexw
+// @email niexiaowen@uestc.edu.cn
+//
+#include "../catch.hpp"
+#include "./fixture.h"
+#include <db/predicate.h>
+#include <db/table.h>
+#include <db/schema.h>
+#include <random>
+#include <string>
+using namespace db;
+
+namespace {
+// 取位图中的第row位
+bool bit(const Bitmap &bitmap, size_t row)
+{
+    return (bitmap[row / 64] >> (row % 64)) & 1;
+}
+
+// 在CPU支持的每个指令集上检查宽度为sizeof(T)的核函数，与逐个比较的结果
+// 一致；行数不是64的倍数，最后一个字的多余位应为0
+template <typename T>
+void check(const char *name)
+{
+    DataType *type = findDataType(name);
+    std::mt19937_64 rng(sizeof(T));
+    const size_t ROWS = 1000;
+    std::vector<T> values(ROWS);
+    // 混入边界值，符号位两侧的值按无符号比较
+    T top = (T) ~(T) 0, mid = (T) (top / 2 + 1);
+    for (size_t i = 0; i < ROWS; ++i) {
+        switch (i % 8) {
+        case 0:
+            values[i] = 0;
+            break;
+        case 1:
+            values[i] = top;
+            break;
+        case 2:
+            values[i] = mid;
+            break;
+        case 3:
+            values[i] = (T) (mid - 1);
+            break;
+        default:
+            values[i] = (T) (rng() % 200);
+            break;
+        }
+    }
+    T constants[] = {0, 7, 100, (T) (mid - 1), mid, top};
+    std::vector<unsigned long long> list;
+    list.push_back(3);
+    list.push_back(mid);
+    list.push_back(150);
+    list.push_back(top);
+
+    Bitmap bitmap((ROWS + 63) / 64);
+    for (int level = SIMD_SCALAR; level <= cpuSimdLevel(); ++level) {
+        REQUIRE(setSimdLevel((SimdLevel) level) == level);
+        const IntKernels *kernels = findKernels(type);
+        REQUIRE(kernels);
+
+        for (size_t c = 0; c < sizeof(constants) / sizeof(T); ++c) {
+            T v = constants[c];
+            for (int op = CMP_EQ; op <= CMP_GE; ++op) {
+                kernels->compare(
+                    values.data(), ROWS, (CompareOp) op, v, bitmap.data());
+                for (size_t i = 0; i < ROWS; ++i) {
+                    bool expect;
+                    switch (op) {
+                    case CMP_EQ:
+                        expect = values[i] == v;
+                        break;
+                    case CMP_NE:
+                        expect = values[i] != v;
+                        break;
+                    case CMP_LT:
+                        expect = values[i] < v;
+                        break;
+                    case CMP_LE:
+                        expect = values[i] <= v;
+                        break;
+                    case CMP_GT:
+                        expect = values[i] > v;
+                        break;
+                    default:
+                        expect = values[i] >= v;
+                        break;
+                    }
+                    REQUIRE(bit(bitmap, i) == expect);
+                }
+                REQUIRE((bitmap.back() >> (ROWS % 64)) == 0);
+            }
+
+            T hi = (T) (v + 50 < v ? top : v + 50);
+            kernels->between(values.data(), ROWS, v, hi, bitmap.data());
+            for (size_t i = 0; i < ROWS; ++i)
+                REQUIRE(bit(bitmap, i) == (v <= values[i] && values[i] <= hi));
+        }
+
+        kernels->in(
+            values.data(), ROWS, list.data(), list.size(), bitmap.data());
+        for (size_t i = 0; i < ROWS; ++i) {
+            bool expect = values[i] == 3 || values[i] == mid ||
+                          values[i] == 150 || values[i] == top;
+            REQUIRE(bit(bitmap, i) == expect);
+        }
+        REQUIRE((bitmap.back() >> (ROWS % 64)) == 0);
+    }
+    setSimdLevel(cpuSimdLevel());
+}
+
+// 创建一张id(BIGINT)+qty(SMALLINT)+name(VARCHAR)的表，插入count条记录，
+// qty = id % 1000，name = "name" + id
+void fill(const char *name, long long count)
+{
+    Column qty = {"qty", "SMALLINT", 2, nullptr};
+    qty.value = [](long long i) { return bytesOf((short) (i % 1000)); };
+    Column text = {"name", "VARCHAR", 32, nullptr};
+    text.value = [](long long i) { return "name" + std::to_string(i); };
+    fillTable(name, {qty, text}, count);
+}
+} // namespace
+
+TEST_CASE("db/predicate.h")
+{
+    SECTION("kernels")
+    {
+        REQUIRE(findKernels(findDataType("CHAR")) == NULL);
+        REQUIRE(findKernels(findDataType("VARCHAR")) == NULL);
+        check<unsigned char>("TINYINT");
+        check<unsigned short>("SMALLINT");
+        check<unsigned int>("INT");
+        check<unsigned long long>("BIGINT");
+        REQUIRE(simdLevel() == cpuSimdLevel());
+    }
+
+    SECTION("string")
+    {
+        ColumnVector column;
+        column.init(findDataType("VARCHAR"), 0, 0);
+        const char *words[] = {
+            "", "a", "ab", "abc", "abd", "b", "abcdefghijklmnopqrstuvwxyz"};
+        const size_t N = sizeof(words) / sizeof(words[0]);
+        for (size_t i = 0; i < N; ++i)
+            column.append(
+                (const unsigned char *) words[i],
+                (unsigned int) ::strlen(words[i]));
+
+        Bitmap bitmap;
+        for (int level = SIMD_SCALAR; level <= cpuSimdLevel(); ++level) {
+            setSimdLevel((SimdLevel) level);
+            filterPrefix(column, "ab", 2, bitmap);
+            for (size_t i = 0; i < N; ++i)
+                REQUIRE(bit(bitmap, i) == (::strncmp(words[i], "ab", 2) == 0));
+            filterPrefix(column, "abcdefghijklmnopqrst", 20, bitmap);
+            for (size_t i = 0; i < N; ++i)
+                REQUIRE(bit(bitmap, i) == (i == N - 1));
+            filterPrefix(column, "", 0, bitmap);
+            for (size_t i = 0; i < N; ++i)
+                REQUIRE(bit(bitmap, i));
+        }
+        setSimdLevel(cpuSimdLevel());
+
+        filterCompare(column, CMP_LT, "abc", 3, bitmap);
+        for (size_t i = 0; i < N; ++i)
+            REQUIRE(bit(bitmap, i) == (::strcmp(words[i], "abc") < 0));
+        filterCompare(column, CMP_EQ, "abd", 3, bitmap);
+        for (size_t i = 0; i < N; ++i)
+            REQUIRE(bit(bitmap, i) == (i == 4));
+        filterCompare(column, CMP_GE, "abd", 3, bitmap);
+        for (size_t i = 0; i < N; ++i)
+            REQUIRE(bit(bitmap, i) == (::strcmp(words[i], "abd") >= 0));
+    }
+
+    SECTION("scan")
+    {
+        fill("predicated", 3000);
+        Table table;
+        REQUIRE(table.open("predicated") == S_OK);
+
+        // qty BETWEEN 100 AND 199 AND name LIKE 'name1%' AND id <> 1100
+        std::vector<unsigned int> fields;
+        fields.push_back(0);
+        fields.push_back(1);
+        fields.push_back(2);
+        BatchScanner scanner(table, fields);
+        Batch batch;
+        Bitmap bitmap;
+        std::vector<long long> ids;
+        while (scanner.next(batch)) {
+            filterBetween(batch.columns[1], 100, 199, bitmap);
+            select(bitmap, batch.selection);
+            filterPrefix(batch.columns[2], "name1", 5, bitmap);
+            select(bitmap, batch.selection);
+            filterCompare(batch.columns[0], CMP_NE, 1100, bitmap);
+            select(bitmap, batch.selection);
+            const unsigned long long *id =
+                batch.columns[0].data<unsigned long long>();
+            for (size_t i = 0; i < batch.selection.size(); ++i)
+                ids.push_back((long long) id[batch.selection[i]]);
+        }
+        // 100..199和1100..1199中name以name1开头的，去掉1100
+        REQUIRE(ids.size() == 199);
+        for (size_t i = 0; i < 100; ++i)
+            REQUIRE(ids[i] == 100 + (long long) i);
+        for (size_t i = 100; i < ids.size(); ++i)
+            REQUIRE(ids[i] == 1001 + (long long) i);
+
+        // IN列表
+        BatchScanner again(table, std::vector<unsigned int>(1, 1));
+        std::vector<unsigned long long> list;
+        list.push_back(5);
+        list.push_back(500);
+        list.push_back(999);
+        size_t selected = 0;
+        while (again.next(batch)) {
+            filterIn(batch.columns[0], list, bitmap);
+            select(bitmap, batch.selection);
+            selected += batch.selection.size();
+        }
+        REQUIRE(selected == 9);
+    }
+}
@@ -0,0 +1,213 @@
+////
+// @file runtimeTest.cc
+// @brief
+// 测试任务运行时
+//
+// @author niexw
+// @email niexiaowen@uestc.edu.cn
+//
+#include "../catch.hpp"
+#include <db/runtime.h>
+#include <db/config.h>
+#include <db/schema.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+using namespace db;
+
+TEST_CASE("db/runtime.h")
+{
+    SECTION("submit")
+    {
+        Runtime runtime;
+        REQUIRE(runtime.start(2) == S_OK);
+        REQUIRE(runtime.start(2) == EEXIST);
+        REQUIRE(runtime.workers() == 2);
+        REQUIRE(Runtime::current() == -1);
+
+        TaskGroup group;
+        std::atomic<int> count(0);
+        for (int i = 0; i < 1000; ++i)
+            runtime.submit(
+                [&count]() { ++count; }, Runtime::FOREGROUND, &group);
+        runtime.wait(group);
+        REQUIRE(group.pending() == 0);
+        REQUIRE(count == 1000);
+
+        RuntimeStats stats = runtime.stats();
+        REQUIRE(stats.submitted == 1000);
+        REQUIRE(stats.executed == 1000);
+    }
+
+    SECTION("priority")
+    {
+        // 唯一的worker被占住，放开后先执行前台任务
+        Runtime runtime;
+        REQUIRE(runtime.start(1) == S_OK);
+        std::atomic<bool> started(false);
+        std::atomic<bool> blocked(true);
+        TaskGroup group;
+        runtime.submit(
+            [&started, &blocked]() {
+                started = true;
+                while (blocked)
+                    std::this_thread::yield();
+            },
+            Runtime::FOREGROUND,
+            &group);
+        while (!started)
+            std::this_thread::yield();
+
+        std::mutex lock;
+        std::vector<int> order;
+        for (int i = 0; i < 3; ++i) {
+            runtime.submit(
+                [&lock, &order]() {
+                    std::lock_guard<std::mutex> guard(lock);
+                    order.push_back(Runtime::BACKGROUND);
+                },
+                Runtime::BACKGROUND,
+                &group);
+            runtime.submit(
+                [&lock, &order]() {
+                    std::lock_guard<std::mutex> guard(lock);
+                    order.push_back(Runtime::FOREGROUND);
+                },
+                Runtime::FOREGROUND,
+                &group);
+        }
+        blocked = false;
+        // 不用wait，等待线程会帮忙执行前台任务，打乱记录的顺序
+        while (group.pending())
+            std::this_thread::yield();
+        REQUIRE(order.size() == 6);
+        for (int i = 0; i < 3; ++i) {
+            REQUIRE(order[i] == Runtime::FOREGROUND);
+            REQUIRE(order[i + 3] == Runtime::BACKGROUND);
+        }
+    }
+
+    SECTION("steal")
+    {
+        // 任务把子任务放入自己的队列后一直占住worker，子任务只能被窃取
+        const int CHILDREN = 100;
+        Runtime runtime;
+        REQUIRE(runtime.start(2) == S_OK);
+        TaskGroup group;
+        std::atomic<int> done(0);
+        std::atomic<int> owner(-1);
+        std::atomic<int> thieves(0);
+        runtime.submit(
+            [&]() {
+                owner = Runtime::current();
+                for (int i = 0; i < CHILDREN; ++i)
+                    runtime.submit(
+                        [&]() {
+                            if (Runtime::current() != owner) ++thieves;
+                            ++done;
+                        },
+                        Runtime::FOREGROUND,
+                        &group);
+                while (done < CHILDREN)
+                    std::this_thread::yield();
+            },
+            Runtime::FOREGROUND,
+            &group);
+        // 外部线程不帮忙，子任务全部由另一个worker窃取
+        while (group.pending())
+            std::this_thread::yield();
+        REQUIRE(owner >= 0);
+        REQUIRE(thieves == CHILDREN);
+        REQUIRE(runtime.stats().steals >= (unsigned long long) CHILDREN);
+    }
+
+    SECTION("timer")
+    {
+        Runtime runtime;
+        REQUIRE(runtime.start(2) == S_OK);
+        TaskGroup group;
+        std::mutex lock;
+        std::vector<unsigned int> fired;
+        std::chrono::steady_clock::time_point start =
+            std::chrono::steady_clock::now();
+        std::chrono::steady_clock::time_point last;
+        unsigned int delays[] = {30, 10, 600, 20};
+        for (size_t i = 0; i < sizeof(delays) / sizeof(delays[0]); ++i) {
+            unsigned int delay = delays[i];
+            REQUIRE(
+                runtime.schedule(
+                    delay,
+                    [&lock, &fired, &last, delay]() {
+                        std::lock_guard<std::mutex> guard(lock);
+                        fired.push_back(delay);
+                        last = std::chrono::steady_clock::now();
+                    },
+                    Runtime::BACKGROUND,
+                    &group) != 0);
+        }
+
+        // 取消的定时任务计为完成
+        unsigned long long id = runtime.schedule(
+            15,
+            [&fired]() { fired.push_back(15); },
+            Runtime::FOREGROUND,
+            &group);
+        REQUIRE(runtime.cancel(id));
+        REQUIRE(!runtime.cancel(id));
+        REQUIRE(group.pending() == 4);
+
+        runtime.wait(group);
+        REQUIRE(fired.size() == 4);
+        REQUIRE(fired[0] == 10);
+        REQUIRE(fired[1] == 20);
+        REQUIRE(fired[2] == 30);
+        // 600个刻度超过一圈
+        REQUIRE(fired[3] == 600);
+        REQUIRE(last - start >= std::chrono::milliseconds(600 - Runtime::TICK));
+        REQUIRE(runtime.stats().timers == 4);
+
+        // 时间轮空闲时不转动，之后设定的定时任务从设定时刻计时
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        start = std::chrono::steady_clock::now();
+        REQUIRE(
+            runtime.schedule(
+                20,
+                [&lock, &last]() {
+                    std::lock_guard<std::mutex> guard(lock);
+                    last = std::chrono::steady_clock::now();
+                },
+                Runtime::BACKGROUND,
+                &group) != 0);
+        runtime.wait(group);
+        REQUIRE(last - start >= std::chrono::milliseconds(20 - Runtime::TICK));
+        REQUIRE(runtime.stats().timers == 5);
+    }
+
+    SECTION("stop")
+    {
+        Runtime runtime;
+        REQUIRE(runtime.start(1) == S_OK);
+        TaskGroup group;
+        std::atomic<int> count(0);
+        for (int i = 0; i < 100; ++i)
+            runtime.submit(
+                [&count]() { ++count; }, Runtime::BACKGROUND, &group);
+        // 未到期的定时任务丢弃
+        REQUIRE(
+            runtime.schedule(
+                10000, [&count]() { ++count; }, Runtime::BACKGROUND, &group) !=
+            0);
+
+        // 停止前提交的任务都会执行
+        runtime.stop();
+        REQUIRE(count == 100);
+        REQUIRE(group.pending() == 0);
+        REQUIRE(runtime.start() == EEXIST);
+
+        // 停止后在调用线程中直接执行，不能再设定定时任务
+        runtime.submit([&count]() { ++count; });
+        REQUIRE(count == 101);
+        REQUIRE(runtime.schedule(1, [&count]() { ++count; }) == 0);
+        runtime.stop();
+    }
+}
@@ -0,0 +1,145 @@
+////
+// @file scanTest.cc
+// @brief
+// 测试并行表扫描
+//
+// @author niexw
+// @email niexiaowen@uestc.edu.cn
+//
+#include "../catch.hpp"
+#include "./fixture.h"
+#include <db/scan.h>
+#include <db/table.h>
+#include <db/buffer.h>
+#include <db/schema.h>
+#include <atomic>
+using namespace db;
+
+TEST_CASE("db/scan.h")
+{
+    SECTION("morsel")
+    {
+        // 1000个block，每个morsel 64个，共16个
+        MorselQueues queues(4, 1, 1000, 64);
+        REQUIRE(queues.size() == 16);
+
+        // 0号worker取完自己的之后窃取其它worker的
+        std::vector<int> seen(1001, 0);
+        Morsel morsel;
+        bool stolen;
+        size_t morsels = 0, steals = 0;
+        while (queues.pop(0, morsel, stolen)) {
+            ++morsels;
+            if (stolen) ++steals;
+            REQUIRE(morsel.begin < morsel.end);
+            REQUIRE(morsel.end <= 1001);
+            for (unsigned int id = morsel.begin; id < morsel.end; ++id)
+                ++seen[id];
+        }
+        REQUIRE(morsels == 16);
+        REQUIRE(steals == 12);
+        for (unsigned int id = 1; id <= 1000; ++id)
+            REQUIRE(seen[id] == 1);
+        REQUIRE(queues.size() == 0);
+
+        // 空表没有morsel
+        MorselQueues empty(2, 1, 0, 64);
+        REQUIRE(empty.size() == 0);
+        REQUIRE(!empty.pop(1, morsel, stolen));
+    }
+
+    SECTION("table")
+    {
+        fillPayload("scanned", 5000, 100);
+        Table table;
+        REQUIRE(table.open("scanned") == S_OK);
+
+        // 删除一部分记录，合并出空闲块
+        DataType *type = table.info_->fields[0].type;
+        for (long long i = 1000; i < 3000; ++i) {
+            long long key = i;
+            type->htobe(&key);
+            REQUIRE(table.remove(table.locate(&key, 8), &key, 8) == S_OK);
+        }
+        REQUIRE(table.idleCount() > 0);
+        size_t blocks = 0;
+        for (Table::BlockIterator bi = table.beginblock();
+             bi != table.endblock();
+             ++bi)
+            ++blocks;
+
+        // 各worker分别累计，不需要同步
+        ScanOptions options;
+        options.threads = 4;
+        options.morsel = 4;
+        std::vector<size_t> counts(options.threads, 0);
+        std::vector<long long> sums(options.threads, 0);
+        ScanStats stats;
+        REQUIRE(
+            table.scanRecords(
+                [&](unsigned int worker, Record &record) {
+                    ++counts[worker];
+                    sums[worker] += keyOf(record);
+                },
+                options,
+                &stats) == S_OK);
+        size_t count = 0;
+        long long sum = 0;
+        for (unsigned int i = 0; i < options.threads; ++i) {
+            count += counts[i];
+            sum += sums[i];
+        }
+        REQUIRE(count == 3000);
+        REQUIRE(sum == 999LL * 1000 / 2 + (3000LL + 4999) * 2000 / 2);
+        REQUIRE(stats.threads == 4);
+        REQUIRE(stats.records == 3000);
+        REQUIRE(stats.blocks == blocks);
+        REQUIRE(stats.morsels == (table.maxid_ + 3) / 4);
+
+        // 按block回调，使用BULKREAD策略
+        options.bulk = true;
+        std::atomic<size_t> slots(0);
+        REQUIRE(
+            table.scan(
+                [&](unsigned int, DataBlock &block) {
+                    slots += block.getSlots();
+                },
+                options) == S_OK);
+        REQUIRE(slots == 3000);
+
+        // 早期版本回收的空闲块仍标为数据块，扫描时按空闲链跳过
+        for (unsigned int id = table.idle_; id;) {
+            BufDesp *desp = kBuffer.borrow("scanned", id);
+            DataBlock data;
+            data.attach(desp->buffer);
+            data.setType(BLOCK_TYPE_DATA);
+            data.setChecksum();
+            id = data.getNext();
+            data.detach();
+            kBuffer.writeBuf(desp);
+            kBuffer.releaseBuf(desp);
+        }
+        options.bulk = false;
+        REQUIRE(
+            table.scanRecords(
+                [](unsigned int, Record &) {}, options, &stats) == S_OK);
+        REQUIRE(stats.records == 3000);
+        REQUIRE(stats.blocks == blocks);
+        options.bulk = true;
+
+        // 映射表同样可以并行扫描
+        REQUIRE(kBuffer.flush() == S_OK);
+        Table mapped;
+        REQUIRE(mapped.open("scanned", Table::MAPPED) == S_OK);
+        slots = 0;
+        REQUIRE(
+            mapped.scan(
+                [&](unsigned int, DataBlock &block) {
+                    slots += block.getSlots();
+                },
+                options,
+                &stats) == S_OK);
+        REQUIRE(slots == 3000);
+        REQUIRE(stats.blocks == blocks);
+    }
+}
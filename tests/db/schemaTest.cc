@@ -41,7 +41,7 @@ TEST_CASE("db/schema.h")
         relation.key = 0;
 
         int total = relation.iovSize();
-        REQUIRE(total == 3 * 4 + 7);
+        REQUIRE(total == 3 * 4 + RelationInfo::HEADER_FIELDS);
 
         Schema schema;
         std::vector<struct iovec> iov(total);
@@ -0,0 +1,166 @@
+////
+// @file spaceTest.cc
+// @brief
+// 测试共享表空间
+//
+// @author niexw
+// @email niexiaowen@uestc.edu.cn
+//
+#include "../catch.hpp"
+#include "./fixture.h"
+#include <db/space.h>
+#include <db/table.h>
+#include <db/buffer.h>
+#include <db/schema.h>
+using namespace db;
+
+TEST_CASE("db/space.h")
+{
+    SECTION("segment")
+    {
+        File::remove("segment.ts");
+        File file;
+        REQUIRE(file.open("segment.ts") == S_OK);
+
+        // 新表空间从第1页开始分配extent
+        SharedSpace space;
+        REQUIRE(space.open(&file, 7) == S_OK);
+        unsigned int root;
+        REQUIRE(space.allocate(&file, root) == S_OK);
+        REQUIRE(root == 1);
+        REQUIRE(space.pages() == 1 + SPACE_EXTENT);
+
+        // 段头占第1页，blockid依次后移
+        Segment segment;
+        REQUIRE(segment.open(&file, 7, root) == S_OK);
+        REQUIRE(segment.extents() == 1);
+        unsigned long long offset;
+        REQUIRE(segment.offset(0, offset) == S_OK);
+        REQUIRE(offset == (root + 1) * BLOCK_SIZE);
+        REQUIRE(segment.offset(62, offset) == S_OK);
+        REQUIRE(offset == (root + 63) * BLOCK_SIZE);
+
+        // 超出第1个extent，查询不分配，扩展后从表空间再分配
+        REQUIRE(segment.offset(63, offset) == ENXIO);
+        REQUIRE(segment.extents() == 1);
+        REQUIRE(space.pages() == 1 + SPACE_EXTENT);
+        REQUIRE(segment.extend(&file, &space, 63) == S_OK);
+        REQUIRE(segment.extents() == 2);
+        REQUIRE(segment.extend(&file, &space, 63) == S_OK);
+        REQUIRE(segment.extents() == 2);
+        REQUIRE(segment.offset(63, offset) == S_OK);
+        REQUIRE(offset == (root + SPACE_EXTENT) * BLOCK_SIZE);
+
+        // 重新加载，头部和段头都已持久化
+        SharedSpace space2;
+        REQUIRE(space2.open(&file, 7) == S_OK);
+        REQUIRE(space2.pages() == space.pages());
+        REQUIRE(space2.open(&file, 8) == EINVAL);
+        Segment segment2;
+        REQUIRE(segment2.open(&file, 7, root) == S_OK);
+        REQUIRE(segment2.extents() == 2);
+        REQUIRE(segment2.offset(63, offset) == S_OK);
+        REQUIRE(offset == (root + SPACE_EXTENT) * BLOCK_SIZE);
+        file.close();
+        REQUIRE(File::remove("segment.ts") == S_OK);
+    }
+
+    SECTION("tables")
+    {
+        unsigned short id;
+        REQUIRE(kSchema.createSpace("small", id) == S_OK);
+        REQUIRE(id >= SPACE_SHARED);
+        REQUIRE(kSchema.createSpace("small", id) == EEXIST);
+        REQUIRE(kSchema.lookupSpace(id).second);
+
+        RelationInfo relation = relationOf();
+
+        // 表空间不存在，压缩表不能放入共享表空间
+        relation.space = (unsigned short) (id + 1);
+        REQUIRE(kSchema.create("orphan", relation) == ENOENT);
+        relation.space = id;
+        relation.type = TABLE_COMPRESSED;
+        REQUIRE(kSchema.create("orphan", relation) == EINVAL);
+        relation.type = 0;
+
+        // 多张表共用一个文件，各自一个段
+        const char *tables[] = {"small0", "small1", "small2"};
+        for (int i = 0; i < 3; ++i) {
+            RelationInfo info = relation;
+            REQUIRE(kSchema.create(tables[i], info) == S_OK);
+            REQUIRE(info.path == "small.ts");
+            REQUIRE(info.root == 1 + i * SPACE_EXTENT);
+            REQUIRE(::strcmp(kFiles.fileName(tables[i]), "small") == 0);
+        }
+        FileRef small0(kFiles, "small0"), small2(kFiles, "small2");
+        REQUIRE(small0.get() == small2.get());
+        REQUIRE(::strcmp(kFiles.fileName("table"), "table") == 0);
+
+        // 插入记录，跨过第1个extent
+        Table table;
+        REQUIRE(table.open("small1") == S_OK);
+        DataType *type = table.info_->fields[0].type;
+        std::vector<struct iovec> iov(1);
+        for (long long i = 1; i <= 1000; ++i) {
+            long long nid = i;
+            type->htobe(&nid);
+            iov[0].iov_base = &nid;
+            iov[0].iov_len = 8;
+            unsigned int blkid =
+                table.locate(iov[0].iov_base, (unsigned int) iov[0].iov_len);
+            REQUIRE(table.insert(blkid, iov) == S_OK);
+        }
+        // 查询偏移量不扩展段，分配block时才扩展
+        unsigned long long last, first;
+        REQUIRE(
+            kFiles.offset("small1", table.maxid_ + SPACE_EXTENT, last) ==
+            ENXIO);
+        while (table.maxid_ < SPACE_EXTENT)
+            table.allocate();
+        REQUIRE(kFiles.offset("small1", SPACE_EXTENT - 2, last) == S_OK);
+        REQUIRE(kFiles.offset("small1", SPACE_EXTENT - 1, first) == S_OK);
+        REQUIRE(last == (table.info_->root + SPACE_EXTENT - 1) * BLOCK_SIZE);
+        REQUIRE(first == (1 + 3 * SPACE_EXTENT) * BLOCK_SIZE);
+        Table mapped;
+        REQUIRE(mapped.open("small1", Table::MAPPED) == EINVAL);
+        REQUIRE(mapped.open("small", Table::READWRITE) == EINVAL);
+
+        // 新分配和从空闲链上复用的block都记录表空间id
+        DataBlock data;
+        BufDesp *bd = kBuffer.borrow("small1", table.maxid_);
+        data.attach(bd->buffer);
+        REQUIRE(data.getSpaceid() == id);
+        data.detach();
+        kBuffer.releaseBuf(bd);
+        unsigned int idle = table.maxid_;
+        table.deallocate(idle);
+        REQUIRE(table.allocate() == idle);
+        bd = kBuffer.borrow("small1", idle);
+        data.attach(bd->buffer);
+        REQUIRE(data.getSpaceid() == id);
+        data.detach();
+        kBuffer.releaseBuf(bd);
+
+        // 回写后，另一个buffer从表空间读到相同的block
+        REQUIRE(kBuffer.flush() == S_OK);
+        REQUIRE(kFiles.commit("small0") == S_OK);
+        Buffer buffer;
+        buffer.init(&kFiles, 1);
+        bd = buffer.borrow("small1", 0);
+        SuperBlock super;
+        super.attach(bd->buffer);
+        REQUIRE(super.getSpaceid() == id);
+        REQUIRE(super.getMaxid() == table.maxid_);
+        buffer.releaseBuf(bd);
+        size_t records = 0;
+        for (Table::BlockIterator bi = table.beginblock();
+             bi != table.endblock();
+             ++bi) {
+            bd = buffer.borrow("small1", bi->getSelf());
+            REQUIRE(::memcmp(bd->buffer, bi->buffer_, BLOCK_SIZE) == 0);
+            buffer.releaseBuf(bd);
+            records += bi->getSlots();
+        }
+        REQUIRE(records == 1000);
+    }
+}
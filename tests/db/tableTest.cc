@@ -7,9 +7,11 @@
 // @email niexiaowen@uestc.edu.cn
 //
 #include "../catch.hpp"
+#include "./fixture.h"
 #include <db/table.h>
 #include <db/block.h>
 #include <db/buffer.h>
+#include <db/file.h>
 using namespace db;
 
 namespace {
@@ -578,4 +580,155 @@ TEST_CASE("db/table.h")
         REQUIRE(totalIdle == table.idleCount());
         REQUIRE(totalRecord == unsigned int(table.recordCount()));
     }
-}
\ No newline at end of file
+
+    SECTION("extent")
+    {
+        REQUIRE(createTable("extents") == S_OK);
+        Table table;
+        REQUIRE(table.open("extents") == S_OK);
+
+        // 第1个extent为1MB，从block 2开始
+        unsigned int perExtent = Table::MIN_EXTENT / BLOCK_SIZE;
+        REQUIRE(table.allocate() == 2);
+        SuperBlock super;
+        BufDesp *bd = kBuffer.borrow("extents", 0);
+        super.attach(bd->buffer);
+        REQUIRE(super.getExtents() == 1);
+        REQUIRE(super.getReserved() == 1 + perExtent);
+
+        // 用完第1个extent之前不再预留
+        while (table.maxid_ < 1 + perExtent)
+            table.allocate();
+        REQUIRE(super.getExtents() == 1);
+
+        // 第2个extent大小翻倍
+        table.allocate();
+        REQUIRE(super.getExtents() == 2);
+        REQUIRE(super.getReserved() == 1 + 3 * perExtent);
+        kBuffer.releaseBuf(bd);
+
+        // 预分配不改变文件长度
+        FileRef file(kFiles, "extents");
+        REQUIRE(file);
+        unsigned long long length;
+        REQUIRE(file->length(length) == S_OK);
+        REQUIRE(file->allocate(length + Table::MIN_EXTENT) == S_OK);
+        unsigned long long after;
+        REQUIRE(file->length(after) == S_OK);
+        REQUIRE(after == length);
+    }
+
+    SECTION("fence")
+    {
+        REQUIRE(createTable("fences") == S_OK);
+        Table table;
+        REQUIRE(table.open("fences") == S_OK);
+        DataType *type = table.info_->fields[0].type;
+
+        // 乱序插入，第1次locate建立缓存，之后由分裂维护
+        std::vector<long long> keys;
+        for (long long i = 1; i <= 3000; ++i)
+            keys.push_back(i * 2);
+        std::srand(43);
+        for (size_t i = keys.size() - 1; i > 0; --i)
+            std::swap(keys[i], keys[std::rand() % (i + 1)]);
+        std::vector<struct iovec> iov(1);
+        for (size_t i = 0; i < keys.size(); ++i) {
+            long long nid = keys[i];
+            type->htobe(&nid);
+            iov[0].iov_base = &nid;
+            iov[0].iov_len = 8;
+            unsigned int blkid = table.locate(&nid, 8);
+            REQUIRE(table.insert(blkid, iov) == S_OK);
+        }
+        REQUIRE(table.fences_.stats().builds == 1);
+        REQUIRE(!check(table));
+
+        // 每个key都定位到所在的block，与重新建立的缓存一致
+        Table fresh;
+        REQUIRE(fresh.open("fences") == S_OK);
+        size_t blocks = 0;
+        for (Table::BlockIterator bi = table.beginblock();
+             bi != table.endblock();
+             ++bi, ++blocks) {
+            for (unsigned short i = 0; i < bi->getSlots(); ++i) {
+                Record record;
+                bi->refslots(i, record);
+                unsigned char *pkey;
+                unsigned int len;
+                record.refByIndex(&pkey, &len, 0);
+                REQUIRE(table.locate(pkey, len) == bi->getSelf());
+            }
+        }
+        REQUIRE(table.fences_.size() == blocks);
+        for (long long i = 0; i <= 6001; ++i) {
+            long long nid = i;
+            type->htobe(&nid);
+            REQUIRE(table.locate(&nid, 8) == fresh.locate(&nid, 8));
+        }
+
+        // 删除大部分记录，合并后缓存仍与重新建立的一致
+        for (size_t i = 0; i < keys.size(); ++i) {
+            if (i % 4 == 0) continue;
+            long long nid = keys[i];
+            type->htobe(&nid);
+            unsigned int blkid = table.locate(&nid, 8);
+            REQUIRE(table.remove(blkid, &nid, 8) == S_OK);
+        }
+        REQUIRE(table.fences_.stats().builds == 1);
+        REQUIRE(table.recordCount() == keys.size() / 4);
+        REQUIRE(!check(table));
+        REQUIRE(fresh.open("fences") == S_OK);
+        for (long long i = 0; i <= 6001; ++i) {
+            long long nid = i;
+            type->htobe(&nid);
+            REQUIRE(table.locate(&nid, 8) == fresh.locate(&nid, 8));
+        }
+        REQUIRE(table.fences_.size() == fresh.fences_.size());
+    }
+
+    SECTION("mapped")
+    {
+        // 经buffer扫描，作为对照
+        Table table;
+        REQUIRE(table.open("table") == S_OK);
+        std::vector<unsigned int> blocks;
+        size_t records = 0;
+        for (Table::BlockIterator bi = table.beginblock();
+             bi != table.endblock();
+             ++bi) {
+            blocks.push_back(bi->getSelf());
+            records += bi->getSlots();
+        }
+        REQUIRE(blocks.size() > 1);
+
+        // 映射扫描，不借用buffer
+        Table mapped;
+        REQUIRE(mapped.open("table", Table::MAPPED) == S_OK);
+        REQUIRE(mapped.mapped_);
+        REQUIRE(mapped.mappedBlock(0) == mapped.mapped_->base_);
+        size_t i = 0;
+        size_t mrecords = 0;
+        for (Table::BlockIterator bi = mapped.beginblock();
+             bi != mapped.endblock();
+             ++bi, ++i) {
+            REQUIRE(bi.bufdesp == NULL);
+            REQUIRE(bi->buffer_ == mapped.mappedBlock(bi->getSelf()));
+            REQUIRE(i < blocks.size());
+            REQUIRE(bi->getSelf() == blocks[i]);
+            mrecords += bi->getSlots();
+        }
+        REQUIRE(i == blocks.size());
+        REQUIRE(mrecords == records);
+
+        // 映射表只读
+        std::vector<struct iovec> iov;
+        REQUIRE(mapped.insert(blocks[0], iov) == EPERM);
+        REQUIRE(mapped.update(blocks[0], iov) == EPERM);
+        long long key = 0;
+        REQUIRE(mapped.remove(blocks[0], &key, sizeof(key)) == EPERM);
+        REQUIRE(
+            mapped.mappedBlock((unsigned int) (mapped.mapped_->length_ /
+                                               BLOCK_SIZE)) == NULL);
+    }
+}
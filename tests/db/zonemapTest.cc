@@ -0,0 +1,147 @@
+////
+// @file zonemapTest.cc
+// @brief
+// 测试block级摘要
+//
+// @author niexw
+// @email niexiaowen@uestc.edu.cn
+//
+#include "../catch.hpp"
+#include <db/table.h>
+#include <db/zonemap.h>
+using namespace db;
+
+namespace {
+// 统计一个block上key在[lo, hi]之间的记录数目
+size_t matches(DataBlock *block, long long lo, long long hi)
+{
+    size_t count = 0;
+    for (DataBlock::RecordIterator ri = block->beginrecord();
+         ri != block->endrecord();
+         ++ri) {
+        unsigned char *pkey;
+        unsigned int len;
+        long long key;
+        ri->refByIndex(&pkey, &len, 0);
+        memcpy(&key, pkey, len);
+        key = be64toh(key);
+        if (key >= lo && key <= hi) ++count;
+    }
+    return count;
+}
+} // namespace
+
+TEST_CASE("db/zonemap.h")
+{
+    SECTION("track")
+    {
+        // NOTE: schemaTest.cc中创建，tableTest.cc中插入记录
+        Table table;
+        REQUIRE(table.open("table") == S_OK);
+
+        std::vector<unsigned int> fields(1, table.info_->count);
+        REQUIRE(table.trackZones(fields) == EINVAL);
+        fields[0] = 0;
+        REQUIRE(table.trackZones(fields) == S_OK);
+        REQUIRE(table.zonemap_.enabled());
+        REQUIRE(table.zonemap_.column(0) == 0);
+        REQUIRE(table.zonemap_.column(1) == -1);
+        REQUIRE(table.zonemap_.size() == 0);
+    }
+
+    SECTION("prune")
+    {
+        Table table;
+        table.open("table");
+        std::vector<unsigned int> fields(1, 0);
+        table.trackZones(fields);
+
+        long long lo = 1000;
+        long long hi = 2000;
+        long long belo = htobe64(lo);
+        long long behi = htobe64(hi);
+        ZoneRange range;
+        range.field = 0;
+        range.lo = &belo;
+        range.lolen = sizeof(belo);
+        range.hi = &behi;
+        range.hilen = sizeof(behi);
+
+        // 全表扫描
+        size_t expect = 0;
+        unsigned int blocks = 0;
+        for (Table::BlockIterator bi = table.beginblock();
+             bi != table.endblock();
+             ++bi, ++blocks)
+            expect += matches(&bi.block, lo, hi);
+
+        // 第1次扫描补齐摘要，结果相同
+        size_t count = 0;
+        Table::PrunedIterator pi = table.beginblock(range);
+        for (; pi != table.endblock(); ++pi)
+            count += matches(&pi.block, lo, hi);
+        REQUIRE(count == expect);
+        REQUIRE(table.zonemap_.size() == blocks);
+
+        // 第2次扫描，key聚集存储，大部分block被跳过
+        count = 0;
+        unsigned int visited = 0;
+        Table::PrunedIterator pi2 = table.beginblock(range);
+        for (; pi2 != table.endblock(); ++pi2, ++visited)
+            count += matches(&pi2.block, lo, hi);
+        REQUIRE(count == expect);
+        REQUIRE(pi2.skipped > 0);
+        REQUIRE(pi2.skipped + visited == blocks);
+    }
+
+    SECTION("maintain")
+    {
+        Table table;
+        table.open("table");
+        std::vector<unsigned int> fields(1, 0);
+        table.trackZones(fields);
+
+        // 先扫描一遍建立摘要，lo/hi为空时匹配所有非空值
+        ZoneRange range;
+        range.field = 0;
+        for (Table::PrunedIterator pi = table.beginblock(range);
+             pi != table.endblock();
+             ++pi)
+            ;
+
+        // 插入一个更大的key，落在最后一个block上
+        std::vector<struct iovec> iov(3);
+        long long nid = htobe64(0x7fffffffffffLL);
+        char phone[20] = {};
+        char addr[128] = {};
+        iov[0].iov_base = &nid;
+        iov[0].iov_len = 8;
+        iov[1].iov_base = phone;
+        iov[1].iov_len = 20;
+        iov[2].iov_base = (void *) addr;
+        iov[2].iov_len = 128;
+        unsigned int blkid =
+            table.locate(iov[0].iov_base, (unsigned int) iov[0].iov_len);
+        REQUIRE(table.insert(blkid, iov) == S_OK);
+
+        // 只查询该key，必然命中且只访问一个block
+        range.lo = &nid;
+        range.lolen = sizeof(nid);
+        range.hi = &nid;
+        range.hilen = sizeof(nid);
+        unsigned int visited = 0;
+        for (Table::PrunedIterator pi = table.beginblock(range);
+             pi != table.endblock();
+             ++pi, ++visited)
+            REQUIRE(
+                matches(&pi.block, 0x7fffffffffffLL, 0x7fffffffffffLL) == 1);
+        REQUIRE(visited == 1);
+
+        // 删除后摘要退化为包络
+        blkid = table.locate(iov[0].iov_base, (unsigned int) iov[0].iov_len);
+        int ret =
+            table.remove(blkid, iov[0].iov_base, (unsigned int) iov[0].iov_len);
+        REQUIRE(ret == S_OK);
+        REQUIRE(!table.zonemap_.find(blkid)->exact);
+    }
+}
@@ -8,9 +8,11 @@
 //
 #define CATCH_CONFIG_RUNNER
 #include "catch.hpp"
+#include <db/schema.h>
 
 int main(int argc, char *argv[])
 {
     int result = Catch::Session().run(argc, argv);
+    db::dbExit();
     return result;
 }